@@ -61,6 +61,49 @@ int sandbox_eth_recv_arp_req(struct udevice *dev);
  */
 int sandbox_eth_recv_ping_req(struct udevice *dev);
 
+/*
+ * sandbox_eth_recv_burst()
+ *
+ * Inject a burst of ARP requests for this target, as if they arrived
+ * back-to-back. Requests which do not fit in the receive ring are counted as
+ * dropped.
+ *
+ * @dev: device that received the packets
+ * @count: number of requests to inject
+ * @return number of requests injected
+ */
+int sandbox_eth_recv_burst(struct udevice *dev, int count);
+
+/*
+ * sandbox_eth_recv_slot()
+ *
+ * Get the buffer for the next packet to be received. Once it is filled in,
+ * it is queued with sandbox_eth_recv_commit(). If the receive ring is full,
+ * the packet is counted as dropped.
+ *
+ * @dev: device to receive the packet
+ * @return pointer to the buffer, or NULL if the receive ring is full
+ */
+void *sandbox_eth_recv_slot(struct udevice *dev);
+
+/*
+ * sandbox_eth_recv_commit()
+ *
+ * Queue the packet filled in after sandbox_eth_recv_slot()
+ *
+ * @dev: device to receive the packet
+ * @len: length of the packet
+ */
+void sandbox_eth_recv_commit(struct udevice *dev, int len);
+
+/*
+ * sandbox_eth_recv_full()
+ *
+ * @dev: device to check
+ * @return true if the receive ring has no room for another packet
+ */
+bool sandbox_eth_recv_full(struct udevice *dev);
+
 /**
  * A packet handler
  *
@@ -77,9 +120,13 @@ typedef int sandbox_eth_tx_hand_f(struct udevice *dev, void *pkt,
  * fake_host_hwaddr - MAC address of mocked machine
  * fake_host_ipaddr - IP address of mocked machine
  * disabled - Will not respond
- * recv_packet_buffer - buffers of the packet returned as received
- * recv_packet_length - lengths of the packet returned as received
- * recv_packets - number of packets returned
+ * recv_ring - receive ring, holding the packets returned as received
+ * recv_length - lengths of the packets in the receive ring
+ * recv_head - index of the oldest packet in the receive ring
+ * recv_packets - number of packets in the receive ring, including those
+ *	lent to the network stack and not yet freed
+ * mcast_hwaddr - multicast MAC address of the group joined
+ * mcast_joined - true if the group in mcast_hwaddr has been joined
  * tx_handler - function to generate responses to sent packets
  * priv - a pointer to some structure a test may want to keep track of
  */
@@ -87,9 +134,12 @@ struct eth_sandbox_priv {
 	uchar fake_host_hwaddr[ARP_HLEN];
 	struct in_addr fake_host_ipaddr;
 	bool disabled;
-	uchar * recv_packet_buffer[PKTBUFSRX];
-	int recv_packet_length[PKTBUFSRX];
+	uchar recv_ring[CONFIG_ETH_SANDBOX_RX_RING][PKTSIZE_ALIGN];
+	int recv_length[CONFIG_ETH_SANDBOX_RX_RING];
+	int recv_head;
 	int recv_packets;
+	uchar mcast_hwaddr[ARP_HLEN];
+	bool mcast_joined;
 	sandbox_eth_tx_hand_f *tx_handler;
 	void *priv;
 };
@@ -11,8 +11,14 @@
 #include <bootstage.h>
 #include <command.h>
 #include <env.h>
+#include <hash.h>
+#include <hexdump.h>
 #include <image.h>
+#include <mapmem.h>
 #include <net.h>
+#include <net/wget.h>
+#include <u-boot/sha256.h>
+#include <linux/sizes.h>
 
 static int netboot_common(enum proto_t, struct cmd_tbl *, int, char * const []);
 
@@ -121,6 +127,200 @@ U_BOOT_CMD(
 );
 #endif
 
+#if defined(CONFIG_CMD_WGET)
+static int do_wget(struct cmd_tbl *cmdtp, int flag, int argc,
+		   char *const argv[])
+{
+	wget_range_size = 0;
+	wget_range_pos = 0;
+	if (argc > 3) {
+		if (strict_strtoul(argv[3], 16, &wget_range_size) < 0 ||
+		    !wget_range_size ||
+		    (argc > 4 &&
+		     strict_strtoul(argv[4], 16, &wget_range_pos) < 0)) {
+			printf("Invalid size/position\n");
+			return CMD_RET_USAGE;
+		}
+		argc = 3;
+	}
+
+	return netboot_common(WGET, cmdtp, argc, argv);
+}
+
+U_BOOT_CMD(
+	wget,	5,	1,	do_wget,
+	"boot image via network using HTTP protocol",
+	"[loadAddress] [[hostIPaddr:]path] [bytes [pos]]\n"
+	"    - download 'path' from an HTTP server to 'loadAddress'. If\n"
+	"      'bytes' is given, only that many bytes (hex) are fetched,\n"
+	"      starting at offset 'pos' (hex) in the file"
+);
+#endif
+
+#if defined(CONFIG_CMD_WGETSEG)
+#define WGETSEG_MAX_SERVERS	16
+#define WGETSEG_SEG_SIZE	SZ_4M
+
+/* Fetch part of @path from @server to @addr, returning its size or -1 */
+static int wgetseg_fetch(struct in_addr server, const char *path, ulong addr,
+			 ulong pos, ulong size)
+{
+	snprintf(net_boot_file_name, sizeof(net_boot_file_name), "%pI4:%s",
+		 &server, path);
+	net_boot_file_name_explicit = true;
+	image_load_addr = addr;
+	wget_range_pos = pos;
+	wget_range_size = size;
+
+	return net_loop(WGET);
+}
+
+/* Read the SHA-256 digest of @path from "<path>.sha256", as from sha256sum */
+static int wgetseg_get_digest(struct in_addr *servers, int count,
+			      const char *path, ulong addr, u8 *digest)
+{
+	char name[256];
+	const char *buf;
+	int size = -1;
+	int ret, i;
+
+	snprintf(name, sizeof(name), "%s.sha256", path);
+	for (i = 0; i < count && size < SHA256_SUM_LEN * 2; i++)
+		size = wgetseg_fetch(servers[i], name, addr, 0, 0);
+	if (size < SHA256_SUM_LEN * 2) {
+		printf("wgetseg: cannot read manifest '%s'\n", name);
+		return -ENOENT;
+	}
+
+	buf = map_sysmem(addr, size);
+	ret = hex2bin(digest, buf, SHA256_SUM_LEN);
+	unmap_sysmem(buf);
+	if (ret) {
+		printf("wgetseg: bad manifest '%s'\n", name);
+		return ret;
+	}
+
+	return 0;
+}
+
+static int do_wgetseg(struct cmd_tbl *cmdtp, int flag, int argc,
+		      char *const argv[])
+{
+	struct in_addr servers[WGETSEG_MAX_SERVERS];
+	u8 digest[SHA256_SUM_LEN], sum[SHA256_SUM_LEN];
+	ulong addr, seg_size, pos, total;
+	int count, server, tries;
+	int sum_size = sizeof(sum);
+	const char *list, *path;
+	bool total_known;
+	const void *buf;
+	int size, ret;
+
+	if (argc != 3)
+		return CMD_RET_USAGE;
+	addr = simple_strtoul(argv[1], NULL, 16);
+	path = argv[2];
+
+	list = env_get("wgetservers");
+	for (count = 0; list && *list && count < WGETSEG_MAX_SERVERS;) {
+		servers[count] = string_to_ip(list);
+		if (servers[count].s_addr)
+			count++;
+		list = strpbrk(list, " ,");
+		if (list)
+			list++;
+	}
+	if (!count) {
+		printf("wgetseg: 'wgetservers' not set\n");
+		return CMD_RET_FAILURE;
+	}
+	seg_size = env_get_hex("wgetsegsize", WGETSEG_SEG_SIZE);
+	if (!seg_size)
+		return CMD_RET_USAGE;
+
+	if (wgetseg_get_digest(servers, count, path, addr, digest))
+		return CMD_RET_FAILURE;
+
+	/*
+	 * Take the segments from the servers in turn, moving on to the next
+	 * server if one fails. The size of the file is learnt from the first
+	 * reply. The TCP client handles one connection at a time, so the
+	 * segments are fetched one after another rather than in parallel.
+	 */
+	pos = 0;
+	total = 0;
+	total_known = false;
+	server = 0;
+	while (!total_known || pos < total) {
+		ulong len = seg_size;
+
+		if (total_known)
+			len = min(len, total - pos);
+		for (tries = 0; tries < count; tries++) {
+			size = wgetseg_fetch(servers[server], path, addr + pos,
+					     pos, len);
+			server = (server + 1) % count;
+			if (size >= 0)
+				break;
+		}
+		if (size < 0) {
+			printf("wgetseg: cannot fetch 0x%lx bytes at 0x%lx\n",
+			       len, pos);
+			ret = CMD_RET_FAILURE;
+			goto out;
+		}
+		if (!total_known && wget_file_size) {
+			total = wget_file_size;
+			total_known = true;
+		}
+		pos += size;
+		/* Without a size from the server, a short segment is the end */
+		if (!total_known && size < len)
+			break;
+		if (total_known && size < len && pos < total) {
+			printf("wgetseg: short segment at 0x%lx\n", pos);
+			ret = CMD_RET_FAILURE;
+			goto out;
+		}
+	}
+	env_set_hex("filesize", pos);
+	env_set_hex("fileaddr", addr);
+	image_load_addr = addr;
+
+	buf = map_sysmem(addr, pos);
+	ret = hash_block("sha256", buf, pos, sum, &sum_size);
+	unmap_sysmem(buf);
+	if (ret) {
+		ret = CMD_RET_FAILURE;
+		goto out;
+	}
+	if (memcmp(sum, digest, SHA256_SUM_LEN)) {
+		printf("wgetseg: SHA-256 of '%s' does not match its manifest\n",
+		       path);
+		ret = CMD_RET_FAILURE;
+		goto out;
+	}
+	printf("wgetseg: 0x%lx bytes from %d server%s, SHA-256 OK\n", pos,
+	       count, count == 1 ? "" : "s");
+	ret = CMD_RET_SUCCESS;
+
+out:
+	wget_range_pos = 0;
+	wget_range_size = 0;
+
+	return ret;
+}
+
+U_BOOT_CMD(
+	wgetseg,	3,	1,	do_wgetseg,
+	"download a file in segments from several HTTP servers",
+	"loadAddress path\n"
+	"    - download 'path' to 'loadAddress' in segments of 'wgetsegsize'\n"
+	"      bytes (hex), taking them from the servers in 'wgetservers' in\n"
+	"      turn, and check it against the SHA-256 digest in 'path.sha256'"
+);
+#endif
+
 static void netboot_update_env(void)
 {
 	char tmp[22];
@@ -305,6 +505,32 @@ U_BOOT_CMD(
 );
 #endif
 
+#if defined(CONFIG_CMD_ARP)
+static int do_arp(struct cmd_tbl *cmdtp, int flag, int argc,
+		  char *const argv[])
+{
+	if (argc == 1) {
+		arp_cache_show();
+		return CMD_RET_SUCCESS;
+	}
+	if (argc == 2 && !strcmp(argv[1], "flush")) {
+		arp_cache_flush();
+		return CMD_RET_SUCCESS;
+	}
+
+	return CMD_RET_USAGE;
+}
+
+U_BOOT_CMD(
+	arp,	2,	1,	do_arp,
+	"show or flush the ARP cache",
+	"\n"
+	"    - show the ARP cache\n"
+	"arp flush\n"
+	"    - forget all entries in the ARP cache"
+);
+#endif
+
 #if defined(CONFIG_CMD_CDP)
 
 static void cdp_update_env(void)
@@ -8,6 +8,7 @@
 #include <command.h>
 #include <fs.h>
 #include <net.h>
+#include <net/tftp.h>
 
 #include "pxe_utils.h"
 
@@ -38,6 +39,7 @@ static int do_get_tftp(struct cmd_tbl *cmdtp, const char *file_path,
 	return 1;
 }
 
+#ifndef CONFIG_TFTP_PROBE
 /*
  * Looks for a pxe file with a name based on the pxeuuid environment variable.
  *
@@ -99,6 +101,44 @@ static int pxe_ipaddr_paths(struct cmd_tbl *cmdtp, unsigned long pxefile_addr_r)
 
 	return -ENOENT;
 }
+#else
+/*
+ * Looks for a pxe file under all of the names tried above, and the default
+ * ones, asking for them all at once. The most specific one found is used.
+ *
+ * Returns 1 on success or < 0 on error.
+ */
+static int pxe_probe_paths(unsigned long pxefile_addr_r)
+{
+	const char *files[TFTP_PROBE_MAX];
+	char ip_addr[8][9];
+	char mac_str[21];
+	char *uuid_str;
+	int count = 0;
+	int mask_pos, i, err;
+
+	uuid_str = from_env("pxeuuid");
+	if (uuid_str)
+		files[count++] = uuid_str;
+
+	if (format_mac_pxe(mac_str, sizeof(mac_str)) > 0)
+		files[count++] = mac_str;
+
+	for (mask_pos = 8; mask_pos > 0; mask_pos--) {
+		sprintf(ip_addr[mask_pos - 1], "%08X", ntohl(net_ip.s_addr));
+		ip_addr[mask_pos - 1][mask_pos] = '\0';
+		files[count++] = ip_addr[mask_pos - 1];
+	}
+
+	for (i = 0; pxe_default_paths[i] && count < TFTP_PROBE_MAX; i++)
+		files[count++] = pxe_default_paths[i];
+
+	err = get_pxelinux_paths(files, count, pxefile_addr_r);
+
+	return err < 0 ? err : 1;
+}
+#endif
+
 /*
  * Entry point for the 'pxe get' command.
  * This Follows pxelinux's rules to download a config file from a tftp server.
@@ -118,7 +158,10 @@ do_pxe_get(struct cmd_tbl *cmdtp, int flag, int argc, char *const argv[])
 {
 	char *pxefile_addr_str;
 	unsigned long pxefile_addr_r;
-	int err, i = 0;
+	int err;
+#ifndef CONFIG_TFTP_PROBE
+	int i = 0;
+#endif
 
 	do_getfile = do_get_tftp;
 
@@ -135,6 +178,18 @@ do_pxe_get(struct cmd_tbl *cmdtp, int flag, int argc, char *const argv[])
 	if (err < 0)
 		return 1;
 
+#ifdef CONFIG_CMD_PXE_CACHE
+	/* A new config file may name new files */
+	pxe_cache_flush();
+#endif
+
+#ifdef CONFIG_TFTP_PROBE
+	if (pxe_probe_paths(pxefile_addr_r) > 0) {
+		printf("Config file found\n");
+
+		return 0;
+	}
+#else
 	/*
 	 * Keep trying paths until we successfully get a file we're looking
 	 * for.
@@ -155,6 +210,7 @@ do_pxe_get(struct cmd_tbl *cmdtp, int flag, int argc, char *const argv[])
 		}
 		i++;
 	}
+#endif
 
 	printf("Config file not found\n");
 
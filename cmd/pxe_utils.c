@@ -13,6 +13,8 @@
 #include <mapmem.h>
 #include <lcd.h>
 #include <net.h>
+#include <net/tftp.h>
+#include <u-boot/crc.h>
 #include <linux/string.h>
 #include <linux/ctype.h>
 #include <errno.h>
@@ -30,6 +32,31 @@
 
 bool is_pxe;
 
+#ifdef CONFIG_CMD_PXE_CACHE
+/* Most label files remembered: enough for a kernel, initrd and device tree */
+#define PXE_CACHE_FILES 4
+
+/*
+ * A file loaded for a label, which need not be retrieved again as long as
+ * it is still in memory, unchanged.
+ */
+struct pxe_cached_file {
+	char path[MAX_TFTP_PATH_LEN + 1];
+	ulong addr;
+	ulong size;
+	u32 crc;
+};
+
+static struct pxe_cached_file pxe_cached_files[PXE_CACHE_FILES];
+static int pxe_cached_next;
+
+/* The menu last parsed, and the address, length and CRC32 of its text */
+static struct pxe_menu *pxe_cached_menu;
+static ulong pxe_cached_menu_addr;
+static size_t pxe_cached_menu_len;
+static u32 pxe_cached_menu_crc;
+#endif
+
 /*
  * Convert an ethaddr from the environment to the format used by pxelinux
  * filenames based on mac addresses. Convert's ':' to '-', and adds "01-" to
@@ -145,29 +172,17 @@ static int get_relfile(struct cmd_tbl *cmdtp, const char *file_path,
 }
 
 /*
- * Retrieve the file at 'file_path' to the locate given by 'file_addr'. If
- * 'bootfile' was specified in the environment, the path to bootfile will be
- * prepended to 'file_path' and the resulting path will be used.
+ * Files come without a NUL byte at the end, so find out the size of the one
+ * just retrieved to 'file_addr' and add the NUL byte.
  *
  * Returns 1 on success, or < 0 for error.
  */
-int get_pxe_file(struct cmd_tbl *cmdtp, const char *file_path,
-		 unsigned long file_addr)
+static int terminate_pxe_file(unsigned long file_addr)
 {
 	unsigned long config_file_size;
 	char *tftp_filesize;
-	int err;
 	char *buf;
 
-	err = get_relfile(cmdtp, file_path, file_addr);
-
-	if (err < 0)
-		return err;
-
-	/*
-	 * the file comes without a NUL byte at the end, so find out its size
-	 * and add the NUL byte.
-	 */
 	tftp_filesize = from_env("filesize");
 
 	if (!tftp_filesize)
@@ -183,6 +198,26 @@ int get_pxe_file(struct cmd_tbl *cmdtp, const char *file_path,
 	return 1;
 }
 
+/*
+ * Retrieve the file at 'file_path' to the locate given by 'file_addr'. If
+ * 'bootfile' was specified in the environment, the path to bootfile will be
+ * prepended to 'file_path' and the resulting path will be used.
+ *
+ * Returns 1 on success, or < 0 for error.
+ */
+int get_pxe_file(struct cmd_tbl *cmdtp, const char *file_path,
+		 unsigned long file_addr)
+{
+	int err;
+
+	err = get_relfile(cmdtp, file_path, file_addr);
+
+	if (err < 0)
+		return err;
+
+	return terminate_pxe_file(file_addr);
+}
+
 #define PXELINUX_DIR "pxelinux.cfg/"
 
 /*
@@ -209,6 +244,147 @@ int get_pxelinux_path(struct cmd_tbl *cmdtp, const char *file,
 	return get_pxe_file(cmdtp, path, pxefile_addr_r);
 }
 
+#ifdef CONFIG_TFTP_PROBE
+/*
+ * Retrieves the first of several files in the 'pxelinux.cfg' folder which
+ * exists, given in order of preference. Requests for the files are sent
+ * without waiting for the replies to the others, so missing files cost
+ * little time.
+ *
+ * Returns the index of the file retrieved, or < 0 on error.
+ */
+int get_pxelinux_paths(const char *const files[], int count,
+		       unsigned long pxefile_addr_r)
+{
+	const char *names[TFTP_PROBE_MAX];
+	char base[MAX_TFTP_PATH_LEN + 1];
+	size_t base_len;
+	char *paths;
+	int i, ret;
+
+	if (count > TFTP_PROBE_MAX)
+		return -E2BIG;
+
+	ret = get_bootfile_path(PXELINUX_DIR, base, sizeof(base));
+	if (ret < 0)
+		return ret;
+	strcat(base, PXELINUX_DIR);
+	base_len = strlen(base);
+
+	paths = malloc(count * (MAX_TFTP_PATH_LEN + 1));
+	if (!paths)
+		return -ENOMEM;
+
+	for (i = 0; i < count; i++) {
+		if (base_len + strlen(files[i]) > MAX_TFTP_PATH_LEN) {
+			printf("path (%s%s) too long\n", base, files[i]);
+			ret = -ENAMETOOLONG;
+			goto out;
+		}
+		names[i] = paths + i * (MAX_TFTP_PATH_LEN + 1);
+		sprintf(paths + i * (MAX_TFTP_PATH_LEN + 1), "%s%s", base,
+			files[i]);
+	}
+
+	printf("Retrieving first file found of %d in: %s\n", count, base);
+	image_load_addr = pxefile_addr_r;
+	ret = tftp_probe(names, count);
+	if (ret < 0)
+		goto out;
+	printf("Retrieved file: %s\n", names[ret]);
+
+	i = ret;
+	ret = terminate_pxe_file(pxefile_addr_r);
+	if (ret > 0)
+		ret = i;
+out:
+	free(paths);
+
+	return ret;
+}
+#endif
+
+#ifdef CONFIG_CMD_PXE_CACHE
+/*
+ * Looks for 'file_path' among the files already retrieved to 'file_addr',
+ * checking that it is still there.
+ *
+ * Returns true if it is, with the 'filesize' environment variable set.
+ */
+static bool pxe_cache_find(const char *file_path, unsigned long file_addr)
+{
+	struct pxe_cached_file *file;
+	void *buf;
+	u32 crc;
+	int i;
+
+	for (i = 0; i < PXE_CACHE_FILES; i++) {
+		file = &pxe_cached_files[i];
+		if (!file->size || file->addr != file_addr ||
+		    strcmp(file->path, file_path))
+			continue;
+
+		buf = map_sysmem(file_addr, file->size);
+		crc = crc32_wd(0, buf, file->size, CHUNKSZ_CRC32);
+		unmap_sysmem(buf);
+		if (crc != file->crc) {
+			/* It has been overwritten */
+			file->size = 0;
+			return false;
+		}
+
+		printf("Using file already retrieved: %s\n", file_path);
+		env_set_hex("filesize", file->size);
+
+		return true;
+	}
+
+	return false;
+}
+
+/* Remembers the file just retrieved to 'file_addr' */
+static void pxe_cache_add(const char *file_path, unsigned long file_addr)
+{
+	struct pxe_cached_file *file = NULL;
+	void *buf;
+	int i;
+
+	if (strlen(file_path) > MAX_TFTP_PATH_LEN)
+		return;
+
+	/* Only one file can be at each address */
+	for (i = 0; i < PXE_CACHE_FILES; i++) {
+		if (pxe_cached_files[i].addr == file_addr)
+			file = &pxe_cached_files[i];
+	}
+	if (!file) {
+		file = &pxe_cached_files[pxe_cached_next];
+		pxe_cached_next = (pxe_cached_next + 1) % PXE_CACHE_FILES;
+	}
+
+	strcpy(file->path, file_path);
+	file->addr = file_addr;
+	file->size = env_get_hex("filesize", 0);
+	buf = map_sysmem(file_addr, file->size);
+	file->crc = crc32_wd(0, buf, file->size, CHUNKSZ_CRC32);
+	unmap_sysmem(buf);
+}
+
+/*
+ * Forgets the menu and files retrieved for it, so that they are retrieved
+ * again next time.
+ */
+void pxe_cache_flush(void)
+{
+	struct pxe_menu *cfg = pxe_cached_menu;
+
+	pxe_cached_menu = NULL;
+	if (cfg)
+		destroy_pxe_menu(cfg);
+	memset(pxe_cached_files, '\0', sizeof(pxe_cached_files));
+}
+#endif
+
 /*
  * Wrapper to make it easier to store the file at file_path in the location
  * specified by envaddr_name. file_path will be joined to the bootfile path,
@@ -230,6 +406,21 @@ static int get_relfile_envaddr(struct cmd_tbl *cmdtp, const char *file_path,
 	if (strict_strtoul(envaddr, 16, &file_addr) < 0)
 		return -EINVAL;
 
+#ifdef CONFIG_CMD_PXE_CACHE
+	if (is_pxe) {
+		int err;
+
+		if (pxe_cache_find(file_path, file_addr))
+			return 1;
+
+		err = get_relfile(cmdtp, file_path, file_addr);
+		if (err > 0)
+			pxe_cache_add(file_path, file_addr);
+
+		return err;
+	}
+#endif
+
 	return get_relfile(cmdtp, file_path, file_addr);
 }
 
@@ -1173,6 +1364,12 @@ void destroy_pxe_menu(struct pxe_menu *cfg)
 	struct list_head *pos, *n;
 	struct pxe_label *label;
 
+#ifdef CONFIG_CMD_PXE_CACHE
+	/* Kept for next time, until pxe_cache_flush() */
+	if (cfg == pxe_cached_menu)
+		return;
+#endif
+
 	if (cfg->title)
 		free(cfg->title);
 
@@ -1202,6 +1399,26 @@ struct pxe_menu *parse_pxefile(struct cmd_tbl *cmdtp, unsigned long menucfg)
 	struct pxe_menu *cfg;
 	char *buf;
 	int r;
+#ifdef CONFIG_CMD_PXE_CACHE
+	struct pxe_label *label;
+	size_t len;
+	u32 crc;
+
+	buf = map_sysmem(menucfg, 0);
+	len = strlen(buf);
+	crc = crc32(0, (uchar *)buf, len);
+	unmap_sysmem(buf);
+
+	cfg = pxe_cached_menu;
+	if (cfg && is_pxe && pxe_cached_menu_addr == menucfg &&
+	    pxe_cached_menu_len == len && pxe_cached_menu_crc == crc) {
+		/* The same file again, so there is nothing to retrieve */
+		list_for_each_entry(label, &cfg->labels, list)
+			label->attempted = 0;
+		return cfg;
+	}
+	pxe_cache_flush();
+#endif
 
 	cfg = malloc(sizeof(struct pxe_menu));
 
@@ -1221,6 +1438,15 @@ struct pxe_menu *parse_pxefile(struct cmd_tbl *cmdtp, unsigned long menucfg)
 		return NULL;
 	}
 
+#ifdef CONFIG_CMD_PXE_CACHE
+	if (is_pxe) {
+		pxe_cached_menu = cfg;
+		pxe_cached_menu_addr = menucfg;
+		pxe_cached_menu_len = len;
+		pxe_cached_menu_crc = crc;
+	}
+#endif
+
 	return cfg;
 }
 
@@ -81,8 +81,11 @@ int get_pxe_file(struct cmd_tbl *cmdtp, const char *file_path,
 		 unsigned long file_addr);
 int get_pxelinux_path(struct cmd_tbl *cmdtp, const char *file,
 		      unsigned long pxefile_addr_r);
+int get_pxelinux_paths(const char *const files[], int count,
+		       unsigned long pxefile_addr_r);
 void handle_pxe_menu(struct cmd_tbl *cmdtp, struct pxe_menu *cfg);
 struct pxe_menu *parse_pxefile(struct cmd_tbl *cmdtp, unsigned long menucfg);
 int format_mac_pxe(char *outbuf, size_t outbuf_len);
+void pxe_cache_flush(void);
 
 #endif /* __PXE_UTILS_H */
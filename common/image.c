@@ -10,6 +10,7 @@
 #include <common.h>
 #include <bootstage.h>
 #include <cpu_func.h>
+#include <dma.h>
 #include <env.h>
 #include <lmb.h>
 #include <log.h>
@@ -42,6 +43,7 @@
 #include <asm/io.h>
 
 #include <bzlib.h>
+#include <decomp_stream.h>
 #include <linux/lzo.h>
 #include <lzma/LzmaTypes.h>
 #include <lzma/LzmaDec.h>
@@ -198,6 +200,7 @@ static const table_entry_t uimage_comp[] = {
 	{	IH_COMP_LZMA,	"lzma",		"lzma compressed",	},
 	{	IH_COMP_LZO,	"lzo",		"lzo compressed",	},
 	{	IH_COMP_LZ4,	"lz4",		"lz4 compressed",	},
+	{	IH_COMP_ZSTD,	"zstd",		"zstd compressed",	},
 	{	-1,		"",		"",			},
 };
 
@@ -211,7 +214,9 @@ static const struct comp_magic_map image_comp[] = {
 	{	IH_COMP_BZIP2,	"bzip2",	{0x42, 0x5a},},
 	{	IH_COMP_GZIP,	"gzip",		{0x1f, 0x8b},},
 	{	IH_COMP_LZMA,	"lzma",		{0x5d, 0x00},},
+	{	IH_COMP_LZMA,	"xz",		{0xfd, 0x37},},
 	{	IH_COMP_LZO,	"lzo",		{0x89, 0x4c},},
+	{	IH_COMP_ZSTD,	"zstd",		{0x28, 0xb5},},
 	{	IH_COMP_NONE,	"none",		{},	},
 };
 
@@ -508,6 +513,24 @@ int image_decomp(int comp, ulong load, ulong image_start, int type,
 		break;
 	}
 #endif /* CONFIG_LZ4 */
+#if defined(CONFIG_ZSTD) && defined(CONFIG_DECOMP_STREAM)
+	case IH_COMP_ZSTD: {
+		struct decomp_stream ds;
+		ulong size;
+
+		ret = decomp_stream_init(&ds, comp, load_buf, unc_len);
+		if (ret)
+			break;
+		ret = decomp_stream_feed(&ds, image_buf, image_len);
+		if (ret) {
+			decomp_stream_abort(&ds);
+			break;
+		}
+		ret = decomp_stream_finish(&ds, &size);
+		image_len = size;
+		break;
+	}
+#endif /* CONFIG_ZSTD */
 	default:
 		printf("Unimplemented compression type %d\n", comp);
 		return -ENOSYS;
@@ -672,6 +695,9 @@ void memmove_wd(void *to, void *from, size_t len, ulong chunksz)
 	if (to == from)
 		return;
 
+	if (!dma_bulk_memcpy(to, from, len))
+		return;
+
 #if defined(CONFIG_HW_WATCHDOG) || defined(CONFIG_WATCHDOG)
 	if (to > from) {
 		from += len;
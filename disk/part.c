@@ -230,15 +230,14 @@ void dev_print (struct blk_desc *dev_desc)
 
 #ifdef CONFIG_HAVE_BLOCK_DEVICE
 
-void part_init(struct blk_desc *dev_desc)
+/* Work out the partition table type, without discarding cached blocks */
+static void part_detect_type(struct blk_desc *dev_desc)
 {
 	struct part_driver *drv =
 		ll_entry_start(struct part_driver, part_driver);
 	const int n_ents = ll_entry_count(struct part_driver, part_driver);
 	struct part_driver *entry;
 
-	blkcache_invalidate(dev_desc->if_type, dev_desc->devnum);
-
 	dev_desc->part_type = PART_TYPE_UNKNOWN;
 	for (entry = drv; entry != drv + n_ents; entry++) {
 		int ret;
@@ -252,6 +251,12 @@ void part_init(struct blk_desc *dev_desc)
 	}
 }
 
+void part_init(struct blk_desc *dev_desc)
+{
+	blkcache_invalidate(dev_desc->if_type, dev_desc->devnum);
+	part_detect_type(dev_desc);
+}
+
 static void print_part_header(const char *type, struct blk_desc *dev_desc)
 {
 #if CONFIG_IS_ENABLED(MAC_PARTITION) || \
@@ -420,9 +425,11 @@ int blk_get_device_by_str(const char *ifname, const char *dev_hwpart_str,
 	/*
 	 * Updates the partition table for the specified hw partition.
 	 * Always should be done, otherwise hw partition 0 will return stale
-	 * data after displaying a non-zero hw partition.
+	 * data after displaying a non-zero hw partition. Switching the hw
+	 * partition discards the cached blocks, so there is no need to do
+	 * that here, and filesystems can stay mounted between commands.
 	 */
-	part_init(*dev_desc);
+	part_detect_type(*dev_desc);
 #endif
 
 cleanup:
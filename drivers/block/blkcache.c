@@ -33,6 +33,9 @@ static struct block_cache_stats _stats = {
 	.max_entries = 32
 };
 
+/* Bumped whenever cached data is discarded, see blkcache_generation() */
+static unsigned int blkcache_gen;
+
 #ifdef CONFIG_M68K
 int blkcache_init(void)
 {
@@ -144,6 +147,7 @@ void blkcache_invalidate(int iftype, int devnum)
 	struct list_head *entry, *n;
 	struct block_cache_node *node;
 
+	blkcache_gen++;
 	list_for_each_safe(entry, n, &block_cache) {
 		node = (struct block_cache_node *)entry;
 		if ((node->iftype == iftype) &&
@@ -169,6 +173,7 @@ void blkcache_configure(unsigned blocks, unsigned entries)
 			free(node);
 		}
 		_stats.entries = 0;
+		blkcache_gen++;
 	}
 
 	_stats.max_blocks_per_entry = blocks;
@@ -178,6 +183,11 @@ void blkcache_configure(unsigned blocks, unsigned entries)
 	_stats.misses = 0;
 }
 
+unsigned int blkcache_generation(void)
+{
+	return blkcache_gen;
+}
+
 void blkcache_stats(struct block_cache_stats *stats)
 {
 	memcpy(stats, &_stats, sizeof(*stats));
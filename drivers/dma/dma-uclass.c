@@ -204,7 +204,7 @@ int dma_get_cfg(struct dma *dma, u32 cfg_id, void **cfg_data)
 }
 #endif /* CONFIG_DMA_CHANNELS */
 
-int dma_get_device(u32 transfer_type, struct udevice **devp)
+static int dma_find_device(u32 transfer_type, struct udevice **devp)
 {
 	struct udevice *dev;
 	int ret;
@@ -218,17 +218,26 @@ int dma_get_device(u32 transfer_type, struct udevice **devp)
 			break;
 	}
 
-	if (!dev) {
-		pr_err("No DMA device found that supports %x type\n",
-		      transfer_type);
+	if (!dev)
 		return -EPROTONOSUPPORT;
-	}
 
 	*devp = dev;
 
 	return ret;
 }
 
+int dma_get_device(u32 transfer_type, struct udevice **devp)
+{
+	int ret;
+
+	ret = dma_find_device(transfer_type, devp);
+	if (ret == -EPROTONOSUPPORT)
+		pr_err("No DMA device found that supports %x type\n",
+		      transfer_type);
+
+	return ret;
+}
+
 int dma_memcpy(void *dst, void *src, size_t len)
 {
 	struct udevice *dev;
@@ -250,6 +259,131 @@ int dma_memcpy(void *dst, void *src, size_t len)
 	return ops->transfer(dev, DMA_MEM_TO_MEM, dst, src, len);
 }
 
+int dma_memcpy_start(struct dma_copy *copy, void *dst, void *src, size_t len)
+{
+	const struct dma_ops *ops;
+	ulong start;
+	int ret;
+
+	copy->pending = false;
+	ret = dma_find_device(DMA_SUPPORTS_MEM_TO_MEM, &copy->dev);
+	if (ret < 0)
+		return ret;
+
+	ops = device_get_ops(copy->dev);
+	if (!ops->transfer_start && !ops->transfer)
+		return -ENOSYS;
+
+	/* Make sure the DMA engine sees what the CPU wrote to the source */
+	start = rounddown((ulong)src, ARCH_DMA_MINALIGN);
+	flush_dcache_range(start, roundup((ulong)src + len, ARCH_DMA_MINALIGN));
+
+	/* Invalidate the area, so no writeback into the RAM races with DMA */
+	invalidate_dcache_range((ulong)dst, (ulong)dst + len);
+
+	copy->dst = dst;
+	copy->len = len;
+	if (ops->transfer_start) {
+		ret = ops->transfer_start(copy->dev, DMA_MEM_TO_MEM, dst, src,
+					  len);
+		copy->pending = !ret;
+	} else {
+		ret = ops->transfer(copy->dev, DMA_MEM_TO_MEM, dst, src, len);
+	}
+
+	return ret < 0 ? ret : 0;
+}
+
+int dma_memcpy_wait(struct dma_copy *copy)
+{
+	const struct dma_ops *ops;
+	int ret = 0;
+
+	if (copy->pending) {
+		ops = device_get_ops(copy->dev);
+		ret = ops->transfer_wait(copy->dev);
+		copy->pending = false;
+	}
+
+	/* Drop any lines the CPU fetched speculatively during the transfer */
+	invalidate_dcache_range((ulong)copy->dst, (ulong)copy->dst + copy->len);
+
+	return ret < 0 ? ret : 0;
+}
+
+#if CONFIG_IS_ENABLED(DMA_BULK_COPY)
+/*
+ * Copy using DMA for the cache-line-aligned middle part of the destination,
+ * while the CPU copies the unaligned head and tail. These share no cache
+ * line with the part written by DMA.
+ */
+static int dma_bulk_copy(void *dst, void *src, size_t len)
+{
+	struct dma_copy copy;
+	size_t head, body;
+	int ret;
+
+	head = -(ulong)dst & (ARCH_DMA_MINALIGN - 1);
+	if (head > len)
+		head = len;
+	body = rounddown(len - head, ARCH_DMA_MINALIGN);
+	if (!body)
+		return -EINVAL;
+
+	ret = dma_memcpy_start(&copy, dst + head, src + head, body);
+	if (ret)
+		return ret;
+	memcpy(dst, src, head);
+	memcpy(dst + head + body, src + head + body, len - head - body);
+
+	return dma_memcpy_wait(&copy);
+}
+
+int dma_bulk_memcpy(void *dst, void *src, size_t len)
+{
+	if (len < CONFIG_DMA_BULK_COPY_MIN)
+		return -E2BIG;
+	if (dst < src + len && src < dst + len)
+		return -EINVAL;
+
+	return dma_bulk_copy(dst, src, len);
+}
+
+int dma_bulk_fill(void *buf, size_t filled, size_t len)
+{
+	int ret;
+
+	if (len < CONFIG_DMA_BULK_COPY_MIN || !filled)
+		return -E2BIG;
+
+	while (filled < len) {
+		size_t todo = min(filled, len - filled);
+
+		if (todo < CONFIG_DMA_BULK_COPY_MIN) {
+			memcpy(buf + filled, buf, todo);
+		} else {
+			ret = dma_bulk_copy(buf + filled, buf, todo);
+			if (ret)
+				return ret;
+		}
+		filled += todo;
+	}
+
+	return 0;
+}
+
+int dma_bulk_memset(void *dst, int c, size_t len)
+{
+	size_t filled = min_t(size_t, len, ARCH_DMA_MINALIGN);
+
+	if (len < CONFIG_DMA_BULK_COPY_MIN)
+		return -E2BIG;
+	memset(dst, c, filled);
+
+	return dma_bulk_fill(dst, filled, len);
+}
+#endif /* DMA_BULK_COPY */
+
 UCLASS_DRIVER(dma) = {
 	.id		= UCLASS_DMA,
 	.name		= "dma",
@@ -36,6 +36,9 @@ struct sandbox_dma_dev {
 	uchar	*buf_rx;
 	size_t	data_len;
 	u32	meta;
+	void	*copy_dst;
+	void	*copy_src;
+	size_t	copy_len;
 };
 
 static int sandbox_dma_transfer(struct udevice *dev, int direction,
@@ -46,6 +49,40 @@ static int sandbox_dma_transfer(struct udevice *dev, int direction,
 	return 0;
 }
 
+/*
+ * Simulate a transfer that runs in the background: nothing is copied until
+ * the transfer is waited for
+ */
+static int sandbox_dma_transfer_start(struct udevice *dev, int direction,
+				      void *dst, void *src, size_t len)
+{
+	struct sandbox_dma_dev *ud = dev_get_priv(dev);
+
+	if (direction != DMA_MEM_TO_MEM)
+		return -EINVAL;
+	if (ud->copy_dst)
+		return -EBUSY;
+
+	ud->copy_dst = dst;
+	ud->copy_src = src;
+	ud->copy_len = len;
+
+	return 0;
+}
+
+static int sandbox_dma_transfer_wait(struct udevice *dev)
+{
+	struct sandbox_dma_dev *ud = dev_get_priv(dev);
+
+	if (!ud->copy_dst)
+		return -EINVAL;
+
+	memcpy(ud->copy_dst, ud->copy_src, ud->copy_len);
+	ud->copy_dst = NULL;
+
+	return 0;
+}
+
 static int sandbox_dma_of_xlate(struct dma *dma,
 				struct ofnode_phandle_args *args)
 {
@@ -229,6 +266,8 @@ static int sandbox_dma_prepare_rcv_buf(struct dma *dma, void *dst, size_t size)
 
 static const struct dma_ops sandbox_dma_ops = {
 	.transfer	= sandbox_dma_transfer,
+	.transfer_start	= sandbox_dma_transfer_start,
+	.transfer_wait	= sandbox_dma_transfer_wait,
 	.of_xlate	= sandbox_dma_of_xlate,
 	.request	= sandbox_dma_request,
 	.rfree		= sandbox_dma_rfree,
@@ -253,8 +292,9 @@ static int sandbox_dma_probe(struct udevice *dev)
 	ud->buf_rx = NULL;
 	ud->meta = 0;
 	ud->data_len = 0;
+	ud->copy_dst = NULL;
 
-	pr_err("Number of channels: %u\n", ud->ch_count);
+	debug("Number of channels: %u\n", ud->ch_count);
 
 	for (i = 0; i < ud->ch_count; i++) {
 		struct sandbox_dma_chan *uc = &ud->channels[i];
@@ -15,6 +15,13 @@
 #define CONFIG_NETCONSOLE_BUFFER_SIZE 512
 #endif
 
+/* Largest datagram which fits in one Ethernet frame */
+#define NC_MAX_DATAGRAM		(1500 - IP_UDP_HDR_SIZE)
+/* Room for the sequence number, "4294967295;" */
+#define NC_SEQ_LEN		11
+/* Most output sent in one datagram */
+#define NC_OUTPUT_SIZE		(NC_MAX_DATAGRAM - NC_SEQ_LEN)
+
 static char input_buffer[CONFIG_NETCONSOLE_BUFFER_SIZE];
 static int input_size; /* char count in input buffer */
 static int input_offset; /* offset to valid chars in input buffer */
@@ -27,6 +34,13 @@ static short nc_out_port; /* target output port */
 static short nc_in_port; /* source input port */
 static const char *output_packet; /* used by first send udp */
 static int output_packet_len;
+static bool nc_use_seq; /* start each datagram with a sequence number */
+static uint nc_seq; /* sequence number of the next datagram */
+#ifdef CONFIG_NETCONSOLE_BATCH
+static char output_buffer[NC_OUTPUT_SIZE];
+static int output_len; /* char count in output buffer */
+static ulong output_time; /* when the oldest char was buffered */
+#endif
 /*
  * Start with a default last protocol.
  * We are only interested in NETCONS or not.
@@ -101,6 +115,8 @@ static int refresh_settings_from_env(void)
 		if (p != NULL)
 			nc_in_port = simple_strtoul(p, NULL, 10);
 
+		nc_use_seq = env_get_yesno("ncseq") == 1;
+
 		if (is_broadcast(nc_ip))
 			/* broadcast MAC address */
 			memset(nc_ether, 0xff, sizeof(nc_ether));
@@ -111,6 +127,18 @@ static int refresh_settings_from_env(void)
 	return 0;
 }
 
+/* Put @len bytes of output at @pkt, after the sequence number if enabled */
+static int nc_fill_packet(uchar *pkt, const char *buf, int len)
+{
+	int hdr_len = 0;
+
+	if (nc_use_seq)
+		hdr_len = sprintf((char *)pkt, "%u;", nc_seq++);
+	memcpy(pkt + hdr_len, buf, len);
+
+	return hdr_len + len;
+}
+
 /**
  * Called from net_loop in net/net.c before each packet
  */
@@ -124,12 +152,16 @@ void nc_start(void)
 	} else {
 		/* send arp request */
 		uchar *pkt;
+		int len;
+
 		net_set_arp_handler(nc_wait_arp_handler);
 		pkt = (uchar *)net_tx_packet + net_eth_hdr_size() +
 			IP_UDP_HDR_SIZE;
-		memcpy(pkt, output_packet, output_packet_len);
-		net_send_udp_packet(nc_ether, nc_ip, nc_out_port, nc_in_port,
-				    output_packet_len);
+		len = nc_fill_packet(pkt, output_packet, output_packet_len);
+		/* If the address was in the ARP cache there is no reply */
+		if (!net_send_udp_packet(nc_ether, nc_ip, nc_out_port,
+					 nc_in_port, len))
+			net_set_state(NETLOOP_SUCCESS);
 	}
 }
 
@@ -212,7 +244,7 @@ static void nc_send_packet(const char *buf, int len)
 		inited = 1;
 	}
 	pkt = (uchar *)net_tx_packet + net_eth_hdr_size() + IP_UDP_HDR_SIZE;
-	memcpy(pkt, buf, len);
+	len = nc_fill_packet(pkt, buf, len);
 	ether = nc_ether;
 	ip = nc_ip;
 	net_send_udp_packet(ether, ip, nc_out_port, nc_in_port, len);
@@ -225,6 +257,72 @@ static void nc_send_packet(const char *buf, int len)
 	}
 }
 
+#ifdef CONFIG_NETCONSOLE_BATCH
+static void nc_flush(void)
+{
+	int len = output_len;
+
+	if (!len)
+		return;
+	output_len = 0;
+	nc_send_packet(output_buffer, len);
+}
+
+/*
+ * Add output to the buffer. It is sent when a line is complete, when the
+ * buffer is full, or when the oldest output has waited long enough.
+ */
+static void nc_output(const char *s, int len)
+{
+	bool newline = false;
+	int chunk;
+
+	while (len) {
+		if (!output_len)
+			output_time = get_timer(0);
+		chunk = min_t(int, len, NC_OUTPUT_SIZE - output_len);
+		memcpy(output_buffer + output_len, s, chunk);
+		output_len += chunk;
+		if (memchr(s, '\n', chunk))
+			newline = true;
+		len -= chunk;
+		s += chunk;
+
+		if (output_len == NC_OUTPUT_SIZE) {
+			nc_flush();
+			newline = false;
+		}
+	}
+
+	if (newline ||
+	    get_timer(output_time) >= CONFIG_NETCONSOLE_FLUSH_MS)
+		nc_flush();
+}
+
+void nc_poll(void)
+{
+	if (output_recursion || !output_len ||
+	    get_timer(output_time) < CONFIG_NETCONSOLE_FLUSH_MS)
+		return;
+	output_recursion = 1;
+
+	nc_flush();
+
+	output_recursion = 0;
+}
+#else
+static void nc_output(const char *s, int len)
+{
+	while (len) {
+		int send_len = min_t(int, len, NC_OUTPUT_SIZE);
+
+		nc_send_packet(s, send_len);
+		len -= send_len;
+		s += send_len;
+	}
+}
+#endif
+
 static int nc_stdio_start(struct stdio_dev *dev)
 {
 	int retval;
@@ -251,26 +349,18 @@ static void nc_stdio_putc(struct stdio_dev *dev, char c)
 		return;
 	output_recursion = 1;
 
-	nc_send_packet(&c, 1);
+	nc_output(&c, 1);
 
 	output_recursion = 0;
 }
 
 static void nc_stdio_puts(struct stdio_dev *dev, const char *s)
 {
-	int len;
-
 	if (output_recursion)
 		return;
 	output_recursion = 1;
 
-	len = strlen(s);
-	while (len) {
-		int send_len = min(len, (int)sizeof(input_buffer));
-		nc_send_packet(s, send_len);
-		len -= send_len;
-		s += send_len;
-	}
+	nc_output(s, strlen(s));
 
 	output_recursion = 0;
 }
@@ -41,13 +41,63 @@ void sandbox_eth_disable_response(int index, bool disable)
 /*
  * sandbox_eth_skip_timeout()
  *
- * When the first packet read is attempted, fast-forward time
+ * When a packet read next finds nothing waiting, fast-forward time
  */
 void sandbox_eth_skip_timeout(void)
 {
 	skip_timeout = true;
 }
 
+/*
+ * sandbox_eth_recv_slot()
+ *
+ * Get the buffer for the next packet to be received
+ *
+ * returns the buffer, or NULL if the receive ring is full
+ */
+void *sandbox_eth_recv_slot(struct udevice *dev)
+{
+	struct eth_sandbox_priv *priv = dev_get_priv(dev);
+	int slot;
+
+	if (priv->recv_packets >= CONFIG_ETH_SANDBOX_RX_RING) {
+		eth_count_rx_dropped(dev, 1);
+		return NULL;
+	}
+	slot = (priv->recv_head + priv->recv_packets) %
+		CONFIG_ETH_SANDBOX_RX_RING;
+
+	return priv->recv_ring[slot];
+}
+
+/*
+ * sandbox_eth_recv_commit()
+ *
+ * Queue the packet filled in after sandbox_eth_recv_slot()
+ */
+void sandbox_eth_recv_commit(struct udevice *dev, int len)
+{
+	struct eth_sandbox_priv *priv = dev_get_priv(dev);
+	int slot;
+
+	slot = (priv->recv_head + priv->recv_packets) %
+		CONFIG_ETH_SANDBOX_RX_RING;
+	priv->recv_length[slot] = len;
+	++priv->recv_packets;
+}
+
+/*
+ * sandbox_eth_recv_full()
+ *
+ * returns true if the receive ring has no room for another packet
+ */
+bool sandbox_eth_recv_full(struct udevice *dev)
+{
+	struct eth_sandbox_priv *priv = dev_get_priv(dev);
+
+	return priv->recv_packets >= CONFIG_ETH_SANDBOX_RX_RING;
+}
+
 /*
  * sandbox_eth_arp_req_to_reply()
  *
@@ -73,14 +123,14 @@ int sandbox_eth_arp_req_to_reply(struct udevice *dev, void *packet,
 		return -EAGAIN;
 
 	/* Don't allow the buffer to overrun */
-	if (priv->recv_packets >= PKTBUFSRX)
+	eth_recv = sandbox_eth_recv_slot(dev);
+	if (!eth_recv)
 		return 0;
 
 	/* store this as the assumed IP of the fake host */
 	priv->fake_host_ipaddr = net_read_ip(&arp->ar_tpa);
 
 	/* Formulate a fake response */
-	eth_recv = (void *)priv->recv_packet_buffer[priv->recv_packets];
 	memcpy(eth_recv->et_dest, eth->et_src, ARP_HLEN);
 	memcpy(eth_recv->et_src, priv->fake_host_hwaddr, ARP_HLEN);
 	eth_recv->et_protlen = htons(PROT_ARP);
@@ -96,9 +146,7 @@ int sandbox_eth_arp_req_to_reply(struct udevice *dev, void *packet,
 	memcpy(&arp_recv->ar_tha, &arp->ar_sha, ARP_HLEN);
 	net_copy_ip(&arp_recv->ar_tpa, &arp->ar_spa);
 
-	priv->recv_packet_length[priv->recv_packets] =
-		ETHER_HDR_SIZE + ARP_HDR_SIZE;
-	++priv->recv_packets;
+	sandbox_eth_recv_commit(dev, ETHER_HDR_SIZE + ARP_HDR_SIZE);
 
 	return 0;
 }
@@ -135,11 +183,11 @@ int sandbox_eth_ping_req_to_reply(struct udevice *dev, void *packet,
 		return -EAGAIN;
 
 	/* Don't allow the buffer to overrun */
-	if (priv->recv_packets >= PKTBUFSRX)
+	eth_recv = sandbox_eth_recv_slot(dev);
+	if (!eth_recv)
 		return 0;
 
 	/* reply to the ping */
-	eth_recv = (void *)priv->recv_packet_buffer[priv->recv_packets];
 	memcpy(eth_recv, packet, len);
 	ipr = (void *)eth_recv + ETHER_HDR_SIZE;
 	icmpr = (struct icmp_hdr *)&ipr->udp_src;
@@ -155,8 +203,7 @@ int sandbox_eth_ping_req_to_reply(struct udevice *dev, void *packet,
 	icmpr->checksum = 0;
 	icmpr->checksum = compute_ip_checksum(icmpr, ICMP_HDR_SIZE);
 
-	priv->recv_packet_length[priv->recv_packets] = len;
-	++priv->recv_packets;
+	sandbox_eth_recv_commit(dev, len);
 
 	return 0;
 }
@@ -175,11 +222,11 @@ int sandbox_eth_recv_arp_req(struct udevice *dev)
 	struct arp_hdr *arp_recv;
 
 	/* Don't allow the buffer to overrun */
-	if (priv->recv_packets >= PKTBUFSRX)
+	eth_recv = sandbox_eth_recv_slot(dev);
+	if (!eth_recv)
 		return -EOVERFLOW;
 
 	/* Formulate a fake request */
-	eth_recv = (void *)priv->recv_packet_buffer[priv->recv_packets];
 	memcpy(eth_recv->et_dest, net_bcast_ethaddr, ARP_HLEN);
 	memcpy(eth_recv->et_src, priv->fake_host_hwaddr, ARP_HLEN);
 	eth_recv->et_protlen = htons(PROT_ARP);
@@ -195,9 +242,7 @@ int sandbox_eth_recv_arp_req(struct udevice *dev)
 	memcpy(&arp_recv->ar_tha, net_null_ethaddr, ARP_HLEN);
 	net_write_ip(&arp_recv->ar_tpa, net_ip);
 
-	priv->recv_packet_length[priv->recv_packets] =
-		ETHER_HDR_SIZE + ARP_HDR_SIZE;
-	++priv->recv_packets;
+	sandbox_eth_recv_commit(dev, ETHER_HDR_SIZE + ARP_HDR_SIZE);
 
 	return 0;
 }
@@ -217,11 +262,11 @@ int sandbox_eth_recv_ping_req(struct udevice *dev)
 	struct icmp_hdr *icmpr;
 
 	/* Don't allow the buffer to overrun */
-	if (priv->recv_packets >= PKTBUFSRX)
+	eth_recv = sandbox_eth_recv_slot(dev);
+	if (!eth_recv)
 		return -EOVERFLOW;
 
 	/* Formulate a fake ping */
-	eth_recv = (void *)priv->recv_packet_buffer[priv->recv_packets];
 
 	memcpy(eth_recv->et_dest, net_ethaddr, ARP_HLEN);
 	memcpy(eth_recv->et_src, priv->fake_host_hwaddr, ARP_HLEN);
@@ -246,13 +291,30 @@ int sandbox_eth_recv_ping_req(struct udevice *dev)
 	icmpr->un.echo.sequence = htons(1);
 	icmpr->checksum = compute_ip_checksum(icmpr, ICMP_HDR_SIZE);
 
-	priv->recv_packet_length[priv->recv_packets] =
-		ETHER_HDR_SIZE + IP_ICMP_HDR_SIZE;
-	++priv->recv_packets;
+	sandbox_eth_recv_commit(dev, ETHER_HDR_SIZE + IP_ICMP_HDR_SIZE);
 
 	return 0;
 }
 
+/*
+ * sandbox_eth_recv_burst()
+ *
+ * Inject a burst of ARP requests for this target
+ *
+ * returns the number of requests injected
+ */
+int sandbox_eth_recv_burst(struct udevice *dev, int count)
+{
+	int i, injected = 0;
+
+	for (i = 0; i < count; i++) {
+		if (!sandbox_eth_recv_arp_req(dev))
+			injected++;
+	}
+
+	return injected;
+}
+
 /*
  * sb_default_handler()
  *
@@ -325,11 +387,8 @@ static int sb_eth_start(struct udevice *dev)
 
 	debug("eth_sandbox: Start\n");
 
+	priv->recv_head = 0;
 	priv->recv_packets = 0;
-	for (int i = 0; i < PKTBUFSRX; i++) {
-		priv->recv_packet_buffer[i] = net_rx_packets[i];
-		priv->recv_packet_length[i] = 0;
-	}
 
 	return 0;
 }
@@ -346,42 +405,69 @@ static int sb_eth_send(struct udevice *dev, void *packet, int length)
 	return priv->tx_handler(dev, packet, length);
 }
 
-static int sb_eth_recv(struct udevice *dev, int flags, uchar **packetp)
+static int sb_eth_recv_batch(struct udevice *dev, int flags, uchar **packetp,
+			     int *lengths, int max)
 {
 	struct eth_sandbox_priv *priv = dev_get_priv(dev);
+	int i, slot, count;
 
-	if (skip_timeout) {
+	if (skip_timeout && !priv->recv_packets) {
 		timer_test_add_offset(11000UL);
 		skip_timeout = false;
 	}
 
-	if (priv->recv_packets) {
-		int lcl_recv_packet_length = priv->recv_packet_length[0];
-
-		debug("eth_sandbox: received packet[%d], %d waiting\n",
-		      lcl_recv_packet_length, priv->recv_packets - 1);
-		*packetp = priv->recv_packet_buffer[0];
-		return lcl_recv_packet_length;
+	count = min(priv->recv_packets, max);
+	for (i = 0; i < count; i++) {
+		slot = (priv->recv_head + i) % CONFIG_ETH_SANDBOX_RX_RING;
+		packetp[i] = priv->recv_ring[slot];
+		lengths[i] = priv->recv_length[slot];
 	}
-	return 0;
+	if (count)
+		debug("eth_sandbox: received %d packets, %d waiting\n", count,
+		      priv->recv_packets - count);
+
+	return count;
+}
+
+static int sb_eth_recv(struct udevice *dev, int flags, uchar **packetp)
+{
+	int length;
+
+	if (!sb_eth_recv_batch(dev, flags, packetp, &length, 1))
+		return 0;
+
+	return length;
 }
 
 static int sb_eth_free_pkt(struct udevice *dev, uchar *packet, int length)
 {
 	struct eth_sandbox_priv *priv = dev_get_priv(dev);
-	int i;
 
+	/* Packets are always handed back in the order they were received */
 	if (!priv->recv_packets)
 		return 0;
 
+	priv->recv_head = (priv->recv_head + 1) % CONFIG_ETH_SANDBOX_RX_RING;
 	--priv->recv_packets;
-	for (i = 0; i < priv->recv_packets; i++) {
-		priv->recv_packet_length[i] = priv->recv_packet_length[i + 1];
-		memcpy(priv->recv_packet_buffer[i],
-		       priv->recv_packet_buffer[i + 1],
-		       priv->recv_packet_length[i + 1]);
+
+	return 0;
+}
+
+static int sb_eth_mcast(struct udevice *dev, const u8 *enetaddr, int join)
+{
+	struct eth_sandbox_priv *priv = dev_get_priv(dev);
+
+	debug("eth_sandbox: %s multicast group %pM\n",
+	      join ? "Join" : "Leave", enetaddr);
+
+	/* Only one group is tracked, which is all that TFTP needs */
+	if (join) {
+		memcpy(priv->mcast_hwaddr, enetaddr, ARP_HLEN);
+		priv->mcast_joined = true;
+	} else if (priv->mcast_joined &&
+		   !memcmp(priv->mcast_hwaddr, enetaddr, ARP_HLEN)) {
+		priv->mcast_joined = false;
 	}
-	priv->recv_packet_length[priv->recv_packets] = 0;
 
 	return 0;
 }
@@ -404,7 +490,9 @@ static const struct eth_ops sb_eth_ops = {
 	.start			= sb_eth_start,
 	.send			= sb_eth_send,
 	.recv			= sb_eth_recv,
+	.recv_batch		= sb_eth_recv_batch,
 	.free_pkt		= sb_eth_free_pkt,
+	.mcast			= sb_eth_mcast,
 	.stop			= sb_eth_stop,
 	.write_hwaddr		= sb_eth_write_hwaddr,
 };
@@ -6,6 +6,7 @@
 #include <common.h>
 #include <cpu_func.h>
 #include <dm.h>
+#include <dma.h>
 #include <log.h>
 #include <malloc.h>
 #include <mapmem.h>
@@ -20,6 +21,9 @@
 #include <asm/sdl.h>
 #endif
 
+/* Bytes cleared by the CPU before DMA fills in the rest of the frame buffer */
+#define VIDEO_CLEAR_DMA_SEED	4096
+
 /*
  * Theory of operation:
  *
@@ -90,15 +94,14 @@ int video_reserve(ulong *addrp)
 	return 0;
 }
 
-int video_clear(struct udevice *dev)
+/* Fill the first @size bytes of the frame buffer with the background colour */
+static void video_fill_bg(struct video_priv *priv, int size)
 {
-	struct video_priv *priv = dev_get_uclass_priv(dev);
-
 	switch (priv->bpix) {
 	case VIDEO_BPP16:
 		if (IS_ENABLED(CONFIG_VIDEO_BPP16)) {
 			u16 *ppix = priv->fb;
-			u16 *end = priv->fb + priv->fb_size;
+			u16 *end = priv->fb + size;
 
 			while (ppix < end)
 				*ppix++ = priv->colour_bg;
@@ -107,16 +110,31 @@ int video_clear(struct udevice *dev)
 	case VIDEO_BPP32:
 		if (IS_ENABLED(CONFIG_VIDEO_BPP32)) {
 			u32 *ppix = priv->fb;
-			u32 *end = priv->fb + priv->fb_size;
+			u32 *end = priv->fb + size;
 
 			while (ppix < end)
 				*ppix++ = priv->colour_bg;
 			break;
 		}
 	default:
-		memset(priv->fb, priv->colour_bg, priv->fb_size);
+		memset(priv->fb, priv->colour_bg, size);
 		break;
 	}
+}
+
+int video_clear(struct udevice *dev)
+{
+	struct video_priv *priv = dev_get_uclass_priv(dev);
+
+	/* Let DMA copy the first few lines over the rest, if possible */
+	if (CONFIG_IS_ENABLED(DMA_BULK_COPY) &&
+	    priv->fb_size > VIDEO_CLEAR_DMA_SEED) {
+		video_fill_bg(priv, VIDEO_CLEAR_DMA_SEED);
+		if (!dma_bulk_fill(priv->fb, VIDEO_CLEAR_DMA_SEED,
+				   priv->fb_size))
+			return 0;
+	}
+	video_fill_bg(priv, priv->fb_size);
 
 	return 0;
 }
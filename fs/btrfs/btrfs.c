@@ -81,6 +81,8 @@ int btrfs_probe(struct blk_desc *fs_dev_desc,
 	btrfs_blk_desc = fs_dev_desc;
 	btrfs_part_info = fs_partition;
 
+	btrfs_node_cache_exit();
+	btrfs_extent_io_exit();
 	memset(&btrfs_info, 0, sizeof(btrfs_info));
 
 	btrfs_hash_init();
@@ -211,6 +213,9 @@ int btrfs_read(const char *file, void *buf, loff_t offset, loff_t len,
 
 void btrfs_close(void)
 {
+	btrfs_node_cache_exit();
+	btrfs_extent_io_exit();
+	btrfs_decompress_exit();
 	btrfs_chunk_map_exit();
 }
 
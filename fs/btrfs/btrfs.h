@@ -48,6 +48,7 @@ int btrfs_read_chunk_tree(void);
 
 /* compression.c */
 u32 btrfs_decompress(u8 type, const char *, u32, char *, u32);
+void btrfs_decompress_exit(void);
 
 /* super.c */
 int btrfs_read_superblock(void);
@@ -83,5 +84,6 @@ u64 btrfs_read_extent_inline(struct btrfs_path *,
 			      char *);
 u64 btrfs_read_extent_reg(struct btrfs_path *, struct btrfs_file_extent_item *,
 			   u64, u64, char *);
+void btrfs_extent_io_exit(void);
 
 #endif /* !__BTRFS_BTRFS_H__ */
@@ -134,29 +134,51 @@ static u32 decompress_zlib(const u8 *_cbuf, u32 clen, u8 *dbuf, u32 dlen)
 #define ZSTD_BTRFS_MAX_WINDOWLOG 17
 #define ZSTD_BTRFS_MAX_INPUT (1 << ZSTD_BTRFS_MAX_WINDOWLOG)
 
-static u32 decompress_zstd(const u8 *cbuf, u32 clen, u8 *dbuf, u32 dlen)
+/*
+ * Setting up a zstd stream takes a large workspace, so it is done once and
+ * the stream reset for each extent
+ */
+static void *zstd_workspace;
+static ZSTD_DStream *zstd_dstream;
+
+static ZSTD_DStream *get_zstd_dstream(void)
 {
-	ZSTD_DStream *dstream;
-	ZSTD_inBuffer in_buf;
-	ZSTD_outBuffer out_buf;
-	void *workspace;
 	size_t wsize;
-	u32 res = -1;
+
+	if (zstd_dstream) {
+		if (!ZSTD_isError(ZSTD_resetDStream(zstd_dstream)))
+			return zstd_dstream;
+		btrfs_decompress_exit();
+	}
 
 	wsize = ZSTD_DStreamWorkspaceBound(ZSTD_BTRFS_MAX_INPUT);
-	workspace = malloc(wsize);
-	if (!workspace) {
+	zstd_workspace = malloc(wsize);
+	if (!zstd_workspace) {
 		debug("%s: cannot allocate workspace of size %zu\n", __func__,
 		      wsize);
-		return -1;
+		return NULL;
 	}
 
-	dstream = ZSTD_initDStream(ZSTD_BTRFS_MAX_INPUT, workspace, wsize);
-	if (!dstream) {
+	zstd_dstream = ZSTD_initDStream(ZSTD_BTRFS_MAX_INPUT, zstd_workspace,
+					wsize);
+	if (!zstd_dstream) {
 		printf("%s: ZSTD_initDStream failed\n", __func__);
-		goto err_free;
+		btrfs_decompress_exit();
 	}
 
+	return zstd_dstream;
+}
+
+static u32 decompress_zstd(const u8 *cbuf, u32 clen, u8 *dbuf, u32 dlen)
+{
+	ZSTD_DStream *dstream;
+	ZSTD_inBuffer in_buf;
+	ZSTD_outBuffer out_buf;
+
+	dstream = get_zstd_dstream();
+	if (!dstream)
+		return -1;
+
 	in_buf.src = cbuf;
 	in_buf.pos = 0;
 	in_buf.size = clen;
@@ -172,18 +194,21 @@ static u32 decompress_zstd(const u8 *cbuf, u32 clen, u8 *dbuf, u32 dlen)
 		if (ZSTD_isError(ret)) {
 			printf("%s: ZSTD_decompressStream error %d\n", __func__,
 			       ZSTD_getErrorCode(ret));
-			goto err_free;
+			return -1;
 		}
 
 		if (in_buf.pos >= clen || !ret)
 			break;
 	}
 
-	res = out_buf.pos;
+	return out_buf.pos;
+}
 
-err_free:
-	free(workspace);
-	return res;
+void btrfs_decompress_exit(void)
+{
+	free(zstd_workspace);
+	zstd_workspace = NULL;
+	zstd_dstream = NULL;
 }
 
 u32 btrfs_decompress(u8 type, const char *c, u32 clen, char *d, u32 dlen)
@@ -9,6 +9,7 @@
 #include <log.h>
 #include <malloc.h>
 #include <memalign.h>
+#include <linux/list.h>
 
 int btrfs_comp_keys(struct btrfs_key *a, struct btrfs_key *b)
 {
@@ -105,37 +106,216 @@ void btrfs_free_path(struct btrfs_path *p)
 	clear_path(p);
 }
 
-static int read_tree_node(u64 physical, union btrfs_tree_node **buf)
+/*
+ * Tree nodes are cached as read from disk, once their checksum has been
+ * verified, so that looking up the next component of a path or the next
+ * item in a directory does not read the same nodes again. The cache is
+ * emptied when the filesystem is closed.
+ */
+struct node_cache_entry {
+	struct list_head list;	/* most recently used first */
+	u64 bytenr;
+	u8 *data;
+};
+
+static LIST_HEAD(node_cache);
+static unsigned int node_cache_count;
+
+/* Number of leaves to read at once when walking through a tree */
+#define BTRFS_READAHEAD_LEAVES	8
+
+static unsigned int node_cache_max(void)
+{
+	return CONFIG_FS_BTRFS_NODE_CACHE_SIZE * 1024 / btrfs_info.sb.nodesize;
+}
+
+void btrfs_node_cache_exit(void)
+{
+	struct node_cache_entry *e, *tmp;
+
+	list_for_each_entry_safe(e, tmp, &node_cache, list) {
+		list_del(&e->list);
+		free(e->data);
+		free(e);
+	}
+	node_cache_count = 0;
+}
+
+static u8 *node_cache_lookup(u64 bytenr)
+{
+	struct node_cache_entry *e;
+
+	list_for_each_entry(e, &node_cache, list) {
+		if (e->bytenr == bytenr) {
+			list_move(&e->list, &node_cache);
+			return e->data;
+		}
+	}
+
+	return NULL;
+}
+
+/* Hand data over to the cache, returning -1 if it has no room for it */
+static int node_cache_insert(u64 bytenr, u8 *data)
+{
+	struct node_cache_entry *e;
+
+	if (!node_cache_max())
+		return -1;
+
+	if (node_cache_count < node_cache_max()) {
+		e = malloc(sizeof(*e));
+		if (!e)
+			return -1;
+		node_cache_count++;
+	} else {
+		/* reuse the least recently used entry */
+		e = list_last_entry(&node_cache, struct node_cache_entry, list);
+		list_del(&e->list);
+		free(e->data);
+	}
+	e->bytenr = bytenr;
+	e->data = data;
+	list_add(&e->list, &node_cache);
+
+	return 0;
+}
+
+/* Check that data is the tree block at logical, as read from disk */
+static int check_tree_node(u64 logical, u8 *data)
+{
+	struct btrfs_header *hdr = (struct btrfs_header *)data;
+	u32 nodesize = btrfs_info.sb.nodesize;
+	u32 crc = ~(u32)0;
+	u8 result[sizeof(crc)];
+
+	crc = btrfs_csum_data((char *)data + BTRFS_CSUM_SIZE, crc,
+			      nodesize - BTRFS_CSUM_SIZE);
+	btrfs_csum_final(crc, result);
+	if (memcmp(hdr->csum, result, sizeof(result)) ||
+	    le64_to_cpu(hdr->bytenr) != logical)
+		return -1;
+
+	return 0;
+}
+
+/*
+ * Read the tree nodes at logical addresses logical[0..count), which must be
+ * consecutive on disk, with a single read and put them in the cache
+ */
+static void readahead_tree_nodes(u64 *logical, int count, u64 physical)
+{
+	u32 nodesize = btrfs_info.sb.nodesize;
+	u8 *buf, *data;
+	int i;
+
+	buf = malloc_cache_aligned(count * nodesize);
+	if (!buf)
+		return;
+
+	if (btrfs_devread(physical, count * nodesize, buf)) {
+		for (i = 0; i < count; ++i) {
+			if (check_tree_node(logical[i], buf + i * nodesize))
+				break;
+			data = malloc(nodesize);
+			if (!data)
+				break;
+			memcpy(data, buf + i * nodesize, nodesize);
+			if (node_cache_insert(logical[i], data)) {
+				free(data);
+				break;
+			}
+		}
+	}
+
+	free(buf);
+}
+
+/*
+ * Before reading the leaf at slot of a level 1 node, read the leaves which
+ * follow it along with it, as far as they are next to each other on disk
+ */
+static void readahead_leaves(union btrfs_tree_node *parent, u32 slot)
+{
+	u64 logical[BTRFS_READAHEAD_LEAVES];
+	u64 physical = 0, next;
+	u32 nodesize = btrfs_info.sb.nodesize;
+	int count = 0, max;
+
+	max = min_t(int, BTRFS_READAHEAD_LEAVES, node_cache_max() / 2);
+	while (count < max && slot < parent->header.nritems) {
+		logical[count] = parent->node.ptrs[slot++].blockptr;
+		if (node_cache_lookup(logical[count]))
+			break;
+		next = btrfs_map_logical_to_physical(logical[count]);
+		if (next == -1ULL ||
+		    (count && next != physical + count * nodesize))
+			break;
+		if (!count)
+			physical = next;
+		count++;
+	}
+
+	if (count > 1)
+		readahead_tree_nodes(logical, count, physical);
+}
+
+static int read_tree_node(u64 logical, union btrfs_tree_node **buf)
 {
 	ALLOC_CACHE_ALIGN_BUFFER(struct btrfs_header, hdr,
 				 sizeof(struct btrfs_header));
-	unsigned long size, offset = sizeof(*hdr);
+	u32 nodesize = btrfs_info.sb.nodesize;
+	unsigned long size;
 	union btrfs_tree_node *res;
+	u64 physical;
+	u8 *data;
+	bool cached = true;
 	u32 i;
 
-	if (!btrfs_devread(physical, sizeof(*hdr), hdr))
-		return -1;
+	data = node_cache_lookup(logical);
+	if (!data) {
+		physical = btrfs_map_logical_to_physical(logical);
+		if (physical == -1ULL)
+			return -1;
 
+		data = malloc_cache_aligned(nodesize);
+		if (!data) {
+			debug("%s: malloc failed\n", __func__);
+			return -1;
+		}
+		if (!btrfs_devread(physical, nodesize, data)) {
+			free(data);
+			return -1;
+		}
+		if (check_tree_node(logical, data)) {
+			printf("%s: bad checksum or address in tree block at %llu\n",
+			       __func__, logical);
+			free(data);
+			return -1;
+		}
+		cached = !node_cache_insert(logical, data);
+	}
+
+	memcpy(hdr, data, sizeof(*hdr));
 	btrfs_header_to_cpu(hdr);
 
 	if (hdr->level)
 		size = sizeof(struct btrfs_node)
 		       + hdr->nritems * sizeof(struct btrfs_key_ptr);
 	else
-		size = btrfs_info.sb.nodesize;
+		size = nodesize;
 
-	res = malloc_cache_aligned(size);
+	res = size <= nodesize ? malloc(size) : NULL;
 	if (!res) {
-		debug("%s: malloc failed\n", __func__);
-		return -1;
-	}
-
-	if (!btrfs_devread(physical + offset, size - offset,
-			   ((u8 *) res) + offset)) {
-		free(res);
+		debug("%s: cannot copy tree node\n", __func__);
+		if (!cached)
+			free(data);
 		return -1;
 	}
 
+	memcpy(res, data, size);
+	if (!cached)
+		free(data);
 	memcpy(&res->header, hdr, sizeof(*hdr));
 	if (hdr->level)
 		for (i = 0; i < hdr->nritems; ++i)
@@ -154,7 +334,7 @@ int btrfs_search_tree(const struct btrfs_root *root, struct btrfs_key *key,
 {
 	u8 lvl, prev_lvl;
 	int i, slot, ret;
-	u64 logical, physical;
+	u64 logical;
 	union btrfs_tree_node *buf;
 
 	clear_path(p);
@@ -162,11 +342,7 @@ int btrfs_search_tree(const struct btrfs_root *root, struct btrfs_key *key,
 	logical = root->bytenr;
 
 	for (i = 0; i < BTRFS_MAX_LEVEL; ++i) {
-		physical = btrfs_map_logical_to_physical(logical);
-		if (physical == -1ULL)
-			goto err;
-
-		if (read_tree_node(physical, &buf))
+		if (read_tree_node(logical, &buf))
 			goto err;
 
 		lvl = buf->header.level;
@@ -238,15 +414,14 @@ static int jump_leaf(struct btrfs_path *path, int dir)
 	from_level = level;
 
 	while (level >= 0) {
-		u64 logical, physical;
+		u64 logical;
 
 		slot = p.slots[level + 1];
 		logical = p.nodes[level + 1]->node.ptrs[slot].blockptr;
-		physical = btrfs_map_logical_to_physical(logical);
-		if (physical == -1ULL)
-			goto err;
+		if (!level && dir > 0)
+			readahead_leaves(p.nodes[1], slot);
 
-		if (read_tree_node(physical, &p.nodes[level]))
+		if (read_tree_node(logical, &p.nodes[level]))
 			goto err;
 
 		if (dir > 0)
@@ -8,6 +8,7 @@
 #include "btrfs.h"
 #include <malloc.h>
 #include <memalign.h>
+#include <part.h>
 
 u64 btrfs_read_extent_inline(struct btrfs_path *path,
 			     struct btrfs_file_extent_item *extent, u64 offset,
@@ -61,13 +62,68 @@ err:
 	return -1ULL;
 }
 
+/*
+ * Compressed data is read into a window which extends past the extent being
+ * read, by as much as the caller still wants to read, so that the following
+ * extents of a file, which are usually next to it on disk, come with the
+ * same read. The window lasts until the filesystem is closed.
+ */
+#define BTRFS_READ_WINDOW	(512 * 1024)
+
+static struct {
+	u64 physical;		/* device offset of buf */
+	u32 len;		/* number of valid bytes in buf */
+	char *buf;		/* BTRFS_READ_WINDOW bytes, or clen if larger */
+	u32 size;
+	char *dbuf;		/* for partly used decompressed extents */
+	u32 dsize;
+} window;
+
+void btrfs_extent_io_exit(void)
+{
+	free(window.buf);
+	free(window.dbuf);
+	memset(&window, 0, sizeof(window));
+}
+
+/* Get clen bytes of compressed data at physical, reading ahead by ahead */
+static const char *read_compressed(u64 physical, u32 clen, u64 ahead)
+{
+	u64 dev_end = (u64)btrfs_part_info->size * btrfs_part_info->blksz;
+	u32 len;
+
+	if (window.len && physical >= window.physical &&
+	    physical + clen <= window.physical + window.len)
+		return window.buf + (physical - window.physical);
+
+	len = max_t(u64, clen, min_t(u64, clen + ahead, BTRFS_READ_WINDOW));
+	if (physical + len > dev_end)
+		len = max_t(u64, clen, dev_end - physical);
+
+	if (len > window.size) {
+		free(window.buf);
+		window.size = max_t(u32, len, BTRFS_READ_WINDOW);
+		window.buf = malloc_cache_aligned(window.size);
+		if (!window.buf)
+			window.size = 0;
+	}
+	window.len = 0;
+	if (!window.buf || !btrfs_devread(physical, len, window.buf))
+		return NULL;
+	window.physical = physical;
+	window.len = len;
+
+	return window.buf;
+}
+
 u64 btrfs_read_extent_reg(struct btrfs_path *path,
 			  struct btrfs_file_extent_item *extent, u64 offset,
 			  u64 size, char *out)
 {
 	u64 physical, clen, dlen, orig_size = size;
 	u32 res;
-	char *cbuf, *dbuf;
+	const char *cbuf;
+	char *dbuf;
 
 	clen = extent->disk_num_bytes;
 	dlen = extent->num_bytes;
@@ -96,31 +152,42 @@ u64 btrfs_read_extent_reg(struct btrfs_path *path,
 		return size;
 	}
 
-	cbuf = malloc_cache_aligned(dlen > size ? clen + dlen : clen);
+	/*
+	 * The extent may use only part of the decompressed data, from
+	 * extent->offset on
+	 */
+	offset += extent->offset;
+	dlen = extent->ram_bytes;
+	if (offset > dlen || size > dlen - offset)
+		return -1ULL;
+
+	cbuf = read_compressed(physical, clen, orig_size - size);
 	if (!cbuf)
 		return -1ULL;
 
-	if (dlen > orig_size)
-		dbuf = cbuf + clen;
-	else
+	if (offset || size < dlen) {
+		if (dlen > window.dsize) {
+			free(window.dbuf);
+			window.dbuf = malloc(dlen);
+			window.dsize = window.dbuf ? dlen : 0;
+			if (!window.dbuf)
+				return -1ULL;
+		}
+		dbuf = window.dbuf;
+	} else {
 		dbuf = out;
-
-	if (!btrfs_devread(physical, clen, cbuf))
-		goto err;
+	}
 
 	res = btrfs_decompress(extent->compression, cbuf, clen, dbuf, dlen);
 	if (res == -1)
-		goto err;
+		return -1ULL;
 
-	if (dlen > orig_size)
-		memcpy(out, dbuf + offset, size);
-	else
-		memmove(out, dbuf + offset, size);
+	/* the end of the last block of a file may not be stored */
+	if (res < dlen)
+		memset(dbuf + res, 0, dlen - res);
 
-	free(cbuf);
-	return res;
+	if (dbuf != out)
+		memcpy(out, dbuf + offset, size);
 
-err:
-	free(cbuf);
-	return -1ULL;
+	return size;
 }
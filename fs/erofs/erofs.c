@@ -0,0 +1,1343 @@
+// SPDX-License-Identifier: GPL-2.0+
+/*
+ * Read-only EROFS filesystem support
+ *
+ * Metadata (inodes, directories, compression indexes) is never compressed
+ * and is read through a small cache of device blocks. Uncompressed file data
+ * is read from the device straight into the caller's buffer, in as few reads
+ * as the layout on the device allows.
+ *
+ * Compressed files are made of variable-sized extents, each decompressed
+ * from one physical cluster (pcluster) of whole blocks. LZ4 data is aligned
+ * to the end of its pcluster, so when an extent is wanted whole and there is
+ * room in the caller's buffer, the pcluster is read into the end of the
+ * extent's place there and decompressed in place. Other extents are
+ * decompressed into a buffer which is kept until the next one is needed.
+ */
+
+#include <common.h>
+#include <blk.h>
+#include <errno.h>
+#include <erofs.h>
+#include <fs.h>
+#include <fs_internal.h>
+#include <log.h>
+#include <lz4.h>
+#include <malloc.h>
+#include <memalign.h>
+#include <part.h>
+#include <uuid.h>
+#include <asm/unaligned.h>
+#include <linux/kernel.h>
+#include <linux/list.h>
+#include <linux/log2.h>
+#include <linux/stat.h>
+#include <u-boot/crc.h>
+
+#include "erofs_fs.h"
+
+/* Number of metadata blocks kept in the cache */
+#define EROFS_META_CACHE_BLOCKS	16
+
+#define EROFS_NAME_LEN		255
+#define EROFS_MAX_SYMLINKS	8
+#define EROFS_SYMLINK_MAX	4096
+
+/* Extra room needed after LZ4 output to decompress in place */
+#define EROFS_LZ4_INPLACE_MARGIN(srcsize)	(((srcsize) >> 8) + 32)
+
+/* Flags for struct erofs_map */
+#define EROFS_MAP_MAPPED	BIT(0)
+#define EROFS_MAP_ZIPPED	BIT(1)
+#define EROFS_MAP_INTERLACED	BIT(2)
+
+/**
+ * struct erofs_inode - the parts of an inode which are used here
+ *
+ * @nid:	Inode number, i.e. the slot holding the inode
+ * @mode:	File type and permissions
+ * @datalayout:	Layout of the data (EROFS_INODE_...)
+ * @size:	Size of the data
+ * @pos:	Position of the inode on the device
+ * @isize:	Size of the inode and its xattrs, which the inline data or
+ *		the block indexes follow
+ * @u:		Start block, or chunk format for chunk-based files
+ * @z_advise:	Compressed files only: Z_EROFS_ADVISE_... flags
+ * @z_algorithm: Compressed files only: algorithm for HEAD1 and HEAD2
+ *		lclusters
+ * @z_inited:	true once the compressed file fields have been read
+ */
+struct erofs_inode {
+	u64 nid;
+	u16 mode;
+	u8 datalayout;
+	u64 size;
+	u64 pos;
+	u32 isize;
+	u32 u;
+	u16 z_advise;
+	u8 z_algorithm[2];
+	bool z_inited;
+};
+
+/**
+ * struct erofs_map - an extent of a file
+ *
+ * @la:		Logical position of the extent in the file
+ * @llen:	Length of the extent in the file
+ * @pa:		Position of the data on the device
+ * @plen:	Length of the data on the device, for compressed extents
+ * @flags:	EROFS_MAP_... flags. Extents which are not mapped are holes
+ */
+struct erofs_map {
+	u64 la;
+	u64 llen;
+	u64 pa;
+	u64 plen;
+	unsigned int flags;
+};
+
+/**
+ * struct z_erofs_lcluster - index of a logical cluster
+ *
+ * @lcn:	Logical cluster number
+ * @type:	Type (Z_EROFS_LCLUSTER_TYPE_...)
+ * @clusterofs:	Offset of the start of the pcluster in the lcluster
+ * @pblk:	Start block of the pcluster, for head lclusters
+ * @delta:	Distance back to the head lcluster, and on to the next head,
+ *		for NONHEAD lclusters
+ * @compressedblks: Size of the pcluster in blocks, if given by this
+ *		lcluster
+ */
+struct z_erofs_lcluster {
+	u64 lcn;
+	u8 type;
+	u32 clusterofs;
+	u32 pblk;
+	u32 delta[2];
+	u32 compressedblks;
+};
+
+struct erofs_meta_block {
+	struct list_head list;
+	u64 blkaddr;
+	u8 *data;
+};
+
+struct erofs_dir_stream {
+	struct fs_dir_stream fs_dirs;
+	struct fs_dirent dirent;
+	struct erofs_inode dir;
+	u64 pos;
+};
+
+static struct erofs_ctxt {
+	struct blk_desc *desc;
+	struct disk_partition *part;
+	u8 blkszbits;
+	u32 blksz;
+	u64 meta_blkaddr;
+	u64 root_nid;
+	u32 feature_incompat;
+	u8 uuid[16];
+	/* Most recently used metadata blocks first */
+	struct list_head meta;
+	unsigned int meta_count;
+	/* Block of a directory being read */
+	u8 *dir_buf;
+	/* Compressed data read from the device */
+	u8 *comp_buf;
+	size_t comp_size;
+	/* Last extent decompressed to a buffer, keyed by its pcluster */
+	u8 *z_buf;
+	size_t z_size;
+	u64 z_pa;
+	u64 z_llen;
+} ctxt;
+
+static u32 erofs_crc32c_table[256];
+
+static int erofs_disk_read(u64 start, size_t len, void *buf)
+{
+	struct blk_desc *desc = ctxt.desc;
+
+	if (!fs_devread(desc, ctxt.part, start >> desc->log2blksz,
+			start & (desc->blksz - 1), len, buf))
+		return -EIO;
+
+	return 0;
+}
+
+static int erofs_meta_block(u64 blkaddr, const u8 **datap)
+{
+	struct erofs_meta_block *mb = NULL;
+	int ret;
+
+	list_for_each_entry(mb, &ctxt.meta, list) {
+		if (mb->blkaddr == blkaddr) {
+			list_move(&mb->list, &ctxt.meta);
+			*datap = mb->data;
+			return 0;
+		}
+	}
+
+	/* Reuse the least recently used block if there are enough */
+	mb = NULL;
+	if (ctxt.meta_count < EROFS_META_CACHE_BLOCKS) {
+		mb = malloc(sizeof(*mb));
+		if (mb) {
+			mb->data = malloc_cache_aligned(ctxt.blksz);
+			if (mb->data) {
+				list_add(&mb->list, &ctxt.meta);
+				ctxt.meta_count++;
+			} else {
+				free(mb);
+				mb = NULL;
+			}
+		}
+	}
+	if (!mb) {
+		if (list_empty(&ctxt.meta))
+			return -ENOMEM;
+		mb = list_last_entry(&ctxt.meta, struct erofs_meta_block, list);
+		list_move(&mb->list, &ctxt.meta);
+	}
+
+	mb->blkaddr = ~0ULL;
+	ret = erofs_disk_read(blkaddr << ctxt.blkszbits, ctxt.blksz, mb->data);
+	if (ret)
+		return ret;
+	mb->blkaddr = blkaddr;
+	*datap = mb->data;
+
+	return 0;
+}
+
+/* Read metadata, which may cross block boundaries, through the cache */
+static int erofs_read_meta(u64 pos, void *buf, size_t len)
+{
+	const u8 *data;
+	u32 offset, count;
+	int ret;
+
+	while (len) {
+		ret = erofs_meta_block(pos >> ctxt.blkszbits, &data);
+		if (ret)
+			return ret;
+		offset = pos & (ctxt.blksz - 1);
+		count = min_t(size_t, len, ctxt.blksz - offset);
+		memcpy(buf, data + offset, count);
+		buf += count;
+		pos += count;
+		len -= count;
+	}
+
+	return 0;
+}
+
+static int erofs_read_inode(u64 nid, struct erofs_inode *inode)
+{
+	union {
+		struct erofs_inode_compact c;
+		struct erofs_inode_extended e;
+	} di;
+	u16 format;
+	int ret;
+
+	memset(inode, '\0', sizeof(*inode));
+	inode->nid = nid;
+	inode->pos = (ctxt.meta_blkaddr << ctxt.blkszbits) +
+		     (nid << EROFS_ISLOTBITS);
+	ret = erofs_read_meta(inode->pos, &di.c, sizeof(di.c));
+	if (ret)
+		return ret;
+
+	format = le16_to_cpu(di.c.i_format);
+	inode->datalayout = EROFS_I_DATALAYOUT(format);
+	inode->mode = le16_to_cpu(di.c.i_mode);
+	switch (EROFS_I_VERSION(format)) {
+	case EROFS_INODE_LAYOUT_COMPACT:
+		inode->isize = sizeof(di.c);
+		inode->size = le32_to_cpu(di.c.i_size);
+		inode->u = le32_to_cpu(di.c.i_u);
+		break;
+	default:
+		ret = erofs_read_meta(inode->pos, &di.e, sizeof(di.e));
+		if (ret)
+			return ret;
+		inode->isize = sizeof(di.e);
+		inode->size = le64_to_cpu(di.e.i_size);
+		inode->u = le32_to_cpu(di.e.i_u);
+		break;
+	}
+	inode->isize += EROFS_XATTR_IBODY_SIZE(le16_to_cpu(di.c.i_xattr_icount));
+
+	if (inode->datalayout > EROFS_INODE_CHUNK_BASED) {
+		log_debug("nid %llu has unknown data layout %d\n", nid,
+			  inode->datalayout);
+		return -EOPNOTSUPP;
+	}
+
+	return 0;
+}
+
+static int z_erofs_init_inode(struct erofs_inode *inode)
+{
+	struct z_erofs_map_header h;
+	int ret;
+
+	if (inode->z_inited)
+		return 0;
+	ret = erofs_read_meta(ALIGN(inode->pos + inode->isize, 8), &h,
+			      sizeof(h));
+	if (ret)
+		return ret;
+
+	inode->z_advise = le16_to_cpu(h.h_advise);
+	inode->z_algorithm[0] = h.h_algorithmtype & 15;
+	inode->z_algorithm[1] = h.h_algorithmtype >> 4;
+	if (inode->z_advise & (Z_EROFS_ADVISE_INLINE_PCLUSTER |
+			       Z_EROFS_ADVISE_FRAGMENT_PCLUSTER) ||
+	    h.h_clusterbits & 7 ||
+	    !(ctxt.feature_incompat & EROFS_FEATURE_INCOMPAT_ZERO_PADDING)) {
+		printf("EROFS: unsupported compressed file layout\n");
+		return -EOPNOTSUPP;
+	}
+	/* Compact indexes have big pclusters for both heads or for neither */
+	if (inode->datalayout == EROFS_INODE_COMPRESSED_COMPACT &&
+	    !(inode->z_advise & Z_EROFS_ADVISE_BIG_PCLUSTER_1) !=
+	    !(inode->z_advise & Z_EROFS_ADVISE_BIG_PCLUSTER_2))
+		return -EIO;
+	inode->z_inited = true;
+
+	return 0;
+}
+
+static int z_erofs_load_full_lcluster(struct erofs_inode *inode, u64 lcn,
+				      struct z_erofs_lcluster *lc)
+{
+	struct z_erofs_lcluster_index di;
+	u16 advise;
+	int ret;
+
+	ret = erofs_read_meta(Z_EROFS_FULL_INDEX_ALIGN(inode->pos +
+						       inode->isize) +
+			      lcn * sizeof(di), &di, sizeof(di));
+	if (ret)
+		return ret;
+
+	advise = le16_to_cpu(di.di_advise);
+	lc->type = advise & Z_EROFS_LI_LCLUSTER_TYPE_MASK;
+	if (lc->type == Z_EROFS_LCLUSTER_TYPE_NONHEAD) {
+		lc->clusterofs = ctxt.blksz;
+		lc->delta[0] = le16_to_cpu(di.di_u.delta[0]);
+		lc->delta[1] = le16_to_cpu(di.di_u.delta[1]);
+		if (lc->delta[0] & Z_EROFS_LI_D0_CBLKCNT) {
+			if (!(inode->z_advise & (Z_EROFS_ADVISE_BIG_PCLUSTER_1 |
+						 Z_EROFS_ADVISE_BIG_PCLUSTER_2)))
+				return -EIO;
+			lc->compressedblks = lc->delta[0] &
+					     ~Z_EROFS_LI_D0_CBLKCNT;
+			lc->delta[0] = 1;
+		}
+	} else {
+		lc->clusterofs = le16_to_cpu(di.di_clusterofs);
+		if (lc->clusterofs >= ctxt.blksz)
+			return -EIO;
+		lc->pblk = le32_to_cpu(di.di_u.blkaddr);
+	}
+
+	return 0;
+}
+
+static u32 z_erofs_decode_bits(u32 lobits, const u8 *in, u32 pos, u8 *type)
+{
+	u32 v = get_unaligned_le32(in + pos / 8) >> (pos & 7);
+
+	*type = (v >> lobits) & Z_EROFS_LI_LCLUSTER_TYPE_MASK;
+
+	return v & ((1 << lobits) - 1);
+}
+
+/*
+ * Compact indexes come in packs of 2 entries in 8 bytes or 16 entries in 32
+ * bytes, ending with the start block of the first pcluster in the pack. The
+ * start block of the others is found by counting the blocks before them.
+ */
+static int z_erofs_unpack_compact(struct erofs_inode *inode, u32 shift,
+				  u64 pos, bool lookahead,
+				  struct z_erofs_lcluster *lc)
+{
+	bool big_pcluster = inode->z_advise & Z_EROFS_ADVISE_BIG_PCLUSTER_1;
+	u32 lobits, encodebits, vcnt, packsize, lo, nblk;
+	u8 in[32 + sizeof(u32)] = { 0 };
+	u8 type;
+	int i, ret;
+
+	if (shift == 2 && ctxt.blkszbits <= 14)
+		vcnt = 2;
+	else if (shift == 1 && ctxt.blkszbits <= 12)
+		vcnt = 16;
+	else
+		return -EOPNOTSUPP;
+	packsize = vcnt << shift;
+	ret = erofs_read_meta(round_down(pos, packsize), in, packsize);
+	if (ret)
+		return ret;
+
+	lobits = max_t(u32, ctxt.blkszbits, ilog2(Z_EROFS_LI_D0_CBLKCNT) + 1);
+	encodebits = (packsize - sizeof(u32)) * 8 / vcnt;
+	i = (pos & (packsize - 1)) >> shift;
+
+	lo = z_erofs_decode_bits(lobits, in, encodebits * i, &type);
+	lc->type = type;
+	if (type == Z_EROFS_LCLUSTER_TYPE_NONHEAD) {
+		lc->clusterofs = ctxt.blksz;
+		if (lookahead) {
+			int j = i;
+			u32 d1 = 0, v = 0;
+
+			/* Count up to the next head, within this pack */
+			do {
+				v = z_erofs_decode_bits(lobits, in,
+							encodebits * j, &type);
+				if (type != Z_EROFS_LCLUSTER_TYPE_NONHEAD)
+					break;
+				d1++;
+			} while (++j < vcnt);
+			/* The last entry of a pack holds its own delta[1] */
+			if (j == vcnt && !(v & Z_EROFS_LI_D0_CBLKCNT))
+				d1 += v - 1;
+			lc->delta[1] = d1;
+		}
+		if (lo & Z_EROFS_LI_D0_CBLKCNT) {
+			if (!big_pcluster)
+				return -EIO;
+			lc->compressedblks = lo & ~Z_EROFS_LI_D0_CBLKCNT;
+			lc->delta[0] = 1;
+			return 0;
+		}
+		if (i + 1 != vcnt) {
+			lc->delta[0] = lo;
+			return 0;
+		}
+		/* Work out delta[0] of the last entry from the one before */
+		lo = z_erofs_decode_bits(lobits, in, encodebits * (i - 1),
+					 &type);
+		if (type != Z_EROFS_LCLUSTER_TYPE_NONHEAD)
+			lo = 0;
+		else if (lo & Z_EROFS_LI_D0_CBLKCNT)
+			lo = 1;
+		lc->delta[0] = lo + 1;
+		return 0;
+	}
+
+	lc->clusterofs = lo;
+	if (!big_pcluster) {
+		nblk = 1;
+		while (i > 0) {
+			--i;
+			lo = z_erofs_decode_bits(lobits, in, encodebits * i,
+						 &type);
+			if (type == Z_EROFS_LCLUSTER_TYPE_NONHEAD)
+				i -= lo;
+			if (i >= 0)
+				++nblk;
+		}
+	} else {
+		nblk = 0;
+		while (i > 0) {
+			--i;
+			lo = z_erofs_decode_bits(lobits, in, encodebits * i,
+						 &type);
+			if (type == Z_EROFS_LCLUSTER_TYPE_NONHEAD) {
+				if (lo & Z_EROFS_LI_D0_CBLKCNT) {
+					--i;
+					nblk += lo & ~Z_EROFS_LI_D0_CBLKCNT;
+					continue;
+				}
+				if (lo <= 1)
+					return -EIO;
+				i -= lo - 2;
+				continue;
+			}
+			++nblk;
+		}
+	}
+	lc->pblk = get_unaligned_le32(in + packsize - sizeof(u32)) + nblk;
+
+	return 0;
+}
+
+static int z_erofs_load_compact_lcluster(struct erofs_inode *inode, u64 lcn,
+					 bool lookahead,
+					 struct z_erofs_lcluster *lc)
+{
+	u64 ebase = ALIGN(inode->pos + inode->isize, 8) +
+		    sizeof(struct z_erofs_map_header);
+	u64 totalidx = DIV_ROUND_UP(inode->size, ctxt.blksz);
+	u64 initial_4b, compacted_2b, pos;
+	u32 shift;
+
+	/* 4-byte packs are used until the 2-byte ones are 32-byte aligned */
+	initial_4b = (32 - ebase % 32) / 4;
+	if (initial_4b == 32 / 4)
+		initial_4b = 0;
+	if ((inode->z_advise & Z_EROFS_ADVISE_COMPACTED_2B) &&
+	    initial_4b < totalidx)
+		compacted_2b = round_down(totalidx - initial_4b, 16);
+	else
+		compacted_2b = 0;
+
+	pos = ebase;
+	if (lcn < initial_4b) {
+		shift = 2;
+	} else {
+		pos += initial_4b * 4;
+		lcn -= initial_4b;
+		if (lcn < compacted_2b) {
+			shift = 1;
+		} else {
+			pos += compacted_2b * 2;
+			lcn -= compacted_2b;
+			shift = 2;
+		}
+	}
+
+	return z_erofs_unpack_compact(inode, shift, pos + (lcn << shift),
+				      lookahead, lc);
+}
+
+static int z_erofs_load_lcluster(struct erofs_inode *inode, u64 lcn,
+				 bool lookahead, struct z_erofs_lcluster *lc)
+{
+	if (lcn >= DIV_ROUND_UP(inode->size, ctxt.blksz))
+		return -EIO;
+	memset(lc, '\0', sizeof(*lc));
+	lc->lcn = lcn;
+	if (inode->datalayout == EROFS_INODE_COMPRESSED_FULL)
+		return z_erofs_load_full_lcluster(inode, lcn, lc);
+
+	return z_erofs_load_compact_lcluster(inode, lcn, lookahead, lc);
+}
+
+/* Find the extent holding @la in a compressed file */
+static int z_erofs_map_blocks(struct erofs_inode *inode, u64 la,
+			      struct erofs_map *map)
+{
+	struct z_erofs_lcluster lc, next;
+	u64 lcn = la >> ctxt.blkszbits;
+	u32 delta;
+	u8 alg;
+	int ret;
+
+	ret = z_erofs_init_inode(inode);
+	if (!ret)
+		ret = z_erofs_load_lcluster(inode, lcn, false, &lc);
+	if (ret)
+		return ret;
+
+	/* Go back to the lcluster where the pcluster starts */
+	if (lc.type == Z_EROFS_LCLUSTER_TYPE_NONHEAD)
+		delta = lc.delta[0];
+	else if ((la & (ctxt.blksz - 1)) < lc.clusterofs)
+		delta = 1;
+	else
+		delta = 0;
+	while (delta) {
+		if (delta > lc.lcn)
+			return -EIO;
+		ret = z_erofs_load_lcluster(inode, lc.lcn - delta, false, &lc);
+		if (ret)
+			return ret;
+		delta = 0;
+		if (lc.type == Z_EROFS_LCLUSTER_TYPE_NONHEAD) {
+			delta = lc.delta[0];
+			if (!delta)
+				return -EIO;
+		}
+	}
+	map->la = (lc.lcn << ctxt.blkszbits) | lc.clusterofs;
+	map->pa = (u64)lc.pblk << ctxt.blkszbits;
+	map->flags = EROFS_MAP_MAPPED;
+
+	/* The size of a big pcluster is given by the next lcluster */
+	map->plen = ctxt.blksz;
+	if (((lc.type == Z_EROFS_LCLUSTER_TYPE_HEAD1 &&
+	      inode->z_advise & Z_EROFS_ADVISE_BIG_PCLUSTER_1) ||
+	     (lc.type != Z_EROFS_LCLUSTER_TYPE_HEAD1 &&
+	      inode->z_advise & Z_EROFS_ADVISE_BIG_PCLUSTER_2)) &&
+	    (lc.lcn + 1) << ctxt.blkszbits < inode->size) {
+		ret = z_erofs_load_lcluster(inode, lc.lcn + 1, false, &next);
+		if (ret)
+			return ret;
+		if (next.compressedblks)
+			map->plen = (u64)next.compressedblks << ctxt.blkszbits;
+		else if (next.type == Z_EROFS_LCLUSTER_TYPE_NONHEAD &&
+			 lc.type != Z_EROFS_LCLUSTER_TYPE_PLAIN)
+			return -EIO;
+	}
+
+	/* The extent ends where the next pcluster starts */
+	for (lcn = lc.lcn; ; lcn += delta) {
+		if (lcn << ctxt.blkszbits >= inode->size) {
+			map->llen = inode->size - map->la;
+			break;
+		}
+		ret = z_erofs_load_lcluster(inode, lcn, true, &next);
+		if (ret)
+			return ret;
+		if (next.type != Z_EROFS_LCLUSTER_TYPE_NONHEAD) {
+			if (lcn != lc.lcn) {
+				map->llen = (lcn << ctxt.blkszbits) +
+					    next.clusterofs - map->la;
+				break;
+			}
+			delta = 1;
+		} else {
+			/* Older mkfs.erofs may leave delta[1] as 0 */
+			delta = max_t(u32, next.delta[1], 1);
+		}
+	}
+	if (map->la > la || map->la + map->llen <= la)
+		return -EIO;
+
+	switch (lc.type) {
+	case Z_EROFS_LCLUSTER_TYPE_PLAIN:
+		if (map->llen > map->plen)
+			return -EIO;
+		if (inode->z_advise & Z_EROFS_ADVISE_INTERLACED_PCLUSTER)
+			map->flags |= EROFS_MAP_INTERLACED;
+		return 0;
+	case Z_EROFS_LCLUSTER_TYPE_HEAD1:
+		alg = inode->z_algorithm[0];
+		break;
+	default:
+		alg = inode->z_algorithm[1];
+		break;
+	}
+	if (alg != Z_EROFS_COMPRESSION_LZ4 || !IS_ENABLED(CONFIG_LZ4)) {
+		printf("EROFS: compression algorithm %d is not supported\n",
+		       alg);
+		return -EOPNOTSUPP;
+	}
+	map->flags |= EROFS_MAP_ZIPPED;
+
+	return 0;
+}
+
+/* Find the extent holding @la */
+static int erofs_map_blocks(struct erofs_inode *inode, u64 la,
+			    struct erofs_map *map)
+{
+	u64 nblocks, chunk, pos;
+	u32 chunkbits, blkaddr;
+	int ret;
+
+	memset(map, '\0', sizeof(*map));
+	switch (inode->datalayout) {
+	case EROFS_INODE_FLAT_PLAIN:
+	case EROFS_INODE_FLAT_INLINE:
+		nblocks = inode->size >> ctxt.blkszbits;
+		if (inode->datalayout == EROFS_INODE_FLAT_PLAIN)
+			nblocks = DIV_ROUND_UP(inode->size, ctxt.blksz);
+		map->flags = EROFS_MAP_MAPPED;
+		if (la < nblocks << ctxt.blkszbits) {
+			map->la = 0;
+			map->llen = min(inode->size, nblocks << ctxt.blkszbits);
+			map->pa = (u64)inode->u << ctxt.blkszbits;
+		} else {
+			/* The tail is inline, just after the inode */
+			map->la = nblocks << ctxt.blkszbits;
+			map->llen = inode->size - map->la;
+			map->pa = inode->pos + inode->isize;
+			if ((map->pa & (ctxt.blksz - 1)) + map->llen >
+			    ctxt.blksz)
+				return -EIO;
+		}
+		return 0;
+	case EROFS_INODE_CHUNK_BASED:
+		chunkbits = ctxt.blkszbits +
+			    (inode->u & EROFS_CHUNK_FORMAT_BLKBITS_MASK);
+		if (chunkbits >= 48)
+			return -EIO;
+		chunk = la >> chunkbits;
+		pos = inode->pos + inode->isize;
+		if (inode->u & EROFS_CHUNK_FORMAT_INDEXES)
+			pos = ALIGN(pos, sizeof(struct erofs_inode_chunk_index)) +
+			      chunk * sizeof(struct erofs_inode_chunk_index) +
+			      offsetof(struct erofs_inode_chunk_index,
+				       blkaddr);
+		else
+			pos = ALIGN(pos, sizeof(u32)) + chunk * sizeof(u32);
+		ret = erofs_read_meta(pos, &blkaddr, sizeof(blkaddr));
+		if (ret)
+			return ret;
+		blkaddr = le32_to_cpu(blkaddr);
+		map->la = chunk << chunkbits;
+		map->llen = min_t(u64, inode->size - map->la,
+				  1ULL << chunkbits);
+		if (blkaddr != EROFS_NULL_ADDR) {
+			map->flags = EROFS_MAP_MAPPED;
+			map->pa = (u64)blkaddr << ctxt.blkszbits;
+		}
+		return 0;
+	default:
+		return z_erofs_map_blocks(inode, la, map);
+	}
+}
+
+/**
+ * struct erofs_run - uncompressed data to read from the device
+ *
+ * Pieces of data which follow each other on the device are read together.
+ *
+ * @pa:		Position of the data on the device
+ * @len:	Length of the data
+ * @out:	Where to put it
+ * @meta:	true to read through the metadata cache
+ */
+struct erofs_run {
+	u64 pa;
+	u64 len;
+	u8 *out;
+	bool meta;
+};
+
+static int erofs_run_flush(struct erofs_run *run)
+{
+	int ret = 0;
+
+	if (run->len) {
+		if (run->meta)
+			ret = erofs_read_meta(run->pa, run->out, run->len);
+		else
+			ret = erofs_disk_read(run->pa, run->len, run->out);
+	}
+	run->len = 0;
+
+	return ret;
+}
+
+static int erofs_run_add(struct erofs_run *run, u64 pa, u64 len, u8 *out)
+{
+	int ret;
+
+	if (run->len && run->pa + run->len == pa &&
+	    run->out + run->len == out) {
+		run->len += len;
+		return 0;
+	}
+	ret = erofs_run_flush(run);
+	run->pa = pa;
+	run->len = len;
+	run->out = out;
+
+	return ret;
+}
+
+static int z_erofs_decompress(const u8 *src, size_t srclen, u8 *dst,
+			      size_t dstlen)
+{
+	size_t len = dstlen;
+
+	if (!IS_ENABLED(CONFIG_LZ4))
+		return -EOPNOTSUPP;
+
+	/* The compressed data is padded with zeroes at the start */
+	while (srclen && !*src) {
+		src++;
+		srclen--;
+	}
+	if (ulz4fn_block(src, srclen, dst, &len) || len != dstlen)
+		return -EIO;
+
+	return 0;
+}
+
+/* Make sure a buffer has room for @size bytes, keeping its contents */
+static int erofs_buf_reserve(u8 **bufp, size_t *sizep, size_t size)
+{
+	u8 *buf;
+
+	if (*sizep >= size)
+		return 0;
+	buf = malloc_cache_aligned(size);
+	if (!buf)
+		return -ENOMEM;
+	free(*bufp);
+	*bufp = buf;
+	*sizep = size;
+
+	return 0;
+}
+
+/*
+ * Read @count bytes at @pos from a compressed extent into @out, which has
+ * room for @room bytes
+ */
+static int z_erofs_read(struct erofs_map *map, u64 pos, u64 count, u8 *out,
+			u64 room)
+{
+	u64 margin = EROFS_LZ4_INPLACE_MARGIN(map->plen);
+	u8 *src;
+	int ret;
+
+	if (pos == map->la && count == map->llen) {
+		/*
+		 * LZ4 can decompress in place if the compressed data ends
+		 * far enough after the output
+		 */
+		if (room >= map->llen + margin &&
+		    map->plen <= map->llen + margin) {
+			src = out + map->llen + margin - map->plen;
+			ret = erofs_disk_read(map->pa, map->plen, src);
+			if (ret)
+				return ret;
+			return z_erofs_decompress(src, map->plen, out,
+						  map->llen);
+		}
+		ret = erofs_buf_reserve(&ctxt.comp_buf, &ctxt.comp_size,
+					map->plen);
+		if (!ret)
+			ret = erofs_disk_read(map->pa, map->plen,
+					      ctxt.comp_buf);
+		if (ret)
+			return ret;
+		return z_erofs_decompress(ctxt.comp_buf, map->plen, out,
+					  map->llen);
+	}
+
+	if (ctxt.z_pa != map->pa || ctxt.z_llen != map->llen) {
+		ctxt.z_llen = 0;
+		ret = erofs_buf_reserve(&ctxt.comp_buf, &ctxt.comp_size,
+					map->plen);
+		if (!ret)
+			ret = erofs_buf_reserve(&ctxt.z_buf, &ctxt.z_size,
+						map->llen);
+		if (!ret)
+			ret = erofs_disk_read(map->pa, map->plen,
+					      ctxt.comp_buf);
+		if (!ret)
+			ret = z_erofs_decompress(ctxt.comp_buf, map->plen,
+						 ctxt.z_buf, map->llen);
+		if (ret)
+			return ret;
+		ctxt.z_pa = map->pa;
+		ctxt.z_llen = map->llen;
+	}
+	memcpy(out, ctxt.z_buf + pos - map->la, count);
+
+	return 0;
+}
+
+/**
+ * erofs_read_data() - Read part of the data of an inode
+ *
+ * @inode:	Inode to read
+ * @offset:	Offset to start at
+ * @len:	Number of bytes to read, which must be within the data
+ * @out:	Output buffer, with room for @len bytes
+ * @meta:	true to read uncompressed data through the metadata cache,
+ *		for directories and symlinks
+ * @return 0 if OK, -EOPNOTSUPP if the data is stored in a way that is not
+ *	supported, -ENOMEM if out of memory, -EIO on a read error or
+ *	corrupt data
+ */
+static int erofs_read_data(struct erofs_inode *inode, u64 offset, u64 len,
+			   u8 *out, bool meta)
+{
+	struct erofs_run run = { .meta = meta };
+	u64 pos, end = offset + len, count, head, skip;
+	struct erofs_map map;
+	u8 *dst;
+	int ret = 0;
+
+	for (pos = offset; !ret && pos < end; pos += count) {
+		ret = erofs_map_blocks(inode, pos, &map);
+		if (ret)
+			break;
+		if (map.la > pos || map.la + map.llen <= pos) {
+			ret = -EIO;
+			break;
+		}
+		count = min(end, map.la + map.llen) - pos;
+		dst = out + pos - offset;
+
+		if (!(map.flags & EROFS_MAP_MAPPED)) {
+			memset(dst, '\0', count);
+		} else if (map.flags & EROFS_MAP_ZIPPED) {
+			ret = erofs_run_flush(&run);
+			if (!ret)
+				ret = z_erofs_read(&map, pos, count, dst,
+						   end - pos);
+		} else if (map.flags & EROFS_MAP_INTERLACED) {
+			/*
+			 * The block holding the start of the extent is
+			 * stored last, so that each block of data is at the
+			 * same offset in a block as it is in the file
+			 */
+			head = ctxt.blksz - (map.la & (ctxt.blksz - 1));
+			skip = pos - map.la;
+			if (skip < head) {
+				ret = erofs_run_add(&run, map.pa + map.plen -
+						    head + skip,
+						    min(count, head - skip),
+						    dst);
+			}
+			if (!ret && skip + count > head) {
+				ret = erofs_run_add(&run, map.pa + max(skip, head) -
+						    head,
+						    skip + count - max(skip, head),
+						    dst + max(skip, head) - skip);
+			}
+		} else {
+			ret = erofs_run_add(&run, map.pa + pos - map.la, count,
+					    dst);
+		}
+	}
+	if (!ret)
+		ret = erofs_run_flush(&run);
+
+	return ret;
+}
+
+static int erofs_dir_block(struct erofs_inode *dir, u64 blk, u32 *lenp,
+			   u32 *countp)
+{
+	u64 start = blk << ctxt.blkszbits;
+	struct erofs_dirent *de = (struct erofs_dirent *)ctxt.dir_buf;
+	u32 len, nameoff;
+	int ret;
+
+	if (start >= dir->size)
+		return -ENOENT;
+	len = min_t(u64, ctxt.blksz, dir->size - start);
+	ret = erofs_read_data(dir, start, len, ctxt.dir_buf, true);
+	if (ret)
+		return ret;
+
+	nameoff = le16_to_cpu(de->nameoff);
+	if (nameoff < sizeof(*de) || nameoff >= len)
+		return -EIO;
+	*lenp = len;
+	*countp = nameoff / sizeof(*de);
+
+	return 0;
+}
+
+/* Get entry @i of the directory block in ctxt.dir_buf */
+static int erofs_dir_entry(u32 len, u32 count, u32 i, const char **namep,
+			   u32 *namelenp)
+{
+	struct erofs_dirent *de = (struct erofs_dirent *)ctxt.dir_buf;
+	u32 nameoff, nameend;
+
+	nameoff = le16_to_cpu(de[i].nameoff);
+	if (i + 1 < count)
+		nameend = le16_to_cpu(de[i + 1].nameoff);
+	else
+		nameend = len;
+	if (nameoff >= nameend || nameend > len)
+		return -EIO;
+	*namep = (const char *)ctxt.dir_buf + nameoff;
+	*namelenp = strnlen(*namep, nameend - nameoff);
+	if (*namelenp > EROFS_NAME_LEN)
+		return -EIO;
+
+	return 0;
+}
+
+static int erofs_name_cmp(const char *name, size_t len, const char *dname,
+			  u32 dlen)
+{
+	int ret = memcmp(name, dname, min_t(size_t, len, dlen));
+
+	if (ret)
+		return ret;
+
+	return len < dlen ? -1 : len > dlen;
+}
+
+/*
+ * Entries are sorted by name across the whole directory, so the block and
+ * then the entry are found by binary search
+ */
+static int erofs_dir_lookup(struct erofs_inode *dir, const char *name,
+			    u64 *nidp)
+{
+	struct erofs_dirent *de = (struct erofs_dirent *)ctxt.dir_buf;
+	size_t len = strlen(name);
+	int lo, hi, mid, cmp, blk = -1;
+	u32 blen, count, dlen;
+	const char *dname;
+	int ret;
+
+	lo = 0;
+	hi = DIV_ROUND_UP(dir->size, ctxt.blksz) - 1;
+	while (lo <= hi) {
+		mid = lo + (hi - lo) / 2;
+		ret = erofs_dir_block(dir, mid, &blen, &count);
+		if (!ret)
+			ret = erofs_dir_entry(blen, count, 0, &dname, &dlen);
+		if (ret)
+			return ret;
+		cmp = erofs_name_cmp(name, len, dname, dlen);
+		if (!cmp) {
+			*nidp = le64_to_cpu(de[0].nid);
+			return 0;
+		}
+		if (cmp < 0) {
+			hi = mid - 1;
+		} else {
+			blk = mid;
+			lo = mid + 1;
+		}
+	}
+	if (blk < 0)
+		return -ENOENT;
+
+	ret = erofs_dir_block(dir, blk, &blen, &count);
+	if (ret)
+		return ret;
+	lo = 1;
+	hi = count - 1;
+	while (lo <= hi) {
+		mid = lo + (hi - lo) / 2;
+		ret = erofs_dir_entry(blen, count, mid, &dname, &dlen);
+		if (ret)
+			return ret;
+		cmp = erofs_name_cmp(name, len, dname, dlen);
+		if (!cmp) {
+			*nidp = le64_to_cpu(de[mid].nid);
+			return 0;
+		}
+		if (cmp < 0)
+			hi = mid - 1;
+		else
+			lo = mid + 1;
+	}
+
+	return -ENOENT;
+}
+
+/**
+ * erofs_lookup() - Find the inode for a path
+ *
+ * '.' and '..' are entries in each directory. Symbolic links in the path
+ * are followed, as is one at the end if @follow is set.
+ *
+ * @path:	Path from the root directory
+ * @inode:	Returns the inode
+ * @follow:	true to follow a symbolic link at the end of the path
+ * @return 0 if OK, -ENOENT if not found, -ENOTDIR if a directory in the
+ *	path is not one, -ELOOP if there are too many symbolic links, other -ve
+ *	on error
+ */
+static int erofs_lookup(const char *path, struct erofs_inode *inode,
+			bool follow)
+{
+	char *buf, *rest, *name, *target;
+	int links = 0;
+	u64 nid, dir_nid;
+	size_t len;
+	int ret;
+
+	buf = strdup(path);
+	if (!buf)
+		return -ENOMEM;
+	ret = erofs_read_inode(ctxt.root_nid, inode);
+	rest = buf;
+
+	while (!ret && rest) {
+		name = strsep(&rest, "/");
+		if (!*name || !strcmp(name, "."))
+			continue;
+		if (!S_ISDIR(inode->mode)) {
+			ret = -ENOTDIR;
+			break;
+		}
+		if (strlen(name) > EROFS_NAME_LEN) {
+			ret = -ENOENT;
+			break;
+		}
+
+		dir_nid = inode->nid;
+		ret = erofs_dir_lookup(inode, name, &nid);
+		if (!ret)
+			ret = erofs_read_inode(nid, inode);
+		if (ret || !S_ISLNK(inode->mode) || (!rest && !follow))
+			continue;
+
+		/* Carry on with the link target followed by the rest */
+		if (++links > EROFS_MAX_SYMLINKS) {
+			ret = -ELOOP;
+			break;
+		}
+		if (!inode->size || inode->size > EROFS_SYMLINK_MAX) {
+			ret = -EIO;
+			break;
+		}
+		len = inode->size + 1 + (rest ? strlen(rest) : 0);
+		target = malloc(len + 1);
+		if (!target) {
+			ret = -ENOMEM;
+			break;
+		}
+		ret = erofs_read_data(inode, 0, inode->size, (u8 *)target,
+				      true);
+		target[inode->size] = '\0';
+		if (rest)
+			strcat(strcat(target, "/"), rest);
+		free(buf);
+		buf = target;
+		rest = buf;
+		if (!ret)
+			ret = erofs_read_inode(*rest == '/' ? ctxt.root_nid :
+					       dir_nid, inode);
+	}
+	free(buf);
+
+	return ret;
+}
+
+int erofs_probe(struct blk_desc *fs_dev_desc,
+		struct disk_partition *fs_partition)
+{
+	ALLOC_CACHE_ALIGN_BUFFER(struct erofs_super_block, sb, 1);
+	static bool crc32c_inited;
+	struct erofs_inode root;
+	u32 features, len, crc;
+	u8 *buf;
+	int ret;
+
+	ctxt.desc = fs_dev_desc;
+	ctxt.part = fs_partition;
+	if (erofs_disk_read(EROFS_SUPER_OFFSET, sizeof(*sb), sb) ||
+	    le32_to_cpu(sb->magic) != EROFS_SUPER_MAGIC)
+		return -EINVAL;
+
+	ctxt.blkszbits = sb->blkszbits;
+	ctxt.blksz = 1 << ctxt.blkszbits;
+	ctxt.meta_blkaddr = le32_to_cpu(sb->meta_blkaddr);
+	ctxt.root_nid = le16_to_cpu(sb->root_nid);
+	ctxt.feature_incompat = le32_to_cpu(sb->feature_incompat);
+	memcpy(ctxt.uuid, sb->uuid, sizeof(ctxt.uuid));
+	INIT_LIST_HEAD(&ctxt.meta);
+	if (ctxt.blkszbits < EROFS_BLKSZ_BITS_MIN ||
+	    ctxt.blkszbits > EROFS_BLKSZ_BITS_MAX) {
+		printf("EROFS: unsupported block size\n");
+		return -EINVAL;
+	}
+	features = ctxt.feature_incompat & ~EROFS_FEATURE_INCOMPAT_SUPPORTED;
+	if (features || sb->extra_devices) {
+		printf("EROFS: unsupported features %#x\n", features);
+		return -EINVAL;
+	}
+
+	/* The checksum covers the rest of the first block */
+	if (le32_to_cpu(sb->feature_compat) & EROFS_FEATURE_COMPAT_SB_CHKSUM) {
+		if (!crc32c_inited) {
+			crc32c_init(erofs_crc32c_table, 0x82F63B78);
+			crc32c_inited = true;
+		}
+		len = ctxt.blksz;
+		if (len > EROFS_SUPER_OFFSET)
+			len -= EROFS_SUPER_OFFSET;
+		buf = malloc_cache_aligned(len);
+		if (!buf)
+			return -ENOMEM;
+		ret = erofs_disk_read(EROFS_SUPER_OFFSET, len, buf);
+		if (!ret) {
+			memset(buf + offsetof(struct erofs_super_block,
+					      checksum), '\0', sizeof(u32));
+			crc = crc32c_cal(~0, (const char *)buf, len,
+					 erofs_crc32c_table);
+			if (crc != le32_to_cpu(sb->checksum))
+				ret = -EINVAL;
+		}
+		free(buf);
+		if (ret) {
+			printf("EROFS: bad superblock checksum\n");
+			return ret;
+		}
+	}
+
+	ctxt.dir_buf = malloc_cache_aligned(ctxt.blksz);
+	if (!ctxt.dir_buf) {
+		ret = -ENOMEM;
+		goto err;
+	}
+	ret = erofs_read_inode(ctxt.root_nid, &root);
+	if (!ret && !S_ISDIR(root.mode))
+		ret = -EIO;
+	if (ret)
+		goto err;
+
+	return 0;
+
+err:
+	printf("EROFS: cannot mount filesystem (err=%d)\n", ret);
+	erofs_close();
+
+	return ret;
+}
+
+int erofs_opendir(const char *filename, struct fs_dir_stream **dirsp)
+{
+	struct erofs_dir_stream *dirs;
+	struct erofs_inode dir;
+	int ret;
+
+	ret = erofs_lookup(filename, &dir, true);
+	if (ret)
+		return ret;
+	if (!S_ISDIR(dir.mode))
+		return -ENOTDIR;
+
+	dirs = calloc(1, sizeof(*dirs));
+	if (!dirs)
+		return -ENOMEM;
+	dirs->dir = dir;
+	*dirsp = &dirs->fs_dirs;
+
+	return 0;
+}
+
+int erofs_readdir(struct fs_dir_stream *fs_dirs, struct fs_dirent **dentp)
+{
+	struct erofs_dirent *de = (struct erofs_dirent *)ctxt.dir_buf;
+	struct erofs_dir_stream *dirs;
+	struct fs_dirent *dent;
+	struct erofs_inode inode;
+	u32 blen, count, i, len = 0;
+	const char *name = NULL;
+	int ret;
+
+	dirs = container_of(fs_dirs, struct erofs_dir_stream, fs_dirs);
+	dent = &dirs->dirent;
+
+	/* dirs->pos is the block and the entry in it */
+	do {
+		ret = erofs_dir_block(&dirs->dir, dirs->pos >> ctxt.blkszbits,
+				      &blen, &count);
+		if (ret)
+			return ret;
+		i = (dirs->pos & (ctxt.blksz - 1)) / sizeof(*de);
+		if (i >= count) {
+			dirs->pos = ALIGN(dirs->pos + 1, ctxt.blksz);
+			continue;
+		}
+		dirs->pos += sizeof(*de);
+		ret = erofs_dir_entry(blen, count, i, &name, &len);
+		if (ret)
+			return ret;
+	} while (i >= count || (name[0] == '.' &&
+				(len == 1 || (len == 2 && name[1] == '.'))));
+
+	memcpy(dent->name, name, len);
+	dent->name[len] = '\0';
+	dent->size = 0;
+	switch (de[i].file_type) {
+	case EROFS_FT_DIR:
+		dent->type = FS_DT_DIR;
+		break;
+	case EROFS_FT_SYMLINK:
+		dent->type = FS_DT_LNK;
+		break;
+	case EROFS_FT_REG_FILE:
+		ret = erofs_read_inode(le64_to_cpu(de[i].nid), &inode);
+		if (ret)
+			return ret;
+		dent->size = inode.size;
+		/* fall through */
+	default:
+		dent->type = FS_DT_REG;
+		break;
+	}
+	*dentp = dent;
+
+	return 0;
+}
+
+void erofs_closedir(struct fs_dir_stream *fs_dirs)
+{
+	free(container_of(fs_dirs, struct erofs_dir_stream, fs_dirs));
+}
+
+int erofs_exists(const char *filename)
+{
+	struct erofs_inode inode;
+
+	return !erofs_lookup(filename, &inode, true);
+}
+
+int erofs_size(const char *filename, loff_t *size)
+{
+	struct erofs_inode inode;
+	int ret;
+
+	ret = erofs_lookup(filename, &inode, true);
+	if (ret)
+		return ret;
+	*size = inode.size;
+
+	return 0;
+}
+
+int erofs_read(const char *filename, void *buf, loff_t offset, loff_t len,
+	       loff_t *actread)
+{
+	struct erofs_inode inode;
+	int ret;
+
+	*actread = 0;
+	ret = erofs_lookup(filename, &inode, true);
+	if (ret) {
+		printf("** File not found %s **\n", filename);
+		return ret;
+	}
+	if (!S_ISREG(inode.mode)) {
+		printf("** %s is not a regular file **\n", filename);
+		return -EISDIR;
+	}
+	if (offset >= inode.size)
+		return 0;
+	if (!len || len > inode.size - offset)
+		len = inode.size - offset;
+
+	ret = erofs_read_data(&inode, offset, len, buf, false);
+	if (ret) {
+		printf("** Error reading %s (err=%d) **\n", filename, ret);
+		return ret;
+	}
+	*actread = len;
+
+	return 0;
+}
+
+int erofs_uuid(char *uuid_str)
+{
+#ifdef CONFIG_LIB_UUID
+	uuid_bin_to_str(ctxt.uuid, uuid_str, UUID_STR_FORMAT_STD);
+	return 0;
+#endif
+	return -ENOSYS;
+}
+
+void erofs_close(void)
+{
+	struct erofs_meta_block *mb, *tmp;
+
+	if (ctxt.meta.next) {
+		list_for_each_entry_safe(mb, tmp, &ctxt.meta, list) {
+			list_del(&mb->list);
+			free(mb->data);
+			free(mb);
+		}
+	}
+	free(ctxt.dir_buf);
+	free(ctxt.comp_buf);
+	free(ctxt.z_buf);
+	memset(&ctxt, '\0', sizeof(ctxt));
+}
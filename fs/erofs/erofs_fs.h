@@ -0,0 +1,202 @@
+/* SPDX-License-Identifier: GPL-2.0+ */
+/*
+ * On-disk format of EROFS filesystems
+ *
+ * All values are little-endian. See fs/erofs/erofs_fs.h in Linux for the
+ * full definition of the format.
+ */
+
+#ifndef EROFS_FS_H
+#define EROFS_FS_H
+
+#include <linux/types.h>
+
+#define EROFS_SUPER_MAGIC		0xe0f5e1e2
+#define EROFS_SUPER_OFFSET		1024
+
+#define EROFS_BLKSZ_BITS_MIN		9
+#define EROFS_BLKSZ_BITS_MAX		16
+
+#define EROFS_FEATURE_COMPAT_SB_CHKSUM	BIT(0)
+
+#define EROFS_FEATURE_INCOMPAT_ZERO_PADDING	BIT(0)
+#define EROFS_FEATURE_INCOMPAT_BIG_PCLUSTER	BIT(1)
+#define EROFS_FEATURE_INCOMPAT_CHUNKED_FILE	BIT(2)
+#define EROFS_FEATURE_INCOMPAT_COMPR_HEAD2	BIT(3)
+#define EROFS_FEATURE_INCOMPAT_ZTAILPACKING	BIT(4)
+#define EROFS_FEATURE_INCOMPAT_FRAGMENTS	BIT(5)
+#define EROFS_FEATURE_INCOMPAT_XATTR_PREFIXES	BIT(6)
+#define EROFS_FEATURE_INCOMPAT_SUPPORTED \
+	(EROFS_FEATURE_INCOMPAT_ZERO_PADDING | \
+	 EROFS_FEATURE_INCOMPAT_BIG_PCLUSTER | \
+	 EROFS_FEATURE_INCOMPAT_CHUNKED_FILE | \
+	 EROFS_FEATURE_INCOMPAT_COMPR_HEAD2 | \
+	 EROFS_FEATURE_INCOMPAT_XATTR_PREFIXES)
+
+struct erofs_super_block {
+	__le32 magic;
+	__le32 checksum;
+	__le32 feature_compat;
+	__u8 blkszbits;
+	__u8 sb_extslots;
+	__le16 root_nid;
+	__le64 inos;
+	__le64 build_time;
+	__le32 build_time_nsec;
+	__le32 blocks;
+	__le32 meta_blkaddr;
+	__le32 xattr_blkaddr;
+	__u8 uuid[16];
+	__u8 volume_name[16];
+	__le32 feature_incompat;
+	__le16 available_compr_algs;
+	__le16 extra_devices;
+	__le16 devt_slotoff;
+	__u8 reserved[38];
+} __packed;
+
+/* Inodes are found in 32-byte slots from the start of the metadata */
+#define EROFS_ISLOTBITS			5
+
+/* i_format holds the inode version and the data layout */
+#define EROFS_I_VERSION(fmt)		((fmt) & 1)
+#define EROFS_I_DATALAYOUT(fmt)		(((fmt) >> 1) & 7)
+
+#define EROFS_INODE_LAYOUT_COMPACT	0
+#define EROFS_INODE_LAYOUT_EXTENDED	1
+
+enum erofs_datalayout {
+	/* Data in consecutive blocks */
+	EROFS_INODE_FLAT_PLAIN,
+	/* Compressed, with one full index per logical cluster */
+	EROFS_INODE_COMPRESSED_FULL,
+	/* Whole blocks as for FLAT_PLAIN, the tail just after the inode */
+	EROFS_INODE_FLAT_INLINE,
+	/* Compressed, with packed indexes */
+	EROFS_INODE_COMPRESSED_COMPACT,
+	/* Data in chunks, each with its own block address */
+	EROFS_INODE_CHUNK_BASED,
+};
+
+/* Chunk format, in i_u of chunk-based inodes */
+#define EROFS_CHUNK_FORMAT_BLKBITS_MASK	0x1f
+#define EROFS_CHUNK_FORMAT_INDEXES	BIT(5)
+
+#define EROFS_NULL_ADDR			0xffffffff
+
+struct erofs_inode_compact {
+	__le16 i_format;
+	__le16 i_xattr_icount;
+	__le16 i_mode;
+	__le16 i_nlink;
+	__le32 i_size;
+	__le32 i_reserved;
+	/* Start block, chunk format or device number */
+	__le32 i_u;
+	__le32 i_ino;
+	__le16 i_uid;
+	__le16 i_gid;
+	__le32 i_reserved2;
+} __packed;
+
+struct erofs_inode_extended {
+	__le16 i_format;
+	__le16 i_xattr_icount;
+	__le16 i_mode;
+	__le16 i_reserved;
+	__le64 i_size;
+	__le32 i_u;
+	__le32 i_ino;
+	__le32 i_uid;
+	__le32 i_gid;
+	__le64 i_mtime;
+	__le32 i_mtime_nsec;
+	__le32 i_nlink;
+	__u8 i_reserved2[16];
+} __packed;
+
+/* In-inode xattrs: a 12-byte header followed by 4-byte slots */
+#define EROFS_XATTR_IBODY_SIZE(icount) \
+	((icount) ? 12 + ((icount) - 1) * 4 : 0)
+
+struct erofs_inode_chunk_index {
+	__le16 advise;
+	__le16 device_id;
+	__le32 blkaddr;
+} __packed;
+
+/*
+ * A directory block starts with the entries, which are followed by the
+ * names. Names are not terminated, except by the end of the data.
+ */
+struct erofs_dirent {
+	__le64 nid;
+	__le16 nameoff;
+	__u8 file_type;
+	__u8 reserved;
+} __packed;
+
+enum erofs_file_type {
+	EROFS_FT_UNKNOWN,
+	EROFS_FT_REG_FILE,
+	EROFS_FT_DIR,
+	EROFS_FT_CHRDEV,
+	EROFS_FT_BLKDEV,
+	EROFS_FT_FIFO,
+	EROFS_FT_SOCK,
+	EROFS_FT_SYMLINK,
+};
+
+/*
+ * Compressed files are split into logical clusters of the block size. Each
+ * has an index saying whether a physical cluster (pcluster) starts in it,
+ * at which offset, and where that pcluster is on the device.
+ */
+#define Z_EROFS_ADVISE_COMPACTED_2B		BIT(0)
+#define Z_EROFS_ADVISE_BIG_PCLUSTER_1		BIT(1)
+#define Z_EROFS_ADVISE_BIG_PCLUSTER_2		BIT(2)
+#define Z_EROFS_ADVISE_INLINE_PCLUSTER		BIT(3)
+#define Z_EROFS_ADVISE_INTERLACED_PCLUSTER	BIT(4)
+#define Z_EROFS_ADVISE_FRAGMENT_PCLUSTER	BIT(5)
+
+#define Z_EROFS_COMPRESSION_LZ4			0
+
+struct z_erofs_map_header {
+	__le32 h_reserved1;
+	__le16 h_advise;
+	/* Algorithm for HEAD1 in bits 0-3, for HEAD2 in bits 4-7 */
+	__u8 h_algorithmtype;
+	/* Logical cluster size is the block size shifted by bits 0-2 */
+	__u8 h_clusterbits;
+} __packed;
+
+enum z_erofs_lcluster_type {
+	/* Start of an uncompressed pcluster */
+	Z_EROFS_LCLUSTER_TYPE_PLAIN,
+	/* Start of a pcluster compressed with the first algorithm */
+	Z_EROFS_LCLUSTER_TYPE_HEAD1,
+	/* No pcluster starts here */
+	Z_EROFS_LCLUSTER_TYPE_NONHEAD,
+	/* Start of a pcluster compressed with the second algorithm */
+	Z_EROFS_LCLUSTER_TYPE_HEAD2,
+};
+
+#define Z_EROFS_LI_LCLUSTER_TYPE_MASK	3
+/* In delta[0] of the first NONHEAD lcluster: pcluster size in blocks */
+#define Z_EROFS_LI_D0_CBLKCNT		BIT(11)
+
+/* Full indexes, placed 8 bytes after the map header */
+struct z_erofs_lcluster_index {
+	__le16 di_advise;
+	__le16 di_clusterofs;
+	union {
+		__le32 blkaddr;
+		/* Distance back to the head, and on to the next one */
+		__le16 delta[2];
+	} di_u;
+} __packed;
+
+#define Z_EROFS_FULL_INDEX_ALIGN(end) \
+	(ALIGN(end, 8) + sizeof(struct z_erofs_map_header) + 8)
+
+#endif /* EROFS_FS_H */
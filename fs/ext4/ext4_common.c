@@ -314,6 +314,7 @@ int ext4fs_set_block_bmap(long int blockno, unsigned char *buffer, int index)
 	int blocksize = EXT2_BLOCK_SIZE(ext4fs_root);
 
 	i = i - (index * blocksize);
+	get_fs()->blk_bmap_dirty[index] = true;
 	if (blocksize != 1024) {
 		ptr = ptr + i;
 		operand = 1 << remainder;
@@ -350,6 +351,7 @@ void ext4fs_reset_block_bmap(long int blockno, unsigned char *buffer, int index)
 	int blocksize = EXT2_BLOCK_SIZE(ext4fs_root);
 
 	i = i - (index * blocksize);
+	get_fs()->blk_bmap_dirty[index] = true;
 	if (blocksize != 1024) {
 		ptr = ptr + i;
 		operand = (1 << remainder);
@@ -377,6 +379,7 @@ int ext4fs_set_inode_bmap(int inode_no, unsigned char *buffer, int index)
 	unsigned char operand;
 
 	inode_no -= (index * le32_to_cpu(ext4fs_root->sblock.inodes_per_group));
+	get_fs()->inode_bmap_dirty[index] = true;
 	i = inode_no / 8;
 	remainder = inode_no % 8;
 	if (remainder == 0) {
@@ -402,6 +405,7 @@ void ext4fs_reset_inode_bmap(int inode_no, unsigned char *buffer, int index)
 	unsigned char operand;
 
 	inode_no -= (index * le32_to_cpu(ext4fs_root->sblock.inodes_per_group));
+	get_fs()->inode_bmap_dirty[index] = true;
 	i = inode_no / 8;
 	remainder = inode_no % 8;
 	if (remainder == 0) {
@@ -518,9 +522,8 @@ restart_read:
 	if (first_block_no_of_root <= 0)
 		goto fail;
 
-	status = ext4fs_devread((lbaint_t)first_block_no_of_root
-				* fs->sect_perblk,
-				0, fs->blksz, root_first_block_buffer);
+	status = ext4fs_get_metadata(root_first_block_buffer,
+				     first_block_no_of_root);
 	if (status == 0)
 		goto fail;
 
@@ -880,8 +883,7 @@ static int unlink_filename(char *filename, unsigned int blknr)
 		return -ENOMEM;
 
 	/* read the directory block */
-	status = ext4fs_devread((lbaint_t)blknr * fs->sect_perblk, 0,
-				fs->blksz, block_buffer);
+	status = ext4fs_get_metadata(block_buffer, blknr);
 	if (status == 0)
 		goto fail;
 
@@ -967,10 +969,8 @@ uint32_t ext4fs_get_new_blk_no(void)
 	static int prev_bg_bitmap_index = -1;
 	unsigned int blk_per_grp = le32_to_cpu(ext4fs_root->sblock.blocks_per_group);
 	struct ext_filesystem *fs = get_fs();
-	char *journal_buffer = zalloc(fs->blksz);
-	char *zero_buffer = zalloc(fs->blksz);
-	if (!journal_buffer || !zero_buffer)
-		goto fail;
+	/* only needed when a new group is used */
+	char *journal_buffer = NULL;
 
 	if (fs->first_pass_bbmap == 0) {
 		for (i = 0; i < fs->no_blkgrp; i++) {
@@ -981,7 +981,7 @@ uint32_t ext4fs_get_new_blk_no(void)
 				uint64_t b_bitmap_blk =
 					ext4fs_bg_get_block_id(bgd, fs);
 				if (bg_flags & EXT4_BG_BLOCK_UNINIT) {
-					memcpy(fs->blk_bmaps[i], zero_buffer,
+					memset(fs->blk_bmaps[i], '\0',
 					       fs->blksz);
 					put_ext4(b_bitmap_blk * fs->blksz,
 						 fs->blk_bmaps[i], fs->blksz);
@@ -996,8 +996,12 @@ uint32_t ext4fs_get_new_blk_no(void)
 				fs->curr_blkno = fs->curr_blkno +
 						(i * fs->blksz * 8);
 				fs->first_pass_bbmap++;
+				fs->blk_bmap_dirty[i] = true;
 				ext4fs_bg_free_blocks_dec(bgd, fs);
 				ext4fs_sb_free_blocks_dec(fs->sb);
+				journal_buffer = zalloc(fs->blksz);
+				if (!journal_buffer)
+					goto fail;
 				status = ext4fs_devread(b_bitmap_blk *
 							fs->sect_perblk,
 							0, fs->blksz,
@@ -1045,9 +1049,9 @@ restart:
 		uint16_t bg_flags = ext4fs_bg_get_flags(bgd);
 		uint64_t b_bitmap_blk = ext4fs_bg_get_block_id(bgd, fs);
 		if (bg_flags & EXT4_BG_BLOCK_UNINIT) {
-			memcpy(fs->blk_bmaps[bg_idx], zero_buffer, fs->blksz);
+			memset(fs->blk_bmaps[bg_idx], '\0', fs->blksz);
 			put_ext4(b_bitmap_blk * fs->blksz,
-				 zero_buffer, fs->blksz);
+				 fs->blk_bmaps[bg_idx], fs->blksz);
 			bg_flags &= ~EXT4_BG_BLOCK_UNINIT;
 			ext4fs_bg_set_flags(bgd, bg_flags);
 		}
@@ -1062,6 +1066,9 @@ restart:
 
 		/* journal backup */
 		if (prev_bg_bitmap_index != bg_idx) {
+			journal_buffer = zalloc(fs->blksz);
+			if (!journal_buffer)
+				goto fail;
 			status = ext4fs_devread(b_bitmap_blk * fs->sect_perblk,
 						0, fs->blksz, journal_buffer);
 			if (status == 0)
@@ -1077,12 +1084,10 @@ restart:
 	}
 success:
 	free(journal_buffer);
-	free(zero_buffer);
 
 	return fs->curr_blkno;
 fail:
 	free(journal_buffer);
-	free(zero_buffer);
 
 	return -1;
 }
@@ -1130,6 +1135,7 @@ int ext4fs_get_new_inode_no(void)
 				fs->curr_inode_no = fs->curr_inode_no +
 							(i * inodes_per_grp);
 				fs->first_pass_ibmap++;
+				fs->inode_bmap_dirty[i] = true;
 				ext4fs_bg_free_inodes_dec(bgd, fs);
 				if (has_gdt_chksum)
 					ext4fs_bg_itable_unused_dec(bgd, fs);
@@ -1523,12 +1529,119 @@ void ext4fs_allocate_blocks(struct ext2_inode *file_inode,
 	*total_no_of_block += no_blks_reqd;
 }
 
+/*
+ * Allocate the blocks of a file on a filesystem with extents, mapping
+ * each run of consecutive blocks with one extent. The extents are kept in
+ * the inode if they fit there, else in leaf blocks, which are added to
+ * total_no_of_block.
+ *
+ * Returns 0 on success, -1 if there is no space left or the file needs
+ * more leaf blocks than fit in the inode.
+ */
+int ext4fs_allocate_extents(struct ext2_inode *file_inode,
+			    unsigned int total_remaining_blocks,
+			    unsigned int *total_no_of_block)
+{
+	struct ext_filesystem *fs = get_fs();
+	struct ext4_extent_header *eh =
+		(struct ext4_extent_header *)&file_inode->b;
+	unsigned int root_max = (sizeof(file_inode->b) - sizeof(*eh)) /
+				sizeof(struct ext4_extent);
+	unsigned int leaf_max = (fs->blksz - sizeof(*eh)) /
+				sizeof(struct ext4_extent);
+	struct ext4_extent_header *leaf;
+	struct ext4_extent_idx *index;
+	struct ext4_extent *extent;
+	unsigned int fileblock, len, count = 0, nleaves, i;
+	uint64_t start = 0;
+	uint32_t blknr;
+	int ret = -1;
+
+	extent = malloc(root_max * leaf_max * sizeof(*extent));
+	leaf = zalloc(fs->blksz);
+	if (!extent || !leaf)
+		goto out;
+
+	for (fileblock = 0; fileblock < total_remaining_blocks; fileblock++) {
+		blknr = ext4fs_get_new_blk_no();
+		if (blknr == -1) {
+			printf("no block left to assign\n");
+			goto out;
+		}
+		if (count) {
+			len = le16_to_cpu(extent[count - 1].ee_len);
+			if (blknr == start + len && len < EXT_INIT_MAX_LEN) {
+				extent[count - 1].ee_len = cpu_to_le16(len + 1);
+				continue;
+			}
+		}
+		if (count == root_max * leaf_max) {
+			printf("free space too fragmented for the file\n");
+			goto out;
+		}
+		start = blknr;
+		extent[count].ee_block = cpu_to_le32(fileblock);
+		extent[count].ee_len = cpu_to_le16(1);
+		extent[count].ee_start_hi = cpu_to_le16(start >> 32);
+		extent[count].ee_start_lo = cpu_to_le32(start);
+		count++;
+	}
+
+	memset(&file_inode->b, '\0', sizeof(file_inode->b));
+	eh->eh_magic = cpu_to_le16(EXT4_EXT_MAGIC);
+	eh->eh_max = cpu_to_le16(root_max);
+	file_inode->flags = cpu_to_le32(le32_to_cpu(file_inode->flags) |
+					EXT4_EXTENTS_FL);
+	if (count <= root_max) {
+		eh->eh_entries = cpu_to_le16(count);
+		memcpy(eh + 1, extent, count * sizeof(*extent));
+		ret = 0;
+		goto out;
+	}
+
+	/* one level of leaf blocks below the inode */
+	nleaves = DIV_ROUND_UP(count, leaf_max);
+	eh->eh_entries = cpu_to_le16(nleaves);
+	eh->eh_depth = cpu_to_le16(1);
+	index = (struct ext4_extent_idx *)(eh + 1);
+	for (i = 0; i < nleaves; i++) {
+		len = min(count - i * leaf_max, leaf_max);
+		blknr = ext4fs_get_new_blk_no();
+		if (blknr == -1) {
+			printf("no block left to assign\n");
+			goto out;
+		}
+		memset(leaf, '\0', fs->blksz);
+		leaf->eh_magic = cpu_to_le16(EXT4_EXT_MAGIC);
+		leaf->eh_entries = cpu_to_le16(len);
+		leaf->eh_max = cpu_to_le16(leaf_max);
+		memcpy(leaf + 1, extent + i * leaf_max, len * sizeof(*extent));
+		put_ext4((uint64_t)blknr * fs->blksz, leaf, fs->blksz);
+
+		index[i].ei_block = extent[i * leaf_max].ee_block;
+		index[i].ei_leaf_lo = cpu_to_le32(blknr);
+		debug("EL %u: %u extents\n", blknr, len);
+	}
+	*total_no_of_block += nleaves;
+	ret = 0;
+out:
+	free(extent);
+	free(leaf);
+
+	return ret;
+}
+
 #endif
 
+/*
+ * Find the leaf of the extent tree which maps fileblock. If next is not
+ * NULL, it is lowered to the first logical block mapped by a later leaf, if
+ * there is one.
+ */
 static struct ext4_extent_header *ext4fs_get_extent_block
 	(struct ext2_data *data, struct ext_block_cache *cache,
 		struct ext4_extent_header *ext_block,
-		uint32_t fileblock, int log2_blksz)
+		uint32_t fileblock, int log2_blksz, uint32_t *next)
 {
 	struct ext4_extent_idx *index;
 	unsigned long long block;
@@ -1556,6 +1669,8 @@ static struct ext4_extent_header *ext4fs_get_extent_block
 		 */
 		if (i > 0)
 			i--;
+		if (next && i + 1 < le16_to_cpu(ext_block->eh_entries))
+			*next = min(*next, le32_to_cpu(index[i + 1].ei_block));
 
 		block = le16_to_cpu(index[i].ei_leaf_hi);
 		block = (block << 32) + le32_to_cpu(index[i].ei_leaf_lo);
@@ -1642,6 +1757,81 @@ int ext4fs_read_inode(struct ext2_data *data, int ino, struct ext2_inode *inode)
 	return 1;
 }
 
+/*
+ * Map fileblock of an inode which uses extents. blknr is set to the block
+ * it is stored in, or to 0 if it is in a hole or an unwritten extent, which
+ * read as zeroes. count is set to the number of blocks from fileblock on
+ * which are mapped the same way, i.e. stored contiguously from blknr, or
+ * read as zeroes.
+ *
+ * Returns 0 on success, or -EINVAL if the extent tree is corrupted.
+ */
+int ext4fs_map_extent(struct ext2_inode *inode, uint32_t fileblock,
+		      struct ext_block_cache *cache, lbaint_t *blknr,
+		      lbaint_t *count)
+{
+	struct ext4_extent_header *ext_block;
+	struct ext4_extent *extent;
+	uint32_t next = U32_MAX;
+	uint32_t startblock, len;
+	unsigned long long start;
+	int log2_blksz;
+	int i;
+
+	log2_blksz = LOG2_BLOCK_SIZE(ext4fs_root)
+		- get_fs()->dev_desc->log2blksz;
+	ext_block = ext4fs_get_extent_block(ext4fs_root, cache,
+					    (struct ext4_extent_header *)
+					    inode->b.blocks.dir_blocks,
+					    fileblock, log2_blksz, &next);
+	if (!ext_block) {
+		printf("invalid extent block\n");
+		return -EINVAL;
+	}
+
+	extent = (struct ext4_extent *)(ext_block + 1);
+	for (i = 0; i < le16_to_cpu(ext_block->eh_entries); i++) {
+		startblock = le32_to_cpu(extent[i].ee_block);
+		len = le16_to_cpu(extent[i].ee_len);
+		if (startblock > fileblock) {
+			/* Sparse file */
+			next = startblock;
+			break;
+		}
+
+		if (len > EXT_INIT_MAX_LEN) {
+			/* Unwritten extent, which reads as zeroes */
+			len -= EXT_INIT_MAX_LEN;
+			if (fileblock < startblock + len) {
+				*blknr = 0;
+				*count = startblock + len - fileblock;
+				return 0;
+			}
+		} else if (fileblock < startblock + len) {
+			start = le16_to_cpu(extent[i].ee_start_hi);
+			start = (start << 32) +
+				le32_to_cpu(extent[i].ee_start_lo);
+			*blknr = start + fileblock - startblock;
+			*count = startblock + len - fileblock;
+			return 0;
+		}
+	}
+
+	/*
+	 * A hole, up to the next extent if there is one. A corrupted index
+	 * can give a next extent which is not after fileblock, which would
+	 * map no blocks at all and stall the caller.
+	 */
+	if (next <= fileblock) {
+		printf("invalid extent index\n");
+		return -EINVAL;
+	}
+	*blknr = 0;
+	*count = next - fileblock;
+
+	return 0;
+}
+
 long int read_allocated_block(struct ext2_inode *inode, int fileblock,
 			      struct ext_block_cache *cache)
 {
@@ -1675,7 +1865,7 @@ long int read_allocated_block(struct ext2_inode *inode, int fileblock,
 			ext4fs_get_extent_block(ext4fs_root, c,
 						(struct ext4_extent_header *)
 						inode->b.blocks.dir_blocks,
-						fileblock, log2_blksz);
+						fileblock, log2_blksz, NULL);
 		if (!ext_block) {
 			printf("invalid extent block\n");
 			if (!cache)
@@ -2341,7 +2531,11 @@ int ext4fs_open(const char *filename, loff_t *len)
 	if (ext4fs_root == NULL)
 		return -1;
 
-	ext4fs_file = NULL;
+	/* The filesystem may have stayed mounted since the last open */
+	if (ext4fs_file) {
+		ext4fs_free_node(ext4fs_file, &ext4fs_root->diropen);
+		ext4fs_file = NULL;
+	}
 	status = ext4fs_find_file(filename, &ext4fs_root->diropen, &fdiro,
 				  FILETYPE_REG);
 	if (status == 0)
@@ -90,17 +90,49 @@ fail:
 	return -1;
 }
 
+/*
+ * Write the modified meta data to its place on disk, sorted by block
+ * number so that adjacent blocks go out in a single write
+ */
 void ext4fs_dump_metadata(void)
 {
 	struct ext_filesystem *fs = get_fs();
-	int i;
-	for (i = 0; i < MAX_JOURNAL_ENTRIES; i++) {
-		if (dirty_block_ptr[i]->blknr == -1)
+	struct dirty_blocks *tmp;
+	char *bounce;
+	int i, j, n;
+
+	for (n = 0; n < MAX_JOURNAL_ENTRIES; n++) {
+		if (dirty_block_ptr[n]->blknr == -1)
 			break;
-		put_ext4((uint64_t) ((uint64_t)dirty_block_ptr[i]->blknr *
-				(uint64_t)fs->blksz), dirty_block_ptr[i]->buf,
-								fs->blksz);
 	}
+	for (i = 1; i < n; i++) {
+		for (j = i; j && dirty_block_ptr[j - 1]->blknr >
+		     dirty_block_ptr[j]->blknr; j--) {
+			tmp = dirty_block_ptr[j];
+			dirty_block_ptr[j] = dirty_block_ptr[j - 1];
+			dirty_block_ptr[j - 1] = tmp;
+		}
+	}
+
+	bounce = malloc(n * fs->blksz);
+	for (i = 0; i < n; i += j) {
+		for (j = 1; bounce && i + j < n; j++) {
+			if (dirty_block_ptr[i + j]->blknr !=
+			    dirty_block_ptr[i]->blknr + j)
+				break;
+		}
+		if (j > 1) {
+			int k;
+
+			for (k = 0; k < j; k++)
+				memcpy(bounce + k * fs->blksz,
+				       dirty_block_ptr[i + k]->buf, fs->blksz);
+		}
+		put_ext4((uint64_t)dirty_block_ptr[i]->blknr * fs->blksz,
+			 j > 1 ? bounce : dirty_block_ptr[i]->buf,
+			 j * fs->blksz);
+	}
+	free(bounce);
 }
 
 void ext4fs_free_journal(void)
@@ -132,6 +164,11 @@ int ext4fs_log_gdt(char *gd_table)
 	struct ext_filesystem *fs = get_fs();
 	short i;
 	long int var = fs->gdtable_blkno;
+
+	if (gindex + fs->no_blk_pergdt > MAX_JOURNAL_ENTRIES) {
+		printf("Too many blocks in one journal transaction\n");
+		return -ENOSPC;
+	}
 	for (i = 0; i < fs->no_blk_pergdt; i++) {
 		journal_ptr[gindex]->buf = zalloc(fs->blksz);
 		if (!journal_ptr[gindex]->buf)
@@ -165,6 +202,10 @@ int ext4fs_log_journal(char *journal_buffer, uint32_t blknr)
 		if (journal_ptr[i]->blknr == blknr)
 			return 0;
 	}
+	if (gindex == MAX_JOURNAL_ENTRIES) {
+		printf("Too many blocks in one journal transaction\n");
+		return -ENOSPC;
+	}
 
 	journal_ptr[gindex]->buf = zalloc(fs->blksz);
 	if (!journal_ptr[gindex]->buf)
@@ -180,17 +221,30 @@ int ext4fs_log_journal(char *journal_buffer, uint32_t blknr)
  * This function stores the modified meta data in RAM
  * metadata_buffer -- Buffer containing meta data
  * blknr -- Block number on disk of the meta data buffer
+ *
+ * A block which is stored more than once keeps only its latest contents.
  */
 int ext4fs_put_metadata(char *metadata_buffer, uint32_t blknr)
 {
 	struct ext_filesystem *fs = get_fs();
+	int i;
+
 	if (!metadata_buffer) {
 		printf("Invalid input arguments %s\n", __func__);
 		return -EINVAL;
 	}
-	if (dirty_block_ptr[gd_index]->buf)
-		assert(dirty_block_ptr[gd_index]->blknr == blknr);
-	else
+	for (i = 0; i < gd_index; i++) {
+		if (dirty_block_ptr[i]->blknr == blknr) {
+			memcpy(dirty_block_ptr[i]->buf, metadata_buffer,
+			       fs->blksz);
+			return 0;
+		}
+	}
+	if (gd_index == MAX_JOURNAL_ENTRIES) {
+		printf("Too many blocks in one journal transaction\n");
+		return -ENOSPC;
+	}
+	if (!dirty_block_ptr[gd_index]->buf)
 		dirty_block_ptr[gd_index]->buf = zalloc(fs->blksz);
 
 	if (!dirty_block_ptr[gd_index]->buf)
@@ -201,6 +255,30 @@ int ext4fs_put_metadata(char *metadata_buffer, uint32_t blknr)
 	return 0;
 }
 
+/*
+ * This function reads a meta data block, returning the copy stored with
+ * ext4fs_put_metadata() if the block has been modified in this transaction
+ * buf -- Buffer to receive the meta data
+ * blknr -- Block number on disk of the meta data
+ *
+ * Returns non-zero on success, like ext4fs_devread()
+ */
+int ext4fs_get_metadata(char *buf, uint32_t blknr)
+{
+	struct ext_filesystem *fs = get_fs();
+	int i;
+
+	for (i = 0; i < gd_index; i++) {
+		if (dirty_block_ptr[i]->blknr == blknr) {
+			memcpy(buf, dirty_block_ptr[i]->buf, fs->blksz);
+			return 1;
+		}
+	}
+
+	return ext4fs_devread((lbaint_t)blknr * fs->sect_perblk, 0, fs->blksz,
+			      buf);
+}
+
 void print_revoke_blks(char *revk_blk)
 {
 	int offset;
@@ -550,37 +628,16 @@ end:
 	return 0;
 }
 
-static void update_descriptor_block(long int blknr)
+static void update_descriptor_block(char *buf, __be32 sequence)
 {
 	int i;
-	long int jsb_blknr;
 	struct journal_header_t jdb;
 	struct ext3_journal_block_tag tag;
-	struct ext2_inode inode_journal;
-	struct journal_superblock_t *jsb = NULL;
-	char *buf = NULL;
-	char *temp = NULL;
-	struct ext_filesystem *fs = get_fs();
-	char *temp_buff = zalloc(fs->blksz);
-	if (!temp_buff)
-		return;
-
-	ext4fs_read_inode(ext4fs_root, EXT2_JOURNAL_INO, &inode_journal);
-	jsb_blknr = read_allocated_block(&inode_journal,
-					 EXT2_JOURNAL_SUPERBLOCK, NULL);
-	ext4fs_devread((lbaint_t)jsb_blknr * fs->sect_perblk, 0, fs->blksz,
-		       temp_buff);
-	jsb = (struct journal_superblock_t *) temp_buff;
+	char *temp = buf;
 
 	jdb.h_blocktype = cpu_to_be32(EXT3_JOURNAL_DESCRIPTOR_BLOCK);
 	jdb.h_magic = cpu_to_be32(EXT3_JOURNAL_MAGIC_NUMBER);
-	jdb.h_sequence = jsb->s_sequence;
-	buf = zalloc(fs->blksz);
-	if (!buf) {
-		free(temp_buff);
-		return;
-	}
-	temp = buf;
+	jdb.h_sequence = sequence;
 	memcpy(buf, &jdb, sizeof(struct journal_header_t));
 	temp += sizeof(struct journal_header_t);
 
@@ -598,69 +655,81 @@ static void update_descriptor_block(long int blknr)
 	tag.flags = cpu_to_be32(EXT3_JOURNAL_FLAG_LAST_TAG);
 	memcpy(temp - sizeof(struct ext3_journal_block_tag), &tag,
 	       sizeof(struct ext3_journal_block_tag));
-	put_ext4((uint64_t) ((uint64_t)blknr * (uint64_t)fs->blksz), buf, (uint32_t) fs->blksz);
-
-	free(temp_buff);
-	free(buf);
 }
 
-static void update_commit_block(long int blknr)
+static void update_commit_block(char *buf, __be32 sequence)
 {
 	struct journal_header_t jdb;
-	struct ext_filesystem *fs = get_fs();
-	char *buf = NULL;
-	struct ext2_inode inode_journal;
-	struct journal_superblock_t *jsb;
-	long int jsb_blknr;
-	char *temp_buff = zalloc(fs->blksz);
-	if (!temp_buff)
-		return;
-
-	ext4fs_read_inode(ext4fs_root, EXT2_JOURNAL_INO,
-			  &inode_journal);
-	jsb_blknr = read_allocated_block(&inode_journal,
-					 EXT2_JOURNAL_SUPERBLOCK, NULL);
-	ext4fs_devread((lbaint_t)jsb_blknr * fs->sect_perblk, 0, fs->blksz,
-		       temp_buff);
-	jsb = (struct journal_superblock_t *) temp_buff;
 
 	jdb.h_blocktype = cpu_to_be32(EXT3_JOURNAL_COMMIT_BLOCK);
 	jdb.h_magic = cpu_to_be32(EXT3_JOURNAL_MAGIC_NUMBER);
-	jdb.h_sequence = jsb->s_sequence;
-	buf = zalloc(fs->blksz);
-	if (!buf) {
-		free(temp_buff);
-		return;
-	}
+	jdb.h_sequence = sequence;
 	memcpy(buf, &jdb, sizeof(struct journal_header_t));
-	put_ext4((uint64_t) ((uint64_t)blknr * (uint64_t)fs->blksz), buf, (uint32_t) fs->blksz);
-
-	free(temp_buff);
-	free(buf);
 }
 
+/*
+ * Write the transaction to the journal: a descriptor block, the logged
+ * blocks and a commit block. They are put together in memory so that each
+ * physically contiguous part of the journal is written at once.
+ */
 void ext4fs_update_journal(void)
 {
 	struct ext2_inode inode_journal;
 	struct ext_filesystem *fs = get_fs();
-	long int blknr;
-	int i;
+	struct journal_superblock_t *jsb;
+	struct ext_block_cache cache;
+	long int blknr, jsb_blknr;
+	int i, count, nblks;
+	__be32 sequence;
+	char *buf;
 
 	if (!(fs->sb->feature_compatibility & EXT4_FEATURE_COMPAT_HAS_JOURNAL))
 		return;
 
-	ext4fs_read_inode(ext4fs_root, EXT2_JOURNAL_INO, &inode_journal);
-	blknr = read_allocated_block(&inode_journal, jrnl_blk_idx++, NULL);
-	update_descriptor_block(blknr);
 	for (i = 0; i < MAX_JOURNAL_ENTRIES; i++) {
 		if (journal_ptr[i]->blknr == -1)
 			break;
-		blknr = read_allocated_block(&inode_journal, jrnl_blk_idx++,
-					     NULL);
-		put_ext4((uint64_t) ((uint64_t)blknr * (uint64_t)fs->blksz),
-			 journal_ptr[i]->buf, fs->blksz);
 	}
-	blknr = read_allocated_block(&inode_journal, jrnl_blk_idx++, NULL);
-	update_commit_block(blknr);
+	nblks = i + 2;
+	buf = zalloc(nblks * fs->blksz);
+	if (!buf)
+		return;
+
+	ext4fs_read_inode(ext4fs_root, EXT2_JOURNAL_INO, &inode_journal);
+	ext_cache_init(&cache);
+	jsb_blknr = read_allocated_block(&inode_journal,
+					 EXT2_JOURNAL_SUPERBLOCK, &cache);
+	if (jsb_blknr <= 0 ||
+	    !ext4fs_devread((lbaint_t)jsb_blknr * fs->sect_perblk, 0,
+			    fs->blksz, buf))
+		goto out;
+	jsb = (struct journal_superblock_t *)buf;
+	sequence = jsb->s_sequence;
+	/* The descriptor block goes where the journal superblock was read */
+	memset(buf, 0, fs->blksz);
+	update_commit_block(buf + (nblks - 1) * fs->blksz, sequence);
+	update_descriptor_block(buf, sequence);
+	for (i = 0; i < nblks - 2; i++)
+		memcpy(buf + (i + 1) * fs->blksz, journal_ptr[i]->buf,
+		       fs->blksz);
+
+	for (i = 0; i < nblks; i += count) {
+		blknr = read_allocated_block(&inode_journal, jrnl_blk_idx,
+					     &cache);
+		if (blknr <= 0)
+			break;
+		for (count = 1; i + count < nblks; count++) {
+			if (read_allocated_block(&inode_journal,
+						 jrnl_blk_idx + count,
+						 &cache) != blknr + count)
+				break;
+		}
+		put_ext4((uint64_t)blknr * fs->blksz, buf + i * fs->blksz,
+			 count * fs->blksz);
+		jrnl_blk_idx += count;
+	}
 	printf("update journal finished\n");
+out:
+	ext_cache_fini(&cache);
+	free(buf);
 }
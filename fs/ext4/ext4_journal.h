@@ -119,6 +119,7 @@ int ext4fs_log_gdt(char *gd_table);
 int ext4fs_check_journal_state(int recovery_flag);
 int ext4fs_log_journal(char *journal_buffer, uint32_t blknr);
 int ext4fs_put_metadata(char *metadata_buffer, uint32_t blknr);
+int ext4fs_get_metadata(char *buf, uint32_t blknr);
 void ext4fs_update_journal(void);
 void ext4fs_dump_metadata(void);
 void ext4fs_push_revoke_blk(char *buffer);
@@ -67,6 +67,34 @@ static inline void ext4fs_bg_free_blocks_inc
 		bg->free_blocks_high = cpu_to_le16(free_blocks >> 16);
 }
 
+/*
+ * Write the bitmaps marked in dirty, each of which is a block following the
+ * previous one in memory. Bitmaps which are next to each other on disk as
+ * well, as with flex_bg, are written together.
+ */
+static void ext4fs_put_bitmaps(unsigned char *bmaps, bool *dirty,
+			       uint64_t (*get_id)(const struct ext2_block_group *,
+						  const struct ext_filesystem *))
+{
+	struct ext_filesystem *fs = get_fs();
+	uint64_t blk;
+	int i, count;
+
+	for (i = 0; i < fs->no_blkgrp; i += count) {
+		count = 1;
+		if (!dirty[i])
+			continue;
+		blk = get_id(ext4fs_get_group_descriptor(fs, i), fs);
+		while (i + count < fs->no_blkgrp && dirty[i + count] &&
+		       get_id(ext4fs_get_group_descriptor(fs, i + count),
+			      fs) == blk + count)
+			count++;
+		put_ext4(blk * fs->blksz, bmaps + i * fs->blksz,
+			 count * fs->blksz);
+		memset(dirty + i, '\0', count * sizeof(*dirty));
+	}
+}
+
 static void ext4fs_update(void)
 {
 	short i;
@@ -78,22 +106,16 @@ static void ext4fs_update(void)
 	put_ext4((uint64_t)(SUPERBLOCK_SIZE),
 		 (struct ext2_sblock *)fs->sb, (uint32_t)SUPERBLOCK_SIZE);
 
-	/* update block bitmaps */
 	for (i = 0; i < fs->no_blkgrp; i++) {
 		bgd = ext4fs_get_group_descriptor(fs, i);
 		bgd->bg_checksum = cpu_to_le16(ext4fs_checksum_update(i));
-		uint64_t b_bitmap_blk = ext4fs_bg_get_block_id(bgd, fs);
-		put_ext4(b_bitmap_blk * fs->blksz,
-			 fs->blk_bmaps[i], fs->blksz);
 	}
 
-	/* update inode bitmaps */
-	for (i = 0; i < fs->no_blkgrp; i++) {
-		bgd = ext4fs_get_group_descriptor(fs, i);
-		uint64_t i_bitmap_blk = ext4fs_bg_get_inode_id(bgd, fs);
-		put_ext4(i_bitmap_blk * fs->blksz,
-			 fs->inode_bmaps[i], fs->blksz);
-	}
+	/* update the block and inode bitmaps which have changed */
+	ext4fs_put_bitmaps(fs->blk_bmaps[0], fs->blk_bmap_dirty,
+			   ext4fs_bg_get_block_id);
+	ext4fs_put_bitmaps(fs->inode_bmaps[0], fs->inode_bmap_dirty,
+			   ext4fs_bg_get_inode_id);
 
 	/* update the block group descriptor table */
 	put_ext4((uint64_t)((uint64_t)fs->gdtable_blkno * (uint64_t)fs->blksz),
@@ -435,24 +457,118 @@ fail:
 	free(journal_buffer);
 }
 
+/*
+ * Release one block of a file, backing up its block bitmap in the journal
+ * unless the previous block released was in the same group
+ */
+static int ext4fs_free_block(long int blknr, int *prev_bg_bmap_idx,
+			     char *journal_buffer)
+{
+	struct ext_filesystem *fs = get_fs();
+	uint32_t blk_per_grp = le32_to_cpu(ext4fs_root->sblock.blocks_per_group);
+	struct ext2_block_group *bgd;
+	int remainder;
+	int bg_idx;
+
+	bg_idx = blknr / blk_per_grp;
+	if (fs->blksz == 1024) {
+		remainder = blknr % blk_per_grp;
+		if (!remainder)
+			bg_idx--;
+	}
+	ext4fs_reset_block_bmap(blknr, fs->blk_bmaps[bg_idx], bg_idx);
+	debug("EXT4 Block releasing %ld: %d\n", blknr, bg_idx);
+
+	/* get  block group descriptor table */
+	bgd = ext4fs_get_group_descriptor(fs, bg_idx);
+	ext4fs_bg_free_blocks_inc(bgd, fs);
+	ext4fs_sb_free_blocks_inc(fs->sb);
+	/* journal backup */
+	if (*prev_bg_bmap_idx != bg_idx) {
+		uint64_t b_bitmap_blk = ext4fs_bg_get_block_id(bgd, fs);
+
+		if (!ext4fs_devread(b_bitmap_blk * fs->sect_perblk, 0,
+				    fs->blksz, journal_buffer))
+			return -1;
+		if (ext4fs_log_journal(journal_buffer, b_bitmap_blk))
+			return -1;
+		*prev_bg_bmap_idx = bg_idx;
+	}
+
+	return 0;
+}
+
+/*
+ * Release the data blocks mapped by an extent tree node and, for an index
+ * node, the tree blocks below it
+ */
+static int ext4fs_delete_extents(struct ext4_extent_header *eh,
+				 int *prev_bg_bmap_idx, char *journal_buffer)
+{
+	struct ext4_extent_idx *index = (struct ext4_extent_idx *)(eh + 1);
+	struct ext4_extent *extent = (struct ext4_extent *)(eh + 1);
+	struct ext_filesystem *fs = get_fs();
+	uint64_t start, blknr;
+	unsigned int len;
+	char *buf;
+	int i, ret = 0;
+
+	if (le16_to_cpu(eh->eh_magic) != EXT4_EXT_MAGIC)
+		return -1;
+
+	for (i = 0; !ret && i < le16_to_cpu(eh->eh_entries); i++) {
+		if (eh->eh_depth) {
+			blknr = le16_to_cpu(index[i].ei_leaf_hi);
+			blknr = (blknr << 32) + le32_to_cpu(index[i].ei_leaf_lo);
+			buf = zalloc(fs->blksz);
+			if (!buf)
+				return -ENOMEM;
+			if (ext4fs_devread(blknr * fs->sect_perblk, 0,
+					   fs->blksz, buf))
+				ret = ext4fs_delete_extents(
+					(struct ext4_extent_header *)buf,
+					prev_bg_bmap_idx, journal_buffer);
+			else
+				ret = -1;
+			free(buf);
+			if (!ret)
+				ret = ext4fs_free_block(blknr, prev_bg_bmap_idx,
+							journal_buffer);
+		} else {
+			len = le16_to_cpu(extent[i].ee_len);
+			if (len > EXT_INIT_MAX_LEN)
+				len -= EXT_INIT_MAX_LEN;
+			start = le16_to_cpu(extent[i].ee_start_hi);
+			start = (start << 32) +
+				le32_to_cpu(extent[i].ee_start_lo);
+			for (blknr = start; !ret && blknr < start + len; blknr++)
+				ret = ext4fs_free_block(blknr, prev_bg_bmap_idx,
+							journal_buffer);
+		}
+	}
+
+	return ret;
+}
+
+/*
+ * Release the blocks and the inode of a file. The changes are part of the
+ * transaction of the caller, which commits them with ext4fs_update().
+ */
 static int ext4fs_delete_file(int inodeno)
 {
 	struct ext2_inode inode;
 	short status;
 	int i;
-	int remainder;
 	long int blknr;
-	int bg_idx;
 	int ibmap_idx;
 	char *read_buffer = NULL;
 	char *start_block_address = NULL;
 	uint32_t no_blocks;
 
-	static int prev_bg_bmap_idx = -1;
+	int prev_bg_bmap_idx = -1;
 	unsigned int inodes_per_block;
 	uint32_t blkno;
 	unsigned int blkoff;
-	uint32_t blk_per_grp = le32_to_cpu(ext4fs_root->sblock.blocks_per_group);
 	uint32_t inode_per_grp = le32_to_cpu(ext4fs_root->sblock.inodes_per_group);
 	struct ext2_inode *inode_buffer = NULL;
 	struct ext2_block_group *bgd = NULL;
@@ -479,11 +595,12 @@ static int ext4fs_delete_file(int inodeno)
 	}
 
 	if (le32_to_cpu(inode.flags) & EXT4_EXTENTS_FL) {
-		/* FIXME delete extent index blocks, i.e. eh_depth >= 1 */
-		struct ext4_extent_header *eh =
-			(struct ext4_extent_header *)
-				inode.b.blocks.dir_blocks;
-		debug("del: dep=%d entries=%d\n", eh->eh_depth, eh->eh_entries);
+		if (no_blocks &&
+		    ext4fs_delete_extents((struct ext4_extent_header *)
+					  inode.b.blocks.dir_blocks,
+					  &prev_bg_bmap_idx, journal_buffer))
+			goto fail;
+		no_blocks = 0;
 	} else {
 		delete_single_indirect_block(&inode);
 		delete_double_indirect_block(&inode);
@@ -497,32 +614,8 @@ static int ext4fs_delete_file(int inodeno)
 			continue;
 		if (blknr < 0)
 			goto fail;
-		bg_idx = blknr / blk_per_grp;
-		if (fs->blksz == 1024) {
-			remainder = blknr % blk_per_grp;
-			if (!remainder)
-				bg_idx--;
-		}
-		ext4fs_reset_block_bmap(blknr, fs->blk_bmaps[bg_idx],
-					bg_idx);
-		debug("EXT4 Block releasing %ld: %d\n", blknr, bg_idx);
-
-		/* get  block group descriptor table */
-		bgd = ext4fs_get_group_descriptor(fs, bg_idx);
-		ext4fs_bg_free_blocks_inc(bgd, fs);
-		ext4fs_sb_free_blocks_inc(fs->sb);
-		/* journal backup */
-		if (prev_bg_bmap_idx != bg_idx) {
-			uint64_t b_bitmap_blk = ext4fs_bg_get_block_id(bgd, fs);
-			status = ext4fs_devread(b_bitmap_blk * fs->sect_perblk,
-						0, fs->blksz,
-						journal_buffer);
-			if (status == 0)
-				goto fail;
-			if (ext4fs_log_journal(journal_buffer, b_bitmap_blk))
-				goto fail;
-			prev_bg_bmap_idx = bg_idx;
-		}
+		if (ext4fs_free_block(blknr, &prev_bg_bmap_idx, journal_buffer))
+			goto fail;
 	}
 
 	/* release inode */
@@ -545,8 +638,7 @@ static int ext4fs_delete_file(int inodeno)
 	if (!read_buffer)
 		goto fail;
 	start_block_address = read_buffer;
-	status = ext4fs_devread((lbaint_t)blkno * fs->sect_perblk,
-				0, fs->blksz, read_buffer);
+	status = ext4fs_get_metadata(read_buffer, blkno);
 	if (status == 0)
 		goto fail;
 
@@ -575,15 +667,9 @@ static int ext4fs_delete_file(int inodeno)
 	if (ext4fs_log_journal(journal_buffer, ext4fs_bg_get_inode_id(bgd, fs)))
 		goto fail;
 
-	ext4fs_update();
-	ext4fs_deinit();
+	/* the indirect blocks read so far may be reused for the new file */
 	ext4fs_reinit_global();
 
-	if (ext4fs_init() != 0) {
-		printf("error in File System init\n");
-		goto fail;
-	}
-
 	free(start_block_address);
 	free(journal_buffer);
 
@@ -595,9 +681,53 @@ fail:
 	return -1;
 }
 
+/*
+ * Read the bitmap of each group into consecutive blocks of one buffer,
+ * reading bitmaps which are next to each other on disk together. The
+ * bitmaps start out clean in the array allocated for *dirty.
+ */
+static unsigned char **ext4fs_get_bitmaps(bool **dirty,
+		uint64_t (*get_id)(const struct ext2_block_group *,
+				   const struct ext_filesystem *))
+{
+	struct ext_filesystem *fs = get_fs();
+	unsigned char **bmaps;
+	unsigned char *buf;
+	uint64_t blk;
+	int i, count;
+
+	bmaps = zalloc(fs->no_blkgrp * sizeof(unsigned char *));
+	*dirty = zalloc(fs->no_blkgrp * sizeof(bool));
+	buf = zalloc(fs->no_blkgrp * fs->blksz);
+	if (!bmaps || !*dirty || !buf)
+		goto fail;
+	for (i = 0; i < fs->no_blkgrp; i++)
+		bmaps[i] = buf + i * fs->blksz;
+
+	for (i = 0; i < fs->no_blkgrp; i += count) {
+		blk = get_id(ext4fs_get_group_descriptor(fs, i), fs);
+		for (count = 1; i + count < fs->no_blkgrp; count++) {
+			if (get_id(ext4fs_get_group_descriptor(fs, i + count),
+				   fs) != blk + count)
+				break;
+		}
+		if (!ext4fs_devread(blk * fs->sect_perblk, 0,
+				    count * fs->blksz, (char *)bmaps[i]))
+			goto fail;
+	}
+
+	return bmaps;
+fail:
+	free(buf);
+	free(*dirty);
+	*dirty = NULL;
+	free(bmaps);
+
+	return NULL;
+}
+
 int ext4fs_init(void)
 {
-	short status;
 	int i;
 	uint32_t real_free_blocks = 0;
 	struct ext_filesystem *fs = get_fs();
@@ -630,46 +760,15 @@ int ext4fs_init(void)
 		goto fail;
 	}
 
-	/* load all the available bitmap block of the partition */
-	fs->blk_bmaps = zalloc(fs->no_blkgrp * sizeof(char *));
+	/* load all the available block and inode bitmaps of the partition */
+	fs->blk_bmaps = ext4fs_get_bitmaps(&fs->blk_bmap_dirty,
+					   ext4fs_bg_get_block_id);
 	if (!fs->blk_bmaps)
 		goto fail;
-	for (i = 0; i < fs->no_blkgrp; i++) {
-		fs->blk_bmaps[i] = zalloc(fs->blksz);
-		if (!fs->blk_bmaps[i])
-			goto fail;
-	}
-
-	for (i = 0; i < fs->no_blkgrp; i++) {
-		struct ext2_block_group *bgd =
-			ext4fs_get_group_descriptor(fs, i);
-		status = ext4fs_devread(ext4fs_bg_get_block_id(bgd, fs) *
-				   fs->sect_perblk, 0,
-				   fs->blksz, (char *)fs->blk_bmaps[i]);
-		if (status == 0)
-			goto fail;
-	}
-
-	/* load all the available inode bitmap of the partition */
-	fs->inode_bmaps = zalloc(fs->no_blkgrp * sizeof(unsigned char *));
+	fs->inode_bmaps = ext4fs_get_bitmaps(&fs->inode_bmap_dirty,
+					     ext4fs_bg_get_inode_id);
 	if (!fs->inode_bmaps)
 		goto fail;
-	for (i = 0; i < fs->no_blkgrp; i++) {
-		fs->inode_bmaps[i] = zalloc(fs->blksz);
-		if (!fs->inode_bmaps[i])
-			goto fail;
-	}
-
-	for (i = 0; i < fs->no_blkgrp; i++) {
-		struct ext2_block_group *bgd =
-			ext4fs_get_group_descriptor(fs, i);
-		status = ext4fs_devread(ext4fs_bg_get_inode_id(bgd, fs) *
-					fs->sect_perblk,
-					0, fs->blksz,
-					(char *)fs->inode_bmaps[i]);
-		if (status == 0)
-			goto fail;
-	}
 
 	/*
 	 * check filesystem consistency with free blocks of file system
@@ -695,7 +794,6 @@ fail:
 
 void ext4fs_deinit(void)
 {
-	int i;
 	struct ext2_inode inode_journal;
 	struct journal_superblock_t *jsb;
 	uint32_t blknr;
@@ -730,22 +828,20 @@ void ext4fs_deinit(void)
 	fs->sb = NULL;
 
 	if (fs->blk_bmaps) {
-		for (i = 0; i < fs->no_blkgrp; i++) {
-			free(fs->blk_bmaps[i]);
-			fs->blk_bmaps[i] = NULL;
-		}
+		free(fs->blk_bmaps[0]);
 		free(fs->blk_bmaps);
 		fs->blk_bmaps = NULL;
 	}
+	free(fs->blk_bmap_dirty);
+	fs->blk_bmap_dirty = NULL;
 
 	if (fs->inode_bmaps) {
-		for (i = 0; i < fs->no_blkgrp; i++) {
-			free(fs->inode_bmaps[i]);
-			fs->inode_bmaps[i] = NULL;
-		}
+		free(fs->inode_bmaps[0]);
 		free(fs->inode_bmaps);
 		fs->inode_bmaps = NULL;
 	}
+	free(fs->inode_bmap_dirty);
+	fs->inode_bmap_dirty = NULL;
 
 
 	free(fs->gdtable);
@@ -762,22 +858,26 @@ void ext4fs_deinit(void)
 
 /*
  * Write data to filesystem blocks. Uses same optimization for
- * contigous sectors as ext4fs_read_file
+ * contigous sectors as ext4fs_read_file, and maps whole extents at a
+ * time for a file with extents.
  */
 static int ext4fs_write_file(struct ext2_inode *file_inode,
 			     int pos, unsigned int len, const char *buf)
 {
-	int i;
-	int blockcnt;
+	unsigned int i;
+	unsigned int blockcnt;
 	uint32_t filesize = le32_to_cpu(file_inode->size);
 	struct ext_filesystem *fs = get_fs();
 	int log2blksz = fs->dev_desc->log2blksz;
 	int log2_fs_blocksize = LOG2_BLOCK_SIZE(ext4fs_root) - log2blksz;
-	int previous_block_number = -1;
-	int delayed_start = 0;
-	int delayed_extent = 0;
-	int delayed_next = 0;
+	bool extents = le32_to_cpu(file_inode->flags) & EXT4_EXTENTS_FL;
+	struct ext_block_cache cache;
+	lbaint_t delayed_start = 0;
+	lbaint_t delayed_next = 0;
+	uint32_t delayed_extent = 0;
 	const char *delayed_buf = NULL;
+	lbaint_t blknr, blocks;
+	int ret = 0;
 
 	/* Adjust len so it we can't read past the end of the file. */
 	if (len > filesize)
@@ -785,61 +885,49 @@ static int ext4fs_write_file(struct ext2_inode *file_inode,
 
 	blockcnt = ((len + pos) + fs->blksz - 1) / fs->blksz;
 
-	for (i = pos / fs->blksz; i < blockcnt; i++) {
-		long int blknr;
-		int blockend = fs->blksz;
-		int skipfirst = 0;
-		blknr = read_allocated_block(file_inode, i, NULL);
-		if (blknr <= 0)
-			return -1;
+	ext_cache_init(&cache);
+	for (i = pos / fs->blksz; i < blockcnt; i += blocks) {
+		if (extents) {
+			if (ext4fs_map_extent(file_inode, i, &cache, &blknr,
+					      &blocks)) {
+				ret = -1;
+				break;
+			}
+			blocks = min_t(lbaint_t, blocks, blockcnt - i);
+		} else {
+			blknr = read_allocated_block(file_inode, i, NULL);
+			blocks = 1;
+		}
+		if ((long int)blknr <= 0) {
+			ret = -1;
+			break;
+		}
 
 		blknr = blknr << log2_fs_blocksize;
 
-		if (blknr) {
-			if (previous_block_number != -1) {
-				if (delayed_next == blknr) {
-					delayed_extent += blockend;
-					delayed_next += blockend >> log2blksz;
-				} else {	/* spill */
-					put_ext4((uint64_t)
-						 ((uint64_t)delayed_start << log2blksz),
-						 delayed_buf,
-						 (uint32_t) delayed_extent);
-					previous_block_number = blknr;
-					delayed_start = blknr;
-					delayed_extent = blockend;
-					delayed_buf = buf;
-					delayed_next = blknr +
-					    (blockend >> log2blksz);
-				}
-			} else {
-				previous_block_number = blknr;
-				delayed_start = blknr;
-				delayed_extent = blockend;
-				delayed_buf = buf;
-				delayed_next = blknr +
-				    (blockend >> log2blksz);
-			}
+		if (delayed_extent && delayed_next == blknr &&
+		    delayed_extent <= INT_MAX - blocks * fs->blksz) {
+			delayed_extent += blocks * fs->blksz;
+			delayed_next += blocks << log2_fs_blocksize;
 		} else {
-			if (previous_block_number != -1) {
-				/* spill */
-				put_ext4((uint64_t) ((uint64_t)delayed_start <<
-						     log2blksz),
-					 delayed_buf,
-					 (uint32_t) delayed_extent);
-				previous_block_number = -1;
-			}
+			if (delayed_extent)	/* spill */
+				put_ext4((uint64_t)delayed_start << log2blksz,
+					 delayed_buf, delayed_extent);
+			delayed_start = blknr;
+			delayed_extent = blocks * fs->blksz;
+			delayed_buf = buf;
+			delayed_next = blknr + (blocks << log2_fs_blocksize);
 		}
-		buf += fs->blksz - skipfirst;
+		buf += blocks * fs->blksz;
 	}
-	if (previous_block_number != -1) {
+	if (!ret && delayed_extent) {
 		/* spill */
-		put_ext4((uint64_t) ((uint64_t)delayed_start << log2blksz),
-			 delayed_buf, (uint32_t) delayed_extent);
-		previous_block_number = -1;
+		put_ext4((uint64_t)delayed_start << log2blksz, delayed_buf,
+			 delayed_extent);
 	}
+	ext_cache_fini(&cache);
 
-	return len;
+	return ret ? ret : len;
 }
 
 int ext4fs_write(const char *fname, const char *buffer,
@@ -958,8 +1046,15 @@ int ext4fs_write(const char *fname, const char *buffer,
 	file_inode->nlinks = cpu_to_le16(1);
 
 	/* Allocate data blocks */
-	ext4fs_allocate_blocks(file_inode, blocks_remaining,
-			       &blks_reqd_for_file);
+	if (blocks_remaining && le32_to_cpu(fs->sb->feature_incompat) &
+	    EXT4_FEATURE_INCOMPAT_EXTENTS) {
+		if (ext4fs_allocate_extents(file_inode, blocks_remaining,
+					    &blks_reqd_for_file))
+			goto fail;
+	} else {
+		ext4fs_allocate_blocks(file_inode, blocks_remaining,
+				       &blks_reqd_for_file);
+	}
 	file_inode->blockcnt = cpu_to_le32((blks_reqd_for_file * fs->blksz) >>
 					   LOG2_SECTOR_SIZE);
 
@@ -973,8 +1068,8 @@ int ext4fs_write(const char *fname, const char *buffer,
 			(inodeno % le32_to_cpu(sblock->inodes_per_group)) /
 			inodes_per_block;
 	blkoff = (inodeno % inodes_per_block) * fs->inodesz;
-	ext4fs_devread((lbaint_t)itable_blkno * fs->sect_perblk, 0, fs->blksz,
-		       temp_ptr);
+	if (!ext4fs_get_metadata(temp_ptr, itable_blkno))
+		goto fail;
 	if (ext4fs_log_journal(temp_ptr, itable_blkno))
 		goto fail;
 
@@ -994,26 +1089,15 @@ int ext4fs_write(const char *fname, const char *buffer,
 	    (parent_inodeno %
 	     le32_to_cpu(sblock->inodes_per_group)) / inodes_per_block;
 	blkoff = (parent_inodeno % inodes_per_block) * fs->inodesz;
-	if (parent_itable_blkno != itable_blkno) {
-		memset(temp_ptr, '\0', fs->blksz);
-		ext4fs_devread((lbaint_t)parent_itable_blkno * fs->sect_perblk,
-			       0, fs->blksz, temp_ptr);
-		if (ext4fs_log_journal(temp_ptr, parent_itable_blkno))
-			goto fail;
+	/* this also finds the new inode if it is in the same block */
+	if (!ext4fs_get_metadata(temp_ptr, parent_itable_blkno))
+		goto fail;
+	if (ext4fs_log_journal(temp_ptr, parent_itable_blkno))
+		goto fail;
 
-		memcpy(temp_ptr + blkoff, g_parent_inode, fs->inodesz);
-		if (ext4fs_put_metadata(temp_ptr, parent_itable_blkno))
-			goto fail;
-	} else {
-		/*
-		 * If parent and child fall in same inode table block
-		 * both should be kept in 1 buffer
-		 */
-		memcpy(temp_ptr + blkoff, g_parent_inode, fs->inodesz);
-		gd_index--;
-		if (ext4fs_put_metadata(temp_ptr, itable_blkno))
-			goto fail;
-	}
+	memcpy(temp_ptr + blkoff, g_parent_inode, fs->inodesz);
+	if (ext4fs_put_metadata(temp_ptr, parent_itable_blkno))
+		goto fail;
 	ext4fs_update();
 	ext4fs_deinit();
 
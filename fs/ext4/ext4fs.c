@@ -44,6 +44,75 @@ void ext4fs_free_node(struct ext2fs_node *node, struct ext2fs_node *currroot)
 		free(node);
 }
 
+/*
+ * Read len bytes at pos from a file which maps its blocks with extents. Each
+ * extent is mapped once, physically contiguous blocks are read with a single
+ * ext4fs_devread() straight into buf, and holes and unwritten extents are
+ * zeroed.
+ */
+static int ext4fs_read_extents(struct ext2fs_node *node, loff_t pos,
+			       loff_t len, char *buf)
+{
+	int log2blksz = get_fs()->dev_desc->log2blksz;
+	int log2_blocksize = LOG2_BLOCK_SIZE(node->data);
+	int log2_fs_blocksize = log2_blocksize - log2blksz;
+	/* Most blocks read in one go, as ext4fs_devread() takes an int */
+	lbaint_t max_blocks = INT_MAX >> log2_blocksize;
+	uint32_t fileblock = pos >> log2_blocksize;
+	int skipfirst = pos & ((1 << log2_blocksize) - 1);
+	lbaint_t run_start = 0, run_next = 0;
+	int run_skipfirst = 0, run_len = 0;
+	char *run_buf = NULL;
+	struct ext_block_cache cache;
+	lbaint_t blknr, count;
+	loff_t n;
+	int ret = 0;
+
+	ext_cache_init(&cache);
+	while (len > 0) {
+		if (ext4fs_map_extent(&node->inode, fileblock, &cache, &blknr,
+				      &count)) {
+			ret = -1;
+			break;
+		}
+		count = min(count, max_blocks);
+		n = ((loff_t)count << log2_blocksize) - skipfirst;
+		if (n > len)
+			n = len;
+
+		if (!blknr) {
+			memset(buf, 0, n);
+		} else if (run_len && blknr << log2_fs_blocksize == run_next &&
+			   run_buf + run_len == buf && run_len <= INT_MAX - n) {
+			/* This carries on from the last extent */
+			run_len += n;
+			run_next += count << log2_fs_blocksize;
+		} else {
+			if (run_len && !ext4fs_devread(run_start, run_skipfirst,
+						       run_len, run_buf)) {
+				ret = -1;
+				break;
+			}
+			run_start = blknr << log2_fs_blocksize;
+			run_next = run_start + (count << log2_fs_blocksize);
+			run_skipfirst = skipfirst;
+			run_len = n;
+			run_buf = buf;
+		}
+
+		buf += n;
+		len -= n;
+		fileblock += count;
+		skipfirst = 0;
+	}
+	if (!ret && run_len &&
+	    !ext4fs_devread(run_start, run_skipfirst, run_len, run_buf))
+		ret = -1;
+	ext_cache_fini(&cache);
+
+	return ret;
+}
+
 /*
  * Taken from openmoko-kernel mailing list: By Andy green
  * Optimized read file API : collects and defers contiguous sector
@@ -80,6 +149,14 @@ int ext4fs_read_file(struct ext2fs_node *node, loff_t pos,
 		return -1;
 	}
 
+	if (le32_to_cpu(node->inode.flags) & EXT4_EXTENTS_FL) {
+		ext_cache_fini(&cache);
+		if (ext4fs_read_extents(node, pos, len, buf))
+			return -1;
+		*actread = len;
+		return 0;
+	}
+
 	blockcnt = lldiv(((len + pos) + blocksize - 1), blocksize);
 
 	for (i = lldiv(pos, blocksize); i < blockcnt; i++) {
@@ -22,6 +22,7 @@
 #include <asm/cache.h>
 #include <linux/compiler.h>
 #include <linux/ctype.h>
+#include <linux/math64.h>
 
 /*
  * Convert a string to lowercase.  Converts at most 'len' characters,
@@ -62,6 +63,7 @@ int fat_set_blk_dev(struct blk_desc *dev_desc, struct disk_partition *info)
 {
 	ALLOC_CACHE_ALIGN_BUFFER(unsigned char, buffer, dev_desc->blksz);
 
+	fs_close_cached();
 	cur_dev = dev_desc;
 	cur_part_info = *info;
 
@@ -157,6 +159,98 @@ int flush_dirty_fat_buffer(fsdata *mydata)
 }
 #endif
 
+/*
+ * Make FAT buffer number 'bufnum' the current one, in mydata->fatbuf.
+ *
+ * A few recently used buffers are kept in mydata->fatcache, so that a
+ * cluster chain which jumps around the FAT does not read the same sectors
+ * again and again. Modified buffers stay in the cache until they are
+ * written back together by flush_dirty_fat_buffer(), which only happens
+ * here when a modified buffer would otherwise be dropped.
+ * Return 0 on success, -EIO if the write-back fails and -1 if the read fails.
+ */
+static int get_fat_buffer(fsdata *mydata, int bufnum)
+{
+	__u32 getsize = FATBUFBLOCKS;
+	__u32 fatlength = mydata->fatlength;
+	__u32 startblock = bufnum * FATBUFBLOCKS;
+	__u8 *bufptr, dirty;
+	int i, num;
+
+	if (bufnum == mydata->fatbufnum)
+		return 0;
+
+	/* Look for the buffer in the cache, else reuse the oldest one */
+	for (i = 0; i < FATBUFWINDOWS - 2; i++) {
+		if (mydata->fatcachenum[i] == bufnum)
+			break;
+	}
+	bufptr = mydata->fatcache[i];
+	num = mydata->fatcachenum[i];
+	if (num != bufnum && mydata->fatbufnum == -1)
+		bufptr = NULL;		/* the current buffer is free to use */
+	else if (!bufptr)
+		bufptr = malloc_cache_aligned(FATBUFSIZE);
+	else if (num != bufnum && mydata->fatcachedirty[i] &&
+		 flush_dirty_fat_buffer(mydata) < 0)
+		return -EIO;
+
+	if (bufptr) {
+		/* Move the current buffer to the front of the cache */
+		dirty = num == bufnum && mydata->fatcachedirty[i];
+		memmove(&mydata->fatcache[1], &mydata->fatcache[0],
+			i * sizeof(mydata->fatcache[0]));
+		memmove(&mydata->fatcachenum[1], &mydata->fatcachenum[0],
+			i * sizeof(mydata->fatcachenum[0]));
+		memmove(&mydata->fatcachedirty[1], &mydata->fatcachedirty[0],
+			i * sizeof(mydata->fatcachedirty[0]));
+		mydata->fatcache[0] = mydata->fatbuf;
+		mydata->fatcachenum[0] = mydata->fatbufnum;
+		mydata->fatcachedirty[0] = mydata->fat_dirty;
+		mydata->fatbuf = bufptr;
+		mydata->fat_dirty = dirty;
+		if (num == bufnum) {
+			mydata->fatbufnum = bufnum;
+			return 0;
+		}
+	} else {
+		/* Read into the current buffer, dropping what it held */
+		if (mydata->fat_dirty && flush_dirty_fat_buffer(mydata) < 0)
+			return -EIO;
+		bufptr = mydata->fatbuf;
+	}
+	mydata->fatbufnum = -1;
+
+	/* Cap length if fatlength is not a multiple of FATBUFBLOCKS */
+	if (startblock + getsize > fatlength)
+		getsize = fatlength - startblock;
+
+	startblock += mydata->fat_sect;	/* Offset from start of disk */
+
+	if (disk_read(startblock, getsize, bufptr) < 0) {
+		debug("Error reading FAT blocks\n");
+		return -1;
+	}
+	mydata->fatbufnum = bufnum;
+
+	return 0;
+}
+
+/* Free the FAT buffers set up by get_fs_info() */
+static void free_fat_buffers(fsdata *mydata)
+{
+	int i;
+
+	free(mydata->fatbuf);
+	mydata->fatbuf = NULL;
+	for (i = 0; i < FATBUFWINDOWS - 1; i++) {
+		free(mydata->fatcache[i]);
+		mydata->fatcache[i] = NULL;
+		mydata->fatcachenum[i] = -1;
+		mydata->fatcachedirty[i] = 0;
+	}
+}
+
 /*
  * Get the entry at index 'entry' in a FAT (12/16/32) table.
  * On failure 0x00 is returned.
@@ -195,27 +289,13 @@ static __u32 get_fatent(fsdata *mydata, __u32 entry)
 	       mydata->fatsize, entry, entry, offset, offset);
 
 	/* Read a new block of FAT entries into the cache. */
-	if (bufnum != mydata->fatbufnum) {
-		__u32 getsize = FATBUFBLOCKS;
-		__u8 *bufptr = mydata->fatbuf;
-		__u32 fatlength = mydata->fatlength;
-		__u32 startblock = bufnum * FATBUFBLOCKS;
-
-		/* Cap length if fatlength is not a multiple of FATBUFBLOCKS */
-		if (startblock + getsize > fatlength)
-			getsize = fatlength - startblock;
-
-		startblock += mydata->fat_sect;	/* Offset from start of disk */
-
-		/* Write back the fatbuf to the disk */
-		if (flush_dirty_fat_buffer(mydata) < 0)
-			return -1;
-
-		if (disk_read(startblock, getsize, bufptr) < 0) {
-			debug("Error reading FAT blocks\n");
-			return ret;
-		}
-		mydata->fatbufnum = bufnum;
+	switch (get_fat_buffer(mydata, bufnum)) {
+	case 0:
+		break;
+	case -EIO:
+		return -1;
+	default:
+		return ret;
 	}
 
 	/* Get the actual entry from the table */
@@ -303,6 +383,108 @@ get_cluster(fsdata *mydata, __u32 clustnum, __u8 *buffer, unsigned long size)
 	return 0;
 }
 
+/* A run of consecutive clusters in a file */
+struct fat_run {
+	__u32 clust;		/* first cluster */
+	__u32 count;		/* number of clusters */
+};
+
+/*
+ * Cluster runs of the file read last. Reading a file in pieces (e.g. through
+ * the EFI file protocol) then only needs to follow the part of the cluster
+ * chain not seen yet, instead of starting again from the first cluster each
+ * time. The map is only kept while the block cache generation shows that
+ * nothing has been written since it was made.
+ */
+static struct {
+	struct blk_desc *dev;
+	lbaint_t part_start;
+	unsigned int gen;
+	__u32 start;		/* first cluster of the file */
+	__u32 next;		/* cluster following the last run */
+	loff_t size;		/* number of bytes covered by the runs */
+	struct fat_run *runs;
+	int count;		/* number of runs */
+	int max;		/* number of runs allocated */
+} fat_map;
+
+static bool fat_map_valid(__u32 start)
+{
+#if CONFIG_IS_ENABLED(BLOCK_CACHE)
+	return fat_map.count && fat_map.dev == cur_dev &&
+	       fat_map.part_start == cur_part_info.start &&
+	       fat_map.start == start &&
+	       fat_map.gen == blkcache_generation();
+#else
+	return false;
+#endif
+}
+
+/**
+ * fat_map_file() - map the clusters of a file
+ *
+ * Make sure that fat_map covers at least the first 'size' bytes of the file
+ * starting at cluster 'start', following the cluster chain as needed.
+ *
+ * @mydata:	file system description
+ * @start:	first cluster of the file
+ * @size:	number of bytes to map
+ * Return:	-1 on error, otherwise 0
+ */
+static int fat_map_file(fsdata *mydata, __u32 start, loff_t size)
+{
+	unsigned int bytesperclust = mydata->clust_size * mydata->sect_size;
+	struct fat_run *run;
+	__u32 clust;
+
+	if (!fat_map_valid(start)) {
+		fat_map.dev = cur_dev;
+		fat_map.part_start = cur_part_info.start;
+#if CONFIG_IS_ENABLED(BLOCK_CACHE)
+		fat_map.gen = blkcache_generation();
+#endif
+		fat_map.start = start;
+		fat_map.next = start;
+		fat_map.size = 0;
+		fat_map.count = 0;
+	}
+
+	while (fat_map.size < size) {
+		clust = fat_map.next;
+		if (CHECK_CLUST(clust, mydata->fatsize)) {
+			debug("curclust: 0x%x\n", clust);
+			printf("Invalid FAT entry\n");
+			fat_map.count = 0;
+			return -1;
+		}
+
+		run = fat_map.count ? &fat_map.runs[fat_map.count - 1] : NULL;
+		if (run && run->clust + run->count == clust) {
+			run->count++;
+		} else {
+			if (fat_map.count == fat_map.max) {
+				int max = fat_map.max ? fat_map.max * 2 : 16;
+
+				run = realloc(fat_map.runs, max * sizeof(*run));
+				if (!run) {
+					debug("Error: allocating memory\n");
+					fat_map.count = 0;
+					return -1;
+				}
+				fat_map.runs = run;
+				fat_map.max = max;
+			}
+			run = &fat_map.runs[fat_map.count++];
+			run->clust = clust;
+			run->count = 1;
+		}
+		fat_map.size += bytesperclust;
+		fat_map.next = get_fatent(mydata, clust);
+	}
+
+	return 0;
+}
+
 /**
  * get_contents() - read from file
  *
@@ -323,9 +505,9 @@ static int get_contents(fsdata *mydata, dir_entry *dentptr, loff_t pos,
 {
 	loff_t filesize = FAT2CPU32(dentptr->size);
 	unsigned int bytesperclust = mydata->clust_size * mydata->sect_size;
-	__u32 curclust = START(dentptr);
-	__u32 endclust, newclust;
-	loff_t actsize;
+	loff_t runpos, runend, actsize;
+	struct fat_run *run;
+	__u32 curclust, skip;
 
 	*gotsize = 0;
 	debug("Filesize: %llu bytes\n", filesize);
@@ -340,29 +522,27 @@ static int get_contents(fsdata *mydata, dir_entry *dentptr, loff_t pos,
 
 	debug("%llu bytes\n", filesize);
 
-	actsize = bytesperclust;
+	if (fat_map_file(mydata, START(dentptr), filesize))
+		return -1;
 
-	/* go to cluster at pos */
-	while (actsize <= pos) {
-		curclust = get_fatent(mydata, curclust);
-		if (CHECK_CLUST(curclust, mydata->fatsize)) {
-			debug("curclust: 0x%x\n", curclust);
-			printf("Invalid FAT entry\n");
-			return -1;
-		}
-		actsize += bytesperclust;
+	/* go to the run holding pos */
+	run = fat_map.runs;
+	runpos = 0;
+	runend = (loff_t)run->count * bytesperclust;
+	while (runend <= pos) {
+		run++;
+		runpos = runend;
+		runend += (loff_t)run->count * bytesperclust;
 	}
 
-	/* actsize > pos */
-	actsize -= bytesperclust;
-	filesize -= actsize;
-	pos -= actsize;
+	/* and to the cluster holding pos within that run */
+	curclust = run->clust + div_u64_rem(pos - runpos, bytesperclust, &skip);
 
 	/* align to beginning of next cluster if any */
-	if (pos) {
+	if (skip) {
 		__u8 *tmp_buffer;
 
-		actsize = min(filesize, (loff_t)bytesperclust);
+		actsize = min(filesize - (pos - skip), (loff_t)bytesperclust);
 		tmp_buffer = malloc_cache_aligned(actsize);
 		if (!tmp_buffer) {
 			debug("Error: allocating buffer\n");
@@ -374,67 +554,33 @@ static int get_contents(fsdata *mydata, dir_entry *dentptr, loff_t pos,
 			free(tmp_buffer);
 			return -1;
 		}
-		filesize -= actsize;
-		actsize -= pos;
-		memcpy(buffer, tmp_buffer + pos, actsize);
+		actsize -= skip;
+		memcpy(buffer, tmp_buffer + skip, actsize);
 		free(tmp_buffer);
 		*gotsize += actsize;
-		if (!filesize)
-			return 0;
 		buffer += actsize;
-
-		curclust = get_fatent(mydata, curclust);
-		if (CHECK_CLUST(curclust, mydata->fatsize)) {
-			debug("curclust: 0x%x\n", curclust);
-			printf("Invalid FAT entry\n");
-			return -1;
-		}
+		pos += actsize;
+		curclust++;
 	}
 
-	actsize = bytesperclust;
-	endclust = curclust;
-
-	do {
-		/* search for consecutive clusters */
-		while (actsize < filesize) {
-			newclust = get_fatent(mydata, endclust);
-			if ((newclust - 1) != endclust)
-				goto getit;
-			if (CHECK_CLUST(newclust, mydata->fatsize)) {
-				debug("curclust: 0x%x\n", newclust);
-				printf("Invalid FAT entry\n");
-				return -1;
-			}
-			endclust = newclust;
-			actsize += bytesperclust;
+	/* read the rest a run at a time */
+	while (pos < filesize) {
+		if (pos == runend) {
+			run++;
+			runend += (loff_t)run->count * bytesperclust;
+			curclust = run->clust;
 		}
-
-		/* get remaining bytes */
-		actsize = filesize;
-		if (get_cluster(mydata, curclust, buffer, (int)actsize) != 0) {
+		actsize = min(filesize, runend) - pos;
+		if (get_cluster(mydata, curclust, buffer, actsize) != 0) {
 			printf("Error reading cluster\n");
 			return -1;
 		}
 		*gotsize += actsize;
-		return 0;
-getit:
-		if (get_cluster(mydata, curclust, buffer, (int)actsize) != 0) {
-			printf("Error reading cluster\n");
-			return -1;
-		}
-		*gotsize += (int)actsize;
-		filesize -= actsize;
 		buffer += actsize;
+		pos += actsize;
+	}
 
-		curclust = get_fatent(mydata, endclust);
-		if (CHECK_CLUST(curclust, mydata->fatsize)) {
-			debug("curclust: 0x%x\n", curclust);
-			printf("Invalid FAT entry\n");
-			return -1;
-		}
-		actsize = bytesperclust;
-		endclust = curclust;
-	} while (1);
+	return 0;
 }
 
 /*
@@ -558,7 +704,7 @@ static int get_fs_info(fsdata *mydata)
 {
 	boot_sector bs;
 	volume_info volinfo;
-	int ret;
+	int ret, i;
 
 	ret = read_bootsectandvi(&bs, &volinfo, &mydata->fatsize);
 	if (ret) {
@@ -625,6 +771,11 @@ static int get_fs_info(fsdata *mydata)
 
 	mydata->fatbufnum = -1;
 	mydata->fat_dirty = 0;
+	for (i = 0; i < FATBUFWINDOWS - 1; i++) {
+		mydata->fatcache[i] = NULL;
+		mydata->fatcachenum[i] = -1;
+		mydata->fatcachedirty[i] = 0;
+	}
 	mydata->fatbuf = malloc_cache_aligned(FATBUFSIZE);
 	if (mydata->fatbuf == NULL) {
 		debug("Error: allocating memory\n");
@@ -1151,7 +1302,7 @@ int fat_exists(const char *filename)
 		goto out;
 
 	ret = fat_itr_resolve(itr, filename, TYPE_ANY);
-	free(fsdata.fatbuf);
+	free_fat_buffers(&fsdata);
 out:
 	free(itr);
 	return ret == 0;
@@ -1176,7 +1327,7 @@ int fat_size(const char *filename, loff_t *size)
 		 * Directories don't have size, but fs_size() is not
 		 * expected to fail if passed a directory path:
 		 */
-		free(fsdata.fatbuf);
+		free_fat_buffers(&fsdata);
 		ret = fat_itr_root(itr, &fsdata);
 		if (ret)
 			goto out_free_itr;
@@ -1188,7 +1339,7 @@ int fat_size(const char *filename, loff_t *size)
 
 	*size = FAT2CPU32(itr->dent->size);
 out_free_both:
-	free(fsdata.fatbuf);
+	free_fat_buffers(&fsdata);
 out_free_itr:
 	free(itr);
 	return ret;
@@ -1220,7 +1371,7 @@ int file_fat_read_at(const char *filename, loff_t pos, void *buffer,
 	ret = get_contents(&fsdata, dentptr, pos, buffer, maxsize, actread);
 
 out_free_both:
-	free(fsdata.fatbuf);
+	free_fat_buffers(&fsdata);
 out_free_itr:
 	free(itr);
 	return ret;
@@ -1279,7 +1430,7 @@ int fat_opendir(const char *filename, struct fs_dir_stream **dirsp)
 	return 0;
 
 fail_free_both:
-	free(dir->fsdata.fatbuf);
+	free_fat_buffers(&dir->fsdata);
 fail_free_dir:
 	free(dir);
 	return ret;
@@ -1311,7 +1462,7 @@ int fat_readdir(struct fs_dir_stream *dirs, struct fs_dirent **dentp)
 void fat_closedir(struct fs_dir_stream *dirs)
 {
 	fat_dir *dir = (fat_dir *)dirs;
-	free(dir->fsdata.fatbuf);
+	free_fat_buffers(&dir->fsdata);
 	free(dir);
 }
 
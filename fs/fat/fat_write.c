@@ -12,8 +12,10 @@
 #include <log.h>
 #include <malloc.h>
 #include <asm/byteorder.h>
+#include <asm/unaligned.h>
 #include <part.h>
 #include <asm/cache.h>
+#include <linux/bitops.h>
 #include <linux/ctype.h>
 #include <div64.h>
 #include <linux/math64.h>
@@ -29,9 +31,71 @@ static void uppercase(char *str, int len)
 	}
 }
 
+/*
+ * Map of the free clusters of the file system last written to, with one bit
+ * set for each free entry of the FAT, so that writes can find free clusters
+ * without reading the whole FAT each time.
+ *
+ * The map is kept between operations while the FAT on the disk matches it,
+ * which is known from the generation of the block cache.
+ */
+static struct {
+	struct blk_desc *dev;	/* Device and partition of the map */
+	lbaint_t part_start;
+	unsigned int gen;	/* Block cache generation when last in sync */
+	unsigned long *map;	/* One bit per FAT entry, set if free */
+	__u32 entries;		/* Number of FAT entries in the map */
+	__u32 free;		/* Number of free clusters */
+	bool valid;		/* Set if map matches the FAT being written */
+	bool synced;		/* Set if map matches the FAT on the disk */
+} fat_free;
+
+/*
+ * Sectors of the FAT read at a time to build the map, a multiple of three
+ * so that each read ends on a whole FAT12 entry
+ */
+#define FAT_FREE_CHUNK	96
+
+/* Check whether the map still matches the FAT on the disk */
+static bool fat_free_synced(void)
+{
+#if CONFIG_IS_ENABLED(BLOCK_CACHE)
+	return fat_free.synced && fat_free.gen == blkcache_generation();
+#else
+	return false;
+#endif
+}
+
+/* Record that the map matches the FAT on the disk */
+static void fat_free_sync(void)
+{
+	fat_free.synced = true;
+#if CONFIG_IS_ENABLED(BLOCK_CACHE)
+	fat_free.gen = blkcache_generation();
+#endif
+}
+
+/* Mark FAT entry 'entry' as free or in use in the map */
+static void fat_free_mark(__u32 entry, bool free)
+{
+	unsigned long *word = &fat_free.map[entry / BITS_PER_LONG];
+	unsigned long bit = 1UL << (entry % BITS_PER_LONG);
+
+	if (!(*word & bit) == !free)
+		return;
+
+	*word ^= bit;
+	if (free)
+		fat_free.free++;
+	else
+		fat_free.free--;
+	fat_free.synced = false;
+}
+
 static int total_sector;
 static int disk_write(__u32 block, __u32 nr_blocks, void *buf)
 {
+	bool synced;
 	ulong ret;
 
 	if (!cur_dev)
@@ -43,10 +107,15 @@ static int disk_write(__u32 block, __u32 nr_blocks, void *buf)
 		return -1;
 	}
 
+	synced = fat_free_synced();
 	ret = blk_dwrite(cur_dev, cur_part_info.start + block, nr_blocks, buf);
 	if (nr_blocks && ret == 0)
 		return -1;
 
+	/* Our own writes leave the FAT matching the free cluster map */
+	if (synced)
+		fat_free_sync();
+
 	return ret;
 }
 
@@ -103,20 +172,16 @@ static void set_name(dir_entry *dirent, const char *filename)
 }
 
 /*
- * Write fat buffer into block device
+ * Write 'count' FAT buffers starting with buffer number 'bufnum' from
+ * 'bufptr' into each copy of the FAT on the block device
  */
-static int flush_dirty_fat_buffer(fsdata *mydata)
+static int write_fat_buffers(fsdata *mydata, int bufnum, int count,
+			     __u8 *bufptr)
 {
-	int getsize = FATBUFBLOCKS;
+	__u32 getsize = count * FATBUFBLOCKS;
 	__u32 fatlength = mydata->fatlength;
-	__u8 *bufptr = mydata->fatbuf;
-	__u32 startblock = mydata->fatbufnum * FATBUFBLOCKS;
-
-	debug("debug: evicting %d, dirty: %d\n", mydata->fatbufnum,
-	      (int)mydata->fat_dirty);
-
-	if ((!mydata->fat_dirty) || (mydata->fatbufnum == -1))
-		return 0;
+	__u32 startblock = bufnum * FATBUFBLOCKS;
+	int i;
 
 	/* Cap length if fatlength is not a multiple of FATBUFBLOCKS */
 	if (startblock + getsize > fatlength)
@@ -124,21 +189,79 @@ static int flush_dirty_fat_buffer(fsdata *mydata)
 
 	startblock += mydata->fat_sect;
 
-	/* Write FAT buf */
-	if (disk_write(startblock, getsize, bufptr) < 0) {
-		debug("error: writing FAT blocks\n");
-		return -1;
+	for (i = 0; i < mydata->fats; i++) {
+		if (disk_write(startblock + i * fatlength, getsize, bufptr) < 0) {
+			debug("error: writing FAT %d blocks\n", i + 1);
+			return -1;
+		}
 	}
 
-	if (mydata->fats == 2) {
-		/* Update corresponding second FAT blocks */
-		startblock += mydata->fatlength;
-		if (disk_write(startblock, getsize, bufptr) < 0) {
-			debug("error: writing second FAT blocks\n");
+	return 0;
+}
+
+/*
+ * Write the modified FAT buffers into block device
+ *
+ * The current buffer and any modified buffers in the cache are written in
+ * order of their place in the FAT, and buffers which follow on from each
+ * other are written together, so that a file spanning several buffers
+ * costs one write per copy of the FAT.
+ */
+static int flush_dirty_fat_buffer(fsdata *mydata)
+{
+	__u8 *bufs[FATBUFWINDOWS], *tmpbuf = NULL;
+	int nums[FATBUFWINDOWS];
+	int count = 0, i, j, k;
+
+	debug("debug: evicting %d, dirty: %d\n", mydata->fatbufnum,
+	      (int)mydata->fat_dirty);
+
+	/* Collect the modified buffers, sorted by buffer number */
+	if (mydata->fat_dirty && mydata->fatbufnum != -1) {
+		bufs[0] = mydata->fatbuf;
+		nums[0] = mydata->fatbufnum;
+		count = 1;
+	}
+	for (i = 0; i < FATBUFWINDOWS - 1; i++) {
+		if (!mydata->fatcachedirty[i])
+			continue;
+		for (j = count++; j > 0; j--) {
+			if (nums[j - 1] < mydata->fatcachenum[i])
+				break;
+			bufs[j] = bufs[j - 1];
+			nums[j] = nums[j - 1];
+		}
+		bufs[j] = mydata->fatcache[i];
+		nums[j] = mydata->fatcachenum[i];
+	}
+
+	if (count > 1)
+		tmpbuf = malloc_cache_aligned(count * FATBUFSIZE);
+
+	for (i = 0; i < count; i = j) {
+		/* Gather the buffers following on from this one */
+		for (j = i + 1; tmpbuf && j < count; j++) {
+			if (nums[j] != nums[j - 1] + 1)
+				break;
+		}
+		if (j - i > 1) {
+			for (k = i; k < j; k++)
+				memcpy(tmpbuf + (k - i) * FATBUFSIZE, bufs[k],
+				       FATBUFSIZE);
+		}
+		if (write_fat_buffers(mydata, nums[i], j - i,
+				      j - i > 1 ? tmpbuf : bufs[i])) {
+			free(tmpbuf);
 			return -1;
 		}
 	}
+	free(tmpbuf);
+
 	mydata->fat_dirty = 0;
+	for (i = 0; i < FATBUFWINDOWS - 1; i++)
+		mydata->fatcachedirty[i] = 0;
+	if (count && fat_free.valid)
+		fat_free_sync();
 
 	return 0;
 }
@@ -288,27 +411,8 @@ static int set_fatent_value(fsdata *mydata, __u32 entry, __u32 entry_value)
 	}
 
 	/* Read a new block of FAT entries into the cache. */
-	if (bufnum != mydata->fatbufnum) {
-		int getsize = FATBUFBLOCKS;
-		__u8 *bufptr = mydata->fatbuf;
-		__u32 fatlength = mydata->fatlength;
-		__u32 startblock = bufnum * FATBUFBLOCKS;
-
-		/* Cap length if fatlength is not a multiple of FATBUFBLOCKS */
-		if (startblock + getsize > fatlength)
-			getsize = fatlength - startblock;
-
-		if (flush_dirty_fat_buffer(mydata) < 0)
-			return -1;
-
-		startblock += mydata->fat_sect;
-
-		if (disk_read(startblock, getsize, bufptr) < 0) {
-			debug("Error reading FAT blocks\n");
-			return -1;
-		}
-		mydata->fatbufnum = bufnum;
-	}
+	if (get_fat_buffer(mydata, bufnum))
+		return -1;
 
 	/* Mark as dirty */
 	mydata->fat_dirty = 1;
@@ -364,7 +468,131 @@ static int set_fatent_value(fsdata *mydata, __u32 entry, __u32 entry_value)
 		return -1;
 	}
 
+	if (fat_free.valid && entry < fat_free.entries)
+		fat_free_mark(entry, !entry_value);
+
+	return 0;
+}
+
+/*
+ * Check whether the free cluster map from an earlier write can be used for
+ * the file system in cur_dev/cur_part_info
+ */
+static void check_free_map(void)
+{
+	fat_free.valid = fat_free.map && fat_free.dev == cur_dev &&
+			 fat_free.part_start == cur_part_info.start &&
+			 fat_free_synced();
+}
+
+/*
+ * Read the whole FAT into the free cluster map, unless it is up to date
+ * already. Return 0 if the map can be used, else -1, in which case the
+ * callers fall back to searching the FAT itself.
+ */
+static int build_free_map(fsdata *mydata)
+{
+	__u32 fatlength = mydata->fatlength;
+	__u32 entries, entry, sect, count, i, n, v;
+	unsigned long *map;
+	__u8 *buf;
+
+	if (fat_free.valid)
+		return 0;
+
+	/* The entries of the FAT on the disk must be up to date */
+	if (flush_dirty_fat_buffer(mydata) < 0)
+		return -1;
+
+	free(fat_free.map);
+	fat_free.map = NULL;
+	fat_free.synced = false;
+
+	/* Only as many entries as there are clusters, and the two reserved */
+	entries = (mydata->total_sect - clust_to_sect(mydata, 2)) /
+		  mydata->clust_size + 2;
+	entries = min_t(u64, entries,
+			div_u64((u64)fatlength * mydata->sect_size * 8,
+				mydata->fatsize));
+
+	buf = malloc_cache_aligned(FAT_FREE_CHUNK * mydata->sect_size);
+	map = calloc(BITS_TO_LONGS(entries), sizeof(*map));
+	if (!buf || !map)
+		goto err;
+	fat_free.free = 0;
+
+	for (sect = 0, entry = 0; entry < entries; sect += n) {
+		n = min_t(__u32, FAT_FREE_CHUNK, fatlength - sect);
+		if (disk_read(mydata->fat_sect + sect, n, buf) < 0) {
+			debug("Error reading FAT blocks\n");
+			goto err;
+		}
+
+		count = n * mydata->sect_size * 8 / mydata->fatsize;
+		count = min(count, entries - entry);
+		for (i = 0; i < count; i++, entry++) {
+			switch (mydata->fatsize) {
+			case 32:
+				v = get_unaligned_le32(buf + i * 4);
+				break;
+			case 16:
+				v = get_unaligned_le16(buf + i * 2);
+				break;
+			default:
+				v = get_unaligned_le16(buf + i * 3 / 2);
+				if (i & 1)
+					v >>= 4;
+				v &= 0xfff;
+				break;
+			}
+			if (!v && entry >= 2) {
+				map[entry / BITS_PER_LONG] |=
+					1UL << (entry % BITS_PER_LONG);
+				fat_free.free++;
+			}
+		}
+	}
+	free(buf);
+
+	fat_free.map = map;
+	fat_free.entries = entries;
+	fat_free.dev = cur_dev;
+	fat_free.part_start = cur_part_info.start;
+	fat_free.valid = true;
+	fat_free_sync();
+	debug("FAT%d: %u of %u clusters free\n", mydata->fatsize,
+	      fat_free.free, entries - 2);
+
 	return 0;
+
+err:
+	free(buf);
+	free(map);
+	return -1;
+}
+
+/*
+ * Find the first entry from 'entry' on which is free if 'free' is set, else
+ * the first one in use. Return fat_free.entries if there is none.
+ */
+static __u32 fat_free_find(__u32 entry, bool free)
+{
+	unsigned long flip = free ? 0 : ~0UL;
+	unsigned long word;
+	__u32 i;
+
+	if (entry >= fat_free.entries)
+		return fat_free.entries;
+
+	i = entry / BITS_PER_LONG;
+	word = (fat_free.map[i] ^ flip) & (~0UL << (entry % BITS_PER_LONG));
+	while (!word) {
+		if (++i >= BITS_TO_LONGS(fat_free.entries))
+			return fat_free.entries;
+		word = fat_free.map[i] ^ flip;
+	}
+
+	return min_t(__u32, i * BITS_PER_LONG + __ffs(word), fat_free.entries);
 }
 
 /*
@@ -375,6 +603,19 @@ static __u32 determine_fatent(fsdata *mydata, __u32 entry)
 {
 	__u32 next_fat, next_entry = entry + 1;
 
+	if (!build_free_map(mydata)) {
+		next_entry = fat_free_find(next_entry, true);
+		if (next_entry == fat_free.entries)
+			next_entry = fat_free_find(2, true);
+		if (next_entry == fat_free.entries) {
+			debug("FAT%d: no free entry\n", mydata->fatsize);
+			return 0;
+		}
+		fat_free_mark(next_entry, false);
+		set_fatent_value(mydata, entry, next_entry);
+		return next_entry;
+	}
+
 	while (1) {
 		next_fat = get_fatent(mydata, next_entry);
 		if (next_fat == 0) {
@@ -607,11 +848,30 @@ get_set_cluster(fsdata *mydata, __u32 clustnum, loff_t pos, __u8 *buffer,
 }
 
 /*
- * Find the first empty cluster
+ * Find an empty cluster to put 'count' new clusters from: the start of the
+ * first free run which is long enough, else of the longest free run.
+ * Return 0 if there is no free cluster.
  */
-static int find_empty_cluster(fsdata *mydata)
+static int find_empty_cluster(fsdata *mydata, __u32 count)
 {
 	__u32 fat_val, entry = 3;
+	__u32 start, end, best = 0, best_len = 0;
+
+	if (!build_free_map(mydata)) {
+		for (start = fat_free_find(2, true); start < fat_free.entries;
+		     start = fat_free_find(end, true)) {
+			end = fat_free_find(start, false);
+			if (end - start > best_len) {
+				best = start;
+				best_len = end - start;
+			}
+			if (best_len >= count)
+				break;
+		}
+		if (best)
+			fat_free_mark(best, false);
+		return best;
+	}
 
 	while (1) {
 		fat_val = get_fatent(mydata, entry);
@@ -632,7 +892,11 @@ static int new_dir_table(fat_itr *itr)
 	int dir_newclust = 0;
 	unsigned int bytesperclust = mydata->clust_size * mydata->sect_size;
 
-	dir_newclust = find_empty_cluster(mydata);
+	dir_newclust = find_empty_cluster(mydata, 1);
+	if (!dir_newclust) {
+		printf("Error: no space left for directory\n");
+		return -1;
+	}
 	set_fatent_value(mydata, itr->clust, dir_newclust);
 	if (mydata->fatsize == 32)
 		set_fatent_value(mydata, dir_newclust, 0xffffff8);
@@ -644,9 +908,6 @@ static int new_dir_table(fat_itr *itr)
 	itr->clust = dir_newclust;
 	itr->next_clust = dir_newclust;
 
-	if (flush_dirty_fat_buffer(mydata) < 0)
-		return -1;
-
 	memset(itr->block, 0x00, bytesperclust);
 
 	itr->dent = (dir_entry *)itr->block;
@@ -673,10 +934,6 @@ static int clear_fatent(fsdata *mydata, __u32 entry)
 		entry = fat_val;
 	}
 
-	/* Flush fat buffer */
-	if (flush_dirty_fat_buffer(mydata) < 0)
-		return -1;
-
 	return 0;
 }
 
@@ -728,7 +985,7 @@ set_contents(fsdata *mydata, dir_entry *dentptr, loff_t pos, __u8 *buffer,
 {
 	unsigned int bytesperclust = mydata->clust_size * mydata->sect_size;
 	__u32 curclust = START(dentptr);
-	__u32 endclust = 0, newclust = 0;
+	__u32 endclust = 0, newclust = 0, count;
 	u64 cur_pos, filesize;
 	loff_t offset, actsize, wsize;
 
@@ -866,9 +1123,15 @@ set_clusters:
 	/* allocate and write */
 	assert(!pos);
 
+	count = div_u64(filesize + bytesperclust - 1, bytesperclust);
+	if (!build_free_map(mydata) && count > fat_free.free) {
+		printf("Error: no space left: %llu\n", filesize);
+		return -1;
+	}
+
 	/* Assure that curclust is valid */
 	if (!curclust) {
-		curclust = find_empty_cluster(mydata);
+		curclust = find_empty_cluster(mydata, count);
 		set_start_cluster(mydata, dentptr, curclust);
 	} else {
 		newclust = get_fatent(mydata, curclust);
@@ -1115,6 +1378,7 @@ int file_fat_write_at(const char *filename, loff_t pos, void *buffer,
 		goto exit;
 
 	total_sector = datablock.total_sect;
+	check_free_map();
 
 	ret = fat_itr_resolve(itr, parent, TYPE_DIR);
 	if (ret) {
@@ -1208,7 +1472,7 @@ int file_fat_write_at(const char *filename, loff_t pos, void *buffer,
 
 exit:
 	free(filename_copy);
-	free(mydata->fatbuf);
+	free_fat_buffers(mydata);
 	free(itr);
 	return ret;
 }
@@ -1224,7 +1488,7 @@ static int fat_dir_entries(fat_itr *itr)
 	fat_itr *dirs;
 	fsdata fsdata = { .fatbuf = NULL, }, *mydata = &fsdata;
 						/* for FATBUFSIZE */
-	int count;
+	int count, i;
 
 	dirs = malloc_cache_aligned(sizeof(fat_itr));
 	if (!dirs) {
@@ -1238,6 +1502,11 @@ static int fat_dir_entries(fat_itr *itr)
 	fsdata = *dirs->fsdata;
 
 	/* allocate local fat buffer */
+	for (i = 0; i < FATBUFWINDOWS - 1; i++) {
+		fsdata.fatcache[i] = NULL;
+		fsdata.fatcachenum[i] = -1;
+		fsdata.fatcachedirty[i] = 0;
+	}
 	fsdata.fatbuf = malloc_cache_aligned(FATBUFSIZE);
 	if (!fsdata.fatbuf) {
 		debug("Error: allocating memory\n");
@@ -1251,7 +1520,7 @@ static int fat_dir_entries(fat_itr *itr)
 		;
 
 exit:
-	free(fsdata.fatbuf);
+	free_fat_buffers(&fsdata);
 	free(dirs);
 	return count;
 }
@@ -1318,6 +1587,7 @@ int fat_unlink(const char *filename)
 		goto exit;
 
 	total_sector = fsdata.total_sect;
+	check_free_map();
 
 	ret = fat_itr_resolve(itr, dirname, TYPE_DIR);
 	if (ret) {
@@ -1349,7 +1619,7 @@ int fat_unlink(const char *filename)
 	ret = delete_dentry(itr);
 
 exit:
-	free(fsdata.fatbuf);
+	free_fat_buffers(&fsdata);
 	free(itr);
 	free(filename_copy);
 
@@ -1396,6 +1666,7 @@ int fat_mkdir(const char *new_dirname)
 		goto exit;
 
 	total_sector = datablock.total_sect;
+	check_free_map();
 
 	ret = fat_itr_resolve(itr, parent, TYPE_DIR);
 	if (ret) {
@@ -1485,7 +1756,7 @@ int fat_mkdir(const char *new_dirname)
 
 exit:
 	free(dirname_copy);
-	free(mydata->fatbuf);
+	free_fat_buffers(mydata);
 	free(itr);
 	free(dotdent);
 	return ret;
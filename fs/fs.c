@@ -3,6 +3,7 @@
  * Copyright (c) 2012, NVIDIA CORPORATION.  All rights reserved.
  */
 
+#include <blk.h>
 #include <command.h>
 #include <config.h>
 #include <errno.h>
@@ -18,6 +19,8 @@
 #include <sandboxfs.h>
 #include <ubifs_uboot.h>
 #include <btrfs.h>
+#include <squashfs.h>
+#include <erofs.h>
 #include <asm/io.h>
 #include <div64.h>
 #include <linux/math64.h>
@@ -276,6 +279,48 @@ static struct fstype_info fstypes[] = {
 		.mkdir = fs_mkdir_unsupported,
 		.ln = fs_ln_unsupported,
 	},
+#endif
+#ifdef CONFIG_FS_SQUASHFS
+	{
+		.fstype = FS_TYPE_SQUASHFS,
+		.name = "squashfs",
+		.null_dev_desc_ok = false,
+		.probe = sqfs_probe,
+		.close = sqfs_close,
+		.ls = fs_ls_generic,
+		.exists = sqfs_exists,
+		.size = sqfs_size,
+		.read = sqfs_read,
+		.write = fs_write_unsupported,
+		.uuid = fs_uuid_unsupported,
+		.opendir = sqfs_opendir,
+		.readdir = sqfs_readdir,
+		.closedir = sqfs_closedir,
+		.unlink = fs_unlink_unsupported,
+		.mkdir = fs_mkdir_unsupported,
+		.ln = fs_ln_unsupported,
+	},
+#endif
+#ifdef CONFIG_FS_EROFS
+	{
+		.fstype = FS_TYPE_EROFS,
+		.name = "erofs",
+		.null_dev_desc_ok = false,
+		.probe = erofs_probe,
+		.close = erofs_close,
+		.ls = fs_ls_generic,
+		.exists = erofs_exists,
+		.size = erofs_size,
+		.read = erofs_read,
+		.write = fs_write_unsupported,
+		.uuid = erofs_uuid,
+		.opendir = erofs_opendir,
+		.readdir = erofs_readdir,
+		.closedir = erofs_closedir,
+		.unlink = fs_unlink_unsupported,
+		.mkdir = fs_mkdir_unsupported,
+		.ln = fs_ln_unsupported,
+	},
 #endif
 	{
 		.fstype = FS_TYPE_ANY,
@@ -336,6 +381,110 @@ const char *fs_get_type_name(void)
 	return fs_get_info(fs_type)->name;
 }
 
+#if CONFIG_IS_ENABLED(FS_MOUNT_CACHE)
+/*
+ * The filesystem which fs_close() left mounted, so that the next command on
+ * the same partition can skip probing it. It is only valid for as long as
+ * the block cache generation stays the same: any write to a block device,
+ * a block cache flush or a device going away forces a fresh probe.
+ */
+static struct {
+	int fstype;		/* FS_TYPE_ANY if nothing is mounted */
+	struct blk_desc *desc;
+	int part;
+	lbaint_t start;
+	lbaint_t size;
+	unsigned int gen;
+} fs_mount = {
+	.fstype = FS_TYPE_ANY,
+};
+
+void fs_close_cached(void)
+{
+	int fstype = fs_mount.fstype;
+
+	if (fstype == FS_TYPE_ANY)
+		return;
+	fs_mount.fstype = FS_TYPE_ANY;
+	if (fs_type == fstype)
+		fs_type = FS_TYPE_ANY;
+	fs_get_info(fstype)->close();
+}
+
+/* Use the mounted filesystem if it is on the current partition */
+static bool fs_mount_lookup(int fstype, int part)
+{
+	if (fs_mount.fstype == FS_TYPE_ANY)
+		return false;
+
+	if (fs_mount.gen == blkcache_generation() &&
+	    fs_mount.desc == fs_dev_desc && fs_mount.part == part &&
+	    fs_mount.start == fs_partition.start &&
+	    fs_mount.size == fs_partition.size &&
+	    (fstype == FS_TYPE_ANY || fstype == fs_mount.fstype)) {
+		fs_type = fs_mount.fstype;
+		fs_dev_part = part;
+		return true;
+	}
+
+	/* The drivers can only have one filesystem mounted at a time */
+	fs_close_cached();
+
+	return false;
+}
+
+/* Remember the filesystem which was just probed */
+static void fs_mount_add(void)
+{
+	/* Virtual filesystems are cheap to probe */
+	if (!fs_dev_desc)
+		return;
+
+	fs_mount.fstype = fs_type;
+	fs_mount.desc = fs_dev_desc;
+	fs_mount.part = fs_dev_part;
+	fs_mount.start = fs_partition.start;
+	fs_mount.size = fs_partition.size;
+	fs_mount.gen = blkcache_generation();
+}
+
+/* Check whether fs_close() can leave the current filesystem mounted */
+static bool fs_mount_keep(void)
+{
+	if (fs_type == FS_TYPE_ANY || fs_type != fs_mount.fstype)
+		return false;
+	if (fs_mount.gen == blkcache_generation())
+		return true;
+	fs_mount.fstype = FS_TYPE_ANY;
+
+	return false;
+}
+
+/*
+ * Stop fs_close() keeping the current filesystem mounted, after an operation
+ * which may have changed the driver's state even if nothing was written
+ */
+static void fs_mount_drop(void)
+{
+	if (fs_type == fs_mount.fstype)
+		fs_mount.fstype = FS_TYPE_ANY;
+}
+#else
+static inline bool fs_mount_lookup(int fstype, int part)
+{
+	return false;
+}
+
+static inline void fs_mount_add(void) {}
+
+static inline bool fs_mount_keep(void)
+{
+	return false;
+}
+
+static inline void fs_mount_drop(void) {}
+#endif
+
 int fs_set_blk_dev(const char *ifname, const char *dev_part_str, int fstype)
 {
 	struct fstype_info *info;
@@ -362,6 +511,9 @@ int fs_set_blk_dev(const char *ifname, const char *dev_part_str, int fstype)
 	if (part < 0)
 		return -1;
 
+	if (fs_mount_lookup(fstype, part))
+		return 0;
+
 	for (i = 0, info = fstypes; i < ARRAY_SIZE(fstypes); i++, info++) {
 		if (fstype != FS_TYPE_ANY && info->fstype != FS_TYPE_ANY &&
 				fstype != info->fstype)
@@ -373,6 +525,7 @@ int fs_set_blk_dev(const char *ifname, const char *dev_part_str, int fstype)
 		if (!info->probe(fs_dev_desc, &fs_partition)) {
 			fs_type = info->fstype;
 			fs_dev_part = part;
+			fs_mount_add();
 			return 0;
 		}
 	}
@@ -394,10 +547,14 @@ int fs_set_blk_dev_with_part(struct blk_desc *desc, int part)
 		return ret;
 	fs_dev_desc = desc;
 
+	if (fs_mount_lookup(FS_TYPE_ANY, part))
+		return 0;
+
 	for (i = 0, info = fstypes; i < ARRAY_SIZE(fstypes); i++, info++) {
 		if (!info->probe(fs_dev_desc, &fs_partition)) {
 			fs_type = info->fstype;
 			fs_dev_part = part;
+			fs_mount_add();
 			return 0;
 		}
 	}
@@ -409,7 +566,8 @@ void fs_close(void)
 {
 	struct fstype_info *info = fs_get_info(fs_type);
 
-	info->close();
+	if (!fs_mount_keep())
+		info->close();
 
 	fs_type = FS_TYPE_ANY;
 }
@@ -547,6 +705,7 @@ int fs_write(const char *filename, ulong addr, loff_t offset, loff_t len,
 		printf("** Unable to write file %s **\n", filename);
 		ret = -1;
 	}
+	fs_mount_drop();
 	fs_close();
 
 	return ret;
@@ -612,6 +771,7 @@ int fs_unlink(const char *filename)
 
 	ret = info->unlink(filename);
 
+	fs_mount_drop();
 	fs_close();
 
 	return ret;
@@ -625,6 +785,7 @@ int fs_mkdir(const char *dirname)
 
 	ret = info->mkdir(dirname);
 
+	fs_mount_drop();
 	fs_close();
 
 	return ret;
@@ -641,6 +802,7 @@ int fs_ln(const char *fname, const char *target)
 		printf("** Unable to create link %s -> %s **\n", fname, target);
 		ret = -1;
 	}
+	fs_mount_drop();
 	fs_close();
 
 	return ret;
@@ -0,0 +1,1055 @@
+// SPDX-License-Identifier: GPL-2.0+
+/*
+ * Read-only SquashFS 4.0 filesystem support
+ *
+ * Inodes and directories live in metadata blocks of up to 8KiB, each
+ * compressed on its own. File data is stored in blocks of the filesystem's
+ * block size, with the tail of small files packed into shared fragment
+ * blocks. Decompressed metadata, fragment and data blocks are kept in small
+ * LRU caches until the filesystem is closed, so that walking a path or
+ * loading several small files does not decompress the same block again.
+ *
+ * Names are looked up with the directory index where the directory has one,
+ * so that only the metadata block holding the name needs to be scanned.
+ * Blocks which are wanted whole are read from the device in runs and
+ * decompressed straight into the caller's buffer.
+ */
+
+#include <common.h>
+#include <blk.h>
+#include <errno.h>
+#include <fs.h>
+#include <fs_internal.h>
+#include <log.h>
+#include <malloc.h>
+#include <memalign.h>
+#include <part.h>
+#include <squashfs.h>
+#include <asm/unaligned.h>
+#include <linux/kernel.h>
+#include <linux/list.h>
+
+#include "sqfs_decompressor.h"
+#include "sqfs_filesystem.h"
+
+/* Number of decompressed blocks kept in each cache */
+#define SQFS_META_CACHE_BLOCKS	32
+#define SQFS_FRAG_CACHE_BLOCKS	4
+#define SQFS_DATA_CACHE_BLOCKS	2
+
+/* Most compressed data read from the device at once */
+#define SQFS_READ_RUN		(256 * 1024)
+
+#define SQFS_NAME_LEN		256
+#define SQFS_MAX_SYMLINKS	8
+#define SQFS_MAX_DEPTH		64
+#define SQFS_SYMLINK_MAX	4096
+
+/**
+ * struct sqfs_cache_entry - a decompressed block
+ *
+ * @list:	Entry in the cache's LRU list
+ * @start:	Position of the block on the device, or ~0 if not valid
+ * @next:	Position of the following block, for metadata blocks
+ * @len:	Number of bytes of decompressed data
+ * @data:	Decompressed data
+ */
+struct sqfs_cache_entry {
+	struct list_head list;
+	u64 start;
+	u64 next;
+	size_t len;
+	u8 *data;
+};
+
+/**
+ * struct sqfs_cache - a set of decompressed blocks
+ *
+ * @lru:	Entries, most recently used first
+ * @count:	Number of entries allocated
+ * @max:	Most entries to allocate
+ * @size:	Size of each entry's buffer in bytes
+ */
+struct sqfs_cache {
+	struct list_head lru;
+	unsigned int count;
+	unsigned int max;
+	size_t size;
+};
+
+/**
+ * struct sqfs_meta_pos - a position in the metadata
+ *
+ * @block:	Position of the metadata block on the device
+ * @offset:	Offset into the decompressed block. This may be past the end
+ *		of the block, in which case it continues in the next ones
+ */
+struct sqfs_meta_pos {
+	u64 block;
+	u32 offset;
+};
+
+/**
+ * struct sqfs_inode - the parts of an inode which are used here
+ *
+ * Extended inode types are reported as the matching basic type.
+ *
+ * @type:	Inode type (SQFS_..._TYPE, basic types only)
+ * @size:	File size, size of the directory listing or length of the
+ *		symlink target
+ * @pos:	Position of the type-specific data which follows the inode:
+ *		the block list, directory index or symlink target
+ * @dir:	Start of the directory listing
+ * @i_count:	Number of directory index entries
+ * @start_block: Position of the first data block on the device
+ * @fragment:	Fragment holding the tail of the file, or SQFS_INVALID_FRAG
+ * @frag_offset: Offset of the tail in the fragment block
+ * @nblocks:	Number of data blocks
+ */
+struct sqfs_inode {
+	int type;
+	u64 size;
+	struct sqfs_meta_pos pos;
+	struct sqfs_meta_pos dir;
+	u32 i_count;
+	u64 start_block;
+	u32 fragment;
+	u32 frag_offset;
+	u32 nblocks;
+};
+
+/**
+ * struct sqfs_dir_iter - position while reading a directory listing
+ *
+ * @pos:	Position of the next header or entry
+ * @left:	Number of bytes of the listing left
+ * @count:	Number of entries left under the current header
+ * @start:	Inode table block of the current header's entries
+ */
+struct sqfs_dir_iter {
+	struct sqfs_meta_pos pos;
+	u64 left;
+	u32 count;
+	u32 start;
+};
+
+struct sqfs_dir_stream {
+	struct fs_dir_stream fs_dirs;
+	struct fs_dirent dirent;
+	struct sqfs_dir_iter iter;
+};
+
+static struct sqfs_ctxt {
+	struct blk_desc *desc;
+	struct disk_partition *part;
+	u32 block_size;
+	u16 block_log;
+	u64 bytes_used;
+	u64 root_inode;
+	u64 inode_table;
+	u64 dir_table;
+	u32 fragments;
+	__le64 *frag_index;
+	/* Compressed data read from the device */
+	u8 *comp_buf;
+	size_t comp_size;
+	struct sqfs_cache meta;
+	struct sqfs_cache frag;
+	struct sqfs_cache data;
+} ctxt;
+
+static int sqfs_disk_read(u64 start, size_t len, void *buf)
+{
+	struct blk_desc *desc = ctxt.desc;
+
+	if (!fs_devread(desc, ctxt.part, start >> desc->log2blksz,
+			start & (desc->blksz - 1), len, buf))
+		return -EIO;
+
+	return 0;
+}
+
+static void sqfs_cache_init(struct sqfs_cache *cache, unsigned int max,
+			    size_t size)
+{
+	INIT_LIST_HEAD(&cache->lru);
+	cache->count = 0;
+	cache->max = max;
+	cache->size = size;
+}
+
+static void sqfs_cache_free(struct sqfs_cache *cache)
+{
+	struct sqfs_cache_entry *entry, *tmp;
+
+	if (!cache->max)
+		return;
+	list_for_each_entry_safe(entry, tmp, &cache->lru, list) {
+		list_del(&entry->list);
+		free(entry->data);
+		free(entry);
+	}
+	cache->count = 0;
+}
+
+static struct sqfs_cache_entry *sqfs_cache_find(struct sqfs_cache *cache,
+						u64 start)
+{
+	struct sqfs_cache_entry *entry;
+
+	list_for_each_entry(entry, &cache->lru, list) {
+		if (entry->start == start) {
+			list_move(&entry->list, &cache->lru);
+			return entry;
+		}
+	}
+
+	return NULL;
+}
+
+/* Get an entry to fill, reusing the least recently used one if need be */
+static struct sqfs_cache_entry *sqfs_cache_slot(struct sqfs_cache *cache)
+{
+	struct sqfs_cache_entry *entry = NULL;
+
+	if (cache->count < cache->max) {
+		entry = malloc(sizeof(*entry));
+		if (entry) {
+			entry->data = malloc(cache->size);
+			if (entry->data) {
+				list_add(&entry->list, &cache->lru);
+				cache->count++;
+			} else {
+				free(entry);
+				entry = NULL;
+			}
+		}
+	}
+	if (!entry) {
+		if (list_empty(&cache->lru))
+			return NULL;
+		entry = list_last_entry(&cache->lru, struct sqfs_cache_entry,
+					list);
+		list_move(&entry->list, &cache->lru);
+	}
+	entry->start = ~0ULL;
+
+	return entry;
+}
+
+/**
+ * sqfs_read_block() - Get a data or fragment block through a cache
+ *
+ * @cache:	Cache to use
+ * @start:	Position of the block on the device
+ * @size:	Size of the block from the block list or fragment table
+ * @entryp:	Returns the cache entry holding the block
+ * @return 0 if OK, -ENOMEM if out of memory, -EIO on a read error or a
+ *	corrupt block
+ */
+static int sqfs_read_block(struct sqfs_cache *cache, u64 start, u32 size,
+			   struct sqfs_cache_entry **entryp)
+{
+	struct sqfs_cache_entry *entry;
+	u32 len = SQFS_BLOCK_LEN(size);
+	int ret;
+
+	entry = sqfs_cache_find(cache, start);
+	if (entry) {
+		*entryp = entry;
+		return 0;
+	}
+	if (!len || len > ctxt.block_size || start + len > ctxt.bytes_used)
+		return -EIO;
+	entry = sqfs_cache_slot(cache);
+	if (!entry)
+		return -ENOMEM;
+
+	if (size & SQFS_BLOCK_UNCOMPRESSED) {
+		ret = sqfs_disk_read(start, len, entry->data);
+		entry->len = len;
+	} else {
+		ret = sqfs_disk_read(start, len, ctxt.comp_buf);
+		entry->len = cache->size;
+		if (!ret)
+			ret = sqfs_decompress(entry->data, &entry->len,
+					      ctxt.comp_buf, len);
+	}
+	if (ret)
+		return ret;
+	entry->start = start;
+	*entryp = entry;
+
+	return 0;
+}
+
+static int sqfs_read_meta_block(u64 start, struct sqfs_cache_entry **entryp)
+{
+	struct sqfs_cache_entry *entry;
+	size_t avail;
+	u16 hdr, len;
+	int ret;
+
+	entry = sqfs_cache_find(&ctxt.meta, start);
+	if (entry) {
+		*entryp = entry;
+		return 0;
+	}
+	if (start + sizeof(hdr) > ctxt.bytes_used)
+		return -EIO;
+	entry = sqfs_cache_slot(&ctxt.meta);
+	if (!entry)
+		return -ENOMEM;
+
+	/* Read the header and the largest possible block in one go */
+	avail = min_t(u64, sizeof(hdr) + SQFS_METADATA_SIZE,
+		      ctxt.bytes_used - start);
+	ret = sqfs_disk_read(start, avail, ctxt.comp_buf);
+	if (ret)
+		return ret;
+	hdr = get_unaligned_le16(ctxt.comp_buf);
+	len = SQFS_METADATA_LEN(hdr);
+	if (!len || len > SQFS_METADATA_SIZE || sizeof(hdr) + len > avail)
+		return -EIO;
+
+	if (hdr & SQFS_METADATA_UNCOMPRESSED) {
+		memcpy(entry->data, ctxt.comp_buf + sizeof(hdr), len);
+		entry->len = len;
+	} else {
+		entry->len = SQFS_METADATA_SIZE;
+		ret = sqfs_decompress(entry->data, &entry->len,
+				      ctxt.comp_buf + sizeof(hdr), len);
+		if (ret)
+			return ret;
+		if (!entry->len)
+			return -EIO;
+	}
+	entry->start = start;
+	entry->next = start + sizeof(hdr) + len;
+	*entryp = entry;
+
+	return 0;
+}
+
+/**
+ * sqfs_read_meta() - Read metadata, which may span several blocks
+ *
+ * @pos:	Position to read from, advanced past the data read
+ * @buf:	Buffer for the data
+ * @len:	Number of bytes to read
+ * @return 0 if OK, -ve on error
+ */
+static int sqfs_read_meta(struct sqfs_meta_pos *pos, void *buf, size_t len)
+{
+	struct sqfs_cache_entry *entry;
+	size_t count;
+	int ret;
+
+	while (len) {
+		ret = sqfs_read_meta_block(pos->block, &entry);
+		if (ret)
+			return ret;
+		if (pos->offset >= entry->len) {
+			pos->offset -= entry->len;
+			pos->block = entry->next;
+			continue;
+		}
+		count = min(len, entry->len - pos->offset);
+		memcpy(buf, entry->data + pos->offset, count);
+		pos->offset += count;
+		buf += count;
+		len -= count;
+	}
+
+	return 0;
+}
+
+static int sqfs_read_inode(u64 ref, struct sqfs_inode *inode)
+{
+	struct sqfs_meta_pos pos = {
+		.block = ctxt.inode_table + SQFS_INODE_BLOCK(ref),
+		.offset = SQFS_INODE_OFFSET(ref),
+	};
+	struct sqfs_base_inode base;
+	union {
+		struct sqfs_dir_inode dir;
+		struct sqfs_ldir_inode ldir;
+		struct sqfs_reg_inode reg;
+		struct sqfs_lreg_inode lreg;
+		struct sqfs_symlink_inode symlink;
+	} u;
+	int ret;
+
+	ret = sqfs_read_meta(&pos, &base, sizeof(base));
+	if (ret)
+		return ret;
+	memset(inode, '\0', sizeof(*inode));
+	inode->type = le16_to_cpu(base.inode_type);
+	inode->fragment = SQFS_INVALID_FRAG;
+
+	switch (inode->type) {
+	case SQFS_DIR_TYPE:
+		ret = sqfs_read_meta(&pos, &u.dir, sizeof(u.dir));
+		inode->size = le16_to_cpu(u.dir.file_size);
+		inode->dir.block = ctxt.dir_table +
+				   le32_to_cpu(u.dir.start_block);
+		inode->dir.offset = le16_to_cpu(u.dir.offset);
+		break;
+	case SQFS_LDIR_TYPE:
+		ret = sqfs_read_meta(&pos, &u.ldir, sizeof(u.ldir));
+		inode->size = le32_to_cpu(u.ldir.file_size);
+		inode->dir.block = ctxt.dir_table +
+				   le32_to_cpu(u.ldir.start_block);
+		inode->dir.offset = le16_to_cpu(u.ldir.offset);
+		inode->i_count = le16_to_cpu(u.ldir.i_count);
+		break;
+	case SQFS_REG_TYPE:
+		ret = sqfs_read_meta(&pos, &u.reg, sizeof(u.reg));
+		inode->size = le32_to_cpu(u.reg.file_size);
+		inode->start_block = le32_to_cpu(u.reg.start_block);
+		inode->fragment = le32_to_cpu(u.reg.fragment);
+		inode->frag_offset = le32_to_cpu(u.reg.offset);
+		break;
+	case SQFS_LREG_TYPE:
+		ret = sqfs_read_meta(&pos, &u.lreg, sizeof(u.lreg));
+		inode->size = le64_to_cpu(u.lreg.file_size);
+		inode->start_block = le64_to_cpu(u.lreg.start_block);
+		inode->fragment = le32_to_cpu(u.lreg.fragment);
+		inode->frag_offset = le32_to_cpu(u.lreg.offset);
+		break;
+	case SQFS_SYMLINK_TYPE:
+	case SQFS_LSYMLINK_TYPE:
+		ret = sqfs_read_meta(&pos, &u.symlink, sizeof(u.symlink));
+		inode->size = le32_to_cpu(u.symlink.symlink_size);
+		break;
+	case SQFS_BLKDEV_TYPE ... SQFS_SOCKET_TYPE:
+	case SQFS_LBLKDEV_TYPE ... SQFS_LSOCKET_TYPE:
+		break;
+	default:
+		return -EIO;
+	}
+	if (ret)
+		return ret;
+	if (inode->type >= SQFS_LDIR_TYPE)
+		inode->type -= SQFS_LDIR_TYPE - SQFS_DIR_TYPE;
+	inode->pos = pos;
+
+	if (inode->type == SQFS_DIR_TYPE) {
+		/* The listing size includes the . and .. entries */
+		inode->size = inode->size > 3 ? inode->size - 3 : 0;
+	} else if (inode->type == SQFS_REG_TYPE) {
+		if (inode->fragment == SQFS_INVALID_FRAG)
+			inode->nblocks = (inode->size + ctxt.block_size - 1) >>
+					 ctxt.block_log;
+		else
+			inode->nblocks = inode->size >> ctxt.block_log;
+	}
+
+	return 0;
+}
+
+static void sqfs_dir_start(struct sqfs_inode *dir, struct sqfs_dir_iter *iter)
+{
+	iter->pos = dir->dir;
+	iter->left = dir->size;
+	iter->count = 0;
+}
+
+/**
+ * sqfs_dir_next() - Read the next entry of a directory listing
+ *
+ * @iter:	Position in the listing
+ * @name:	Returns the entry name, SQFS_NAME_LEN + 1 bytes
+ * @ref:	Returns the inode reference
+ * @type:	Returns the basic inode type
+ * @return 0 if OK, -ENOENT at the end of the listing, other -ve on error
+ */
+static int sqfs_dir_next(struct sqfs_dir_iter *iter, char *name, u64 *ref,
+			 int *type)
+{
+	struct sqfs_dir_header hdr;
+	struct sqfs_dir_entry ent;
+	u32 size;
+	int ret;
+
+	if (!iter->count) {
+		if (iter->left < sizeof(hdr))
+			return -ENOENT;
+		ret = sqfs_read_meta(&iter->pos, &hdr, sizeof(hdr));
+		if (ret)
+			return ret;
+		iter->left -= sizeof(hdr);
+		iter->count = le32_to_cpu(hdr.count) + 1;
+		iter->start = le32_to_cpu(hdr.start);
+		if (iter->count > SQFS_NAME_LEN)
+			return -EIO;
+	}
+
+	if (iter->left < sizeof(ent))
+		return -EIO;
+	ret = sqfs_read_meta(&iter->pos, &ent, sizeof(ent));
+	if (ret)
+		return ret;
+	size = le16_to_cpu(ent.size) + 1;
+	if (size > SQFS_NAME_LEN || iter->left < sizeof(ent) + size)
+		return -EIO;
+	ret = sqfs_read_meta(&iter->pos, name, size);
+	if (ret)
+		return ret;
+	name[size] = '\0';
+	iter->left -= sizeof(ent) + size;
+	iter->count--;
+
+	*ref = ((u64)iter->start << 16) | le16_to_cpu(ent.offset);
+	*type = le16_to_cpu(ent.type);
+	if (*type >= SQFS_LDIR_TYPE)
+		*type -= SQFS_LDIR_TYPE - SQFS_DIR_TYPE;
+
+	return 0;
+}
+
+/*
+ * Move @iter to the last index entry whose name does not sort after @name.
+ * Each index entry records where a listing header starts, together with the
+ * first name under it.
+ */
+static int sqfs_dir_seek(struct sqfs_inode *dir, const char *name,
+			 struct sqfs_dir_iter *iter)
+{
+	struct sqfs_meta_pos pos = dir->pos;
+	struct sqfs_dir_index index;
+	char iname[SQFS_NAME_LEN + 1];
+	u32 i, size, offset;
+	int ret;
+
+	for (i = 0; i < dir->i_count; i++) {
+		ret = sqfs_read_meta(&pos, &index, sizeof(index));
+		if (ret)
+			return ret;
+		size = le32_to_cpu(index.size) + 1;
+		if (size > SQFS_NAME_LEN)
+			return -EIO;
+		ret = sqfs_read_meta(&pos, iname, size);
+		if (ret)
+			return ret;
+		iname[size] = '\0';
+		if (strcmp(iname, name) > 0)
+			break;
+
+		offset = le32_to_cpu(index.index);
+		if (offset > dir->size)
+			return -EIO;
+		iter->pos.block = ctxt.dir_table +
+				  le32_to_cpu(index.start_block);
+		iter->pos.offset = (dir->dir.offset + offset) %
+				   SQFS_METADATA_SIZE;
+		iter->left = dir->size - offset;
+		iter->count = 0;
+	}
+
+	return 0;
+}
+
+static int sqfs_dir_lookup(struct sqfs_inode *dir, const char *name, u64 *ref)
+{
+	char ename[SQFS_NAME_LEN + 1];
+	struct sqfs_dir_iter iter;
+	int ret, cmp, type;
+
+	sqfs_dir_start(dir, &iter);
+	ret = sqfs_dir_seek(dir, name, &iter);
+	if (ret)
+		return ret;
+
+	/* The listing is sorted by name */
+	while (!(ret = sqfs_dir_next(&iter, ename, ref, &type))) {
+		cmp = strcmp(ename, name);
+		if (!cmp)
+			return 0;
+		if (cmp > 0)
+			return -ENOENT;
+	}
+
+	return ret;
+}
+
+/**
+ * sqfs_lookup() - Find the inode for a path
+ *
+ * Symbolic links are followed in the directories of the path, and also at
+ * the end if @follow is set.
+ *
+ * @path:	Path from the root directory
+ * @inode:	Returns the inode
+ * @follow:	true to follow a symbolic link at the end of the path
+ * @return 0 if OK, -ENOENT if not found, -ENOTDIR if a directory in the
+ *	path is not one, -ELOOP if there are too many symbolic links, other -ve
+ *	on error
+ */
+static int sqfs_lookup(const char *path, struct sqfs_inode *inode,
+		       bool follow)
+{
+	u64 stack[SQFS_MAX_DEPTH];
+	int depth = 0, links = 0;
+	char *buf, *rest, *name, *target;
+	size_t len;
+	u64 ref;
+	int ret;
+
+	buf = strdup(path);
+	if (!buf)
+		return -ENOMEM;
+	stack[0] = ctxt.root_inode;
+	ret = sqfs_read_inode(stack[0], inode);
+	rest = buf;
+
+	while (!ret && rest) {
+		name = strsep(&rest, "/");
+		if (!*name || !strcmp(name, "."))
+			continue;
+		if (inode->type != SQFS_DIR_TYPE) {
+			ret = -ENOTDIR;
+			break;
+		}
+		if (!strcmp(name, "..")) {
+			if (depth)
+				depth--;
+			ret = sqfs_read_inode(stack[depth], inode);
+			continue;
+		}
+		if (strlen(name) > SQFS_NAME_LEN) {
+			ret = -ENOENT;
+			break;
+		}
+
+		ret = sqfs_dir_lookup(inode, name, &ref);
+		if (!ret)
+			ret = sqfs_read_inode(ref, inode);
+		if (ret)
+			break;
+		if (inode->type != SQFS_SYMLINK_TYPE ||
+		    (!rest && !follow)) {
+			if (depth == SQFS_MAX_DEPTH - 1) {
+				ret = -ENAMETOOLONG;
+				break;
+			}
+			stack[++depth] = ref;
+			continue;
+		}
+
+		/* Carry on with the link target followed by the rest */
+		if (++links > SQFS_MAX_SYMLINKS) {
+			ret = -ELOOP;
+			break;
+		}
+		if (!inode->size || inode->size > SQFS_SYMLINK_MAX) {
+			ret = -EIO;
+			break;
+		}
+		len = inode->size + 1 + (rest ? strlen(rest) : 0);
+		target = malloc(len + 1);
+		if (!target) {
+			ret = -ENOMEM;
+			break;
+		}
+		ret = sqfs_read_meta(&inode->pos, target, inode->size);
+		target[inode->size] = '\0';
+		if (rest)
+			strcat(strcat(target, "/"), rest);
+		free(buf);
+		buf = target;
+		rest = buf;
+		if (*rest == '/')
+			depth = 0;
+		if (!ret)
+			ret = sqfs_read_inode(stack[depth], inode);
+	}
+	free(buf);
+
+	return ret;
+}
+
+static int sqfs_read_frag(struct sqfs_inode *inode, u32 offset, u32 len,
+			  u8 *out)
+{
+	struct sqfs_fragment_entry frag;
+	struct sqfs_cache_entry *entry;
+	struct sqfs_meta_pos pos;
+	int ret;
+
+	if (inode->fragment >= ctxt.fragments)
+		return -EIO;
+	pos.block = le64_to_cpu(ctxt.frag_index[inode->fragment /
+						SQFS_FRAGMENTS_PER_BLOCK]);
+	pos.offset = (inode->fragment % SQFS_FRAGMENTS_PER_BLOCK) *
+		     sizeof(frag);
+	ret = sqfs_read_meta(&pos, &frag, sizeof(frag));
+	if (ret)
+		return ret;
+
+	ret = sqfs_read_block(&ctxt.frag, le64_to_cpu(frag.start),
+			      le32_to_cpu(frag.size), &entry);
+	if (ret)
+		return ret;
+	if (inode->frag_offset + offset + len > entry->len)
+		return -EIO;
+	memcpy(out, entry->data + inode->frag_offset + offset, len);
+
+	return 0;
+}
+
+/*
+ * Read a run of @count data blocks, all wanted whole, straight into @out.
+ * @len is the number of bytes the run holds once decompressed.
+ */
+static int sqfs_read_run(u64 start, const __le32 *sizes, u32 count, u64 len,
+			 u8 *out)
+{
+	u64 clen = 0;
+	u32 i, size;
+	size_t dlen;
+	u8 *src;
+	int ret;
+
+	for (i = 0; i < count; i++)
+		clen += SQFS_BLOCK_LEN(le32_to_cpu(sizes[i]));
+	if (clen > ctxt.comp_size || start + clen > ctxt.bytes_used)
+		return -EIO;
+
+	/* A single uncompressed block can go straight to its place */
+	size = le32_to_cpu(sizes[0]);
+	if (count == 1 && (size & SQFS_BLOCK_UNCOMPRESSED)) {
+		if (clen != len)
+			return -EIO;
+		return sqfs_disk_read(start, clen, out);
+	}
+
+	ret = sqfs_disk_read(start, clen, ctxt.comp_buf);
+	if (ret)
+		return ret;
+	for (i = 0, src = ctxt.comp_buf; i < count; i++) {
+		size = le32_to_cpu(sizes[i]);
+		dlen = min_t(u64, len, ctxt.block_size);
+		if (size & SQFS_BLOCK_UNCOMPRESSED) {
+			if (SQFS_BLOCK_LEN(size) != dlen)
+				return -EIO;
+			memcpy(out, src, dlen);
+		} else {
+			ret = sqfs_decompress(out, &dlen, src,
+					      SQFS_BLOCK_LEN(size));
+			if (ret)
+				return ret;
+			if (dlen != min_t(u64, len, ctxt.block_size))
+				return -EIO;
+		}
+		src += SQFS_BLOCK_LEN(size);
+		out += dlen;
+		len -= dlen;
+	}
+
+	return 0;
+}
+
+static int sqfs_read_file(struct sqfs_inode *inode, u64 offset, u64 len,
+			  u8 *out)
+{
+	u32 first, last, i, n, size, clen;
+	u64 pos, blk_start, blk_len, end = offset + len;
+	u64 from, to, run_len;
+	struct sqfs_cache_entry *entry;
+	struct sqfs_meta_pos lpos;
+	__le32 *sizes = NULL;
+	int ret = 0;
+
+	first = offset >> ctxt.block_log;
+	last = min_t(u64, inode->nblocks,
+		     (end + ctxt.block_size - 1) >> ctxt.block_log);
+	pos = inode->start_block;
+	if (first < last) {
+		sizes = malloc(last * sizeof(*sizes));
+		if (!sizes)
+			return -ENOMEM;
+		lpos = inode->pos;
+		ret = sqfs_read_meta(&lpos, sizes, last * sizeof(*sizes));
+		if (ret)
+			goto out;
+
+		for (i = 0; i < last; i++) {
+			/* A block is never stored bigger than it is */
+			if (SQFS_BLOCK_LEN(le32_to_cpu(sizes[i])) >
+			    ctxt.block_size) {
+				ret = -EIO;
+				goto out;
+			}
+			/* Blocks are stored one after the other */
+			if (i < first)
+				pos += SQFS_BLOCK_LEN(le32_to_cpu(sizes[i]));
+		}
+	}
+
+	for (i = first; i < last; i += n) {
+		blk_start = (u64)i << ctxt.block_log;
+		blk_len = min_t(u64, ctxt.block_size, inode->size - blk_start);
+		from = max(offset, blk_start);
+		to = min(end, blk_start + blk_len);
+		size = le32_to_cpu(sizes[i]);
+		clen = SQFS_BLOCK_LEN(size);
+		n = 1;
+
+		if (!clen) {
+			/* Sparse block */
+			memset(out + from - offset, '\0', to - from);
+			continue;
+		}
+		if (from != blk_start || to != blk_start + blk_len) {
+			ret = sqfs_read_block(&ctxt.data, pos, size, &entry);
+			if (ret)
+				goto out;
+			if (to - blk_start > entry->len) {
+				ret = -EIO;
+				goto out;
+			}
+			memcpy(out + from - offset,
+			       entry->data + from - blk_start, to - from);
+			pos += clen;
+			continue;
+		}
+
+		/* Gather the following blocks which are wanted whole */
+		run_len = blk_len;
+		while (i + n < last) {
+			size = le32_to_cpu(sizes[i + n]);
+			blk_start = (u64)(i + n) << ctxt.block_log;
+			blk_len = min_t(u64, ctxt.block_size,
+					inode->size - blk_start);
+			if (!SQFS_BLOCK_LEN(size) ||
+			    blk_start + blk_len > end ||
+			    clen + SQFS_BLOCK_LEN(size) > ctxt.comp_size)
+				break;
+			clen += SQFS_BLOCK_LEN(size);
+			run_len += blk_len;
+			n++;
+		}
+		ret = sqfs_read_run(pos, sizes + i, n, run_len,
+				    out + from - offset);
+		if (ret)
+			goto out;
+		pos += clen;
+	}
+
+	/* The tail of the file may be in a fragment */
+	blk_start = (u64)inode->nblocks << ctxt.block_log;
+	if (inode->fragment != SQFS_INVALID_FRAG && end > blk_start) {
+		from = max(offset, blk_start);
+		ret = sqfs_read_frag(inode, from - blk_start, end - from,
+				     out + from - offset);
+	}
+
+out:
+	free(sizes);
+
+	return ret;
+}
+
+int sqfs_probe(struct blk_desc *fs_dev_desc,
+	       struct disk_partition *fs_partition)
+{
+	ALLOC_CACHE_ALIGN_BUFFER(struct sqfs_super_block, sblk, 1);
+	struct sqfs_inode root;
+	u32 nfrag_blocks;
+	u64 part_size;
+	int ret;
+
+	ctxt.desc = fs_dev_desc;
+	ctxt.part = fs_partition;
+	if (sqfs_disk_read(0, sizeof(*sblk), sblk) ||
+	    le32_to_cpu(sblk->s_magic) != SQFS_MAGIC)
+		return -EINVAL;
+
+	ctxt.block_size = le32_to_cpu(sblk->block_size);
+	ctxt.block_log = le16_to_cpu(sblk->block_log);
+	ctxt.bytes_used = le64_to_cpu(sblk->bytes_used);
+	ctxt.root_inode = le64_to_cpu(sblk->root_inode);
+	ctxt.inode_table = le64_to_cpu(sblk->inode_table_start);
+	ctxt.dir_table = le64_to_cpu(sblk->directory_table_start);
+	ctxt.fragments = le32_to_cpu(sblk->fragments);
+	part_size = (u64)fs_partition->size * fs_partition->blksz;
+	if (le16_to_cpu(sblk->s_major) != SQFS_MAJOR ||
+	    ctxt.block_log < SQFS_BLOCK_LOG_MIN ||
+	    ctxt.block_log > SQFS_BLOCK_LOG_MAX ||
+	    ctxt.block_size != 1 << ctxt.block_log ||
+	    ctxt.bytes_used > part_size) {
+		printf("SquashFS: unsupported or corrupt superblock\n");
+		return -EINVAL;
+	}
+
+	ret = sqfs_decompressor_init(le16_to_cpu(sblk->compression));
+	if (ret)
+		return ret;
+
+	ctxt.comp_size = max_t(size_t, SQFS_READ_RUN, ctxt.block_size);
+	ctxt.comp_buf = malloc_cache_aligned(ctxt.comp_size);
+	if (!ctxt.comp_buf)
+		goto nomem;
+	sqfs_cache_init(&ctxt.meta, SQFS_META_CACHE_BLOCKS,
+			SQFS_METADATA_SIZE);
+	sqfs_cache_init(&ctxt.frag, SQFS_FRAG_CACHE_BLOCKS, ctxt.block_size);
+	sqfs_cache_init(&ctxt.data, SQFS_DATA_CACHE_BLOCKS, ctxt.block_size);
+
+	if (ctxt.fragments) {
+		nfrag_blocks = DIV_ROUND_UP(ctxt.fragments,
+					    SQFS_FRAGMENTS_PER_BLOCK);
+		ctxt.frag_index = malloc_cache_aligned(nfrag_blocks *
+						       sizeof(__le64));
+		if (!ctxt.frag_index)
+			goto nomem;
+		ret = sqfs_disk_read(le64_to_cpu(sblk->fragment_table_start),
+				     nfrag_blocks * sizeof(__le64),
+				     ctxt.frag_index);
+		if (ret)
+			goto err;
+	}
+
+	ret = sqfs_read_inode(ctxt.root_inode, &root);
+	if (!ret && root.type != SQFS_DIR_TYPE)
+		ret = -EIO;
+	if (ret)
+		goto err;
+
+	return 0;
+
+nomem:
+	ret = -ENOMEM;
+err:
+	printf("SquashFS: cannot mount filesystem (err=%d)\n", ret);
+	sqfs_close();
+
+	return ret;
+}
+
+int sqfs_opendir(const char *filename, struct fs_dir_stream **dirsp)
+{
+	struct sqfs_dir_stream *dirs;
+	struct sqfs_inode dir;
+	int ret;
+
+	ret = sqfs_lookup(filename, &dir, true);
+	if (ret)
+		return ret;
+	if (dir.type != SQFS_DIR_TYPE)
+		return -ENOTDIR;
+
+	dirs = calloc(1, sizeof(*dirs));
+	if (!dirs)
+		return -ENOMEM;
+	sqfs_dir_start(&dir, &dirs->iter);
+	*dirsp = &dirs->fs_dirs;
+
+	return 0;
+}
+
+int sqfs_readdir(struct fs_dir_stream *fs_dirs, struct fs_dirent **dentp)
+{
+	char name[SQFS_NAME_LEN + 1];
+	struct sqfs_dir_stream *dirs;
+	struct fs_dirent *dent;
+	struct sqfs_inode inode;
+	int ret, type;
+	u64 ref;
+
+	dirs = container_of(fs_dirs, struct sqfs_dir_stream, fs_dirs);
+	dent = &dirs->dirent;
+	ret = sqfs_dir_next(&dirs->iter, name, &ref, &type);
+	if (ret)
+		return ret;
+
+	strlcpy(dent->name, name, sizeof(dent->name));
+	dent->size = 0;
+	switch (type) {
+	case SQFS_DIR_TYPE:
+		dent->type = FS_DT_DIR;
+		break;
+	case SQFS_SYMLINK_TYPE:
+		dent->type = FS_DT_LNK;
+		break;
+	case SQFS_REG_TYPE:
+		ret = sqfs_read_inode(ref, &inode);
+		if (ret)
+			return ret;
+		dent->size = inode.size;
+		/* fall through */
+	default:
+		dent->type = FS_DT_REG;
+		break;
+	}
+	*dentp = dent;
+
+	return 0;
+}
+
+void sqfs_closedir(struct fs_dir_stream *fs_dirs)
+{
+	free(container_of(fs_dirs, struct sqfs_dir_stream, fs_dirs));
+}
+
+int sqfs_exists(const char *filename)
+{
+	struct sqfs_inode inode;
+
+	return !sqfs_lookup(filename, &inode, true);
+}
+
+int sqfs_size(const char *filename, loff_t *size)
+{
+	struct sqfs_inode inode;
+	int ret;
+
+	ret = sqfs_lookup(filename, &inode, true);
+	if (ret)
+		return ret;
+	*size = inode.size;
+
+	return 0;
+}
+
+int sqfs_read(const char *filename, void *buf, loff_t offset, loff_t len,
+	      loff_t *actread)
+{
+	struct sqfs_inode inode;
+	int ret;
+
+	*actread = 0;
+	ret = sqfs_lookup(filename, &inode, true);
+	if (ret) {
+		printf("** File not found %s **\n", filename);
+		return ret;
+	}
+	if (inode.type != SQFS_REG_TYPE) {
+		printf("** %s is not a regular file **\n", filename);
+		return -EISDIR;
+	}
+	if (offset >= inode.size)
+		return 0;
+	if (!len || len > inode.size - offset)
+		len = inode.size - offset;
+
+	ret = sqfs_read_file(&inode, offset, len, buf);
+	if (ret) {
+		printf("** Error reading %s (err=%d) **\n", filename, ret);
+		return ret;
+	}
+	*actread = len;
+
+	return 0;
+}
+
+void sqfs_close(void)
+{
+	sqfs_cache_free(&ctxt.meta);
+	sqfs_cache_free(&ctxt.frag);
+	sqfs_cache_free(&ctxt.data);
+	free(ctxt.frag_index);
+	free(ctxt.comp_buf);
+	sqfs_decompressor_cleanup();
+	memset(&ctxt, '\0', sizeof(ctxt));
+}
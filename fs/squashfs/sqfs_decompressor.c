@@ -0,0 +1,152 @@
+// SPDX-License-Identifier: GPL-2.0+
+/*
+ * Decompression of SquashFS blocks, using the decompressors in lib/
+ *
+ * Every metadata and data block is compressed on its own, so each one is
+ * decompressed in a single call. The zstd context is set up once per mount
+ * and reused for every block.
+ */
+
+#include <common.h>
+#include <errno.h>
+#include <gzip.h>
+#include <log.h>
+#include <lz4.h>
+#include <malloc.h>
+#include <linux/lzo.h>
+#include <linux/zstd.h>
+#include <lzma/LzmaTypes.h>
+#include <lzma/LzmaTools.h>
+
+#include "sqfs_decompressor.h"
+#include "sqfs_filesystem.h"
+
+static int sqfs_comp;
+static void *zstd_workspace;
+static ZSTD_DCtx *zstd_dctx;
+
+static const char *const sqfs_comp_names[] = {
+	[SQFS_COMP_GZIP] = "gzip",
+	[SQFS_COMP_LZMA] = "lzma",
+	[SQFS_COMP_LZO] = "lzo",
+	[SQFS_COMP_XZ] = "xz",
+	[SQFS_COMP_LZ4] = "lz4",
+	[SQFS_COMP_ZSTD] = "zstd",
+};
+
+static bool sqfs_comp_supported(int comp)
+{
+	switch (comp) {
+	case SQFS_COMP_GZIP:
+		return IS_ENABLED(CONFIG_GZIP);
+	case SQFS_COMP_LZMA:
+		return IS_ENABLED(CONFIG_LZMA);
+	case SQFS_COMP_LZO:
+		return IS_ENABLED(CONFIG_LZO);
+	case SQFS_COMP_XZ:
+		return IS_ENABLED(CONFIG_LZMA_XZ);
+	case SQFS_COMP_LZ4:
+		return IS_ENABLED(CONFIG_LZ4);
+	case SQFS_COMP_ZSTD:
+		return IS_ENABLED(CONFIG_ZSTD);
+	default:
+		return false;
+	}
+}
+
+int sqfs_decompressor_init(int comp)
+{
+	if (!sqfs_comp_supported(comp)) {
+		if (comp > 0 && comp < ARRAY_SIZE(sqfs_comp_names))
+			printf("SquashFS: %s compression is not supported\n",
+			       sqfs_comp_names[comp]);
+		else
+			printf("SquashFS: unknown compression type %d\n", comp);
+		return -EPROTONOSUPPORT;
+	}
+	sqfs_comp = comp;
+
+#if IS_ENABLED(CONFIG_ZSTD)
+	if (comp == SQFS_COMP_ZSTD) {
+		size_t wsize = ZSTD_DCtxWorkspaceBound();
+
+		zstd_workspace = malloc(wsize);
+		if (!zstd_workspace)
+			return -ENOMEM;
+		zstd_dctx = ZSTD_initDCtx(zstd_workspace, wsize);
+		if (!zstd_dctx) {
+			sqfs_decompressor_cleanup();
+			return -ENOMEM;
+		}
+	}
+#endif
+
+	return 0;
+}
+
+int sqfs_decompress(void *dst, size_t *dst_len, const void *src,
+		    size_t src_len)
+{
+	int ret = -1;
+
+	switch (sqfs_comp) {
+#if IS_ENABLED(CONFIG_GZIP)
+	case SQFS_COMP_GZIP: {
+		unsigned long len = src_len;
+
+		/* Skip the zlib header; the trailer is not checked */
+		ret = zunzip(dst, *dst_len, (unsigned char *)src, &len, 1, 2);
+		*dst_len = len;
+		break;
+	}
+#endif
+#if IS_ENABLED(CONFIG_LZMA)
+	case SQFS_COMP_LZMA:
+	case SQFS_COMP_XZ: {
+		SizeT len = *dst_len;
+
+		ret = lzmaBuffToBuffDecompress(dst, &len, (unsigned char *)src,
+					       src_len);
+		*dst_len = len;
+		break;
+	}
+#endif
+#if IS_ENABLED(CONFIG_LZO)
+	case SQFS_COMP_LZO:
+		ret = lzo1x_decompress_safe(src, src_len, dst, dst_len);
+		break;
+#endif
+#if IS_ENABLED(CONFIG_LZ4)
+	case SQFS_COMP_LZ4:
+		ret = ulz4fn_block(src, src_len, dst, dst_len);
+		break;
+#endif
+#if IS_ENABLED(CONFIG_ZSTD)
+	case SQFS_COMP_ZSTD: {
+		size_t len;
+
+		len = ZSTD_decompressDCtx(zstd_dctx, dst, *dst_len, src,
+					  src_len);
+		if (ZSTD_isError(len))
+			break;
+		*dst_len = len;
+		ret = 0;
+		break;
+	}
+#endif
+	}
+	if (ret) {
+		log_debug("%s decompression failed (%d)\n",
+			  sqfs_comp_names[sqfs_comp], ret);
+		return -EIO;
+	}
+
+	return 0;
+}
+
+void sqfs_decompressor_cleanup(void)
+{
+	free(zstd_workspace);
+	zstd_workspace = NULL;
+	zstd_dctx = NULL;
+}
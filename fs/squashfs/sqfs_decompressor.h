@@ -0,0 +1,38 @@
+/* SPDX-License-Identifier: GPL-2.0+ */
+/*
+ * Decompression of SquashFS blocks
+ */
+
+#ifndef SQFS_DECOMPRESSOR_H
+#define SQFS_DECOMPRESSOR_H
+
+#include <linux/types.h>
+
+/**
+ * sqfs_decompressor_init() - Set up the decompressor for a filesystem
+ *
+ * @comp:	Compression type from the superblock (SQFS_COMP_...)
+ * @return 0 if OK, -EPROTONOSUPPORT if the compression type is not supported
+ *	by this build, -ENOMEM if out of memory
+ */
+int sqfs_decompressor_init(int comp);
+
+/**
+ * sqfs_decompress() - Decompress a metadata or data block
+ *
+ * @dst:	Output buffer
+ * @dst_len:	On entry, the size of @dst. Returns the number of bytes
+ *		written
+ * @src:	Compressed block
+ * @src_len:	Size of @src in bytes
+ * @return 0 if OK, -EIO if the block is corrupt or does not fit in @dst
+ */
+int sqfs_decompress(void *dst, size_t *dst_len, const void *src,
+		    size_t src_len);
+
+/**
+ * sqfs_decompressor_cleanup() - Free the decompressor's memory
+ */
+void sqfs_decompressor_cleanup(void);
+
+#endif /* SQFS_DECOMPRESSOR_H */
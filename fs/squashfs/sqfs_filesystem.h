@@ -0,0 +1,165 @@
+/* SPDX-License-Identifier: GPL-2.0+ */
+/*
+ * On-disk format of SquashFS 4.0 filesystems
+ *
+ * All values are little-endian. See Documentation/filesystems/squashfs.rst
+ * in Linux for a description of the layout.
+ */
+
+#ifndef SQFS_FILESYSTEM_H
+#define SQFS_FILESYSTEM_H
+
+#include <linux/types.h>
+
+#define SQFS_MAGIC			0x73717368
+#define SQFS_MAJOR			4
+
+#define SQFS_METADATA_SIZE		8192
+#define SQFS_METADATA_UNCOMPRESSED	BIT(15)
+#define SQFS_METADATA_LEN(hdr)		((hdr) & ~SQFS_METADATA_UNCOMPRESSED)
+
+#define SQFS_BLOCK_UNCOMPRESSED		BIT(24)
+#define SQFS_BLOCK_LEN(size)		((size) & (SQFS_BLOCK_UNCOMPRESSED - 1))
+#define SQFS_BLOCK_LOG_MIN		12
+#define SQFS_BLOCK_LOG_MAX		20
+
+#define SQFS_INVALID_FRAG		0xffffffff
+#define SQFS_FRAGMENTS_PER_BLOCK	(SQFS_METADATA_SIZE / \
+					 sizeof(struct sqfs_fragment_entry))
+
+/* Superblock flags */
+#define SQFS_FLAG_COMPRESSOR_OPTIONS	BIT(10)
+
+/* An inode reference holds the metadata block and offset of an inode */
+#define SQFS_INODE_BLOCK(ref)		((u32)((ref) >> 16))
+#define SQFS_INODE_OFFSET(ref)		((u16)(ref))
+
+enum sqfs_compression {
+	SQFS_COMP_GZIP = 1,
+	SQFS_COMP_LZMA,
+	SQFS_COMP_LZO,
+	SQFS_COMP_XZ,
+	SQFS_COMP_LZ4,
+	SQFS_COMP_ZSTD,
+};
+
+enum sqfs_inode_type {
+	SQFS_DIR_TYPE = 1,
+	SQFS_REG_TYPE,
+	SQFS_SYMLINK_TYPE,
+	SQFS_BLKDEV_TYPE,
+	SQFS_CHRDEV_TYPE,
+	SQFS_FIFO_TYPE,
+	SQFS_SOCKET_TYPE,
+	SQFS_LDIR_TYPE,
+	SQFS_LREG_TYPE,
+	SQFS_LSYMLINK_TYPE,
+	SQFS_LBLKDEV_TYPE,
+	SQFS_LCHRDEV_TYPE,
+	SQFS_LFIFO_TYPE,
+	SQFS_LSOCKET_TYPE,
+};
+
+struct sqfs_super_block {
+	__le32 s_magic;
+	__le32 inodes;
+	__le32 mkfs_time;
+	__le32 block_size;
+	__le32 fragments;
+	__le16 compression;
+	__le16 block_log;
+	__le16 flags;
+	__le16 no_ids;
+	__le16 s_major;
+	__le16 s_minor;
+	__le64 root_inode;
+	__le64 bytes_used;
+	__le64 id_table_start;
+	__le64 xattr_id_table_start;
+	__le64 inode_table_start;
+	__le64 directory_table_start;
+	__le64 fragment_table_start;
+	__le64 export_table_start;
+} __packed;
+
+struct sqfs_base_inode {
+	__le16 inode_type;
+	__le16 mode;
+	__le16 uid;
+	__le16 guid;
+	__le32 mtime;
+	__le32 inode_number;
+} __packed;
+
+struct sqfs_dir_inode {
+	__le32 start_block;
+	__le32 nlink;
+	__le16 file_size;
+	__le16 offset;
+	__le32 parent_inode;
+} __packed;
+
+/* Followed by i_count directory index entries */
+struct sqfs_ldir_inode {
+	__le32 nlink;
+	__le32 file_size;
+	__le32 start_block;
+	__le32 parent_inode;
+	__le16 i_count;
+	__le16 offset;
+	__le32 xattr;
+} __packed;
+
+/* Followed by the name, size + 1 bytes long */
+struct sqfs_dir_index {
+	__le32 index;
+	__le32 start_block;
+	__le32 size;
+} __packed;
+
+/* Followed by the block list, one __le32 size per block */
+struct sqfs_reg_inode {
+	__le32 start_block;
+	__le32 fragment;
+	__le32 offset;
+	__le32 file_size;
+} __packed;
+
+struct sqfs_lreg_inode {
+	__le64 start_block;
+	__le64 file_size;
+	__le64 sparse;
+	__le32 nlink;
+	__le32 fragment;
+	__le32 offset;
+	__le32 xattr;
+} __packed;
+
+/* Followed by the target, symlink_size bytes long */
+struct sqfs_symlink_inode {
+	__le32 nlink;
+	__le32 symlink_size;
+} __packed;
+
+/* Followed by count + 1 entries */
+struct sqfs_dir_header {
+	__le32 count;
+	__le32 start;
+	__le32 inode_number;
+} __packed;
+
+/* Followed by the name, size + 1 bytes long */
+struct sqfs_dir_entry {
+	__le16 offset;
+	__le16 inode_offset;
+	__le16 type;
+	__le16 size;
+} __packed;
+
+struct sqfs_fragment_entry {
+	__le64 start;
+	__le32 size;
+	__le32 unused;
+} __packed;
+
+#endif /* SQFS_FILESYSTEM_H */
@@ -1402,6 +1402,12 @@ static int mount_ubifs(struct ubifs_info *c)
 		if (!c->ileb_buf)
 			goto out_free;
 	}
+#else
+	/*
+	 * There are no mount options. Always read consecutive data nodes in
+	 * one go, which saves a flash read per data node.
+	 */
+	c->bulk_read = 1;
 #endif
 
 	if (c->bulk_read == 1)
@@ -1740,9 +1746,9 @@ void ubifs_umount(struct ubifs_info *c)
 #ifndef __UBOOT__
 	if (c->bgt)
 		kthread_stop(c->bgt);
+#endif
 
 	destroy_journal(c);
-#endif
 	free_wbufs(c);
 	free_orphans(c);
 	ubifs_lpt_free(c, 0);
@@ -2874,6 +2874,71 @@ void ubifs_tnc_close(struct ubifs_info *c)
 	destroy_old_idx(c);
 }
 
+#ifdef __UBOOT__
+/* Ticks once per file-system operation, see get_seconds() */
+unsigned long ubifs_tnc_clock;
+
+/**
+ * tnc_trim_older - free the znodes which were last used before a given time.
+ * @c: UBIFS file-system description object
+ * @time: free znodes whose time is not after this one
+ * @budget: stop once there are no more clean znodes than this
+ *
+ * The TNC is traversed in levelorder, so that whole sub-trees are freed at
+ * once; the children of a znode were never used after the znode itself. The
+ * root znode is kept. Returns the oldest time among the znodes left which are
+ * newer than @time, or %ULONG_MAX if there are none.
+ */
+static unsigned long tnc_trim_older(struct ubifs_info *c, unsigned long time,
+				    long budget)
+{
+	struct ubifs_znode *znode, *zprev = NULL;
+	unsigned long next = ULONG_MAX;
+	long freed;
+
+	znode = ubifs_tnc_levelorder_next(c->zroot.znode, NULL);
+	while (znode && atomic_long_read(&c->clean_zn_cnt) > budget) {
+		if (znode->parent && !znode->cnext && !ubifs_zn_dirty(znode) &&
+		    znode->time <= time) {
+			znode->parent->zbranch[znode->iip].znode = NULL;
+			freed = ubifs_destroy_tnc_subtree(znode);
+			atomic_long_sub(freed, &ubifs_clean_zn_cnt);
+			atomic_long_sub(freed, &c->clean_zn_cnt);
+			znode = zprev;
+		} else if (znode->time > time && znode->time < next) {
+			next = znode->time;
+		}
+
+		zprev = znode;
+		znode = ubifs_tnc_levelorder_next(c->zroot.znode, znode);
+	}
+
+	return next;
+}
+
+/**
+ * ubifs_tnc_trim - keep the TNC within its memory budget.
+ * @c: UBIFS file-system description object
+ *
+ * U-Boot has no memory shrinker, so znodes stay in memory from the moment they
+ * are read until un-mount, and the index does not have to be read again by
+ * the next command. This function is called at the end of each operation; it
+ * frees the least recently used znodes once they take more memory than
+ * CONFIG_UBIFS_TNC_CACHE_SIZE, and starts a new period of the TNC clock.
+ */
+void ubifs_tnc_trim(struct ubifs_info *c)
+{
+	long budget = CONFIG_UBIFS_TNC_CACHE_SIZE * 1024L / c->max_znode_sz;
+	unsigned long time = 0;
+
+	while (c->zroot.znode && time != ULONG_MAX &&
+	       atomic_long_read(&c->clean_zn_cnt) > budget)
+		time = tnc_trim_older(c, time, budget);
+
+	ubifs_tnc_clock++;
+}
+#endif
+
 /**
  * left_znode - get the znode to the left.
  * @c: UBIFS file-system description object
@@ -614,6 +614,7 @@ out_mem:
 		free(dir);
 
 out:
+	ubifs_tnc_trim(c);
 	ubi_close_volume(c->ubi);
 	return ret;
 }
@@ -625,6 +626,7 @@ int ubifs_exists(const char *filename)
 
 	c->ubi = ubi_open_volume(c->vi.ubi_num, c->vi.vol_id, UBI_READONLY);
 	inum = ubifs_findfile(ubifs_sb, (char *)filename);
+	ubifs_tnc_trim(c);
 	ubi_close_volume(c->ubi);
 
 	return inum != 0;
@@ -656,6 +658,7 @@ int ubifs_size(const char *filename, loff_t *size)
 
 	ubifs_iput(inode);
 out:
+	ubifs_tnc_trim(c);
 	ubi_close_volume(c->ubi);
 	return err;
 }
@@ -671,23 +674,13 @@ static inline void *kmap(struct page *page)
 	return page->addr;
 }
 
-static int read_block(struct inode *inode, void *addr, unsigned int block,
-		      struct ubifs_data_node *dn)
+static int unpack_block(struct inode *inode, void *addr, unsigned int block,
+			struct ubifs_data_node *dn)
 {
 	struct ubifs_info *c = inode->i_sb->s_fs_info;
 	int err, len, out_len;
-	union ubifs_key key;
 	unsigned int dlen;
 
-	data_key_init(c, &key, inode->i_ino, block);
-	err = ubifs_tnc_lookup(c, &key, dn);
-	if (err) {
-		if (err == -ENOENT)
-			/* Not found, so it must be a hole */
-			memset(addr, 0, UBIFS_BLOCK_SIZE);
-		return err;
-	}
-
 	ubifs_assert(le64_to_cpu(dn->ch.sqnum) > ubifs_inode(inode)->creat_sqnum);
 
 	len = le32_to_cpu(dn->size);
@@ -718,6 +711,92 @@ dump:
 	return -EINVAL;
 }
 
+static int read_block(struct inode *inode, void *addr, unsigned int block,
+		      struct ubifs_data_node *dn)
+{
+	struct ubifs_info *c = inode->i_sb->s_fs_info;
+	union ubifs_key key;
+	int err;
+
+	data_key_init(c, &key, inode->i_ino, block);
+	err = ubifs_tnc_lookup(c, &key, dn);
+	if (err) {
+		if (err == -ENOENT)
+			/* Not found, so it must be a hole */
+			memset(addr, 0, UBIFS_BLOCK_SIZE);
+		return err;
+	}
+
+	return unpack_block(inode, addr, block, dn);
+}
+
+/*
+ * Read @count whole blocks of a file, starting at @block, into @addr. Data
+ * nodes which follow each other in the same LEB are read from the flash in
+ * one go and decompressed from the bulk-read buffer. Blocks without a data
+ * node are holes.
+ */
+static int read_blocks(struct ubifs_info *c, struct inode *inode, void *addr,
+		       unsigned int block, unsigned int count)
+{
+	struct bu_info *bu = &c->bu;
+	unsigned int end = block + count;
+	unsigned int next;
+	int err, i, offs, holes;
+
+	while (block < end) {
+		data_key_init(c, &bu->key, inode->i_ino, block);
+		bu->buf_len = c->max_bu_buf_len;
+		err = ubifs_tnc_get_bu_keys(c, bu);
+		if (err)
+			return err;
+
+		/* Leave out the data nodes past the blocks wanted */
+		while (bu->cnt &&
+		       key_block(c, &bu->zbranch[bu->cnt - 1].key) >= end) {
+			bu->cnt--;
+			bu->eof = 1;
+		}
+
+		if (bu->cnt) {
+			err = ubifs_tnc_bulk_read(c, bu);
+			if (err)
+				return err;
+		}
+
+		for (i = 0; i < bu->cnt; i++) {
+			next = key_block(c, &bu->zbranch[i].key);
+			holes = next - block;
+			memset(addr, 0, holes * UBIFS_BLOCK_SIZE);
+			addr += holes * UBIFS_BLOCK_SIZE;
+
+			offs = bu->zbranch[i].offs - bu->zbranch[0].offs;
+			err = unpack_block(inode, addr, next, bu->buf + offs);
+			if (err)
+				return err;
+			addr += UBIFS_BLOCK_SIZE;
+			block = next + 1;
+		}
+
+		/*
+		 * There are no more data nodes before the end, or a hole too
+		 * big to be bulk-read in one go
+		 */
+		if (bu->eof)
+			holes = end - block;
+		else if (!bu->cnt)
+			holes = min_t(unsigned int, max(bu->blk_cnt, 1),
+				      end - block);
+		else
+			continue;
+		memset(addr, 0, holes * UBIFS_BLOCK_SIZE);
+		addr += holes * UBIFS_BLOCK_SIZE;
+		block += holes;
+	}
+
+	return 0;
+}
+
 static int do_readpage(struct ubifs_info *c, struct inode *inode,
 		       struct page *page, int last_block_size)
 {
@@ -887,7 +966,23 @@ int ubifs_read(const char *filename, void *buf, loff_t offset,
 	page.addr = buf;
 	page.index = offset / PAGE_SIZE;
 	page.inode = inode;
-	for (i = 0; i < count; i++) {
+
+	/*
+	 * All pages but the last one are whole blocks inside the file, which
+	 * can be read in bulk
+	 */
+	i = 0;
+	if (c->bulk_read && count > 1) {
+		err = read_blocks(c, inode, buf,
+				  page.index << UBIFS_BLOCKS_PER_PAGE_SHIFT,
+				  (count - 1) << UBIFS_BLOCKS_PER_PAGE_SHIFT);
+		if (!err) {
+			i = count - 1;
+			page.addr += i * PAGE_SIZE;
+			page.index += i;
+		}
+	}
+	for (; !err && i < count; i++) {
 		/*
 		 * Make sure to not read beyond the requested size
 		 */
@@ -913,6 +1008,7 @@ put_inode:
 	ubifs_iput(inode);
 
 out:
+	ubifs_tnc_trim(c);
 	ubi_close_volume(c->ubi);
 	return err;
 }
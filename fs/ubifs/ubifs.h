@@ -68,7 +68,12 @@ void iput(struct inode *inode);
 
 /* linux/include/time.h */
 #define NSEC_PER_SEC	1000000000L
-#define get_seconds()	0
+/*
+ * get_seconds() is only used to date znodes. There is no clock worth
+ * reading here, so count the file-system operations instead.
+ */
+extern unsigned long ubifs_tnc_clock;
+#define get_seconds()	ubifs_tnc_clock
 #define CURRENT_TIME_SEC	((struct timespec) { get_seconds(), 0 })
 
 struct timespec {
@@ -452,11 +457,6 @@ struct file {
 #endif
 };
 
-/*
- * get_seconds() not really needed in the read-only implmentation
- */
-#define get_seconds()		0
-
 /* 4k page size */
 #define PAGE_CACHE_SHIFT	12
 #define PAGE_CACHE_SIZE		(1 << PAGE_CACHE_SHIFT)
@@ -2405,5 +2405,6 @@ int ubifs_decompress(const struct ubifs_info *c, const void *buf, int len,
 
 #ifdef __UBOOT__
 void ubifs_umount(struct ubifs_info *c);
+void ubifs_tnc_trim(struct ubifs_info *c);
 #endif
 #endif /* !__UBIFS_H__ */
@@ -168,6 +168,18 @@ void blkcache_invalidate(int iftype, int dev);
  */
 void blkcache_configure(unsigned blocks, unsigned entries);
 
+/**
+ * blkcache_generation() - get the block cache generation
+ *
+ * The generation changes each time cached data is discarded, i.e. after
+ * a write to any block device, a device being (re)initialised or removed,
+ * or the cache being reconfigured. Anything derived from block data may
+ * be kept for as long as the generation stays the same.
+ *
+ * @return - current generation
+ */
+unsigned int blkcache_generation(void);
+
 /*
  * statistics of the block cache
  */
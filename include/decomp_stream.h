@@ -0,0 +1,88 @@
+/* SPDX-License-Identifier: GPL-2.0+ */
+/*
+ * Incremental decompression into a memory buffer
+ */
+
+#ifndef __DECOMP_STREAM_H
+#define __DECOMP_STREAM_H
+
+#include <linux/types.h>
+
+struct decomp_stream_ops;
+
+/**
+ * struct decomp_stream - state of an incremental decompressor
+ *
+ * This allows compressed data to be decompressed while it arrives, e.g. from
+ * the network or a filesystem, so that the whole compressed image never has
+ * to be held in memory. The producer calls decomp_stream_feed() with each
+ * chunk of data, in order and of any size, then decomp_stream_finish().
+ *
+ * @comp:	Compression type (IH_COMP_...)
+ * @dst:	Output buffer
+ * @dst_size:	Size of output buffer in bytes
+ * @out_len:	Number of bytes written to @dst so far
+ * @in_len:	Number of compressed bytes fed so far
+ * @done:	true once the end of the compressed data has been seen. Any
+ *		data fed after that is ignored
+ * @ops:	Operations for this compression type
+ * @priv:	Private state of the decompressor
+ */
+struct decomp_stream {
+	int comp;
+	u8 *dst;
+	ulong dst_size;
+	ulong out_len;
+	ulong in_len;
+	bool done;
+	const struct decomp_stream_ops *ops;
+	void *priv;
+};
+
+/**
+ * decomp_stream_init() - Set up an incremental decompressor
+ *
+ * @ds:		Stream to set up
+ * @comp:	Compression type (IH_COMP_...)
+ * @dst:	Output buffer
+ * @dst_size:	Size of output buffer in bytes
+ * @return 0 if OK, -EPROTONOSUPPORT if the compression type is not supported,
+ *	-ENOMEM if out of memory. On error there is nothing to release
+ */
+int decomp_stream_init(struct decomp_stream *ds, int comp, void *dst,
+		       ulong dst_size);
+
+/**
+ * decomp_stream_feed() - Decompress the next chunk of compressed data
+ *
+ * Compression types that have no incremental decoder (lzo) gather the data
+ * and decompress it in decomp_stream_finish(), as does .xz data fed to an lzma
+ * stream.
+ *
+ * @ds:		Stream to use
+ * @src:	Compressed data
+ * @len:	Number of bytes in @src
+ * @return 0 if OK, -ENOSPC if the output buffer is too small, -EINVAL if the
+ *	data is corrupt, -ENOMEM if out of memory. On error the stream must
+ *	still be released with decomp_stream_abort()
+ */
+int decomp_stream_feed(struct decomp_stream *ds, const void *src, ulong len);
+
+/**
+ * decomp_stream_finish() - Finish decompressing and release the stream
+ *
+ * @ds:		Stream to finish
+ * @out_len:	Returns the number of bytes written to the output buffer
+ * @return 0 if OK, -EINVAL if the compressed data is incomplete or corrupt,
+ *	other -ve value on error
+ */
+int decomp_stream_finish(struct decomp_stream *ds, ulong *out_len);
+
+/**
+ * decomp_stream_abort() - Release a stream without finishing it
+ *
+ * @ds:		Stream to release
+ */
+void decomp_stream_abort(struct decomp_stream *ds);
+
+#endif
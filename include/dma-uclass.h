@@ -134,6 +134,30 @@ struct dma_ops {
 	 */
 	int (*transfer)(struct udevice *dev, int direction, void *dst,
 			void *src, size_t len);
+	/**
+	 * transfer_start() - Start a DMA transfer without waiting for it
+	 *   to complete. This is optional; transfer() is used if it is not
+	 *   provided. Only one transfer can be outstanding per device.
+	 *
+	 * @dev: The DMA device
+	 * @direction: direction of data transfer (should be one from
+	 *   enum dma_direction)
+	 * @dst: The destination pointer.
+	 * @src: The source pointer.
+	 * @len: Length of the data to be copied (number of bytes).
+	 * @return zero on success, or -ve error code.
+	 */
+	int (*transfer_start)(struct udevice *dev, int direction, void *dst,
+			      void *src, size_t len);
+	/**
+	 * transfer_wait() - Wait for the transfer started by
+	 *   transfer_start() to complete. Required if transfer_start() is
+	 *   provided.
+	 *
+	 * @dev: The DMA device
+	 * @return zero on success, or -ve error code.
+	 */
+	int (*transfer_wait)(struct udevice *dev);
 };
 
 #endif /* _DMA_UCLASS_H */
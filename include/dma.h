@@ -42,6 +42,21 @@ struct dma_dev_priv {
 	u32 supported;
 };
 
+/**
+ * struct dma_copy - a memory-to-memory copy that may still be in progress
+ *
+ * @dev:	DMA device doing the copy
+ * @dst:	Destination of the copy
+ * @len:	Number of bytes being copied
+ * @pending:	true if the copy was started but not yet waited for
+ */
+struct dma_copy {
+	struct udevice *dev;
+	void *dst;
+	size_t len;
+	bool pending;
+};
+
 #ifdef CONFIG_DMA_CHANNELS
 /**
  * A DMA is a feature of computer systems that allows certain hardware
@@ -329,6 +344,32 @@ int dma_get_device(u32 transfer_type, struct udevice **devp);
 	     transferred and on failure return error code.
  */
 int dma_memcpy(void *dst, void *src, size_t len);
+
+/**
+ * dma_memcpy_start() - Start a memory-to-memory DMA copy
+ *
+ * The source is written back from the data cache and the destination is
+ * invalidated before the copy starts, so @dst and @dst + @len should be
+ * aligned to ARCH_DMA_MINALIGN. The CPU must not touch the destination until
+ * dma_memcpy_wait() has returned. If the DMA device cannot run a transfer in
+ * the background, the copy is complete when this function returns.
+ *
+ * @copy:	Returns information about the copy, for dma_memcpy_wait()
+ * @dst:	Destination pointer
+ * @src:	Source pointer
+ * @len:	Number of bytes to copy
+ * @return 0 if OK, -EPROTONOSUPPORT if there is no memory-to-memory DMA
+ *	device, other -ve error code on failure
+ */
+int dma_memcpy_start(struct dma_copy *copy, void *dst, void *src, size_t len);
+
+/**
+ * dma_memcpy_wait() - Wait for a copy started by dma_memcpy_start()
+ *
+ * @copy:	Copy to wait for
+ * @return 0 if OK, -ve error code if the transfer failed
+ */
+int dma_memcpy_wait(struct dma_copy *copy);
 #else
 static inline int dma_get_device(u32 transfer_type, struct udevice **devp)
 {
@@ -339,5 +380,76 @@ static inline int dma_memcpy(void *dst, void *src, size_t len)
 {
 	return -ENOSYS;
 }
+
+static inline int dma_memcpy_start(struct dma_copy *copy, void *dst,
+				   void *src, size_t len)
+{
+	return -ENOSYS;
+}
+
+static inline int dma_memcpy_wait(struct dma_copy *copy)
+{
+	return -ENOSYS;
+}
 #endif /* CONFIG_DMA */
+
+#if CONFIG_IS_ENABLED(DMA_BULK_COPY)
+/**
+ * dma_bulk_memcpy() - Copy a large block of memory using DMA if possible
+ *
+ * Copies of at least CONFIG_DMA_BULK_COPY_MIN bytes between regions that do
+ * not overlap are handed to a memory-to-memory DMA device. The CPU copies the
+ * parts of the destination which do not fill a whole cache line while the
+ * DMA transfer runs.
+ *
+ * @dst:	Destination pointer
+ * @src:	Source pointer
+ * @len:	Number of bytes to copy
+ * @return 0 if the data was copied, -ve error code if DMA could not be used,
+ *	in which case the caller must copy the data itself
+ */
+int dma_bulk_memcpy(void *dst, void *src, size_t len);
+
+/**
+ * dma_bulk_fill() - Fill a large block of memory with a repeating pattern
+ *
+ * The first @filled bytes of @buf hold the pattern, which is copied
+ * repeatedly to fill @len bytes in total. The amount copied doubles with each
+ * step, so large blocks are filled with a few large DMA transfers.
+ *
+ * @buf:	Buffer to fill
+ * @filled:	Number of bytes already filled, which must be a multiple of
+ *		the pattern size
+ * @len:	Total number of bytes to fill
+ * @return 0 if the buffer was filled, -ve error code if DMA could not be
+ *	used, in which case the caller must fill the buffer itself
+ */
+int dma_bulk_fill(void *buf, size_t filled, size_t len);
+
+/**
+ * dma_bulk_memset() - Set a large block of memory using DMA if possible
+ *
+ * @dst:	Destination pointer
+ * @c:		Value to set
+ * @len:	Number of bytes to set
+ * @return 0 if the memory was set, -ve error code if DMA could not be used,
+ *	in which case the caller must set the memory itself
+ */
+int dma_bulk_memset(void *dst, int c, size_t len);
+#else
+static inline int dma_bulk_memcpy(void *dst, void *src, size_t len)
+{
+	return -ENOSYS;
+}
+
+static inline int dma_bulk_fill(void *buf, size_t filled, size_t len)
+{
+	return -ENOSYS;
+}
+
+static inline int dma_bulk_memset(void *dst, int c, size_t len)
+{
+	return -ENOSYS;
+}
+#endif /* DMA_BULK_COPY */
 #endif	/* _DMA_H_ */
@@ -0,0 +1,26 @@
+/* SPDX-License-Identifier: GPL-2.0+ */
+/*
+ * Read-only EROFS filesystem support
+ */
+
+#ifndef __U_BOOT_EROFS_H__
+#define __U_BOOT_EROFS_H__
+
+struct blk_desc;
+struct disk_partition;
+struct fs_dir_stream;
+struct fs_dirent;
+
+int erofs_probe(struct blk_desc *fs_dev_desc,
+		struct disk_partition *fs_partition);
+int erofs_opendir(const char *filename, struct fs_dir_stream **dirsp);
+int erofs_readdir(struct fs_dir_stream *dirs, struct fs_dirent **dentp);
+void erofs_closedir(struct fs_dir_stream *dirs);
+int erofs_exists(const char *filename);
+int erofs_size(const char *filename, loff_t *size);
+int erofs_read(const char *filename, void *buf, loff_t offset, loff_t len,
+	       loff_t *actread);
+int erofs_uuid(char *uuid_str);
+void erofs_close(void);
+
+#endif /* __U_BOOT_EROFS_H__ */
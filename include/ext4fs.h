@@ -60,6 +60,12 @@ struct ext4_extent {
 	__le32	ee_start_lo;	/* low 32 bits of physical block */
 };
 
+/*
+ * An ee_len above this marks an unwritten extent, of ee_len minus this
+ * many blocks
+ */
+#define EXT_INIT_MAX_LEN	(1 << 15)
+
 /*
  * This is index on-disk structure.
  * It's used at all the levels except the bottom.
@@ -105,11 +111,13 @@ struct ext_filesystem {
 
 	/* Block Bitmap Related */
 	unsigned char **blk_bmaps;
+	bool *blk_bmap_dirty;
 	long int curr_blkno;
 	uint16_t first_pass_bbmap;
 
 	/* Inode Bitmap Related */
 	unsigned char **inode_bmaps;
+	bool *inode_bmap_dirty;
 	int curr_inode_no;
 	uint16_t first_pass_ibmap;
 
@@ -157,6 +165,9 @@ int ext4fs_devread(lbaint_t sector, int byte_offset, int byte_len, char *buf);
 void ext4fs_set_blk_dev(struct blk_desc *rbdd, struct disk_partition *info);
 long int read_allocated_block(struct ext2_inode *inode, int fileblock,
 			      struct ext_block_cache *cache);
+int ext4fs_map_extent(struct ext2_inode *inode, uint32_t fileblock,
+		      struct ext_block_cache *cache, lbaint_t *blknr,
+		      lbaint_t *count);
 int ext4fs_probe(struct blk_desc *fs_dev_desc,
 		 struct disk_partition *fs_partition);
 int ext4_read_file(const char *filename, void *buf, loff_t offset, loff_t len,
@@ -26,6 +26,12 @@ struct disk_partition;
 			 sizeof(dir_entry))
 
 #define FATBUFBLOCKS	6
+/* Number of FATBUFBLOCKS buffers of the FAT kept in memory */
+#ifdef CONFIG_SPL_BUILD
+#define FATBUFWINDOWS	2
+#else
+#define FATBUFWINDOWS	8
+#endif
 #define FATBUFSIZE	(mydata->sect_size * FATBUFBLOCKS)
 #define FAT12BUFSIZE	((FATBUFSIZE*2)/3)
 #define FAT16BUFSIZE	(FATBUFSIZE/2)
@@ -173,6 +179,10 @@ typedef struct {
 	__u16	clust_size;	/* Size of clusters in sectors */
 	int	data_begin;	/* The sector of the first cluster, can be negative */
 	int	fatbufnum;	/* Used by get_fatent, init to -1 */
+	/* Other recently used FAT buffers, most recent first */
+	__u8	*fatcache[FATBUFWINDOWS - 1];
+	int	fatcachenum[FATBUFWINDOWS - 1];
+	__u8	fatcachedirty[FATBUFWINDOWS - 1];
 	int	rootdir_size;	/* Size of root dir for non-FAT32 */
 	__u32	root_cluster;	/* First cluster of root dir for FAT32 */
 	u32	total_sect;	/* Number of sectors */
@@ -15,6 +15,8 @@ struct cmd_tbl;
 #define FS_TYPE_SANDBOX	3
 #define FS_TYPE_UBIFS	4
 #define FS_TYPE_BTRFS	5
+#define FS_TYPE_SQUASHFS 6
+#define FS_TYPE_EROFS	7
 
 struct blk_desc;
 
@@ -73,9 +75,26 @@ int fs_set_blk_dev_with_part(struct blk_desc *desc, int part);
  * Many file functions implicitly call fs_close(), e.g. fs_closedir(),
  * fs_exist(), fs_ln(), fs_ls(), fs_mkdir(), fs_read(), fs_size(), fs_write(),
  * fs_unlink().
+ *
+ * With CONFIG_FS_MOUNT_CACHE the filesystem stays mounted until something
+ * changes the block device, so that the next fs_set_blk_dev() on the same
+ * partition need not probe it again.
  */
 void fs_close(void);
 
+#if CONFIG_IS_ENABLED(FS_MOUNT_CACHE)
+/**
+ * fs_close_cached() - Unmount the filesystem kept mounted by fs_close()
+ *
+ * The filesystem drivers can only have one filesystem mounted at a time,
+ * so code which uses a driver directly rather than through the fs layer
+ * must call this first.
+ */
+void fs_close_cached(void);
+#else
+static inline void fs_close_cached(void) {}
+#endif
+
 /**
  * fs_get_type() - Get type of current filesystem
  *
@@ -21,4 +21,15 @@
  */
 int ulz4fn(const void *src, size_t srcn, void *dst, size_t *dstn);
 
+/**
+ * ulz4fn_block() - Decompress a single LZ4 block, without the frame
+ *
+ * @src: Compressed block data, without the block header
+ * @srcn: Length of the block data
+ * @dst: Destination for uncompressed data
+ * @dstn: On entry, the size of @dst. Returns length of uncompressed data
+ * @return 0 if OK, -EPROTO if the block is corrupt or does not fit in @dst
+ */
+int ulz4fn_block(const void *src, size_t srcn, void *dst, size_t *dstn);
+
 #endif
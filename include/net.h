@@ -140,9 +140,15 @@ enum eth_recv_flags {
  *	 indicate that the hardware receive FIFO is empty. If 0 is returned, the
  *	 network stack will not process the empty packet, but free_pkt() will be
  *	 called if supplied
+ * recv_batch: Like recv, but return up to "max" packets at once, setting
+ *	       their buffers in "packetp" and their lengths in "lengths".
+ *	       Returns the number of packets, 0 if there are none, or an error.
+ *	       Each buffer is lent to the network stack until it is handed
+ *	       back with free_pkt(), so a driver with a receive ring can pass a
+ *	       burst of packets on without copying them - optional
  * free_pkt: Give the driver an opportunity to manage its packet buffer memory
  *	     when the network stack is finished processing it. This will only be
- *	     called when no error was returned from recv - optional
+ *	     called when no error was returned from recv or recv_batch - optional
  * stop: Stop the hardware from looking for packets - may be called even if
  *	 state == PASSIVE
  * mcast: Join or leave a multicast group (for TFTP) - optional
@@ -160,6 +166,8 @@ struct eth_ops {
 	int (*start)(struct udevice *dev);
 	int (*send)(struct udevice *dev, void *packet, int length);
 	int (*recv)(struct udevice *dev, int flags, uchar **packetp);
+	int (*recv_batch)(struct udevice *dev, int flags, uchar **packetp,
+			  int *lengths, int max);
 	int (*free_pkt)(struct udevice *dev, uchar *packet, int length);
 	void (*stop)(struct udevice *dev);
 	int (*mcast)(struct udevice *dev, const u8 *enetaddr, int join);
@@ -177,6 +185,45 @@ struct udevice *eth_get_dev(void); /* get the current device */
 struct udevice *eth_get_dev_by_name(const char *devname);
 unsigned char *eth_get_ethaddr(void); /* get the current device MAC */
 
+/**
+ * struct eth_stats - packet counters of an Ethernet device
+ *
+ * @rx_packets:	Packets received and passed to the network stack
+ * @rx_bytes:	Number of bytes in those packets
+ * @rx_dropped:	Packets lost by the driver, e.g. because its receive ring
+ *		was full
+ * @rx_errors:	Number of errors returned by recv() or recv_batch()
+ * @tx_packets:	Packets sent
+ * @tx_errors:	Number of errors returned by send()
+ */
+struct eth_stats {
+	ulong rx_packets;
+	ulong rx_bytes;
+	ulong rx_dropped;
+	ulong rx_errors;
+	ulong tx_packets;
+	ulong tx_errors;
+};
+
+/**
+ * eth_get_stats() - Get the packet counters of a device
+ *
+ * @dev:	Ethernet device
+ * @return pointer to the counters
+ */
+const struct eth_stats *eth_get_stats(struct udevice *dev);
+
+/**
+ * eth_count_rx_dropped() - Record packets lost by a driver
+ *
+ * Drivers call this when they know that received packets were lost, for
+ * example because no receive buffer was free.
+ *
+ * @dev:	Ethernet device
+ * @count:	Number of packets lost
+ */
+void eth_count_rx_dropped(struct udevice *dev, uint count);
+
 /* Used only when NetConsole is enabled */
 int eth_is_active(struct udevice *dev); /* Test device for active state */
 int eth_init_state_only(void); /* Set active state */
@@ -366,6 +413,7 @@ struct vlan_ethernet_hdr {
 #define PROT_NCSI	0x88f8		/* NC-SI control packets        */
 
 #define IPPROTO_ICMP	 1	/* Internet Control Message Protocol	*/
+#define IPPROTO_TCP	 6	/* Transmission Control Protocol	*/
 #define IPPROTO_UDP	17	/* User Datagram Protocol		*/
 
 /*
@@ -451,6 +499,7 @@ struct arp_hdr {
 } __attribute__((packed));
 
 #define ARP_HDR_SIZE	(8+20)		/* Size assuming ethernet	*/
+#define ARP_QUEUE_SIZE	4		/* Packets waiting for ARP	*/
 
 /*
  * ICMP stuff (just enough to handle (host) redirect messages)
@@ -535,6 +584,9 @@ extern u8		net_ethaddr[ARP_HLEN];		/* Our ethernet address */
 extern u8		net_server_ethaddr[ARP_HLEN];	/* Boot server enet address */
 extern struct in_addr	net_ip;		/* Our    IP addr (0 = unknown) */
 extern struct in_addr	net_server_ip;	/* Server IP addr (0 = unknown) */
+#ifdef CONFIG_TFTP_MULTICAST
+extern struct in_addr	net_mcast_addr;	/* Multicast group joined (0 = none) */
+#endif
 extern uchar		*net_tx_packet;		/* THE transmit packet */
 extern uchar		*net_rx_packets[PKTBUFSRX]; /* Receive packets */
 extern uchar		*net_rx_packet;		/* Current receive packet */
@@ -551,7 +603,7 @@ extern int		net_restart_wrap;	/* Tried all network devices */
 
 enum proto_t {
 	BOOTP, RARP, ARP, TFTPGET, DHCP, PING, DNS, NFS, CDP, NETCONS, SNTP,
-	TFTPSRV, TFTPPUT, LINKLOCAL, FASTBOOT, WOL
+	TFTPSRV, TFTPPUT, LINKLOCAL, FASTBOOT, WOL, WGET
 };
 
 extern char	net_boot_file_name[1024];/* Boot File name */
@@ -651,6 +703,27 @@ bool arp_is_waiting(void);		/* Waiting for ARP reply? */
 void net_set_icmp_handler(rxhand_icmp_f *f); /* Set ICMP RX handler */
 void net_set_timeout_handler(ulong, thand_f *);/* Set timeout handler */
 
+/**
+ * arp_cache_lookup() - Look up the Ethernet address of a host in the ARP cache
+ *
+ * For a host on another network, the gateway's address is looked up.
+ *
+ * @dest:	IP address of the host
+ * @ethaddr:	Returns the Ethernet address, if found
+ * @return true if found, false if not known or out of date
+ */
+bool arp_cache_lookup(struct in_addr dest, uchar *ethaddr);
+
+/**
+ * arp_cache_flush() - Forget all entries in the ARP cache
+ */
+void arp_cache_flush(void);
+
+/**
+ * arp_cache_show() - Print the entries in the ARP cache
+ */
+void arp_cache_show(void);
+
 /* Network loop state */
 enum net_loop_state {
 	NETLOOP_CONTINUE,
@@ -690,6 +763,8 @@ static inline void net_send_packet(uchar *pkt, int len)
  * @param dport Destination UDP port
  * @param sport Source UDP port
  * @param payload_len Length of data after the UDP header
+ * @return 0 if sent, 1 if waiting for an ARP reply, or -ve on error, e.g.
+ *	-ENOBUFS if there is no room left to queue the packet for ARP
  */
 int net_send_ip_packet(uchar *ether, struct in_addr dest, int dport, int sport,
 		       int payload_len, int proto, u8 action, u32 tcp_seq_num,
@@ -702,6 +777,8 @@ void net_process_received_packet(uchar *in_packet, int len);
 
 #if defined(CONFIG_NETCONSOLE) && !defined(CONFIG_SPL_BUILD)
 void nc_start(void);
+/* Send netconsole output which has been waiting too long */
+void nc_poll(void);
 int nc_input_packet(uchar *pkt, struct in_addr src_ip, unsigned dest_port,
 	unsigned src_port, unsigned len);
 #endif
@@ -0,0 +1,167 @@
+/* SPDX-License-Identifier: GPL-2.0+ */
+/*
+ * Minimal TCP client, for downloading files over the network
+ */
+
+#ifndef __TCP_H__
+#define __TCP_H__
+
+#include <net.h>
+
+/*
+ *	Internet Protocol (IP) + TCP header, without TCP options.
+ */
+struct ip_tcp_hdr {
+	u8		ip_hl_v;	/* header length and version	*/
+	u8		ip_tos;		/* type of service		*/
+	u16		ip_len;		/* total length			*/
+	u16		ip_id;		/* identification		*/
+	u16		ip_off;		/* fragment offset field	*/
+	u8		ip_ttl;		/* time to live			*/
+	u8		ip_p;		/* protocol			*/
+	u16		ip_sum;		/* checksum			*/
+	struct in_addr	ip_src;		/* Source IP address		*/
+	struct in_addr	ip_dst;		/* Destination IP address	*/
+	u16		tcp_src;	/* TCP source port		*/
+	u16		tcp_dst;	/* TCP destination port		*/
+	u32		tcp_seq;	/* Sequence number		*/
+	u32		tcp_ack;	/* Acknowledgment number	*/
+	u8		tcp_hlen;	/* Header length in words << 4	*/
+	u8		tcp_flags;	/* Control flags		*/
+	u16		tcp_win;	/* Receive window		*/
+	u16		tcp_xsum;	/* Checksum			*/
+	u16		tcp_urg;	/* Urgent pointer		*/
+} __attribute__((packed));
+
+#define IP_TCP_HDR_SIZE		(sizeof(struct ip_tcp_hdr))
+#define TCP_HDR_SIZE		(IP_TCP_HDR_SIZE - IP_HDR_SIZE)
+
+/* TCP control flags */
+#define TCP_FIN		0x01
+#define TCP_SYN		0x02
+#define TCP_RST		0x04
+#define TCP_PSH		0x08
+#define TCP_ACK		0x10
+
+/* Largest segment that fits in an Ethernet frame without fragmentation */
+#define TCP_MSS			(1500 - IP_TCP_HDR_SIZE)
+/* Options sent with a SYN: maximum segment size, NOP, window scale */
+#define TCP_SYN_OPT_SIZE	8
+
+/**
+ * struct tcp_ops - callbacks from the TCP layer to its user
+ *
+ * All callbacks are made from the network loop, i.e. from
+ * net_process_received_packet() or a timeout handler.
+ */
+struct tcp_ops {
+	/**
+	 * connected() - The connection has been set up
+	 *
+	 * The user normally sends its request with tcp_send() here.
+	 */
+	void (*connected)(void);
+
+	/**
+	 * rx() - Data has been received
+	 *
+	 * Data is passed on straight from the received packet, so the user
+	 * can copy it to its final place without further buffering. Data may
+	 * arrive out of order, in which case @offset is beyond the end of the
+	 * data seen so far, and may be passed on more than once. Returning
+	 * -EAGAIN for out-of-order data drops it, to be sent again by the
+	 * peer. In-order data must always be accepted.
+	 *
+	 * @offset:	Position of the data in the stream from the peer
+	 * @data:	Received data
+	 * @len:	Number of bytes in @data
+	 * @return 0 if the data was accepted, -EAGAIN to drop out-of-order
+	 *	data, any other -ve value to abort the connection
+	 */
+	int (*rx)(u32 offset, const uchar *data, unsigned int len);
+
+	/**
+	 * closed() - The connection has ended
+	 *
+	 * @err:	0 if the peer closed the connection after sending all its
+	 *		data, -ECONNRESET if it was reset, -ETIMEDOUT if the peer
+	 *		stopped responding, other -ve value on error
+	 */
+	void (*closed)(int err);
+};
+
+/**
+ * tcp_connect() - Open a connection to a server
+ *
+ * This sends a SYN and returns; @ops->connected() is called once the server
+ * has accepted the connection. Only one connection can be open at a time, so
+ * any earlier connection is forgotten, e.g. one left over from an
+ * interrupted command.
+ *
+ * @ip:		Server IP address
+ * @port:	Server port
+ * @ops:	Callbacks for events on the connection
+ * @return 0 if OK, -ve error code if the SYN could not be sent
+ */
+int tcp_connect(struct in_addr ip, u16 port, const struct tcp_ops *ops);
+
+/**
+ * tcp_send() - Send data on the connection
+ *
+ * The data is copied, so that it can be sent again if lost. At most one
+ * segment of data can be outstanding at a time, which is plenty for
+ * sending a request.
+ *
+ * @data:	Data to send
+ * @len:	Number of bytes to send
+ * @return 0 if OK, -ENOTCONN if the connection is not open, -EBUSY if
+ *	earlier data has not been acknowledged yet, -E2BIG if @len is larger
+ *	than one segment
+ */
+int tcp_send(const void *data, unsigned int len);
+
+/**
+ * tcp_close() - Close the connection once all data is sent
+ *
+ * @ops->closed() is called once the peer has closed its side too.
+ */
+void tcp_close(void);
+
+/**
+ * tcp_abort() - Reset the connection
+ *
+ * No further callbacks are made.
+ */
+void tcp_abort(void);
+
+/**
+ * tcp_set_tcp_header() - Set up the IP and TCP headers of a segment
+ *
+ * This is called by net_send_ip_packet() for TCP packets. TCP options are
+ * added to SYN segments, so @pkt must have room for TCP_SYN_OPT_SIZE bytes
+ * of options before the data.
+ *
+ * @pkt:	Start of the IP header
+ * @dest:	Destination IP address
+ * @dport:	Destination port
+ * @sport:	Source port
+ * @payload_len: Number of bytes of data after the headers
+ * @action:	TCP control flags (TCP_...)
+ * @tcp_seq_num: Sequence number
+ * @tcp_ack_num: Acknowledgment number
+ * @return size of the IP and TCP headers, including options
+ */
+int tcp_set_tcp_header(uchar *pkt, struct in_addr dest, int dport, int sport,
+		       int payload_len, u8 action, u32 tcp_seq_num,
+		       u32 tcp_ack_num);
+
+/**
+ * tcp_receive() - Handle a received TCP segment
+ *
+ * @ip:		IP header of the packet
+ * @len:	Length of the IP packet in bytes
+ * @src_ip:	Source IP address
+ */
+void tcp_receive(struct ip_tcp_hdr *ip, int len, struct in_addr src_ip);
+
+#endif /* __TCP_H__ */
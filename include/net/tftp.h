@@ -22,6 +22,25 @@ void tftp_start(enum proto_t protocol);	/* Begin TFTP get/put */
 void tftp_start_server(void);	/* Wait for incoming TFTP put */
 #endif
 
+/* Most names tftp_probe() can be given */
+#define TFTP_PROBE_MAX		16
+
+/**
+ * tftp_probe() - Load the first file in a list which the server has
+ *
+ * A request for each name is sent without waiting for the replies to the
+ * others, up to CONFIG_TFTP_PROBE_WINDOW at a time, so that looking through
+ * a list of names mostly missing from the server takes about one round trip
+ * rather than one per name. The file is loaded at image_load_addr from the
+ * server at net_server_ip.
+ *
+ * @names:	File names, the most wanted first
+ * @count:	Number of names, at most TFTP_PROBE_MAX
+ * @return index of the name loaded, -ENONET if none was found or there was
+ * an error, -EINVAL if @count is out of range
+ */
+int tftp_probe(const char *const names[], int count);
+
 extern ulong tftp_timeout_ms;
 extern int tftp_timeout_count_max;
 
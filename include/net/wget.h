@@ -0,0 +1,25 @@
+/* SPDX-License-Identifier: GPL-2.0+ */
+/*
+ * HTTP client, for downloading files with wget
+ */
+
+#ifndef __WGET_H__
+#define __WGET_H__
+
+/* Begin an HTTP download of net_boot_file_name to image_load_addr */
+void wget_start(void);
+
+/*
+ * Part of the file to download, for an HTTP range request. The whole file
+ * is downloaded if wget_range_size is 0.
+ */
+extern ulong wget_range_size;
+extern ulong wget_range_pos;
+
+/*
+ * Size of the whole file as given by the server, from Content-Length or
+ * Content-Range, or 0 if the server did not say
+ */
+extern ulong wget_file_size;
+
+#endif /* __WGET_H__ */
@@ -0,0 +1,144 @@
+/* SPDX-License-Identifier: GPL-2.0+ */
+/*
+ * ECDSA signature support for FIT images
+ */
+
+#ifndef _ECDSA_H
+#define _ECDSA_H
+
+#include <errno.h>
+#include <image.h>
+
+#define ECDSA256_BYTES	(256 / 8)
+#define ECDSA384_BYTES	(384 / 8)
+
+/* This is the maximum curve size we support, in bytes */
+#define ECDSA_MAX_BYTES	ECDSA384_BYTES
+
+#if defined(USE_HOSTCC)
+# define ECDSA_ENABLE_VERIFY	IMAGE_ENABLE_VERIFY
+#else
+# define ECDSA_ENABLE_VERIFY	CONFIG_IS_ENABLED(ECDSA_VERIFY)
+#endif
+
+/**
+ * struct ecdsa_curve - parameters of a short Weierstrass curve with a = -3
+ *
+ * All values are big-endian byte arrays of @bytes bytes.
+ *
+ * @name:	Curve name as used by OpenSSL, e.g. "prime256v1"
+ * @bytes:	Size of a field element / scalar in bytes
+ * @p:		Field prime
+ * @n:		Order of the base point
+ * @b:		Curve coefficient b
+ * @gx:		Base point x coordinate
+ * @gy:		Base point y coordinate
+ */
+struct ecdsa_curve {
+	const char *name;
+	unsigned int bytes;
+	const uint8_t *p;
+	const uint8_t *n;
+	const uint8_t *b;
+	const uint8_t *gx;
+	const uint8_t *gy;
+};
+
+struct image_sign_info;
+
+#if IMAGE_ENABLE_SIGN
+/**
+ * ecdsa_sign() - calculate and return signature for given input data
+ *
+ * @info:	Specifies key and FIT information
+ * @region:	List of regions to sign
+ * @region_count: Number of regions
+ * @sigp:	Set to an allocated buffer holding the signature
+ * @sig_len:	Set to length of the signature
+ *
+ * The signature is stored as the big-endian values r and s, each padded to
+ * the size of the curve. The caller should free *sigp.
+ *
+ * @return: 0, on success, -ve on error
+ */
+int ecdsa_sign(struct image_sign_info *info,
+	       const struct image_region region[],
+	       int region_count, uint8_t **sigp, uint *sig_len);
+
+/**
+ * ecdsa_add_verify_data() - Add verification information to FDT
+ *
+ * Add the curve name and public key point to the FDT node, suitable for
+ * verification at run-time.
+ *
+ * @info:	Specifies key and FIT information
+ * @keydest:	Destination FDT blob for public key data
+ * @return: 0, on success, -ENOSPC if the keydest FDT blob ran out of space,
+ *	other -ve value on error
+ */
+int ecdsa_add_verify_data(struct image_sign_info *info, void *keydest);
+#else
+static inline int ecdsa_sign(struct image_sign_info *info,
+			     const struct image_region region[],
+			     int region_count, uint8_t **sigp, uint *sig_len)
+{
+	return -ENXIO;
+}
+
+static inline int ecdsa_add_verify_data(struct image_sign_info *info,
+					void *keydest)
+{
+	return -ENXIO;
+}
+#endif
+
+#if ECDSA_ENABLE_VERIFY
+/**
+ * ecdsa_verify() - Verify a signature against some data
+ *
+ * @info:	Specifies key and FIT information
+ * @region:	List of regions which were signed
+ * @region_count: Number of regions
+ * @sig:	Signature
+ * @sig_len:	Number of bytes in signature
+ * @return 0 if verified, -ve on error
+ */
+int ecdsa_verify(struct image_sign_info *info,
+		 const struct image_region region[], int region_count,
+		 uint8_t *sig, uint sig_len);
+
+/**
+ * ecdsa_get_curve() - Look up a curve by name
+ *
+ * @name:	Curve name, e.g. "prime256v1" or "secp384r1"
+ * @return curve parameters, or NULL if the curve is not supported
+ */
+const struct ecdsa_curve *ecdsa_get_curve(const char *name);
+
+/**
+ * ecdsa_verify_hash() - Verify an ECDSA signature of a hash
+ *
+ * The field arithmetic runs in constant time. The public key is checked to
+ * be a point on the curve before it is used.
+ *
+ * @curve:	Curve to use
+ * @qx:		Public key x coordinate, big-endian, curve->bytes long
+ * @qy:		Public key y coordinate, big-endian, curve->bytes long
+ * @hash:	Hash of the signed data
+ * @hash_len:	Number of bytes in @hash
+ * @sig:	Signature as big-endian r followed by s, each curve->bytes long
+ * @return 0 if the signature is valid, -EINVAL if not or if the key is bad
+ */
+int ecdsa_verify_hash(const struct ecdsa_curve *curve, const uint8_t *qx,
+		      const uint8_t *qy, const uint8_t *hash, uint hash_len,
+		      const uint8_t *sig);
+#else
+static inline int ecdsa_verify(struct image_sign_info *info,
+			       const struct image_region region[],
+			       int region_count, uint8_t *sig, uint sig_len)
+{
+	return -ENXIO;
+}
+#endif
+
+#endif
@@ -0,0 +1,855 @@
+// SPDX-License-Identifier: GPL-2.0+
+/*
+ * Incremental decompression into a memory buffer
+ *
+ * Each compression type provides a feed() operation which consumes a chunk of
+ * compressed data of any size and writes as much output as it can. Headers
+ * and LZ4 blocks which are split across chunks are gathered in a small
+ * buffer first. The output buffer doubles as the dictionary wherever the
+ * decompressor allows it, so that only bounded state is kept.
+ */
+
+#include <common.h>
+#include <decomp_stream.h>
+#include <image.h>
+#include <log.h>
+#include <lz4.h>
+#include <malloc.h>
+#include <asm/unaligned.h>
+#include <linux/lzo.h>
+#include <linux/zstd.h>
+#include <u-boot/zlib.h>
+#include <bzlib.h>
+
+#include <lzma/LzmaTypes.h>
+#include <lzma/LzmaDec.h>
+#include <lzma/LzmaTools.h>
+#include "lzma/XzTools.h"
+
+/**
+ * struct decomp_stream_ops - operations for one compression type
+ *
+ * @comp:	Compression type (IH_COMP_...)
+ * @init:	Set up ds->priv
+ * @feed:	Decompress a chunk of data, setting ds->done at the end
+ * @finish:	Complete decompression, or NULL if only ds->done is checked
+ * @release:	Free ds->priv and anything it refers to
+ */
+struct decomp_stream_ops {
+	int comp;
+	int (*init)(struct decomp_stream *ds);
+	int (*feed)(struct decomp_stream *ds, const u8 *src, ulong len);
+	int (*finish)(struct decomp_stream *ds);
+	void (*release)(struct decomp_stream *ds);
+};
+
+/**
+ * ds_gather() - Copy input into a buffer until it holds a given amount
+ *
+ * @buf:	Buffer to fill
+ * @have:	Number of bytes already in @buf, updated
+ * @want:	Number of bytes wanted in @buf
+ * @src:	Input pointer, advanced past the bytes copied
+ * @len:	Number of bytes at @src, reduced by the bytes copied
+ * @return true if @buf now holds @want bytes
+ */
+static bool ds_gather(u8 *buf, ulong *have, ulong want, const u8 **src,
+		      ulong *len)
+{
+	ulong count = min(want - *have, *len);
+
+	memcpy(buf + *have, *src, count);
+	*have += count;
+	*src += count;
+	*len -= count;
+
+	return *have == want;
+}
+
+/*
+ * Formats without an incremental decoder gather all the input and decompress
+ * it in finish()
+ */
+struct ds_buf {
+	u8 *data;
+	ulong len;
+	ulong size;
+};
+
+static int ds_buf_append(struct ds_buf *buf, const u8 *src, ulong len)
+{
+	if (len > buf->size - buf->len) {
+		ulong size = max(buf->size * 2, buf->len + len);
+		u8 *data;
+
+		size = max(size, 0x10000UL);
+		data = realloc(buf->data, size);
+		if (!data)
+			return -ENOMEM;
+		buf->data = data;
+		buf->size = size;
+	}
+	memcpy(buf->data + buf->len, src, len);
+	buf->len += len;
+
+	return 0;
+}
+
+static int ds_alloc_priv(struct decomp_stream *ds, size_t size)
+{
+	ds->priv = calloc(1, size);
+
+	return ds->priv ? 0 : -ENOMEM;
+}
+
+static int ds_none_feed(struct decomp_stream *ds, const u8 *src, ulong len)
+{
+	if (len > ds->dst_size - ds->out_len)
+		return -ENOSPC;
+	memcpy(ds->dst + ds->out_len, src, len);
+	ds->out_len += len;
+
+	return 0;
+}
+
+static int ds_none_finish(struct decomp_stream *ds)
+{
+	/* Uncompressed data has no end marker */
+	return 0;
+}
+
+static int ds_none_init(struct decomp_stream *ds)
+{
+	return 0;
+}
+
+static void ds_none_release(struct decomp_stream *ds)
+{
+}
+
+#if CONFIG_IS_ENABLED(GZIP)
+static int ds_gzip_init(struct decomp_stream *ds)
+{
+	z_stream *s;
+	int ret;
+
+	ret = ds_alloc_priv(ds, sizeof(*s));
+	if (ret)
+		return ret;
+	s = ds->priv;
+	s->zalloc = gzalloc;
+	s->zfree = gzfree;
+
+	/* Expect a gzip header, so that the CRC and length are checked */
+	if (inflateInit2(s, 16 + MAX_WBITS) != Z_OK) {
+		free(s);
+		ds->priv = NULL;
+		return -ENOMEM;
+	}
+
+	return 0;
+}
+
+static int ds_gzip_feed(struct decomp_stream *ds, const u8 *src, ulong len)
+{
+	z_stream *s = ds->priv;
+	int r;
+
+	s->next_in = (u8 *)src;
+	s->avail_in = len;
+	s->next_out = ds->dst + ds->out_len;
+	s->avail_out = ds->dst_size - ds->out_len;
+	r = inflate(s, Z_NO_FLUSH);
+	ds->out_len = s->next_out - ds->dst;
+	if (r == Z_STREAM_END) {
+		ds->done = true;
+		return 0;
+	}
+	if (r != Z_OK && r != Z_BUF_ERROR)
+		return -EINVAL;
+
+	/* inflate() only leaves input behind when the output is full */
+	return s->avail_in ? -ENOSPC : 0;
+}
+
+static void ds_gzip_release(struct decomp_stream *ds)
+{
+	inflateEnd(ds->priv);
+	free(ds->priv);
+}
+#endif /* GZIP */
+
+#if CONFIG_IS_ENABLED(BZIP2)
+static int ds_bzip2_init(struct decomp_stream *ds)
+{
+	bz_stream *s;
+	int ret;
+
+	ret = ds_alloc_priv(ds, sizeof(*s));
+	if (ret)
+		return ret;
+	s = ds->priv;
+
+	/*
+	 * If we've got less than 4 MB of malloc() space, use the slower
+	 * algorithm which requires at most 2300 KB of memory
+	 */
+	if (BZ2_bzDecompressInit(s, 0, CONFIG_SYS_MALLOC_LEN < (4096 * 1024)) !=
+	    BZ_OK) {
+		free(s);
+		ds->priv = NULL;
+		return -ENOMEM;
+	}
+
+	return 0;
+}
+
+static int ds_bzip2_feed(struct decomp_stream *ds, const u8 *src, ulong len)
+{
+	bz_stream *s = ds->priv;
+	int r;
+
+	s->next_in = (char *)src;
+	s->avail_in = len;
+	s->next_out = (char *)ds->dst + ds->out_len;
+	s->avail_out = ds->dst_size - ds->out_len;
+	r = BZ2_bzDecompress(s);
+	ds->out_len = (u8 *)s->next_out - ds->dst;
+	if (r == BZ_STREAM_END) {
+		ds->done = true;
+		return 0;
+	}
+	if (r != BZ_OK)
+		return -EINVAL;
+
+	return s->avail_in ? -ENOSPC : 0;
+}
+
+static void ds_bzip2_release(struct decomp_stream *ds)
+{
+	BZ2_bzDecompressEnd(ds->priv);
+	free(ds->priv);
+}
+#endif /* BZIP2 */
+
+#if CONFIG_IS_ENABLED(LZMA)
+#define LZMA_HEADER_SIZE	(LZMA_PROPS_SIZE + sizeof(u64))
+
+/**
+ * struct ds_lzma - state of the LZMA decompressor
+ *
+ * @dec:	LZMA decoder, using the output buffer as its dictionary
+ * @hdr:	LZMA_Alone header, i.e. properties and uncompressed size
+ * @hdr_len:	Number of bytes in @hdr
+ * @limit:	Number of bytes to decompress
+ * @has_size:	true if the header holds the uncompressed size
+ * @started:	true once the header has been read
+ * @xz:		Gathered input, if the data is in .xz format instead
+ * @is_xz:	true if the data is in .xz format
+ */
+struct ds_lzma {
+	CLzmaDec dec;
+	u8 hdr[LZMA_HEADER_SIZE];
+	ulong hdr_len;
+	SizeT limit;
+	bool has_size;
+	bool started;
+	struct ds_buf xz;
+	bool is_xz;
+};
+
+static void *ds_lzma_alloc(void *p, size_t size) { return malloc(size); }
+static void ds_lzma_free(void *p, void *address) { free(address); }
+
+static ISzAlloc ds_lzma_allocator = {
+	.Alloc = ds_lzma_alloc,
+	.Free = ds_lzma_free,
+};
+
+static int ds_lzma_init(struct decomp_stream *ds)
+{
+	struct ds_lzma *priv;
+	int ret;
+
+	ret = ds_alloc_priv(ds, sizeof(*priv));
+	if (ret)
+		return ret;
+	priv = ds->priv;
+	LzmaDec_Construct(&priv->dec);
+
+	return 0;
+}
+
+static int ds_lzma_start(struct decomp_stream *ds, struct ds_lzma *priv)
+{
+	u64 size;
+	int res;
+
+	res = LzmaDec_AllocateProbs(&priv->dec, priv->hdr, LZMA_PROPS_SIZE,
+				    &ds_lzma_allocator);
+	if (res != SZ_OK)
+		return res == SZ_ERROR_MEM ? -ENOMEM : -EINVAL;
+	priv->dec.dic = ds->dst;
+	priv->dec.dicBufSize = ds->dst_size;
+	LzmaDec_Init(&priv->dec);
+
+	/* All ones means the size is unknown and there is an end marker */
+	size = get_unaligned_le64(priv->hdr + LZMA_PROPS_SIZE);
+	priv->has_size = size != -1ULL;
+	if (priv->has_size && size > ds->dst_size)
+		return -ENOSPC;
+	priv->limit = priv->has_size ? size : ds->dst_size;
+
+	return 0;
+}
+
+static int ds_lzma_feed(struct decomp_stream *ds, const u8 *src, ulong len)
+{
+	struct ds_lzma *priv = ds->priv;
+	CLzmaDec *dec = &priv->dec;
+	ELzmaStatus status;
+	SizeT used;
+	int res;
+
+	if (!priv->started) {
+		if (!ds_gather(priv->hdr, &priv->hdr_len, LZMA_HEADER_SIZE,
+			       &src, &len))
+			return 0;
+		priv->started = true;
+		if (CONFIG_IS_ENABLED(LZMA_XZ) &&
+		    xz_check_magic(priv->hdr, LZMA_HEADER_SIZE)) {
+			priv->is_xz = true;
+			res = ds_buf_append(&priv->xz, priv->hdr,
+					    LZMA_HEADER_SIZE);
+			if (res)
+				return res;
+		} else {
+			res = ds_lzma_start(ds, priv);
+			if (res)
+				return res;
+		}
+	}
+	if (priv->is_xz)
+		return ds_buf_append(&priv->xz, src, len);
+
+	used = len;
+	res = LzmaDec_DecodeToDic(dec, priv->limit, src, &used,
+				  LZMA_FINISH_ANY, &status);
+	ds->out_len = dec->dicPos;
+	if (res != SZ_OK)
+		return -EINVAL;
+
+	if (status == LZMA_STATUS_FINISHED_WITH_MARK ||
+	    (priv->has_size && dec->dicPos == priv->limit)) {
+		ds->done = true;
+	} else if (dec->dicPos == priv->limit && used < len) {
+		/* The output is full, so the rest must be the end marker */
+		src += used;
+		used = len - used;
+		res = LzmaDec_DecodeToDic(dec, priv->limit, src, &used,
+					  LZMA_FINISH_END, &status);
+		if (res != SZ_OK)
+			return -ENOSPC;
+		if (status == LZMA_STATUS_FINISHED_WITH_MARK)
+			ds->done = true;
+	}
+
+	return 0;
+}
+
+static int ds_lzma_finish(struct decomp_stream *ds)
+{
+	struct ds_lzma *priv = ds->priv;
+	SizeT size = ds->dst_size;
+	int res;
+
+	if (!priv->is_xz)
+		return ds->done ? 0 : -EINVAL;
+
+	res = lzmaBuffToBuffDecompress(ds->dst, &size, priv->xz.data,
+				       priv->xz.len);
+	ds->out_len = size;
+	if (res == SZ_ERROR_OUTPUT_EOF)
+		return -ENOSPC;
+
+	return res == SZ_OK ? 0 : -EINVAL;
+}
+
+static void ds_lzma_release(struct decomp_stream *ds)
+{
+	struct ds_lzma *priv = ds->priv;
+
+	LzmaDec_FreeProbs(&priv->dec, &ds_lzma_allocator);
+	free(priv->xz.data);
+	free(priv);
+}
+#endif /* LZMA */
+
+#if CONFIG_IS_ENABLED(LZO)
+static int ds_lzo_init(struct decomp_stream *ds)
+{
+	return ds_alloc_priv(ds, sizeof(struct ds_buf));
+}
+
+static int ds_lzo_feed(struct decomp_stream *ds, const u8 *src, ulong len)
+{
+	return ds_buf_append(ds->priv, src, len);
+}
+
+static int ds_lzo_finish(struct decomp_stream *ds)
+{
+	struct ds_buf *buf = ds->priv;
+	size_t size = ds->dst_size;
+	int ret;
+
+	ret = lzop_decompress(buf->data, buf->len, ds->dst, &size);
+	ds->out_len = size;
+	if (ret == LZO_E_OUTPUT_OVERRUN)
+		return -ENOSPC;
+
+	return ret == LZO_E_OK ? 0 : -EINVAL;
+}
+
+static void ds_lzo_release(struct decomp_stream *ds)
+{
+	struct ds_buf *buf = ds->priv;
+
+	free(buf->data);
+	free(buf);
+}
+#endif /* LZO */
+
+#if CONFIG_IS_ENABLED(LZ4)
+#define LZ4_FLG_VERSION_MASK	0xc0
+#define LZ4_FLG_VERSION_1	0x40
+#define LZ4_FLG_INDEPENDENT	0x20
+#define LZ4_FLG_BLOCK_CHECKSUM	0x10
+#define LZ4_FLG_CONTENT_SIZE	0x08
+#define LZ4_FLG_RESERVED	0x03
+#define LZ4_BD_RESERVED		0x8f
+#define LZ4_BLOCK_UNCOMPRESSED	0x80000000
+#define LZ4_HEADER_MAX		15
+
+enum ds_lz4_stage {
+	LZ4_STAGE_HEADER,
+	LZ4_STAGE_BLOCK_HEADER,
+	LZ4_STAGE_BLOCK,
+	LZ4_STAGE_CHECKSUM,
+};
+
+/**
+ * struct ds_lz4 - state of the LZ4 decompressor
+ *
+ * Only frames with independent blocks are supported, as with ulz4fn(), so
+ * each block can be decompressed on its own once all of it is available.
+ *
+ * @stage:	Part of the frame that is expected next
+ * @hdr:	Frame or block header
+ * @hdr_len:	Number of bytes in @hdr
+ * @hdr_want:	Size of the header being read
+ * @block:	Buffer for a compressed block which is split across chunks
+ * @block_max:	Maximum block size from the frame header
+ * @block_len:	Number of bytes in @block, or of the uncompressed block copied
+ * @block_size:	Size of the current block
+ * @uncompressed: true if the current block is stored uncompressed
+ * @block_checksum: true if each block is followed by a checksum
+ */
+struct ds_lz4 {
+	enum ds_lz4_stage stage;
+	u8 hdr[LZ4_HEADER_MAX];
+	ulong hdr_len;
+	ulong hdr_want;
+	u8 *block;
+	ulong block_max;
+	ulong block_len;
+	ulong block_size;
+	bool uncompressed;
+	bool block_checksum;
+};
+
+static int ds_lz4_init(struct decomp_stream *ds)
+{
+	struct ds_lz4 *priv;
+	int ret;
+
+	ret = ds_alloc_priv(ds, sizeof(*priv));
+	if (ret)
+		return ret;
+	priv = ds->priv;
+	priv->hdr_want = 6;
+
+	return 0;
+}
+
+static int ds_lz4_frame_header(struct ds_lz4 *priv)
+{
+	u8 flg = priv->hdr[4], bd = priv->hdr[5];
+	uint size_code;
+
+	if (get_unaligned_le32(priv->hdr) != LZ4F_MAGIC ||
+	    (flg & LZ4_FLG_VERSION_MASK) != LZ4_FLG_VERSION_1 ||
+	    !(flg & LZ4_FLG_INDEPENDENT))
+		return -EPROTONOSUPPORT;
+	if ((flg & LZ4_FLG_RESERVED) || (bd & LZ4_BD_RESERVED))
+		return -EINVAL;
+	size_code = bd >> 4;
+	if (size_code < 4)
+		return -EINVAL;
+
+	/* The magic, FLG and BD are followed by the content size and HC */
+	if (priv->hdr_want == 6) {
+		priv->hdr_want = flg & LZ4_FLG_CONTENT_SIZE ? 15 : 7;
+		return 0;
+	}
+
+	priv->block_checksum = flg & LZ4_FLG_BLOCK_CHECKSUM;
+	priv->block_max = 1UL << (2 * size_code + 8);
+	priv->block = malloc(priv->block_max);
+	if (!priv->block)
+		return -ENOMEM;
+	priv->stage = LZ4_STAGE_BLOCK_HEADER;
+	priv->hdr_len = 0;
+	priv->hdr_want = 4;
+
+	return 0;
+}
+
+static int ds_lz4_block(struct decomp_stream *ds, const u8 *src, ulong len)
+{
+	size_t size = ds->dst_size - ds->out_len;
+	int ret;
+
+	ret = ulz4fn_block(src, len, ds->dst + ds->out_len, &size);
+	if (ret)
+		return -EINVAL;
+	ds->out_len += size;
+
+	return 0;
+}
+
+static int ds_lz4_feed(struct decomp_stream *ds, const u8 *src, ulong len)
+{
+	struct ds_lz4 *priv = ds->priv;
+	ulong count;
+	u32 raw;
+	int ret;
+
+	while (len && !ds->done) {
+		switch (priv->stage) {
+		case LZ4_STAGE_HEADER:
+			if (!ds_gather(priv->hdr, &priv->hdr_len,
+				       priv->hdr_want, &src, &len))
+				break;
+			ret = ds_lz4_frame_header(priv);
+			if (ret)
+				return ret;
+			break;
+		case LZ4_STAGE_BLOCK_HEADER:
+			if (!ds_gather(priv->hdr, &priv->hdr_len, 4, &src,
+				       &len))
+				break;
+			raw = get_unaligned_le32(priv->hdr);
+			priv->hdr_len = 0;
+			if (!raw) {
+				/* End mark, any content checksum is ignored */
+				ds->done = true;
+				break;
+			}
+			priv->uncompressed = raw & LZ4_BLOCK_UNCOMPRESSED;
+			priv->block_size = raw & ~LZ4_BLOCK_UNCOMPRESSED;
+			if (priv->block_size > priv->block_max)
+				return -EINVAL;
+			priv->block_len = 0;
+			priv->stage = LZ4_STAGE_BLOCK;
+			break;
+		case LZ4_STAGE_BLOCK:
+			count = min(priv->block_size - priv->block_len, len);
+			if (priv->uncompressed) {
+				ret = ds_none_feed(ds, src, count);
+				if (ret)
+					return ret;
+				src += count;
+				len -= count;
+				priv->block_len += count;
+			} else if (!priv->block_len && count == priv->block_size) {
+				/* The whole block is here, no need to copy */
+				ret = ds_lz4_block(ds, src, count);
+				if (ret)
+					return ret;
+				src += count;
+				len -= count;
+				priv->block_len = count;
+			} else {
+				if (!ds_gather(priv->block, &priv->block_len,
+					       priv->block_size, &src, &len))
+					break;
+				ret = ds_lz4_block(ds, priv->block,
+						   priv->block_size);
+				if (ret)
+					return ret;
+			}
+			if (priv->block_len < priv->block_size)
+				break;
+			priv->stage = priv->block_checksum ?
+				LZ4_STAGE_CHECKSUM : LZ4_STAGE_BLOCK_HEADER;
+			break;
+		case LZ4_STAGE_CHECKSUM:
+			/* Block checksums are not verified, as in ulz4fn() */
+			if (!ds_gather(priv->hdr, &priv->hdr_len, 4, &src,
+				       &len))
+				break;
+			priv->hdr_len = 0;
+			priv->stage = LZ4_STAGE_BLOCK_HEADER;
+			break;
+		}
+	}
+
+	return 0;
+}
+
+static void ds_lz4_release(struct decomp_stream *ds)
+{
+	struct ds_lz4 *priv = ds->priv;
+
+	free(priv->block);
+	free(priv);
+}
+#endif /* LZ4 */
+
+#if CONFIG_IS_ENABLED(ZSTD)
+/**
+ * struct ds_zstd - state of the Zstandard decompressor
+ *
+ * @hdr:	Start of the frame, until the window size is known
+ * @hdr_len:	Number of bytes in @hdr
+ * @workspace:	Memory used by @dstream, sized for the frame's window
+ * @dstream:	Zstandard stream, or NULL before the header has been read
+ */
+struct ds_zstd {
+	u8 hdr[ZSTD_FRAMEHEADERSIZE_MAX];
+	ulong hdr_len;
+	void *workspace;
+	ZSTD_DStream *dstream;
+};
+
+static int ds_zstd_init(struct decomp_stream *ds)
+{
+	return ds_alloc_priv(ds, sizeof(struct ds_zstd));
+}
+
+static int ds_zstd_decompress(struct decomp_stream *ds, const u8 *src,
+			      ulong len)
+{
+	struct ds_zstd *priv = ds->priv;
+	ZSTD_inBuffer in = { .src = src, .size = len };
+	ZSTD_outBuffer out = {
+		.dst = ds->dst,
+		.size = ds->dst_size,
+		.pos = ds->out_len,
+	};
+
+	for (;;) {
+		size_t in_pos = in.pos, out_pos = out.pos;
+		size_t ret;
+
+		ret = ZSTD_decompressStream(priv->dstream, &out, &in);
+		ds->out_len = out.pos;
+		if (ZSTD_isError(ret))
+			return -EINVAL;
+		if (!ret) {
+			ds->done = true;
+			return 0;
+		}
+		if (in.pos == in_pos && out.pos == out_pos)
+			break;
+	}
+
+	/* No progress is possible with input left, so the output is full */
+	return in.pos < in.size ? -ENOSPC : 0;
+}
+
+static int ds_zstd_feed(struct decomp_stream *ds, const u8 *src, ulong len)
+{
+	struct ds_zstd *priv = ds->priv;
+	ZSTD_frameParams params;
+	size_t wsize;
+	size_t ret;
+
+	if (priv->dstream)
+		return ds_zstd_decompress(ds, src, len);
+
+	/* Read enough of the frame header to know the window size */
+	ds_gather(priv->hdr, &priv->hdr_len, sizeof(priv->hdr), &src, &len);
+	ret = ZSTD_getFrameParams(&params, priv->hdr, priv->hdr_len);
+	if (ZSTD_isError(ret))
+		return -EINVAL;
+	if (ret)
+		return priv->hdr_len < sizeof(priv->hdr) ? 0 : -EINVAL;
+	if (!params.windowSize)
+		return -EPROTONOSUPPORT;	/* skippable frame */
+
+	/* The decompressor rounds small windows up to the minimum */
+	params.windowSize = max(params.windowSize, 1U << ZSTD_WINDOWLOG_MIN);
+	wsize = ZSTD_DStreamWorkspaceBound(params.windowSize);
+	priv->workspace = malloc(wsize);
+	if (!priv->workspace) {
+		debug("%s: cannot allocate workspace of size %zu\n", __func__,
+		      wsize);
+		return -ENOMEM;
+	}
+	priv->dstream = ZSTD_initDStream(params.windowSize, priv->workspace,
+					 wsize);
+	if (!priv->dstream)
+		return -ENOMEM;
+
+	ret = ds_zstd_decompress(ds, priv->hdr, priv->hdr_len);
+	if (ret || ds->done)
+		return ret;
+
+	return ds_zstd_decompress(ds, src, len);
+}
+
+static int ds_zstd_finish(struct decomp_stream *ds)
+{
+	struct ds_zstd *priv = ds->priv;
+	int ret;
+
+	/* Flush anything that did not fit in the output buffer earlier */
+	if (!ds->done && priv->dstream) {
+		ret = ds_zstd_decompress(ds, NULL, 0);
+		if (ret)
+			return ret;
+	}
+
+	return ds->done ? 0 : -EINVAL;
+}
+
+static void ds_zstd_release(struct decomp_stream *ds)
+{
+	struct ds_zstd *priv = ds->priv;
+
+	free(priv->workspace);
+	free(priv);
+}
+#endif /* ZSTD */
+
+static const struct decomp_stream_ops decomp_stream_ops[] = {
+	{
+		.comp = IH_COMP_NONE,
+		.init = ds_none_init,
+		.feed = ds_none_feed,
+		.finish = ds_none_finish,
+		.release = ds_none_release,
+	},
+#if CONFIG_IS_ENABLED(GZIP)
+	{
+		.comp = IH_COMP_GZIP,
+		.init = ds_gzip_init,
+		.feed = ds_gzip_feed,
+		.release = ds_gzip_release,
+	},
+#endif
+#if CONFIG_IS_ENABLED(BZIP2)
+	{
+		.comp = IH_COMP_BZIP2,
+		.init = ds_bzip2_init,
+		.feed = ds_bzip2_feed,
+		.release = ds_bzip2_release,
+	},
+#endif
+#if CONFIG_IS_ENABLED(LZMA)
+	{
+		.comp = IH_COMP_LZMA,
+		.init = ds_lzma_init,
+		.feed = ds_lzma_feed,
+		.finish = ds_lzma_finish,
+		.release = ds_lzma_release,
+	},
+#endif
+#if CONFIG_IS_ENABLED(LZO)
+	{
+		.comp = IH_COMP_LZO,
+		.init = ds_lzo_init,
+		.feed = ds_lzo_feed,
+		.finish = ds_lzo_finish,
+		.release = ds_lzo_release,
+	},
+#endif
+#if CONFIG_IS_ENABLED(LZ4)
+	{
+		.comp = IH_COMP_LZ4,
+		.init = ds_lz4_init,
+		.feed = ds_lz4_feed,
+		.release = ds_lz4_release,
+	},
+#endif
+#if CONFIG_IS_ENABLED(ZSTD)
+	{
+		.comp = IH_COMP_ZSTD,
+		.init = ds_zstd_init,
+		.feed = ds_zstd_feed,
+		.finish = ds_zstd_finish,
+		.release = ds_zstd_release,
+	},
+#endif
+};
+
+int decomp_stream_init(struct decomp_stream *ds, int comp, void *dst,
+		       ulong dst_size)
+{
+	int i, ret;
+
+	memset(ds, '\0', sizeof(*ds));
+	for (i = 0; i < ARRAY_SIZE(decomp_stream_ops); i++) {
+		if (decomp_stream_ops[i].comp == comp)
+			ds->ops = &decomp_stream_ops[i];
+	}
+	if (!ds->ops) {
+		debug("%s: Unsupported compression type %d\n", __func__, comp);
+		return -EPROTONOSUPPORT;
+	}
+	ds->comp = comp;
+	ds->dst = dst;
+	ds->dst_size = dst_size;
+
+	/* A failed init leaves nothing for decomp_stream_abort() to release */
+	ret = ds->ops->init(ds);
+	if (ret)
+		ds->ops = NULL;
+
+	return ret;
+}
+
+int decomp_stream_feed(struct decomp_stream *ds, const void *src, ulong len)
+{
+	int ret = 0;
+
+	if (!ds->done && len)
+		ret = ds->ops->feed(ds, src, len);
+	ds->in_len += len;
+
+	return ret;
+}
+
+int decomp_stream_finish(struct decomp_stream *ds, ulong *out_len)
+{
+	int ret;
+
+	if (ds->ops->finish)
+		ret = ds->ops->finish(ds);
+	else
+		ret = ds->done ? 0 : -EINVAL;
+	*out_len = ds->out_len;
+	decomp_stream_abort(ds);
+
+	return ret;
+}
+
+void decomp_stream_abort(struct decomp_stream *ds)
+{
+	if (ds->ops) {
+		ds->ops->release(ds);
+		ds->ops = NULL;
+		ds->priv = NULL;
+	}
+}
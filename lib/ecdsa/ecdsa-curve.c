@@ -0,0 +1,678 @@
+// SPDX-License-Identifier: GPL-2.0+
+/*
+ * Software ECDSA signature verification over the NIST P-256 and P-384
+ * curves.
+ *
+ * Field and scalar arithmetic uses Montgomery multiplication on 32-bit words.
+ * Carries and reductions are handled with masks rather than branches, so the
+ * arithmetic runs in constant time. Points are kept in Jacobian coordinates to
+ * avoid a field inversion per point operation.
+ */
+
+#ifndef USE_HOSTCC
+#include <common.h>
+#include <log.h>
+#include <linux/errno.h>
+#else
+#include "mkimage.h"
+#endif
+#include <u-boot/ecdsa.h>
+
+#define ECC_MAX_WORDS	(ECDSA_MAX_BYTES / 4)
+
+/**
+ * struct ecc_mod - a modulus set up for Montgomery multiplication
+ *
+ * @words:	Number of 32-bit words in each value
+ * @m:		Modulus, as little endian word array
+ * @one:	R mod m, i.e. 1 in Montgomery form (R = 2^(32 * words))
+ * @rr:		R^2 mod m, used to convert values into Montgomery form
+ * @n0inv:	-1 / m[0] mod 2^32
+ */
+struct ecc_mod {
+	uint words;
+	uint32_t m[ECC_MAX_WORDS];
+	uint32_t one[ECC_MAX_WORDS];
+	uint32_t rr[ECC_MAX_WORDS];
+	uint32_t n0inv;
+};
+
+/* A point in Jacobian coordinates (X / Z^2, Y / Z^3), Z = 0 for infinity */
+struct ecc_point {
+	uint32_t x[ECC_MAX_WORDS];
+	uint32_t y[ECC_MAX_WORDS];
+	uint32_t z[ECC_MAX_WORDS];
+};
+
+/**
+ * struct ecc_ctx - state for verifying a signature on a curve
+ *
+ * @p:		Field prime
+ * @n:		Group order
+ * @b:		Curve coefficient b, in Montgomery form modulo p
+ */
+struct ecc_ctx {
+	struct ecc_mod p;
+	struct ecc_mod n;
+	uint32_t b[ECC_MAX_WORDS];
+};
+
+static const uint8_t p256_p[] = {
+	0xff, 0xff, 0xff, 0xff, 0x00, 0x00, 0x00, 0x01,
+	0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+	0x00, 0x00, 0x00, 0x00, 0xff, 0xff, 0xff, 0xff,
+	0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+};
+
+static const uint8_t p256_n[] = {
+	0xff, 0xff, 0xff, 0xff, 0x00, 0x00, 0x00, 0x00,
+	0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+	0xbc, 0xe6, 0xfa, 0xad, 0xa7, 0x17, 0x9e, 0x84,
+	0xf3, 0xb9, 0xca, 0xc2, 0xfc, 0x63, 0x25, 0x51,
+};
+
+static const uint8_t p256_b[] = {
+	0x5a, 0xc6, 0x35, 0xd8, 0xaa, 0x3a, 0x93, 0xe7,
+	0xb3, 0xeb, 0xbd, 0x55, 0x76, 0x98, 0x86, 0xbc,
+	0x65, 0x1d, 0x06, 0xb0, 0xcc, 0x53, 0xb0, 0xf6,
+	0x3b, 0xce, 0x3c, 0x3e, 0x27, 0xd2, 0x60, 0x4b,
+};
+
+static const uint8_t p256_gx[] = {
+	0x6b, 0x17, 0xd1, 0xf2, 0xe1, 0x2c, 0x42, 0x47,
+	0xf8, 0xbc, 0xe6, 0xe5, 0x63, 0xa4, 0x40, 0xf2,
+	0x77, 0x03, 0x7d, 0x81, 0x2d, 0xeb, 0x33, 0xa0,
+	0xf4, 0xa1, 0x39, 0x45, 0xd8, 0x98, 0xc2, 0x96,
+};
+
+static const uint8_t p256_gy[] = {
+	0x4f, 0xe3, 0x42, 0xe2, 0xfe, 0x1a, 0x7f, 0x9b,
+	0x8e, 0xe7, 0xeb, 0x4a, 0x7c, 0x0f, 0x9e, 0x16,
+	0x2b, 0xce, 0x33, 0x57, 0x6b, 0x31, 0x5e, 0xce,
+	0xcb, 0xb6, 0x40, 0x68, 0x37, 0xbf, 0x51, 0xf5,
+};
+
+static const uint8_t p384_p[] = {
+	0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+	0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+	0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+	0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xfe,
+	0xff, 0xff, 0xff, 0xff, 0x00, 0x00, 0x00, 0x00,
+	0x00, 0x00, 0x00, 0x00, 0xff, 0xff, 0xff, 0xff,
+};
+
+static const uint8_t p384_n[] = {
+	0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+	0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+	0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+	0xc7, 0x63, 0x4d, 0x81, 0xf4, 0x37, 0x2d, 0xdf,
+	0x58, 0x1a, 0x0d, 0xb2, 0x48, 0xb0, 0xa7, 0x7a,
+	0xec, 0xec, 0x19, 0x6a, 0xcc, 0xc5, 0x29, 0x73,
+};
+
+static const uint8_t p384_b[] = {
+	0xb3, 0x31, 0x2f, 0xa7, 0xe2, 0x3e, 0xe7, 0xe4,
+	0x98, 0x8e, 0x05, 0x6b, 0xe3, 0xf8, 0x2d, 0x19,
+	0x18, 0x1d, 0x9c, 0x6e, 0xfe, 0x81, 0x41, 0x12,
+	0x03, 0x14, 0x08, 0x8f, 0x50, 0x13, 0x87, 0x5a,
+	0xc6, 0x56, 0x39, 0x8d, 0x8a, 0x2e, 0xd1, 0x9d,
+	0x2a, 0x85, 0xc8, 0xed, 0xd3, 0xec, 0x2a, 0xef,
+};
+
+static const uint8_t p384_gx[] = {
+	0xaa, 0x87, 0xca, 0x22, 0xbe, 0x8b, 0x05, 0x37,
+	0x8e, 0xb1, 0xc7, 0x1e, 0xf3, 0x20, 0xad, 0x74,
+	0x6e, 0x1d, 0x3b, 0x62, 0x8b, 0xa7, 0x9b, 0x98,
+	0x59, 0xf7, 0x41, 0xe0, 0x82, 0x54, 0x2a, 0x38,
+	0x55, 0x02, 0xf2, 0x5d, 0xbf, 0x55, 0x29, 0x6c,
+	0x3a, 0x54, 0x5e, 0x38, 0x72, 0x76, 0x0a, 0xb7,
+};
+
+static const uint8_t p384_gy[] = {
+	0x36, 0x17, 0xde, 0x4a, 0x96, 0x26, 0x2c, 0x6f,
+	0x5d, 0x9e, 0x98, 0xbf, 0x92, 0x92, 0xdc, 0x29,
+	0xf8, 0xf4, 0x1d, 0xbd, 0x28, 0x9a, 0x14, 0x7c,
+	0xe9, 0xda, 0x31, 0x13, 0xb5, 0xf0, 0xb8, 0xc0,
+	0x0a, 0x60, 0xb1, 0xce, 0x1d, 0x7e, 0x81, 0x9d,
+	0x7a, 0x43, 0x1d, 0x7c, 0x90, 0xea, 0x0e, 0x5f,
+};
+
+static const struct ecdsa_curve ecdsa_curves[] = {
+	{
+		.name = "prime256v1",
+		.bytes = ECDSA256_BYTES,
+		.p = p256_p,
+		.n = p256_n,
+		.b = p256_b,
+		.gx = p256_gx,
+		.gy = p256_gy,
+	},
+	{
+		.name = "secp384r1",
+		.bytes = ECDSA384_BYTES,
+		.p = p384_p,
+		.n = p384_n,
+		.b = p384_b,
+		.gx = p384_gx,
+		.gy = p384_gy,
+	},
+};
+
+const struct ecdsa_curve *ecdsa_get_curve(const char *name)
+{
+	int i;
+
+	for (i = 0; i < ARRAY_SIZE(ecdsa_curves); i++) {
+		if (!strcmp(ecdsa_curves[i].name, name))
+			return &ecdsa_curves[i];
+	}
+
+	return NULL;
+}
+
+/**
+ * ecc_decode() - Convert a big-endian byte array to a little endian word array
+ *
+ * @x:		Destination, @words words
+ * @src:	Source, @words * 4 bytes
+ * @words:	Number of words
+ */
+static void ecc_decode(uint32_t *x, const uint8_t *src, uint words)
+{
+	const uint8_t *ptr;
+	uint i;
+
+	for (i = 0; i < words; i++) {
+		ptr = src + (words - 1 - i) * 4;
+		x[i] = (uint32_t)ptr[0] << 24 | (uint32_t)ptr[1] << 16 |
+		       (uint32_t)ptr[2] << 8 | ptr[3];
+	}
+}
+
+static uint32_t ecc_add(uint32_t *r, const uint32_t *a, const uint32_t *b,
+			uint words)
+{
+	uint64_t acc = 0;
+	uint i;
+
+	for (i = 0; i < words; i++) {
+		acc += (uint64_t)a[i] + b[i];
+		r[i] = (uint32_t)acc;
+		acc >>= 32;
+	}
+
+	return (uint32_t)acc;
+}
+
+static uint32_t ecc_sub(uint32_t *r, const uint32_t *a, const uint32_t *b,
+			uint words)
+{
+	uint64_t acc;
+	uint32_t borrow = 0;
+	uint i;
+
+	for (i = 0; i < words; i++) {
+		acc = (uint64_t)a[i] - b[i] - borrow;
+		r[i] = (uint32_t)acc;
+		borrow = (uint32_t)(acc >> 32) & 1;
+	}
+
+	return borrow;
+}
+
+/* Set r to a if ctl is 1, or leave it unchanged if ctl is 0 */
+static void ecc_cond_copy(uint32_t *r, const uint32_t *a, uint32_t ctl,
+			  uint words)
+{
+	uint32_t mask = -ctl;
+	uint i;
+
+	for (i = 0; i < words; i++)
+		r[i] = (a[i] & mask) | (r[i] & ~mask);
+}
+
+/* Returns 1 if a is zero, else 0 */
+static uint32_t ecc_is_zero(const uint32_t *a, uint words)
+{
+	uint32_t acc = 0;
+	uint i;
+
+	for (i = 0; i < words; i++)
+		acc |= a[i];
+
+	return ((acc | -acc) >> 31) ^ 1;
+}
+
+/* Returns 1 if a < m, else 0 */
+static uint32_t ecc_is_less(const uint32_t *a, const uint32_t *m, uint words)
+{
+	uint32_t tmp[ECC_MAX_WORDS];
+
+	return ecc_sub(tmp, a, m, words);
+}
+
+/* r = a + b mod m, with a, b < m */
+static void ecc_mod_add(const struct ecc_mod *md, uint32_t *r,
+			const uint32_t *a, const uint32_t *b)
+{
+	uint32_t tmp[ECC_MAX_WORDS];
+	uint32_t carry, borrow;
+
+	carry = ecc_add(r, a, b, md->words);
+	borrow = ecc_sub(tmp, r, md->m, md->words);
+	ecc_cond_copy(r, tmp, carry | (borrow ^ 1), md->words);
+}
+
+/* r = a - b mod m, with a, b < m */
+static void ecc_mod_sub(const struct ecc_mod *md, uint32_t *r,
+			const uint32_t *a, const uint32_t *b)
+{
+	uint32_t tmp[ECC_MAX_WORDS];
+	uint32_t borrow;
+
+	borrow = ecc_sub(r, a, b, md->words);
+	ecc_add(tmp, r, md->m, md->words);
+	ecc_cond_copy(r, tmp, borrow, md->words);
+}
+
+/**
+ * ecc_mod_mul() - Montgomery multiplication
+ *
+ * Operation: r = a * b / R mod m, with a, b < m. The result may alias either
+ * input.
+ *
+ * @md:		Modulus
+ * @r:		Result
+ * @a:		Multiplier
+ * @b:		Multiplicand
+ */
+static void ecc_mod_mul(const struct ecc_mod *md, uint32_t *r,
+			const uint32_t *a, const uint32_t *b)
+{
+	uint32_t t[ECC_MAX_WORDS + 2];
+	uint32_t tmp[ECC_MAX_WORDS];
+	uint words = md->words;
+	uint64_t acc;
+	uint32_t q, borrow;
+	uint i, j;
+
+	for (i = 0; i < words + 2; i++)
+		t[i] = 0;
+
+	for (i = 0; i < words; i++) {
+		/* t += a * b[i] */
+		acc = 0;
+		for (j = 0; j < words; j++) {
+			acc += (uint64_t)a[j] * b[i] + t[j];
+			t[j] = (uint32_t)acc;
+			acc >>= 32;
+		}
+		acc += t[words];
+		t[words] = (uint32_t)acc;
+		t[words + 1] = (uint32_t)(acc >> 32);
+
+		/* t = (t + q * m) / 2^32, where q makes the low word zero */
+		q = t[0] * md->n0inv;
+		acc = (uint64_t)q * md->m[0] + t[0];
+		acc >>= 32;
+		for (j = 1; j < words; j++) {
+			acc += (uint64_t)q * md->m[j] + t[j];
+			t[j - 1] = (uint32_t)acc;
+			acc >>= 32;
+		}
+		acc += t[words];
+		t[words - 1] = (uint32_t)acc;
+		t[words] = t[words + 1] + (uint32_t)(acc >> 32);
+	}
+
+	/* t < 2m, so at most one subtraction is needed */
+	borrow = ecc_sub(tmp, t, md->m, words);
+	for (i = 0; i < words; i++)
+		r[i] = t[i];
+	ecc_cond_copy(r, tmp, t[words] | (borrow ^ 1), words);
+}
+
+/**
+ * ecc_mod_init() - Set up a modulus for Montgomery multiplication
+ *
+ * The modulus must be odd and have its top bit set, which is true for the
+ * primes and group orders of all supported curves.
+ *
+ * @md:		Modulus to set up
+ * @m:		Modulus as big-endian byte array
+ * @words:	Number of 32-bit words in the modulus
+ */
+static void ecc_mod_init(struct ecc_mod *md, const uint8_t *m, uint words)
+{
+	uint32_t zero[ECC_MAX_WORDS] = { 0 };
+	uint32_t inv;
+	uint i;
+
+	md->words = words;
+	ecc_decode(md->m, m, words);
+
+	/* Newton's iteration: each step doubles the number of correct bits */
+	inv = md->m[0];
+	for (i = 0; i < 4; i++)
+		inv *= 2 - md->m[0] * inv;
+	md->n0inv = -inv;
+
+	/* R mod m = 2^(32 * words) - m, since m > R / 2 */
+	ecc_sub(md->one, zero, md->m, words);
+
+	/* R^2 mod m, by doubling R mod m another 32 * words times */
+	memcpy(md->rr, md->one, words * sizeof(uint32_t));
+	for (i = 0; i < words * 32; i++)
+		ecc_mod_add(md, md->rr, md->rr, md->rr);
+}
+
+static void ecc_to_mont(const struct ecc_mod *md, uint32_t *r,
+			const uint32_t *a)
+{
+	ecc_mod_mul(md, r, a, md->rr);
+}
+
+static void ecc_from_mont(const struct ecc_mod *md, uint32_t *r,
+			  const uint32_t *a)
+{
+	uint32_t one[ECC_MAX_WORDS] = { 1 };
+
+	ecc_mod_mul(md, r, a, one);
+}
+
+/**
+ * ecc_mod_inv() - Modular inversion by exponentiation to m - 2
+ *
+ * The exponent only depends on the (public) modulus, so this runs in constant
+ * time with respect to @a.
+ *
+ * @md:		Modulus, which must be prime
+ * @r:		Result, 1 / a in Montgomery form
+ * @a:		Value to invert, in Montgomery form
+ */
+static void ecc_mod_inv(const struct ecc_mod *md, uint32_t *r,
+			const uint32_t *a)
+{
+	uint32_t e[ECC_MAX_WORDS], two[ECC_MAX_WORDS] = { 2 };
+	uint32_t acc[ECC_MAX_WORDS], tmp[ECC_MAX_WORDS];
+	int i;
+
+	ecc_sub(e, md->m, two, md->words);
+	memcpy(acc, md->one, md->words * sizeof(uint32_t));
+	for (i = md->words * 32 - 1; i >= 0; i--) {
+		ecc_mod_mul(md, acc, acc, acc);
+		ecc_mod_mul(md, tmp, acc, a);
+		ecc_cond_copy(acc, tmp, (e[i / 32] >> (i % 32)) & 1, md->words);
+	}
+	memcpy(r, acc, md->words * sizeof(uint32_t));
+}
+
+/**
+ * ecc_point_double() - Double a point
+ *
+ * This uses the formulas for a = -3 from "dbl-2001-b" in the Explicit-Formulas
+ * Database. Doubling the point at infinity, or a point with y = 0, correctly
+ * gives Z = 0. The result may alias the input.
+ *
+ * @ctx:	Curve context
+ * @r:		Result
+ * @pt:		Point to double
+ */
+static void ecc_point_double(const struct ecc_ctx *ctx, struct ecc_point *r,
+			     const struct ecc_point *pt)
+{
+	const struct ecc_mod *md = &ctx->p;
+	uint32_t delta[ECC_MAX_WORDS], gamma[ECC_MAX_WORDS];
+	uint32_t beta[ECC_MAX_WORDS], alpha[ECC_MAX_WORDS];
+	uint32_t t1[ECC_MAX_WORDS], t2[ECC_MAX_WORDS];
+
+	ecc_mod_mul(md, delta, pt->z, pt->z);
+	ecc_mod_mul(md, gamma, pt->y, pt->y);
+	ecc_mod_mul(md, beta, pt->x, gamma);
+
+	/* alpha = 3 * (x - delta) * (x + delta) */
+	ecc_mod_sub(md, t1, pt->x, delta);
+	ecc_mod_add(md, t2, pt->x, delta);
+	ecc_mod_mul(md, t1, t1, t2);
+	ecc_mod_add(md, alpha, t1, t1);
+	ecc_mod_add(md, alpha, alpha, t1);
+
+	/* z3 = (y + z)^2 - gamma - delta */
+	ecc_mod_add(md, t1, pt->y, pt->z);
+	ecc_mod_mul(md, t1, t1, t1);
+	ecc_mod_sub(md, t1, t1, gamma);
+	ecc_mod_sub(md, r->z, t1, delta);
+
+	/* x3 = alpha^2 - 8 * beta */
+	ecc_mod_add(md, beta, beta, beta);
+	ecc_mod_add(md, beta, beta, beta);
+	ecc_mod_mul(md, t1, alpha, alpha);
+	ecc_mod_sub(md, t1, t1, beta);
+	ecc_mod_sub(md, r->x, t1, beta);
+
+	/* y3 = alpha * (4 * beta - x3) - 8 * gamma^2 */
+	ecc_mod_sub(md, t1, beta, r->x);
+	ecc_mod_mul(md, t1, alpha, t1);
+	ecc_mod_mul(md, gamma, gamma, gamma);
+	ecc_mod_add(md, gamma, gamma, gamma);
+	ecc_mod_add(md, gamma, gamma, gamma);
+	ecc_mod_add(md, gamma, gamma, gamma);
+	ecc_mod_sub(md, r->y, t1, gamma);
+}
+
+/**
+ * ecc_point_add() - Add two points
+ *
+ * The special cases (either point at infinity, equal or opposite points) are
+ * handled explicitly. Only public values are processed during verification,
+ * so these branches do not leak anything. The result may alias either input.
+ *
+ * @ctx:	Curve context
+ * @r:		Result
+ * @a:		First point
+ * @b:		Second point
+ */
+static void ecc_point_add(const struct ecc_ctx *ctx, struct ecc_point *r,
+			  const struct ecc_point *a, const struct ecc_point *b)
+{
+	const struct ecc_mod *md = &ctx->p;
+	uint words = md->words;
+	uint32_t u1[ECC_MAX_WORDS], u2[ECC_MAX_WORDS];
+	uint32_t s1[ECC_MAX_WORDS], s2[ECC_MAX_WORDS];
+	uint32_t h[ECC_MAX_WORDS], rr[ECC_MAX_WORDS];
+	uint32_t t1[ECC_MAX_WORDS], t2[ECC_MAX_WORDS];
+
+	if (ecc_is_zero(a->z, words)) {
+		if (r != b)
+			memcpy(r, b, sizeof(*r));
+		return;
+	}
+	if (ecc_is_zero(b->z, words)) {
+		if (r != a)
+			memcpy(r, a, sizeof(*r));
+		return;
+	}
+
+	/* u1 = x1 * z2^2, s1 = y1 * z2^3 */
+	ecc_mod_mul(md, t1, b->z, b->z);
+	ecc_mod_mul(md, u1, a->x, t1);
+	ecc_mod_mul(md, t1, t1, b->z);
+	ecc_mod_mul(md, s1, a->y, t1);
+
+	/* u2 = x2 * z1^2, s2 = y2 * z1^3 */
+	ecc_mod_mul(md, t1, a->z, a->z);
+	ecc_mod_mul(md, u2, b->x, t1);
+	ecc_mod_mul(md, t1, t1, a->z);
+	ecc_mod_mul(md, s2, b->y, t1);
+
+	ecc_mod_sub(md, h, u2, u1);
+	ecc_mod_sub(md, rr, s2, s1);
+	if (ecc_is_zero(h, words)) {
+		if (ecc_is_zero(rr, words)) {
+			ecc_point_double(ctx, r, a);
+		} else {
+			/* a = -b */
+			memset(r, '\0', sizeof(*r));
+		}
+		return;
+	}
+
+	/* z3 = z1 * z2 * h */
+	ecc_mod_mul(md, t1, a->z, b->z);
+	ecc_mod_mul(md, r->z, t1, h);
+
+	/* t1 = h^3, u1 = u1 * h^2 */
+	ecc_mod_mul(md, t2, h, h);
+	ecc_mod_mul(md, t1, t2, h);
+	ecc_mod_mul(md, u1, u1, t2);
+
+	/* x3 = rr^2 - h^3 - 2 * u1 * h^2 */
+	ecc_mod_mul(md, t2, rr, rr);
+	ecc_mod_sub(md, t2, t2, t1);
+	ecc_mod_sub(md, t2, t2, u1);
+	ecc_mod_sub(md, r->x, t2, u1);
+
+	/* y3 = rr * (u1 * h^2 - x3) - s1 * h^3 */
+	ecc_mod_sub(md, t2, u1, r->x);
+	ecc_mod_mul(md, t2, rr, t2);
+	ecc_mod_mul(md, t1, s1, t1);
+	ecc_mod_sub(md, r->y, t2, t1);
+}
+
+/**
+ * ecc_point_init() - Set up an affine point, checking that it is on the curve
+ *
+ * @ctx:	Curve context
+ * @pt:		Returns the point in Jacobian coordinates, Montgomery form
+ * @x:		x coordinate, big-endian
+ * @y:		y coordinate, big-endian
+ * @return 0 if OK, -EINVAL if the point is not on the curve
+ */
+static int ecc_point_init(const struct ecc_ctx *ctx, struct ecc_point *pt,
+			  const uint8_t *x, const uint8_t *y)
+{
+	const struct ecc_mod *md = &ctx->p;
+	uint32_t lhs[ECC_MAX_WORDS], rhs[ECC_MAX_WORDS];
+	uint32_t tmp[ECC_MAX_WORDS];
+
+	ecc_decode(tmp, x, md->words);
+	if (!ecc_is_less(tmp, md->m, md->words))
+		return -EINVAL;
+	ecc_to_mont(md, pt->x, tmp);
+
+	ecc_decode(tmp, y, md->words);
+	if (!ecc_is_less(tmp, md->m, md->words))
+		return -EINVAL;
+	ecc_to_mont(md, pt->y, tmp);
+
+	memcpy(pt->z, md->one, md->words * sizeof(uint32_t));
+
+	/* y^2 = x^3 - 3x + b */
+	ecc_mod_mul(md, lhs, pt->y, pt->y);
+	ecc_mod_mul(md, rhs, pt->x, pt->x);
+	ecc_mod_mul(md, rhs, rhs, pt->x);
+	ecc_mod_add(md, tmp, pt->x, pt->x);
+	ecc_mod_add(md, tmp, tmp, pt->x);
+	ecc_mod_sub(md, rhs, rhs, tmp);
+	ecc_mod_add(md, rhs, rhs, ctx->b);
+	ecc_mod_sub(md, tmp, lhs, rhs);
+	if (!ecc_is_zero(tmp, md->words))
+		return -EINVAL;
+
+	return 0;
+}
+
+/* Decode a scalar and check that it is in the range [1, n - 1] */
+static int ecc_scalar_init(const struct ecc_ctx *ctx, uint32_t *k,
+			   const uint8_t *src)
+{
+	ecc_decode(k, src, ctx->n.words);
+	if (ecc_is_zero(k, ctx->n.words) ||
+	    !ecc_is_less(k, ctx->n.m, ctx->n.words))
+		return -EINVAL;
+
+	return 0;
+}
+
+int ecdsa_verify_hash(const struct ecdsa_curve *curve, const uint8_t *qx,
+		      const uint8_t *qy, const uint8_t *hash, uint hash_len,
+		      const uint8_t *sig)
+{
+	struct ecc_ctx ctx;
+	struct ecc_point g, q, gq, res;
+	uint32_t r[ECC_MAX_WORDS], s[ECC_MAX_WORDS], e[ECC_MAX_WORDS];
+	uint32_t u1[ECC_MAX_WORDS], u2[ECC_MAX_WORDS], tmp[ECC_MAX_WORDS];
+	uint8_t ebuf[ECDSA_MAX_BYTES];
+	uint words;
+	int bit1, bit2;
+	int i;
+
+	if (!curve || curve->bytes > ECDSA_MAX_BYTES || curve->bytes % 4)
+		return -EINVAL;
+	words = curve->bytes / 4;
+
+	ecc_mod_init(&ctx.p, curve->p, words);
+	ecc_mod_init(&ctx.n, curve->n, words);
+	ecc_decode(tmp, curve->b, words);
+	ecc_to_mont(&ctx.p, ctx.b, tmp);
+
+	if (ecc_scalar_init(&ctx, r, sig) ||
+	    ecc_scalar_init(&ctx, s, sig + curve->bytes)) {
+		debug("ECDSA: signature out of range\n");
+		return -EINVAL;
+	}
+
+	if (ecc_point_init(&ctx, &q, qx, qy)) {
+		debug("ECDSA: public key is not on curve %s\n", curve->name);
+		return -EINVAL;
+	}
+	ecc_point_init(&ctx, &g, curve->gx, curve->gy);
+
+	/* e = leftmost bits of the hash, reduced modulo n */
+	memset(ebuf, '\0', sizeof(ebuf));
+	if (hash_len > curve->bytes)
+		hash_len = curve->bytes;
+	memcpy(ebuf + curve->bytes - hash_len, hash, hash_len);
+	ecc_decode(e, ebuf, words);
+	if (ecc_sub(tmp, e, ctx.n.m, words) == 0)
+		memcpy(e, tmp, sizeof(tmp));
+
+	/* w = 1 / s; u1 = e * w, u2 = r * w (all mod n) */
+	ecc_to_mont(&ctx.n, tmp, s);
+	ecc_mod_inv(&ctx.n, tmp, tmp);
+	ecc_mod_mul(&ctx.n, u1, e, tmp);
+	ecc_mod_mul(&ctx.n, u2, r, tmp);
+
+	/* res = u1 * G + u2 * Q, using Shamir's trick */
+	ecc_point_add(&ctx, &gq, &g, &q);
+	memset(&res, '\0', sizeof(res));
+	for (i = words * 32 - 1; i >= 0; i--) {
+		ecc_point_double(&ctx, &res, &res);
+		bit1 = (u1[i / 32] >> (i % 32)) & 1;
+		bit2 = (u2[i / 32] >> (i % 32)) & 1;
+		if (bit1 && bit2)
+			ecc_point_add(&ctx, &res, &res, &gq);
+		else if (bit1)
+			ecc_point_add(&ctx, &res, &res, &g);
+		else if (bit2)
+			ecc_point_add(&ctx, &res, &res, &q);
+	}
+	if (ecc_is_zero(res.z, words))
+		return -EINVAL;
+
+	/* x = X / Z^2, reduced modulo n */
+	ecc_mod_inv(&ctx.p, tmp, res.z);
+	ecc_mod_mul(&ctx.p, tmp, tmp, tmp);
+	ecc_mod_mul(&ctx.p, tmp, res.x, tmp);
+	ecc_from_mont(&ctx.p, e, tmp);
+	if (ecc_sub(tmp, e, ctx.n.m, words) == 0)
+		memcpy(e, tmp, sizeof(tmp));
+
+	ecc_sub(tmp, e, r, words);
+	if (!ecc_is_zero(tmp, words)) {
+		debug("ECDSA: signature mismatch\n");
+		return -EINVAL;
+	}
+
+	return 0;
+}
@@ -0,0 +1,305 @@
+// SPDX-License-Identifier: GPL-2.0+
+/*
+ * ECDSA signing of FIT images, using OpenSSL
+ */
+
+#include "mkimage.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <image.h>
+#include <openssl/bn.h>
+#include <openssl/ec.h>
+#include <openssl/ecdsa.h>
+#include <openssl/obj_mac.h>
+#include <openssl/pem.h>
+#include <openssl/err.h>
+#include <openssl/evp.h>
+#include <u-boot/ecdsa.h>
+
+#if OPENSSL_VERSION_NUMBER < 0x10100000L || \
+	(defined(LIBRESSL_VERSION_NUMBER) && LIBRESSL_VERSION_NUMBER < 0x02070000fL)
+static void ECDSA_SIG_get0(const ECDSA_SIG *sig, const BIGNUM **pr,
+			   const BIGNUM **ps)
+{
+	if (pr != NULL)
+		*pr = sig->r;
+	if (ps != NULL)
+		*ps = sig->s;
+}
+#endif
+
+static int ecdsa_err(const char *msg)
+{
+	unsigned long sslErr = ERR_get_error();
+
+	fprintf(stderr, "%s", msg);
+	fprintf(stderr, ": %s\n",
+		ERR_error_string(sslErr, 0));
+
+	return -1;
+}
+
+/**
+ * ecdsa_get_priv_key() - read a private key from a .key file
+ *
+ * @keydir:	Directory containing the key
+ * @name:	Name of key file (will have a .key extension)
+ * @info:	Signing information, used to check the curve size
+ * @ecp:	Returns EC_KEY object, or NULL on failure
+ * @return 0 if ok, -ve on error (in which case *ecp will be set to NULL)
+ */
+static int ecdsa_get_priv_key(const char *keydir, const char *name,
+			      struct image_sign_info *info, EC_KEY **ecp)
+{
+	char path[1024];
+	EC_KEY *ec;
+	FILE *f;
+	int bits;
+
+	*ecp = NULL;
+	snprintf(path, sizeof(path), "%s/%s.key", keydir, name);
+	f = fopen(path, "r");
+	if (!f) {
+		fprintf(stderr, "Couldn't open ECDSA private key: '%s': %s\n",
+			path, strerror(errno));
+		return -ENOENT;
+	}
+
+	ec = PEM_read_ECPrivateKey(f, 0, NULL, path);
+	fclose(f);
+	if (!ec) {
+		ecdsa_err("Failure reading private key");
+		return -EPROTO;
+	}
+
+	bits = EC_GROUP_get_degree(EC_KEY_get0_group(ec));
+	if ((bits + 7) / 8 != info->crypto->key_len) {
+		fprintf(stderr, "Key '%s' has %d bits, but %s was requested\n",
+			path, bits, info->crypto->name);
+		EC_KEY_free(ec);
+		return -EINVAL;
+	}
+	*ecp = ec;
+
+	return 0;
+}
+
+/**
+ * ecdsa_bn_to_bytes() - Write a big number as a fixed-size big-endian array
+ *
+ * @num:	Number to write
+ * @buf:	Destination buffer
+ * @size:	Size of the destination buffer, the number is zero-padded
+ * @return 0 if ok, -EINVAL if the number does not fit
+ */
+static int ecdsa_bn_to_bytes(const BIGNUM *num, uint8_t *buf, int size)
+{
+	int len = BN_num_bytes(num);
+
+	if (len > size)
+		return -EINVAL;
+	memset(buf, '\0', size - len);
+	BN_bn2bin(num, buf + size - len);
+
+	return 0;
+}
+
+int ecdsa_sign(struct image_sign_info *info,
+	       const struct image_region region[], int region_count,
+	       uint8_t **sigp, uint *sig_len)
+{
+	const BIGNUM *r, *s;
+	const unsigned char *ptr;
+	EVP_MD_CTX *context;
+	EVP_PKEY *key;
+	ECDSA_SIG *ecsig;
+	uint8_t *der, *sig;
+	size_t der_len;
+	EC_KEY *ec;
+	int size, ret, i;
+
+	ret = ecdsa_get_priv_key(info->keydir, info->keyname, info, &ec);
+	if (ret)
+		return ret;
+
+	key = EVP_PKEY_new();
+	if (!key || !EVP_PKEY_set1_EC_KEY(key, ec)) {
+		ret = ecdsa_err("EVP key setup failed");
+		goto err_key;
+	}
+
+	der_len = EVP_PKEY_size(key);
+	der = malloc(der_len);
+	size = info->crypto->key_len;
+	sig = malloc(size * 2);
+	if (!der || !sig) {
+		fprintf(stderr, "Out of memory for signature\n");
+		ret = -ENOMEM;
+		goto err_alloc;
+	}
+
+	context = EVP_MD_CTX_create();
+	if (!context) {
+		ret = ecdsa_err("EVP context creation failed");
+		goto err_alloc;
+	}
+
+	if (EVP_DigestSignInit(context, NULL, info->checksum->calculate_sign(),
+			       NULL, key) <= 0) {
+		ret = ecdsa_err("Signer setup failed");
+		goto err_sign;
+	}
+
+	for (i = 0; i < region_count; i++) {
+		if (!EVP_DigestSignUpdate(context, region[i].data,
+					  region[i].size)) {
+			ret = ecdsa_err("Signing data failed");
+			goto err_sign;
+		}
+	}
+
+	if (!EVP_DigestSignFinal(context, der, &der_len)) {
+		ret = ecdsa_err("Could not obtain signature");
+		goto err_sign;
+	}
+
+	/* Convert the DER signature to the fixed-size r || s format */
+	ptr = der;
+	ecsig = d2i_ECDSA_SIG(NULL, &ptr, der_len);
+	if (!ecsig) {
+		ret = ecdsa_err("Could not decode signature");
+		goto err_sign;
+	}
+	ECDSA_SIG_get0(ecsig, &r, &s);
+	ret = ecdsa_bn_to_bytes(r, sig, size);
+	if (!ret)
+		ret = ecdsa_bn_to_bytes(s, sig + size, size);
+	ECDSA_SIG_free(ecsig);
+	if (ret) {
+		fprintf(stderr, "Signature does not fit in %d bytes\n", size);
+		goto err_sign;
+	}
+
+	EVP_MD_CTX_destroy(context);
+	free(der);
+	EVP_PKEY_free(key);
+	EC_KEY_free(ec);
+
+	*sigp = sig;
+	*sig_len = size * 2;
+
+	return 0;
+
+err_sign:
+	EVP_MD_CTX_destroy(context);
+err_alloc:
+	free(sig);
+	free(der);
+err_key:
+	EVP_PKEY_free(key);
+	EC_KEY_free(ec);
+
+	return ret;
+}
+
+int ecdsa_add_verify_data(struct image_sign_info *info, void *keydest)
+{
+	const EC_GROUP *group;
+	const char *curve_name;
+	uint8_t x[ECDSA_MAX_BYTES], y[ECDSA_MAX_BYTES];
+	BIGNUM *bx, *by;
+	int parent, node;
+	char name[100];
+	EC_KEY *ec;
+	int size;
+	int ret;
+
+	debug("%s: Getting verification data\n", __func__);
+	ret = ecdsa_get_priv_key(info->keydir, info->keyname, info, &ec);
+	if (ret)
+		return ret;
+
+	group = EC_KEY_get0_group(ec);
+	curve_name = OBJ_nid2sn(EC_GROUP_get_curve_name(group));
+	if (!curve_name) {
+		fprintf(stderr, "Key '%s/%s.key' is not on a named curve\n",
+			info->keydir, info->keyname);
+		EC_KEY_free(ec);
+		return -EINVAL;
+	}
+	size = info->crypto->key_len;
+	bx = BN_new();
+	by = BN_new();
+	if (!bx || !by ||
+	    !EC_POINT_get_affine_coordinates_GFp(group,
+						 EC_KEY_get0_public_key(ec),
+						 bx, by, NULL)) {
+		ret = ecdsa_err("Could not get public key point");
+		goto done;
+	}
+	if (ecdsa_bn_to_bytes(bx, x, size) || ecdsa_bn_to_bytes(by, y, size)) {
+		ret = -EINVAL;
+		goto done;
+	}
+
+	parent = fdt_subnode_offset(keydest, 0, FIT_SIG_NODENAME);
+	if (parent == -FDT_ERR_NOTFOUND) {
+		parent = fdt_add_subnode(keydest, 0, FIT_SIG_NODENAME);
+		if (parent < 0) {
+			ret = parent;
+			if (ret != -FDT_ERR_NOSPACE) {
+				fprintf(stderr, "Couldn't create signature node: %s\n",
+					fdt_strerror(parent));
+			}
+		}
+	}
+	if (ret)
+		goto done;
+
+	/* Either create or overwrite the named key node */
+	snprintf(name, sizeof(name), "key-%s", info->keyname);
+	node = fdt_subnode_offset(keydest, parent, name);
+	if (node == -FDT_ERR_NOTFOUND) {
+		node = fdt_add_subnode(keydest, parent, name);
+		if (node < 0) {
+			ret = node;
+			if (ret != -FDT_ERR_NOSPACE) {
+				fprintf(stderr, "Could not create key subnode: %s\n",
+					fdt_strerror(node));
+			}
+		}
+	} else if (node < 0) {
+		fprintf(stderr, "Cannot select keys parent: %s\n",
+			fdt_strerror(node));
+		ret = node;
+	}
+
+	if (!ret) {
+		ret = fdt_setprop_string(keydest, node, FIT_KEY_HINT,
+					 info->keyname);
+	}
+	if (!ret)
+		ret = fdt_setprop_string(keydest, node, "ecdsa,curve",
+					 curve_name);
+	if (!ret)
+		ret = fdt_setprop(keydest, node, "ecdsa,x-point", x, size);
+	if (!ret)
+		ret = fdt_setprop(keydest, node, "ecdsa,y-point", y, size);
+	if (!ret) {
+		ret = fdt_setprop_string(keydest, node, FIT_ALGO_PROP,
+					 info->name);
+	}
+	if (!ret && info->require_keys) {
+		ret = fdt_setprop_string(keydest, node, FIT_KEY_REQUIRED,
+					 info->require_keys);
+	}
+	if (ret)
+		ret = ret == -FDT_ERR_NOSPACE ? -ENOSPC : -EIO;
+done:
+	BN_free(bx);
+	BN_free(by);
+	EC_KEY_free(ec);
+
+	return ret;
+}
@@ -0,0 +1,138 @@
+// SPDX-License-Identifier: GPL-2.0+
+/*
+ * ECDSA signature verification for FIT images
+ */
+
+#ifndef USE_HOSTCC
+#include <common.h>
+#include <fdtdec.h>
+#include <log.h>
+#include <linux/errno.h>
+#else
+#include "fdt_host.h"
+#include "mkimage.h"
+#include <fdt_support.h>
+#endif
+#include <u-boot/ecdsa.h>
+
+/**
+ * ecdsa_verify_with_keynode() - Verify a signature against some data using
+ * the ECDSA public key held in a key node.
+ *
+ * The key node must describe a key for the curve implied by the algorithm
+ * name, so that e.g. a "sha256,ecdsa384" signature is never checked against a
+ * P-256 key.
+ *
+ * @info:	Specifies key and FIT information
+ * @hash:	Pointer to the expected hash
+ * @sig:	Signature
+ * @sig_len:	Number of bytes in signature
+ * @node:	Node having the ECDSA key properties
+ * @return 0 if verified, -ve on error
+ */
+static int ecdsa_verify_with_keynode(struct image_sign_info *info,
+				     const void *hash, uint8_t *sig,
+				     uint sig_len, int node)
+{
+	const void *blob = info->fdt_blob;
+	const struct ecdsa_curve *curve;
+	const char *curve_name;
+	const void *x, *y;
+	int x_len, y_len;
+
+	if (node < 0) {
+		debug("%s: Skipping invalid node", __func__);
+		return -EBADF;
+	}
+
+	curve_name = fdt_getprop(blob, node, "ecdsa,curve", NULL);
+	if (!curve_name) {
+		debug("%s: Missing ECDSA key info", __func__);
+		return -EFAULT;
+	}
+
+	curve = ecdsa_get_curve(curve_name);
+	if (!curve || curve->bytes != info->crypto->key_len) {
+		debug("%s: Unsupported curve '%s' for %s\n", __func__,
+		      curve_name, info->crypto->name);
+		return -EINVAL;
+	}
+
+	x = fdt_getprop(blob, node, "ecdsa,x-point", &x_len);
+	y = fdt_getprop(blob, node, "ecdsa,y-point", &y_len);
+	if (!x || !y || x_len != curve->bytes || y_len != curve->bytes) {
+		debug("%s: Missing ECDSA key info", __func__);
+		return -EFAULT;
+	}
+
+	if (sig_len != curve->bytes * 2) {
+		debug("Signature is of incorrect length %d\n", sig_len);
+		return -EINVAL;
+	}
+
+	return ecdsa_verify_hash(curve, x, y, hash,
+				 info->checksum->checksum_len, sig);
+}
+
+int ecdsa_verify(struct image_sign_info *info,
+		 const struct image_region region[], int region_count,
+		 uint8_t *sig, uint sig_len)
+{
+	const void *blob = info->fdt_blob;
+	/* Reserve memory for maximum checksum-length */
+	uint8_t hash[info->crypto->key_len];
+	int ndepth, noffset;
+	int sig_node, node;
+	char name[100];
+	int ret;
+
+	/*
+	 * Verify that the checksum-length does not exceed the size of the
+	 * curve
+	 */
+	if (info->checksum->checksum_len > info->crypto->key_len) {
+		debug("%s: invalid checksum-algorithm %s for %s\n",
+		      __func__, info->checksum->name, info->crypto->name);
+		return -EINVAL;
+	}
+
+	sig_node = fdt_subnode_offset(blob, 0, FIT_SIG_NODENAME);
+	if (sig_node < 0) {
+		debug("%s: No signature node found\n", __func__);
+		return -ENOENT;
+	}
+
+	/* Calculate checksum with checksum-algorithm */
+	ret = info->checksum->calculate(info->checksum->name,
+					region, region_count, hash);
+	if (ret < 0) {
+		debug("%s: Error in checksum calculation\n", __func__);
+		return -EINVAL;
+	}
+
+	/* See if we must use a particular key */
+	if (info->required_keynode != -1)
+		return ecdsa_verify_with_keynode(info, hash, sig, sig_len,
+						 info->required_keynode);
+
+	/* Look for a key that matches our hint */
+	snprintf(name, sizeof(name), "key-%s", info->keyname);
+	node = fdt_subnode_offset(blob, sig_node, name);
+	ret = ecdsa_verify_with_keynode(info, hash, sig, sig_len, node);
+	if (!ret)
+		return ret;
+
+	/* No luck, so try each of the keys in turn */
+	for (ndepth = 0, noffset = fdt_next_node(blob, sig_node, &ndepth);
+	     (noffset >= 0) && (ndepth > 0);
+	     noffset = fdt_next_node(blob, noffset, &ndepth)) {
+		if (ndepth == 1 && noffset != node) {
+			ret = ecdsa_verify_with_keynode(info, hash, sig,
+							sig_len, noffset);
+			if (!ret)
+				break;
+		}
+	}
+
+	return ret;
+}
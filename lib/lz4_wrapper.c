@@ -62,6 +62,20 @@ struct lz4_block_header {
 	/* + u32 block_checksum iff has_block_checksum is set */
 } __packed;
 
+int ulz4fn_block(const void *src, size_t srcn, void *dst, size_t *dstn)
+{
+	int ret;
+
+	/* constant folding essential, do not touch params! */
+	ret = LZ4_decompress_generic(src, dst, srcn, *dstn, endOnInputSize,
+				     full, 0, noDict, dst, NULL, 0);
+	if (ret < 0)
+		return -EPROTO;	/* decompression error */
+	*dstn = ret;
+
+	return 0;
+}
+
 int ulz4fn(const void *src, size_t srcn, void *dst, size_t *dstn)
 {
 	const void *end = dst + *dstn;
@@ -68,6 +68,9 @@ typedef struct
 
 void LzmaDec_Init(CLzmaDec *p);
 
+/* Resets the dictionary and/or the state, as LZMA2 chunks require */
+void LzmaDec_InitDicAndState(CLzmaDec *p, Bool initDic, Bool initState);
+
 /* There are two types of LZMA streams:
      0) Stream with end mark. That end mark adds about 6 bytes to compressed size.
      1) Stream without end mark. You must know exact uncompressed size to decompress such stream. */
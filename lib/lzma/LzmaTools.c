@@ -15,6 +15,8 @@
  * uint64  Uncompressed size
  * uchar   data[*]
  *
+ * With CONFIG_LZMA_XZ, files in the .xz container format are handed over to
+ * xzBuffToBuffDecompress() instead.
  */
 
 #include <config.h>
@@ -30,6 +32,7 @@
 
 #include "LzmaTools.h"
 #include "LzmaDec.h"
+#include "XzTools.h"
 
 #include <linux/string.h>
 #include <malloc.h>
@@ -51,6 +54,10 @@ int lzmaBuffToBuffDecompress (unsigned char *outStream, SizeT *uncompressedSize,
     ELzmaStatus state;
     SizeT compressedSize = (SizeT)(length - LZMA_PROPS_SIZE);
 
+    if (CONFIG_IS_ENABLED(LZMA_XZ) && xz_check_magic(inStream, length))
+        return xzBuffToBuffDecompress(outStream, uncompressedSize,
+                                      inStream, length);
+
     debug ("LZMA: Image address............... 0x%p\n", inStream);
     debug ("LZMA: Properties address.......... 0x%p\n", inStream + LZMA_PROPERTIES_OFFSET);
     debug ("LZMA: Uncompressed size address... 0x%p\n", inStream + LZMA_SIZE_OFFSET);
@@ -0,0 +1,577 @@
+// SPDX-License-Identifier: GPL-2.0+
+/*
+ * Decoder for the .xz container format, using LZMA2 on top of LzmaDec.c
+ *
+ * The format is described in "The .xz File Format", version 1.0.4, see
+ * https://tukaani.org/xz/xz-file-format.txt
+ *
+ * Only the LZMA2 filter is supported, which is what 'xz' uses unless told
+ * otherwise. Since the whole output is in memory, LZMA2 chunks are decoded
+ * straight into the output buffer, which doubles as the dictionary, so no
+ * extra dictionary buffer has to be allocated however large the dictionary
+ * size in the block header is.
+ */
+
+#include <common.h>
+#include <log.h>
+#include <malloc.h>
+#include <watchdog.h>
+#include <asm/unaligned.h>
+#include <u-boot/crc.h>
+#include <u-boot/sha256.h>
+
+#include "LzmaDec.h"
+#include "XzTools.h"
+
+#define XZ_HEADER_SIZE		12
+#define XZ_FOOTER_SIZE		12
+
+#define XZ_CHECK_NONE		0x00
+#define XZ_CHECK_CRC32		0x01
+#define XZ_CHECK_CRC64		0x04
+#define XZ_CHECK_SHA256		0x0a
+#define XZ_CHECK_MAX_SIZE	32
+
+#define XZ_FILTER_LZMA2		0x21
+#define XZ_VLI_BYTES_MAX	9
+
+/* LZMA2 allows lc + lp <= 4, so this many probabilities are always enough */
+#define LZMA2_LCLP_MAX		4
+
+static const u8 xz_header_magic[XZ_HEADER_MAGIC_SIZE] = {
+	0xfd, '7', 'z', 'X', 'Z', 0x00
+};
+static const u8 xz_footer_magic[2] = { 'Y', 'Z' };
+
+/**
+ * struct xz_dec - state of the .xz decoder
+ *
+ * @lzma:	LZMA decoder, whose dictionary points into @out
+ * @in:		Input buffer
+ * @in_pos:	Current position in @in
+ * @in_size:	Size of @in
+ * @out:	Output buffer
+ * @out_pos:	Number of bytes written to @out
+ * @out_size:	Size of @out
+ * @check:	Type of integrity check used by the current stream
+ * @count:	Number of blocks seen in the current stream
+ * @hash:	Hash of the sizes of those blocks, compared with the index
+ */
+struct xz_dec {
+	CLzmaDec lzma;
+	const u8 *in;
+	SizeT in_pos;
+	SizeT in_size;
+	u8 *out;
+	SizeT out_pos;
+	SizeT out_size;
+	unsigned int check;
+	u64 count;
+	u32 hash;
+};
+
+static void *SzAlloc(void *p, size_t size) { return malloc(size); }
+static void SzFree(void *p, void *address) { free(address); }
+
+#define XZ_CRC64_POLY		0xc96c5795d7870f42ULL
+
+static u64 xz_crc64_table[256];
+
+static u64 xz_crc64(const u8 *buf, size_t len)
+{
+	u64 crc = ~0ULL;
+
+	if (!xz_crc64_table[1]) {
+		int i, j;
+
+		for (i = 0; i < 256; i++) {
+			u64 r = i;
+
+			for (j = 0; j < 8; j++)
+				r = (r >> 1) ^ (XZ_CRC64_POLY & -(r & 1));
+			xz_crc64_table[i] = r;
+		}
+	}
+
+	while (len--)
+		crc = xz_crc64_table[(crc ^ *buf++) & 0xff] ^ (crc >> 8);
+
+	return ~crc;
+}
+
+static unsigned int xz_check_size(unsigned int check)
+{
+	switch (check) {
+	case XZ_CHECK_NONE:
+		return 0;
+	case XZ_CHECK_CRC32:
+		return 4;
+	case XZ_CHECK_CRC64:
+		return 8;
+	case XZ_CHECK_SHA256:
+		return 32;
+	}
+
+	return 0;
+}
+
+static bool xz_check_supported(unsigned int check)
+{
+	switch (check) {
+	case XZ_CHECK_NONE:
+	case XZ_CHECK_CRC32:
+	case XZ_CHECK_CRC64:
+		return true;
+	case XZ_CHECK_SHA256:
+		return IS_ENABLED(CONFIG_SHA256);
+	}
+
+	return false;
+}
+
+static int xz_verify_check(unsigned int check, const u8 *data, size_t len,
+			   const u8 *expect)
+{
+	u8 digest[XZ_CHECK_MAX_SIZE];
+
+	switch (check) {
+	case XZ_CHECK_CRC32:
+		put_unaligned_le32(crc32(0, data, len), digest);
+		break;
+	case XZ_CHECK_CRC64:
+		put_unaligned_le64(xz_crc64(data, len), digest);
+		break;
+#ifdef CONFIG_SHA256
+	case XZ_CHECK_SHA256:
+		sha256_csum_wd(data, len, digest, CHUNKSZ_SHA256);
+		break;
+#endif
+	default:
+		return SZ_OK;
+	}
+
+	return memcmp(digest, expect, xz_check_size(check)) ?
+		SZ_ERROR_CRC : SZ_OK;
+}
+
+/*
+ * Combine the sizes of a block into a hash, so that the blocks that were
+ * decoded can be compared with the index without having to store them
+ */
+static u32 xz_hash_block(u32 hash, u64 unpadded, u64 uncompressed)
+{
+	u8 buf[16];
+
+	put_unaligned_le64(unpadded, buf);
+	put_unaligned_le64(uncompressed, buf + 8);
+
+	return crc32(hash, buf, sizeof(buf));
+}
+
+static int xz_read_vli(const u8 *buf, size_t size, size_t *pos, u64 *val)
+{
+	u64 res = 0;
+	int i;
+
+	for (i = 0; i < XZ_VLI_BYTES_MAX; i++) {
+		u8 b;
+
+		if (*pos >= size)
+			return SZ_ERROR_INPUT_EOF;
+		b = buf[(*pos)++];
+		res |= (u64)(b & 0x7f) << (i * 7);
+		if (!(b & 0x80)) {
+			/* Multi-byte values must use the shortest encoding */
+			if (!b && i)
+				return SZ_ERROR_DATA;
+			*val = res;
+			return SZ_OK;
+		}
+	}
+
+	return SZ_ERROR_DATA;
+}
+
+bool xz_check_magic(const unsigned char *inStream, SizeT length)
+{
+	return length >= XZ_HEADER_MAGIC_SIZE &&
+		!memcmp(inStream, xz_header_magic, XZ_HEADER_MAGIC_SIZE);
+}
+
+static void xz_lzma2_uncompressed(CLzmaDec *p, const u8 *src, SizeT size)
+{
+	memcpy(p->dic + p->dicPos, src, size);
+	p->dicPos += size;
+	if (!p->checkDicSize && p->prop.dicSize - p->processedPos <= size)
+		p->checkDicSize = p->prop.dicSize;
+	p->processedPos += size;
+}
+
+/**
+ * xz_dec_lzma2() - Decode the LZMA2 data of a block
+ *
+ * @s:		Decoder state, the LZMA2 data starts at s->in_pos
+ * @dict_size:	Dictionary size from the block header
+ * @return SZ_OK on success, or an SZ_ERROR_... value on failure
+ */
+static int xz_dec_lzma2(struct xz_dec *s, u32 dict_size)
+{
+	CLzmaDec *p = &s->lzma;
+	bool need_dict_reset = true;
+	bool need_props = true;
+
+	p->dic = s->out + s->out_pos;
+	p->dicBufSize = s->out_size - s->out_pos;
+	p->dicPos = 0;
+	p->prop.dicSize = dict_size;
+
+	for (;;) {
+		const u8 *in = s->in + s->in_pos;
+		SizeT avail = s->in_size - s->in_pos;
+		SizeT unpacked, packed;
+		ELzmaStatus status;
+		u8 control;
+		int res;
+
+		if (!avail)
+			return SZ_ERROR_INPUT_EOF;
+		control = *in;
+		if (!control)
+			break;
+
+		if (control >= 0xe0 || control == 0x01) {
+			need_props = true;
+			need_dict_reset = false;
+		} else if (need_dict_reset) {
+			return SZ_ERROR_DATA;
+		}
+
+		if (control < 0x80) {
+			/* Uncompressed chunk, 0x01 also resets the dictionary */
+			if (control > 0x02)
+				return SZ_ERROR_DATA;
+			if (avail < 3)
+				return SZ_ERROR_INPUT_EOF;
+			unpacked = get_unaligned_be16(in + 1) + 1;
+			s->in_pos += 3;
+			if (unpacked > avail - 3)
+				return SZ_ERROR_INPUT_EOF;
+			if (unpacked > p->dicBufSize - p->dicPos)
+				return SZ_ERROR_OUTPUT_EOF;
+			if (control == 0x01)
+				LzmaDec_InitDicAndState(p, True, False);
+			xz_lzma2_uncompressed(p, in + 3, unpacked);
+			s->in_pos += unpacked;
+			continue;
+		}
+
+		/* LZMA chunk, bits 5-6 of the control byte tell what to reset */
+		if (avail < 5)
+			return SZ_ERROR_INPUT_EOF;
+		unpacked = ((control & 0x1f) << 16) + get_unaligned_be16(in + 1) +
+			1;
+		packed = get_unaligned_be16(in + 3) + 1;
+		s->in_pos += 5;
+		if (control >= 0xc0) {
+			unsigned int props, lc, lp;
+
+			if (s->in_pos >= s->in_size)
+				return SZ_ERROR_INPUT_EOF;
+			props = s->in[s->in_pos++];
+			if (props >= 9 * 5 * 5)
+				return SZ_ERROR_DATA;
+			lc = props % 9;
+			lp = (props / 9) % 5;
+			if (lc + lp > LZMA2_LCLP_MAX)
+				return SZ_ERROR_DATA;
+			p->prop.lc = lc;
+			p->prop.lp = lp;
+			p->prop.pb = props / 45;
+			need_props = false;
+		} else if (need_props) {
+			return SZ_ERROR_DATA;
+		}
+
+		if (packed > s->in_size - s->in_pos)
+			return SZ_ERROR_INPUT_EOF;
+		if (unpacked > p->dicBufSize - p->dicPos)
+			return SZ_ERROR_OUTPUT_EOF;
+
+		LzmaDec_InitDicAndState(p, control >= 0xe0, control >= 0xa0);
+		avail = packed;
+		unpacked += p->dicPos;
+		res = LzmaDec_DecodeToDic(p, unpacked, s->in + s->in_pos, &avail,
+					  LZMA_FINISH_ANY, &status);
+		if (res != SZ_OK)
+			return res;
+		/* A chunk must end exactly at a symbol boundary */
+		if (avail != packed || p->dicPos != unpacked || p->remainLen ||
+		    p->code)
+			return SZ_ERROR_DATA;
+		s->in_pos += packed;
+
+		WATCHDOG_RESET();
+	}
+
+	s->in_pos++;
+	s->out_pos += p->dicPos;
+
+	return SZ_OK;
+}
+
+/**
+ * xz_dec_block() - Decode one block, starting with its header
+ *
+ * @s:		Decoder state, the block header starts at s->in_pos
+ * @return SZ_OK on success, or an SZ_ERROR_... value on failure
+ */
+static int xz_dec_block(struct xz_dec *s)
+{
+	const u8 *hdr = s->in + s->in_pos;
+	u64 compressed = -1ULL, uncompressed = -1ULL;
+	u64 filter, props_size;
+	SizeT start, out_start;
+	size_t hdr_size, pos;
+	unsigned int check_size, d;
+	u32 dict_size;
+	int res;
+
+	hdr_size = (hdr[0] + 1) * 4;
+	if (hdr_size > s->in_size - s->in_pos)
+		return SZ_ERROR_INPUT_EOF;
+	if (crc32(0, hdr, hdr_size - 4) !=
+	    get_unaligned_le32(hdr + hdr_size - 4))
+		return SZ_ERROR_CRC;
+
+	/* Filter chains (e.g. BCJ + LZMA2) are not supported */
+	if (hdr[1] & 0x3f) {
+		debug("XZ: Unsupported block flags %#x\n", hdr[1]);
+		return SZ_ERROR_UNSUPPORTED;
+	}
+
+	pos = 2;
+	hdr_size -= 4;
+	if (hdr[1] & 0x40) {
+		res = xz_read_vli(hdr, hdr_size, &pos, &compressed);
+		if (res != SZ_OK)
+			return SZ_ERROR_DATA;
+	}
+	if (hdr[1] & 0x80) {
+		res = xz_read_vli(hdr, hdr_size, &pos, &uncompressed);
+		if (res != SZ_OK)
+			return SZ_ERROR_DATA;
+	}
+
+	if (xz_read_vli(hdr, hdr_size, &pos, &filter) != SZ_OK ||
+	    xz_read_vli(hdr, hdr_size, &pos, &props_size) != SZ_OK)
+		return SZ_ERROR_DATA;
+	if (filter != XZ_FILTER_LZMA2 || props_size != 1) {
+		debug("XZ: Unsupported filter %#llx\n", filter);
+		return SZ_ERROR_UNSUPPORTED;
+	}
+	if (pos >= hdr_size)
+		return SZ_ERROR_DATA;
+	d = hdr[pos++];
+	if (d > 40)
+		return SZ_ERROR_DATA;
+	dict_size = d == 40 ? 0xffffffff : (2 | (d & 1)) << (d / 2 + 11);
+
+	/* The rest of the header is padding */
+	while (pos < hdr_size) {
+		if (hdr[pos++])
+			return SZ_ERROR_DATA;
+	}
+
+	s->in_pos += hdr_size + 4;
+	start = s->in_pos;
+	out_start = s->out_pos;
+	if (uncompressed != -1ULL && uncompressed > s->out_size - out_start)
+		return SZ_ERROR_OUTPUT_EOF;
+
+	res = xz_dec_lzma2(s, dict_size);
+	if (res != SZ_OK)
+		return res;
+
+	if ((compressed != -1ULL && compressed != s->in_pos - start) ||
+	    (uncompressed != -1ULL &&
+	     uncompressed != s->out_pos - out_start))
+		return SZ_ERROR_DATA;
+	compressed = s->in_pos - start;
+	uncompressed = s->out_pos - out_start;
+
+	/* Block padding, then the check */
+	while (s->in_pos & 3) {
+		if (s->in_pos >= s->in_size)
+			return SZ_ERROR_INPUT_EOF;
+		if (s->in[s->in_pos++])
+			return SZ_ERROR_DATA;
+	}
+	check_size = xz_check_size(s->check);
+	if (check_size > s->in_size - s->in_pos)
+		return SZ_ERROR_INPUT_EOF;
+	res = xz_verify_check(s->check, s->out + out_start, uncompressed,
+			      s->in + s->in_pos);
+	if (res != SZ_OK)
+		return res;
+	s->in_pos += check_size;
+
+	s->count++;
+	s->hash = xz_hash_block(s->hash, hdr_size + 4 + compressed + check_size,
+				uncompressed);
+
+	return SZ_OK;
+}
+
+/**
+ * xz_dec_index() - Check the index against the blocks that were decoded
+ *
+ * @s:		Decoder state, the index indicator is at s->in_pos
+ * @index_size:	Returns the size of the index in bytes
+ * @return SZ_OK on success, or an SZ_ERROR_... value on failure
+ */
+static int xz_dec_index(struct xz_dec *s, SizeT *index_size)
+{
+	SizeT start = s->in_pos;
+	u64 count, unpadded, uncompressed;
+	size_t pos = start + 1;
+	u32 hash = 0;
+	int res;
+
+	res = xz_read_vli(s->in, s->in_size, &pos, &count);
+	if (res != SZ_OK)
+		return res;
+	if (count != s->count)
+		return SZ_ERROR_DATA;
+
+	while (count--) {
+		res = xz_read_vli(s->in, s->in_size, &pos, &unpadded);
+		if (res == SZ_OK)
+			res = xz_read_vli(s->in, s->in_size, &pos,
+					  &uncompressed);
+		if (res != SZ_OK)
+			return res;
+		hash = xz_hash_block(hash, unpadded, uncompressed);
+	}
+	if (hash != s->hash)
+		return SZ_ERROR_DATA;
+
+	while ((pos - start) & 3) {
+		if (pos >= s->in_size)
+			return SZ_ERROR_INPUT_EOF;
+		if (s->in[pos++])
+			return SZ_ERROR_DATA;
+	}
+	if (s->in_size - pos < 4)
+		return SZ_ERROR_INPUT_EOF;
+	if (crc32(0, s->in + start, pos - start) !=
+	    get_unaligned_le32(s->in + pos))
+		return SZ_ERROR_CRC;
+
+	s->in_pos = pos + 4;
+	*index_size = s->in_pos - start;
+
+	return SZ_OK;
+}
+
+/**
+ * xz_dec_stream() - Decode a whole stream
+ *
+ * @s:		Decoder state, the stream header is at s->in_pos
+ * @return SZ_OK on success, or an SZ_ERROR_... value on failure
+ */
+static int xz_dec_stream(struct xz_dec *s)
+{
+	const u8 *hdr = s->in + s->in_pos;
+	SizeT index_size;
+	const u8 *ftr;
+	int res;
+
+	if (s->in_size - s->in_pos < XZ_HEADER_SIZE)
+		return SZ_ERROR_INPUT_EOF;
+	if (!xz_check_magic(hdr, XZ_HEADER_SIZE))
+		return SZ_ERROR_DATA;
+	if (crc32(0, hdr + 6, 2) != get_unaligned_le32(hdr + 8))
+		return SZ_ERROR_CRC;
+	if (hdr[6] || hdr[7] > 0x0f)
+		return SZ_ERROR_UNSUPPORTED;
+	s->check = hdr[7];
+	if (!xz_check_supported(s->check)) {
+		debug("XZ: Unsupported check type %u\n", s->check);
+		return SZ_ERROR_UNSUPPORTED;
+	}
+	s->in_pos += XZ_HEADER_SIZE;
+	s->count = 0;
+	s->hash = 0;
+
+	for (;;) {
+		if (s->in_pos >= s->in_size)
+			return SZ_ERROR_INPUT_EOF;
+		if (!s->in[s->in_pos])
+			break;
+		res = xz_dec_block(s);
+		if (res != SZ_OK)
+			return res;
+	}
+
+	res = xz_dec_index(s, &index_size);
+	if (res != SZ_OK)
+		return res;
+
+	if (s->in_size - s->in_pos < XZ_FOOTER_SIZE)
+		return SZ_ERROR_INPUT_EOF;
+	ftr = s->in + s->in_pos;
+	if (memcmp(ftr + 10, xz_footer_magic, sizeof(xz_footer_magic)) ||
+	    crc32(0, ftr + 4, 6) != get_unaligned_le32(ftr))
+		return SZ_ERROR_DATA;
+	if ((get_unaligned_le32(ftr + 4) + 1ULL) * 4 != index_size ||
+	    memcmp(ftr + 8, hdr + 6, 2))
+		return SZ_ERROR_DATA;
+	s->in_pos += XZ_FOOTER_SIZE;
+
+	return SZ_OK;
+}
+
+int xzBuffToBuffDecompress(unsigned char *outStream, SizeT *uncompressedSize,
+			   const unsigned char *inStream, SizeT length)
+{
+	struct xz_dec s;
+	u8 props[LZMA_PROPS_SIZE] = { LZMA2_LCLP_MAX };
+	ISzAlloc alloc;
+	int res;
+
+	debug("XZ: Image address............... 0x%p\n", inStream);
+	debug("XZ: Destination address......... 0x%p\n", outStream);
+
+	memset(&s, 0, sizeof(s));
+	s.in = inStream;
+	s.in_size = length;
+	s.out = outStream;
+	s.out_size = *uncompressedSize;
+
+	alloc.Alloc = SzAlloc;
+	alloc.Free = SzFree;
+	LzmaDec_Construct(&s.lzma);
+	res = LzmaDec_AllocateProbs(&s.lzma, props, LZMA_PROPS_SIZE, &alloc);
+	if (res != SZ_OK)
+		return res;
+
+	for (;;) {
+		res = xz_dec_stream(&s);
+		if (res != SZ_OK || length == (SizeT)-1)
+			break;
+
+		/* Skip stream padding, then look for a concatenated stream */
+		while (s.in_size - s.in_pos >= 4 &&
+		       !get_unaligned_le32(s.in + s.in_pos))
+			s.in_pos += 4;
+		if (!xz_check_magic(s.in + s.in_pos, s.in_size - s.in_pos))
+			break;
+	}
+
+	LzmaDec_FreeProbs(&s.lzma, &alloc);
+	*uncompressedSize = s.out_pos;
+
+	debug("XZ: Uncompressed ............... 0x%zx\n", (size_t)s.out_pos);
+
+	return res;
+}
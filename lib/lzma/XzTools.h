@@ -0,0 +1,40 @@
+/* SPDX-License-Identifier: GPL-2.0+ */
+/*
+ * Decoder for the .xz container format, using LZMA2 on top of LzmaDec.c
+ */
+
+#ifndef __XZ_TOOL_H__
+#define __XZ_TOOL_H__
+
+#include <lzma/LzmaTypes.h>
+
+#define XZ_HEADER_MAGIC_SIZE	6
+
+/**
+ * xz_check_magic() - Check whether a buffer starts with an .xz stream header
+ *
+ * @inStream:	Buffer to check
+ * @length:	Number of bytes available in @inStream
+ * @return true if the buffer starts with the .xz magic bytes
+ */
+bool xz_check_magic(const unsigned char *inStream, SizeT length);
+
+/**
+ * xzBuffToBuffDecompress() - Decompress an .xz file held in memory
+ *
+ * All blocks of all concatenated streams are decoded, each straight into its
+ * final place in @outStream, which is also used as the LZMA2 dictionary. The
+ * block sizes and integrity checks are verified against the stream index.
+ *
+ * @outStream:		Output buffer
+ * @uncompressedSize:	On entry, size of @outStream. On exit, number of
+ *			bytes written
+ * @inStream:		Compressed .xz data
+ * @length:		Size of @inStream, or (SizeT)-1 if unknown, in which
+ *			case only the first stream is decoded
+ * @return SZ_OK on success, or an SZ_ERROR_... value on failure
+ */
+int xzBuffToBuffDecompress(unsigned char *outStream, SizeT *uncompressedSize,
+			   const unsigned char *inStream, SizeT length);
+
+#endif
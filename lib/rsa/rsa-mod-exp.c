@@ -127,17 +127,14 @@ static void montgomery_mul(const struct rsa_public_key *key,
 /**
  * num_pub_exponent_bits() - Number of bits in the public exponent
  *
- * @key:	RSA key
+ * @exponent:	RSA public exponent
  * @num_bits:	Storage for the number of public exponent bits
  */
-static int num_public_exponent_bits(const struct rsa_public_key *key,
-		int *num_bits)
+static int num_public_exponent_bits(uint64_t exponent, int *num_bits)
 {
-	uint64_t exponent;
 	int exponent_bits;
 	const uint max_bits = (sizeof(exponent) * 8);
 
-	exponent = key->exponent;
 	exponent_bits = 0;
 
 	if (!exponent) {
@@ -157,13 +154,38 @@ static int num_public_exponent_bits(const struct rsa_public_key *key,
 /**
  * is_public_exponent_bit_set() - Check if a bit in the public exponent is set
  *
- * @key:	RSA key
+ * @exponent:	RSA public exponent
  * @pos:	The bit position to check
  */
-static int is_public_exponent_bit_set(const struct rsa_public_key *key,
-		int pos)
+static int is_public_exponent_bit_set(uint64_t exponent, int pos)
+{
+	return exponent & (1ULL << pos);
+}
+
+/**
+ * check_public_exponent() - Check that a public exponent is usable
+ *
+ * @exponent:	RSA public exponent
+ * @num_bits:	Returns the number of bits in the exponent
+ * @return 0 if OK, -EINVAL if the exponent is too short or even
+ */
+static int check_public_exponent(uint64_t exponent, int *num_bits)
 {
-	return key->exponent & (1ULL << pos);
+	if (0 != num_public_exponent_bits(exponent, num_bits))
+		return -EINVAL;
+
+	if (*num_bits < 2) {
+		debug("Public exponent is too short (%d bits, minimum 2)\n",
+		      *num_bits);
+		return -EINVAL;
+	}
+
+	if (!is_public_exponent_bit_set(exponent, 0)) {
+		debug("LSB of RSA public exponent must be set.\n");
+		return -EINVAL;
+	}
+
+	return 0;
 }
 
 /**
@@ -193,20 +215,9 @@ static int pow_mod(const struct rsa_public_key *key, uint32_t *inout)
 	for (i = 0, ptr = inout + key->len - 1; i < key->len; i++, ptr--)
 		val[i] = get_unaligned_be32(ptr);
 
-	if (0 != num_public_exponent_bits(key, &k))
+	if (check_public_exponent(key->exponent, &k))
 		return -EINVAL;
 
-	if (k < 2) {
-		debug("Public exponent is too short (%d bits, minimum 2)\n",
-		      k);
-		return -EINVAL;
-	}
-
-	if (!is_public_exponent_bit_set(key, 0)) {
-		debug("LSB of RSA public exponent must be set.\n");
-		return -EINVAL;
-	}
-
 	/* the bit at e[k-1] is 1 by definition, so start with: C := M */
 	montgomery_mul(key, acc, val, key->rr); /* acc = a * RR / R mod n */
 	/* retain scaled version for intermediate use */
@@ -215,7 +226,7 @@ static int pow_mod(const struct rsa_public_key *key, uint32_t *inout)
 	for (j = k - 2; j > 0; --j) {
 		montgomery_mul(key, tmp, acc, acc); /* tmp = acc^2 / R mod n */
 
-		if (is_public_exponent_bit_set(key, j)) {
+		if (is_public_exponent_bit_set(key->exponent, j)) {
 			/* acc = tmp * val / R mod n */
 			montgomery_mul(key, acc, tmp, a_scaled);
 		} else {
@@ -239,6 +250,239 @@ static int pow_mod(const struct rsa_public_key *key, uint32_t *inout)
 	return 0;
 }
 
+#if defined(CONFIG_RSA_SOFTWARE_EXP_64) && defined(__SIZEOF_INT128__)
+/*
+ * 64-bit implementation of the above. Each Montgomery step handles twice as
+ * many bits per multiplication, which roughly quarters the number of
+ * multiplications needed for an exponentiation on 64-bit CPUs.
+ *
+ * R is 2^(32 * words) for both word sizes as long as the key has an even
+ * number of 32-bit words, so the R^2 value stored in the key node can be
+ * used as is. Only n0inv needs to be extended to 64 bits.
+ */
+#define RSA_MOD_EXP_64
+
+typedef unsigned __int128 rsa_dword_t;
+
+/**
+ * struct rsa_public_key64 - RSA public key using 64-bit words
+ *
+ * @len:	Length of modulus[] in number of uint64_t
+ * @n0inv:	-1 / modulus[0] mod 2^64
+ * @modulus:	Modulus as little endian array
+ * @rr:		R^2 as little endian array
+ * @exponent:	Public exponent
+ */
+struct rsa_public_key64 {
+	uint len;
+	uint64_t n0inv;
+	uint64_t *modulus;
+	uint64_t *rr;
+	uint64_t exponent;
+};
+
+static void subtract_modulus64(const struct rsa_public_key64 *key,
+			       uint64_t num[])
+{
+	uint64_t borrow = 0;
+	uint i;
+
+	for (i = 0; i < key->len; i++) {
+		rsa_dword_t acc;
+
+		acc = (rsa_dword_t)num[i] - key->modulus[i] - borrow;
+		num[i] = (uint64_t)acc;
+		borrow = (uint64_t)(acc >> 64) & 1;
+	}
+}
+
+static int greater_equal_modulus64(const struct rsa_public_key64 *key,
+				   uint64_t num[])
+{
+	int i;
+
+	for (i = (int)key->len - 1; i >= 0; i--) {
+		if (num[i] < key->modulus[i])
+			return 0;
+		if (num[i] > key->modulus[i])
+			return 1;
+	}
+
+	return 1;  /* equal */
+}
+
+static void montgomery_mul_add_step64(const struct rsa_public_key64 *key,
+		uint64_t result[], const uint64_t a, const uint64_t b[])
+{
+	rsa_dword_t acc_a, acc_b;
+	uint64_t d0;
+	uint i;
+
+	acc_a = (rsa_dword_t)a * b[0] + result[0];
+	d0 = (uint64_t)acc_a * key->n0inv;
+	acc_b = (rsa_dword_t)d0 * key->modulus[0] + (uint64_t)acc_a;
+	for (i = 1; i < key->len; i++) {
+		acc_a = (acc_a >> 64) + (rsa_dword_t)a * b[i] + result[i];
+		acc_b = (acc_b >> 64) + (rsa_dword_t)d0 * key->modulus[i] +
+				(uint64_t)acc_a;
+		result[i - 1] = (uint64_t)acc_b;
+	}
+
+	acc_a = (acc_a >> 64) + (acc_b >> 64);
+
+	result[i - 1] = (uint64_t)acc_a;
+
+	if (acc_a >> 64)
+		subtract_modulus64(key, result);
+}
+
+static void montgomery_mul64(const struct rsa_public_key64 *key,
+		uint64_t result[], uint64_t a[], const uint64_t b[])
+{
+	uint i;
+
+	for (i = 0; i < key->len; ++i)
+		result[i] = 0;
+	for (i = 0; i < key->len; ++i)
+		montgomery_mul_add_step64(key, result, a[i], b);
+}
+
+/**
+ * rsa_n0inv64() - Calculate -1 / n0 mod 2^64
+ *
+ * This uses Newton's iteration, which doubles the number of correct bits in
+ * each step. An odd n0 is its own inverse modulo 8, so five steps are enough.
+ *
+ * @n0:		Least significant word of the modulus (must be odd)
+ * @return -1 / n0 mod 2^64
+ */
+static uint64_t rsa_n0inv64(uint64_t n0)
+{
+	uint64_t inv = n0;
+	int i;
+
+	for (i = 0; i < 5; i++)
+		inv *= 2 - n0 * inv;
+
+	return -inv;
+}
+
+/**
+ * pow_mod64() - in-place public exponentiation using 64-bit words
+ *
+ * @key:	RSA key
+ * @inout:	Big-endian byte array containing value and result
+ */
+static int pow_mod64(const struct rsa_public_key64 *key, uint8_t *inout)
+{
+	uint64_t *result;
+	uint i;
+	int j, k;
+
+	if (key->len > RSA_MAX_KEY_BITS / 64) {
+		debug("RSA key words %u exceeds maximum %d\n", key->len,
+		      RSA_MAX_KEY_BITS / 64);
+		return -EINVAL;
+	}
+
+	uint64_t val[key->len], acc[key->len], tmp[key->len];
+	uint64_t a_scaled[key->len];
+	result = tmp;  /* Re-use location. */
+
+	/* Convert from big endian byte array to little endian word array. */
+	for (i = 0; i < key->len; i++)
+		val[i] = get_unaligned_be64(inout + (key->len - 1 - i) * 8);
+
+	if (check_public_exponent(key->exponent, &k))
+		return -EINVAL;
+
+	/* the bit at e[k-1] is 1 by definition, so start with: C := M */
+	montgomery_mul64(key, acc, val, key->rr);
+	memcpy(a_scaled, acc, key->len * sizeof(a_scaled[0]));
+
+	for (j = k - 2; j > 0; --j) {
+		montgomery_mul64(key, tmp, acc, acc);
+
+		if (is_public_exponent_bit_set(key->exponent, j))
+			montgomery_mul64(key, acc, tmp, a_scaled);
+		else
+			memcpy(acc, tmp, key->len * sizeof(acc[0]));
+	}
+
+	/* the bit at e[0] is always 1 */
+	montgomery_mul64(key, tmp, acc, acc);
+	montgomery_mul64(key, acc, tmp, val);
+	memcpy(result, acc, key->len * sizeof(result[0]));
+
+	/* Make sure result < mod; result is at most 1x mod too large. */
+	if (greater_equal_modulus64(key, result))
+		subtract_modulus64(key, result);
+
+	/* Convert to bigendian byte array */
+	for (i = 0; i < key->len; i++)
+		put_unaligned_be64(result[i],
+				   inout + (key->len - 1 - i) * 8);
+
+	return 0;
+}
+
+/**
+ * rsa_convert_big_endian64() - Convert a big-endian byte array to 64-bit words
+ *
+ * @dst:	Little endian word array to fill
+ * @src:	Big endian byte array
+ * @len:	Number of 64-bit words to convert
+ */
+static void rsa_convert_big_endian64(uint64_t *dst, const uint8_t *src,
+				     int len)
+{
+	int i;
+
+	for (i = 0; i < len; i++)
+		dst[i] = get_unaligned_be64(src + (len - 1 - i) * 8);
+}
+
+/**
+ * rsa_mod_exp_sw64() - Perform RSA Modular Exponentiation using 64-bit words
+ *
+ * @sig:	RSA signature
+ * @sig_len:	Length of signature in number of bytes
+ * @prop:	Key properties, already checked by the caller
+ * @exponent:	Public exponent
+ * @out:	Result in form of byte array of len equal to sig_len
+ * @return 0 if OK, -ve on error
+ */
+static int rsa_mod_exp_sw64(const uint8_t *sig, uint32_t sig_len,
+			    struct key_prop *prop, uint64_t exponent,
+			    uint8_t *out)
+{
+	struct rsa_public_key64 key;
+	int ret;
+
+	key.len = prop->num_bits / 64;
+	key.exponent = exponent;
+	uint64_t key1[key.len], key2[key.len];
+
+	key.modulus = key1;
+	key.rr = key2;
+	rsa_convert_big_endian64(key.modulus, prop->modulus, key.len);
+	rsa_convert_big_endian64(key.rr, prop->rr, key.len);
+	key.n0inv = rsa_n0inv64(key.modulus[0]);
+
+	uint8_t buf[sig_len];
+
+	memcpy(buf, sig, sig_len);
+
+	ret = pow_mod64(&key, buf);
+	if (ret)
+		return ret;
+
+	memcpy(out, buf, sig_len);
+
+	return 0;
+}
+#endif /* CONFIG_RSA_SOFTWARE_EXP_64 */
+
 static void rsa_convert_big_endian(uint32_t *dst, const uint32_t *src, int len)
 {
 	int i;
@@ -277,6 +521,11 @@ int rsa_mod_exp_sw(const uint8_t *sig, uint32_t sig_len,
 		      key.len, RSA_MIN_KEY_BITS, RSA_MAX_KEY_BITS);
 		return -EFAULT;
 	}
+
+#ifdef RSA_MOD_EXP_64
+	if (!(key.len % 64) && sig_len == key.len / 8)
+		return rsa_mod_exp_sw64(sig, sig_len, prop, key.exponent, out);
+#endif
 	key.len /= sizeof(uint32_t) * 8;
 	uint32_t key1[key.len], key2[key.len];
 
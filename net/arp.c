@@ -31,23 +31,50 @@
 # define ARP_TIMEOUT_COUNT	CONFIG_NET_RETRY_COUNT
 #endif
 
-struct in_addr net_arp_wait_packet_ip;
-static struct in_addr net_arp_wait_reply_ip;
-/* MAC address of waiting packet's destination */
-uchar	       *arp_wait_packet_ethaddr;
-int		arp_wait_tx_packet_size;
-ulong		arp_wait_timer_start;
-int		arp_wait_try;
+/**
+ * struct arp_entry - An entry in the ARP cache
+ *
+ * @ip:		IP address, 0 if the entry is not in use
+ * @ethaddr:	Ethernet address, valid once the entry has been resolved
+ * @time:	Time the address was learnt, or the last request was sent
+ * @tries:	Number of requests sent while resolving, 0 once resolved
+ */
+struct arp_entry {
+	struct in_addr ip;
+	uchar ethaddr[ARP_HLEN];
+	ulong time;
+	int tries;
+};
+
+/**
+ * struct arp_queued - A packet waiting for an ARP reply
+ *
+ * @ip:		IP address being resolved, 0 if the slot is not in use. For a
+ *		host on another network this is the gateway
+ * @dest:	IP address the packet is sent to
+ * @ethaddr:	Where to save the Ethernet address for the sender, or NULL
+ * @seq:	Sequence number, to send packets in the order they were queued
+ * @len:	Length of the packet
+ * @pkt:	The packet, starting with its Ethernet header
+ */
+struct arp_queued {
+	struct in_addr ip;
+	struct in_addr dest;
+	uchar *ethaddr;
+	ulong seq;
+	int len;
+	uchar pkt[PKTSIZE_ALIGN] __aligned(PKTALIGN);
+};
+
+static struct arp_entry arp_cache[CONFIG_NET_ARP_CACHE_SIZE];
+static struct arp_queued arp_queue[ARP_QUEUE_SIZE];
+static ulong arp_queue_seq;
 uchar	       *arp_tx_packet; /* THE ARP transmit packet */
 static uchar	arp_tx_packet_buf[PKTSIZE_ALIGN + PKTALIGN];
 
 void arp_init(void)
 {
-	/* XXX problem with bss workaround */
-	arp_wait_packet_ethaddr = NULL;
-	net_arp_wait_packet_ip.s_addr = 0;
-	net_arp_wait_reply_ip.s_addr = 0;
-	arp_wait_tx_packet_size = 0;
+	arp_cache_flush();
 	arp_tx_packet = &arp_tx_packet_buf[0] + (PKTALIGN - 1);
 	arp_tx_packet -= (ulong)arp_tx_packet % PKTALIGN;
 }
@@ -59,7 +86,7 @@ void arp_raw_request(struct in_addr source_ip, const uchar *target_ethaddr,
 	struct arp_hdr *arp;
 	int eth_hdr_size;
 
-	debug_cond(DEBUG_DEV_PKT, "ARP broadcast %d\n", arp_wait_try);
+	debug_cond(DEBUG_DEV_PKT, "ARP broadcast for %pI4\n", &target_ip);
 
 	pkt = arp_tx_packet;
 
@@ -82,52 +109,268 @@ void arp_raw_request(struct in_addr source_ip, const uchar *target_ethaddr,
 	net_send_packet(arp_tx_packet, eth_hdr_size + ARP_HDR_SIZE);
 }
 
-void arp_request(void)
+/* Get the address to resolve to reach @dest: @dest itself or the gateway */
+static struct in_addr arp_next_hop(struct in_addr dest)
 {
-	if ((net_arp_wait_packet_ip.s_addr & net_netmask.s_addr) !=
-	    (net_ip.s_addr & net_netmask.s_addr)) {
-		if (net_gateway.s_addr == 0) {
-			puts("## Warning: gatewayip needed but not set\n");
-			net_arp_wait_reply_ip = net_arp_wait_packet_ip;
-		} else {
-			net_arp_wait_reply_ip = net_gateway;
+	if ((dest.s_addr & net_netmask.s_addr) ==
+	    (net_ip.s_addr & net_netmask.s_addr) || !net_gateway.s_addr)
+		return dest;
+
+	return net_gateway;
+}
+
+static struct arp_entry *arp_find(struct in_addr ip)
+{
+	int i;
+
+	for (i = 0; i < CONFIG_NET_ARP_CACHE_SIZE; i++) {
+		if (arp_cache[i].ip.s_addr == ip.s_addr)
+			return &arp_cache[i];
+	}
+
+	return NULL;
+}
+
+/*
+ * Get a new entry for @ip. If the cache is full the oldest resolved entry is
+ * reused; entries still being resolved are kept, as packets wait for them.
+ */
+static struct arp_entry *arp_alloc(struct in_addr ip)
+{
+	struct arp_entry *entry = NULL;
+	int i;
+
+	for (i = 0; i < CONFIG_NET_ARP_CACHE_SIZE; i++) {
+		if (!arp_cache[i].ip.s_addr) {
+			entry = &arp_cache[i];
+			break;
 		}
-	} else {
-		net_arp_wait_reply_ip = net_arp_wait_packet_ip;
+		if (!arp_cache[i].tries && (!entry ||
+		    get_timer(arp_cache[i].time) > get_timer(entry->time)))
+			entry = &arp_cache[i];
+	}
+	if (entry) {
+		memset(entry, '\0', sizeof(*entry));
+		entry->ip = ip;
 	}
 
-	arp_raw_request(net_ip, net_null_ethaddr, net_arp_wait_reply_ip);
+	return entry;
 }
 
-int arp_timeout_check(void)
+static bool arp_expired(struct arp_entry *entry)
+{
+	return get_timer(entry->time) > CONFIG_NET_ARP_CACHE_TTL * 1000UL;
+}
+
+/* Forget @entry, dropping any packets waiting for it */
+static void arp_drop(struct arp_entry *entry)
+{
+	int i;
+
+	for (i = 0; i < ARP_QUEUE_SIZE; i++) {
+		if (arp_queue[i].ip.s_addr == entry->ip.s_addr)
+			arp_queue[i].ip.s_addr = 0;
+	}
+	memset(entry, '\0', sizeof(*entry));
+}
+
+static void arp_send_request(struct arp_entry *entry)
+{
+	entry->time = get_timer(0);
+	arp_raw_request(net_ip, net_null_ethaddr, entry->ip);
+}
+
+/* Send the packets waiting for @entry, now that its address is known */
+static void arp_send_queued(struct arp_entry *entry)
+{
+	struct arp_queued *queued;
+	int i;
+
+	for (;;) {
+		queued = NULL;
+		for (i = 0; i < ARP_QUEUE_SIZE; i++) {
+			if (arp_queue[i].ip.s_addr == entry->ip.s_addr &&
+			    (!queued || arp_queue[i].seq < queued->seq))
+				queued = &arp_queue[i];
+		}
+		if (!queued)
+			break;
+
+#ifdef CONFIG_KEEP_SERVERADDR
+		if (net_server_ip.s_addr == queued->dest.s_addr) {
+			char buf[20];
+
+			sprintf(buf, "%pM", entry->ethaddr);
+			env_set("serveraddr", buf);
+		}
+#endif
+		/* save address for later use */
+		if (queued->ethaddr)
+			memcpy(queued->ethaddr, entry->ethaddr, ARP_HLEN);
+
+		memcpy(((struct ethernet_hdr *)queued->pkt)->et_dest,
+		       entry->ethaddr, ARP_HLEN);
+		net_send_packet(queued->pkt, queued->len);
+		queued->ip.s_addr = 0;
+	}
+}
+
+/*
+ * Note the Ethernet address of @ip. A new entry is only made if @create is
+ * set. If packets are waiting for the address, they are sent.
+ */
+static void arp_learn(struct in_addr ip, const uchar *ethaddr, bool create,
+		      struct arp_hdr *arp, int len)
+{
+	struct arp_entry *entry;
+	bool resolving;
+
+	entry = arp_find(ip);
+	if (!entry && create)
+		entry = arp_alloc(ip);
+	if (!entry)
+		return;
+
+	debug_cond(DEBUG_DEV_PKT, "ARP: %pI4 is at %pM\n", &ip, ethaddr);
+	resolving = entry->tries;
+	memcpy(entry->ethaddr, ethaddr, ARP_HLEN);
+	entry->time = get_timer(0);
+	entry->tries = 0;
+
+	if (resolving) {
+		net_get_arp_handler()((uchar *)arp, 0, ip, 0, len);
+		arp_send_queued(entry);
+	}
+}
+
+bool arp_cache_lookup(struct in_addr dest, uchar *ethaddr)
+{
+	struct arp_entry *entry;
+
+	entry = arp_find(arp_next_hop(dest));
+	if (!entry || entry->tries || arp_expired(entry))
+		return false;
+
+	memcpy(ethaddr, entry->ethaddr, ARP_HLEN);
+
+	return true;
+}
+
+int arp_queue_packet(struct in_addr dest, uchar *ethaddr, uchar *pkt, int len)
+{
+	struct arp_queued *queued = NULL;
+	struct arp_entry *entry;
+	struct in_addr ip;
+	int i;
+
+	if ((dest.s_addr & net_netmask.s_addr) !=
+	    (net_ip.s_addr & net_netmask.s_addr) && !net_gateway.s_addr)
+		puts("## Warning: gatewayip needed but not set\n");
+	ip = arp_next_hop(dest);
+
+	for (i = 0; i < ARP_QUEUE_SIZE; i++) {
+		if (!arp_queue[i].ip.s_addr) {
+			queued = &arp_queue[i];
+			break;
+		}
+	}
+	entry = arp_find(ip);
+	if (!entry)
+		entry = arp_alloc(ip);
+	if (!queued || !entry) {
+		debug("ARP: no room to queue packet for %pI4\n", &dest);
+		return -ENOBUFS;
+	}
+
+	queued->ip = ip;
+	queued->dest = dest;
+	queued->ethaddr = ethaddr;
+	queued->seq = arp_queue_seq++;
+	queued->len = len;
+	memcpy(queued->pkt, pkt, len);
+
+	/* Ask again even if the address is known, in case it has changed */
+	if (!entry->tries) {
+		entry->tries = 1;
+		arp_send_request(entry);
+	}
+
+	return 0;
+}
+
+void arp_cancel(void)
+{
+	int i;
+
+	for (i = 0; i < CONFIG_NET_ARP_CACHE_SIZE; i++) {
+		if (arp_cache[i].tries)
+			arp_drop(&arp_cache[i]);
+	}
+}
+
+void arp_cache_flush(void)
+{
+	memset(arp_cache, '\0', sizeof(arp_cache));
+	memset(arp_queue, '\0', sizeof(arp_queue));
+}
+
+void arp_cache_show(void)
 {
-	ulong t;
+	struct arp_entry *entry;
+	ulong age;
+	int i;
+
+	puts("IP address       MAC address        Expires\n");
+	for (i = 0; i < CONFIG_NET_ARP_CACHE_SIZE; i++) {
+		entry = &arp_cache[i];
+		if (!entry->ip.s_addr)
+			continue;
+		printf("%-16pI4 ", &entry->ip);
+		if (entry->tries) {
+			puts("(incomplete)\n");
+			continue;
+		}
+		age = get_timer(entry->time) / 1000;
+		printf("%pM  ", entry->ethaddr);
+		if (age < CONFIG_NET_ARP_CACHE_TTL)
+			printf("%lu s\n", CONFIG_NET_ARP_CACHE_TTL - age);
+		else
+			puts("expired\n");
+	}
+}
 
-	if (!arp_is_waiting())
-		return 0;
+int arp_timeout_check(void)
+{
+	struct arp_entry *entry;
+	int waiting = 0;
+	int i;
 
-	t = get_timer(0);
+	for (i = 0; i < CONFIG_NET_ARP_CACHE_SIZE; i++) {
+		entry = &arp_cache[i];
+		if (!entry->tries)
+			continue;
+		waiting = 1;
 
-	/* check for arp timeout */
-	if ((t - arp_wait_timer_start) > ARP_TIMEOUT) {
-		arp_wait_try++;
+		/* check for arp timeout */
+		if (get_timer(entry->time) <= ARP_TIMEOUT)
+			continue;
 
-		if (arp_wait_try >= ARP_TIMEOUT_COUNT) {
+		if (++entry->tries >= ARP_TIMEOUT_COUNT) {
 			puts("\nARP Retry count exceeded; starting again\n");
-			arp_wait_try = 0;
+			arp_drop(entry);
 			net_set_state(NETLOOP_FAIL);
 		} else {
-			arp_wait_timer_start = t;
-			arp_request();
+			arp_send_request(entry);
 		}
 	}
-	return 1;
+
+	return waiting;
 }
 
 void arp_receive(struct ethernet_hdr *et, struct ip_udp_hdr *ip, int len)
 {
 	struct arp_hdr *arp;
-	struct in_addr reply_ip_addr;
+	struct in_addr sender_ip, target_ip;
 	int eth_hdr_size;
 	uchar *tx_packet;
 
@@ -139,6 +382,7 @@ void arp_receive(struct ethernet_hdr *et, struct ip_udp_hdr *ip, int len)
 	 *   for the TFTP server's or the gateway's ethernet
 	 *   address; so if we receive such a packet, we set
 	 *   the server ethernet address
+	 * Either kind also tells us the sender's ethernet address.
 	 */
 	debug_cond(DEBUG_NET_PKT, "Got ARP\n");
 
@@ -159,7 +403,19 @@ void arp_receive(struct ethernet_hdr *et, struct ip_udp_hdr *ip, int len)
 	if (net_ip.s_addr == 0)
 		return;
 
-	if (net_read_ip(&arp->ar_tpa).s_addr != net_ip.s_addr)
+	/*
+	 * Keep the cache up to date from any ARP packet (RFC 826). New
+	 * entries are made for hosts which talk to us, and for gratuitous
+	 * ARP, where a host announces its own address.
+	 */
+	sender_ip = net_read_ip(&arp->ar_spa);
+	target_ip = net_read_ip(&arp->ar_tpa);
+	if (sender_ip.s_addr && sender_ip.s_addr != net_ip.s_addr)
+		arp_learn(sender_ip, &arp->ar_sha,
+			  target_ip.s_addr == net_ip.s_addr ||
+			  target_ip.s_addr == sender_ip.s_addr, arp, len);
+
+	if (target_ip.s_addr != net_ip.s_addr)
 		return;
 
 	switch (ntohs(arp->ar_op)) {
@@ -192,45 +448,7 @@ void arp_receive(struct ethernet_hdr *et, struct ip_udp_hdr *ip, int len)
 		return;
 
 	case ARPOP_REPLY:		/* arp reply */
-		/* are we waiting for a reply? */
-		if (!arp_is_waiting())
-			break;
-
-#ifdef CONFIG_KEEP_SERVERADDR
-		if (net_server_ip.s_addr == net_arp_wait_packet_ip.s_addr) {
-			char buf[20];
-			sprintf(buf, "%pM", &arp->ar_sha);
-			env_set("serveraddr", buf);
-		}
-#endif
-
-		reply_ip_addr = net_read_ip(&arp->ar_spa);
-
-		/* matched waiting packet's address */
-		if (reply_ip_addr.s_addr == net_arp_wait_reply_ip.s_addr) {
-			debug_cond(DEBUG_DEV_PKT,
-				   "Got ARP REPLY, set eth addr (%pM)\n",
-				   arp->ar_data);
-
-			/* save address for later use */
-			if (arp_wait_packet_ethaddr != NULL)
-				memcpy(arp_wait_packet_ethaddr,
-				       &arp->ar_sha, ARP_HLEN);
-
-			net_get_arp_handler()((uchar *)arp, 0, reply_ip_addr,
-					      0, len);
-
-			/* set the mac address in the waiting packet's header
-			   and transmit it */
-			memcpy(((struct ethernet_hdr *)net_tx_packet)->et_dest,
-			       &arp->ar_sha, ARP_HLEN);
-			net_send_packet(net_tx_packet, arp_wait_tx_packet_size);
-
-			/* no arp request pending now */
-			net_arp_wait_packet_ip.s_addr = 0;
-			arp_wait_tx_packet_size = 0;
-			arp_wait_packet_ethaddr = NULL;
-		}
+		/* already handled above */
 		return;
 	default:
 		debug("Unexpected ARP opcode 0x%x\n",
@@ -241,5 +459,12 @@ void arp_receive(struct ethernet_hdr *et, struct ip_udp_hdr *ip, int len)
 
 bool arp_is_waiting(void)
 {
-	return !!net_arp_wait_packet_ip.s_addr;
+	int i;
+
+	for (i = 0; i < CONFIG_NET_ARP_CACHE_SIZE; i++) {
+		if (arp_cache[i].tries)
+			return true;
+	}
+
+	return false;
 }
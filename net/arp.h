@@ -14,18 +14,31 @@
 
 #include <common.h>
 
-extern struct in_addr net_arp_wait_packet_ip;
-/* MAC address of waiting packet's destination */
-extern uchar *arp_wait_packet_ethaddr;
-extern int arp_wait_tx_packet_size;
-extern ulong arp_wait_timer_start;
-extern int arp_wait_try;
 extern uchar *arp_tx_packet;
 
 void arp_init(void);
-void arp_request(void);
 void arp_raw_request(struct in_addr source_ip, const uchar *targetEther,
 	struct in_addr target_ip);
+
+/**
+ * arp_queue_packet() - Send a packet once the address of its host is known
+ *
+ * The packet is copied and an ARP request is sent, even if the address is in
+ * the cache already. The packet is sent when the reply arrives.
+ *
+ * @dest:	IP address the packet is for
+ * @ethaddr:	Where to save the Ethernet address found, or NULL
+ * @pkt:	Packet, starting with its Ethernet header
+ * @len:	Length of the packet
+ * @return 0 if OK, -ENOBUFS if there is no room for the packet
+ */
+int arp_queue_packet(struct in_addr dest, uchar *ethaddr, uchar *pkt, int len);
+
+/**
+ * arp_cancel() - Stop resolving addresses, dropping the waiting packets
+ */
+void arp_cancel(void);
+
 int arp_timeout_check(void);
 void arp_receive(struct ethernet_hdr *et, struct ip_udp_hdr *ip, int len);
 
@@ -109,6 +109,25 @@ static void bootp_add_id(ulong id)
 	}
 }
 
+/*
+ * Bootp ID is the lower 4 bytes of our ethernet address plus the current
+ * time in ms. It is remembered so that replies to it are accepted.
+ */
+static u32 bootp_new_id(void)
+{
+	u32 bootp_id;
+
+	bootp_id = ((u32)net_ethaddr[2] << 24)
+		| ((u32)net_ethaddr[3] << 16)
+		| ((u32)net_ethaddr[4] << 8)
+		| (u32)net_ethaddr[5];
+	bootp_id += get_timer(0);
+	bootp_id = htonl(bootp_id);
+	bootp_add_id(bootp_id);
+
+	return bootp_id;
+}
+
 static bool bootp_match_id(ulong id)
 {
 	unsigned int i;
@@ -796,17 +815,7 @@ void bootp_request(void)
 	extlen = bootp_extended((u8 *)bp->bp_vend);
 #endif
 
-	/*
-	 *	Bootp ID is the lower 4 bytes of our ethernet address
-	 *	plus the current time in ms.
-	 */
-	bootp_id = ((u32)net_ethaddr[2] << 24)
-		| ((u32)net_ethaddr[3] << 16)
-		| ((u32)net_ethaddr[4] << 8)
-		| (u32)net_ethaddr[5];
-	bootp_id += get_timer(0);
-	bootp_id = htonl(bootp_id);
-	bootp_add_id(bootp_id);
+	bootp_id = bootp_new_id();
 	net_copy_u32(&bp->bp_id, &bootp_id);
 
 	/*
@@ -971,13 +980,17 @@ static int dhcp_message_type(unsigned char *popt)
 	return -1;
 }
 
-static void dhcp_send_request_packet(struct bootp_hdr *bp_offer)
+/*
+ * Send a DHCPREQUEST for @requested_ip, with ID @id. @server_ip is only set
+ * when replying to an offer from that server.
+ */
+static void dhcp_send_request(u32 id, struct in_addr server_ip,
+			      struct in_addr requested_ip)
 {
 	uchar *pkt, *iphdr;
 	struct bootp_hdr *bp;
 	int pktlen, iplen, extlen;
 	int eth_hdr_size;
-	struct in_addr offered_ip;
 	struct in_addr zero_ip;
 	struct in_addr bcast_ip;
 
@@ -1010,20 +1023,10 @@ static void dhcp_send_request_packet(struct bootp_hdr *bp_offer)
 	memcpy(bp->bp_chaddr, net_ethaddr, 6);
 	copy_filename(bp->bp_file, net_boot_file_name, sizeof(bp->bp_file));
 
-	/*
-	 * ID is the id of the OFFER packet
-	 */
-
-	net_copy_u32(&bp->bp_id, &bp_offer->bp_id);
-
-	/*
-	 * Copy options from OFFER packet if present
-	 */
+	net_copy_u32(&bp->bp_id, &id);
 
-	/* Copy offered IP into the parameters request list */
-	net_copy_ip(&offered_ip, &bp_offer->bp_yiaddr);
 	extlen = dhcp_extended((u8 *)bp->bp_vend, DHCP_REQUEST,
-		dhcp_server_ip, offered_ip);
+		server_ip, requested_ip);
 
 	iplen = BOOTP_HDR_SIZE - OPT_FIELD_SIZE + extlen;
 	pktlen = eth_hdr_size + IP_UDP_HDR_SIZE + iplen;
@@ -1037,6 +1040,73 @@ static void dhcp_send_request_packet(struct bootp_hdr *bp_offer)
 	net_send_packet(net_tx_packet, pktlen);
 }
 
+static void dhcp_send_request_packet(struct bootp_hdr *bp_offer)
+{
+	struct in_addr offered_ip;
+	u32 id;
+
+	/*
+	 * ID is the id of the OFFER packet
+	 */
+	net_copy_u32(&id, &bp_offer->bp_id);
+
+	/* Copy offered IP into the parameters request list */
+	net_copy_ip(&offered_ip, &bp_offer->bp_yiaddr);
+	dhcp_send_request(id, dhcp_server_ip, offered_ip);
+}
+
+#ifdef CONFIG_DHCP_REBOOT
+/* Give up on the previous lease and look for a server from scratch */
+static void dhcp_reboot_discover(void)
+{
+	bootp_reset();
+	bootp_request();
+}
+
+static void dhcp_reboot_timeout_handler(void)
+{
+	puts("No reply for previous DHCP lease\n");
+	dhcp_reboot_discover();
+}
+
+/* Remember the address just leased, to ask for it again next time */
+static void dhcp_reboot_save(void)
+{
+	char tmp[22];
+
+	ip_to_string(net_ip, tmp);
+	env_set("dhcplease", tmp);
+}
+
+/*
+ * Ask for the address in 'dhcplease' again, as a client which has just
+ * rebooted does (RFC 2131, section 3.2). Any server which knows the lease
+ * still belongs to us replies with an ACK, saving the DISCOVER and OFFER.
+ *
+ * Returns 0 if the request was sent, -ENOENT if there is no lease to ask for.
+ */
+static int dhcp_reboot_request(void)
+{
+	struct in_addr lease_ip;
+	struct in_addr zero_ip;
+
+	lease_ip = env_get_ip("dhcplease");
+	if (!lease_ip.s_addr)
+		return -ENOENT;
+
+	bootstage_mark_name(BOOTSTAGE_ID_BOOTP_START, "bootp_start");
+	printf("DHCP requesting previous lease %pI4\n", &lease_ip);
+	zero_ip.s_addr = 0;
+	dhcp_state = REBOOTING;
+	net_set_udp_handler(dhcp_handler);
+	net_set_timeout_handler(CONFIG_DHCP_REBOOT_TIMEOUT,
+				dhcp_reboot_timeout_handler);
+	dhcp_send_request(bootp_new_id(), zero_ip, lease_ip);
+
+	return 0;
+}
+#endif
+
 /*
  *	Handle DHCP received packets.
  */
@@ -1055,8 +1125,17 @@ static void dhcp_handler(uchar *pkt, unsigned dest, struct in_addr sip,
 	debug("DHCPHandler: got DHCP packet: (src=%d, dst=%d, len=%d) state: "
 	      "%d\n", src, dest, len, dhcp_state);
 
-	if (net_read_ip(&bp->bp_yiaddr).s_addr == 0)
+	if (net_read_ip(&bp->bp_yiaddr).s_addr == 0) {
+#ifdef CONFIG_DHCP_REBOOT
+		if (dhcp_state == REBOOTING &&
+		    dhcp_message_type((u8 *)bp->bp_vend) == DHCP_NAK) {
+			puts("Previous DHCP lease refused\n");
+			env_set("dhcplease", NULL);
+			dhcp_reboot_discover();
+		}
+#endif
 		return;
+	}
 
 	switch (dhcp_state) {
 	case SELECTING:
@@ -1086,6 +1165,7 @@ static void dhcp_handler(uchar *pkt, unsigned dest, struct in_addr sip,
 
 		return;
 		break;
+	case REBOOTING:
 	case REQUESTING:
 		debug("DHCP State: REQUESTING\n");
 
@@ -1096,6 +1176,9 @@ static void dhcp_handler(uchar *pkt, unsigned dest, struct in_addr sip,
 			dhcp_state = BOUND;
 			printf("DHCP client bound to address %pI4 (%lu ms)\n",
 			       &net_ip, get_timer(bootp_start));
+#ifdef CONFIG_DHCP_REBOOT
+			dhcp_reboot_save();
+#endif
 			net_set_timeout_handler(0, (thand_f *)0);
 			bootstage_mark_name(BOOTSTAGE_ID_BOOTP_STOP,
 					    "bootp_stop");
@@ -1115,6 +1198,10 @@ static void dhcp_handler(uchar *pkt, unsigned dest, struct in_addr sip,
 
 void dhcp_request(void)
 {
+#ifdef CONFIG_DHCP_REBOOT
+	if (!dhcp_reboot_request())
+		return;
+#endif
 	bootp_request();
 }
 #endif	/* CONFIG_CMD_DHCP */
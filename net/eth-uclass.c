@@ -19,13 +19,18 @@
 
 DECLARE_GLOBAL_DATA_PTR;
 
+/* Maximum number of packets processed by one call to eth_rx() */
+#define ETH_RX_BUDGET	32
+
 /**
  * struct eth_device_priv - private structure for each Ethernet device
  *
  * @state: The state of the Ethernet MAC driver (defined by enum eth_state_t)
+ * @stats: Packet counters
  */
 struct eth_device_priv {
 	enum eth_state_t state;
+	struct eth_stats stats;
 };
 
 /**
@@ -341,6 +346,7 @@ int eth_is_active(struct udevice *dev)
 
 int eth_send(void *packet, int length)
 {
+	struct eth_device_priv *priv;
 	struct udevice *current;
 	int ret;
 
@@ -351,10 +357,14 @@ int eth_send(void *packet, int length)
 	if (!eth_is_active(current))
 		return -EINVAL;
 
+	priv = dev_get_uclass_priv(current);
 	ret = eth_get_ops(current)->send(current, packet, length);
 	if (ret < 0) {
 		/* We cannot completely return the error at present */
 		debug("%s: send() returned error %d\n", __func__, ret);
+		priv->stats.tx_errors++;
+	} else {
+		priv->stats.tx_packets++;
 	}
 #if defined(CONFIG_CMD_PCAP)
 	if (ret >= 0)
@@ -365,8 +375,12 @@ int eth_send(void *packet, int length)
 
 int eth_rx(void)
 {
+	struct eth_device_priv *priv;
+	const struct eth_ops *ops;
 	struct udevice *current;
-	uchar *packet;
+	uchar *packets[ETH_RX_BUDGET];
+	int lengths[ETH_RX_BUDGET];
+	int done, count;
 	int flags;
 	int ret;
 	int i;
@@ -378,15 +392,34 @@ int eth_rx(void)
 	if (!eth_is_active(current))
 		return -EINVAL;
 
-	/* Process up to 32 packets at one time */
+	ops = eth_get_ops(current);
+	priv = dev_get_uclass_priv(current);
+
+	/* Process up to ETH_RX_BUDGET packets at one time */
 	flags = ETH_RECV_CHECK_DEVICE;
-	for (i = 0; i < 32; i++) {
-		ret = eth_get_ops(current)->recv(current, flags, &packet);
+	for (done = 0; done < ETH_RX_BUDGET; done += count) {
+		if (ops->recv_batch) {
+			ret = ops->recv_batch(current, flags, packets, lengths,
+					      ETH_RX_BUDGET - done);
+			count = ret;
+		} else {
+			ret = ops->recv(current, flags, &packets[0]);
+			lengths[0] = ret;
+			count = 1;
+		}
 		flags = 0;
-		if (ret > 0)
-			net_process_received_packet(packet, ret);
-		if (ret >= 0 && eth_get_ops(current)->free_pkt)
-			eth_get_ops(current)->free_pkt(current, packet, ret);
+		if (ret < 0)
+			break;
+		for (i = 0; i < count; i++) {
+			if (lengths[i] > 0) {
+				priv->stats.rx_packets++;
+				priv->stats.rx_bytes += lengths[i];
+				net_process_received_packet(packets[i],
+							    lengths[i]);
+			}
+			if (ops->free_pkt)
+				ops->free_pkt(current, packets[i], lengths[i]);
+		}
 		if (ret <= 0)
 			break;
 	}
@@ -395,10 +428,49 @@ int eth_rx(void)
 	if (ret < 0) {
 		/* We cannot completely return the error at present */
 		debug("%s: recv() returned error %d\n", __func__, ret);
+		priv->stats.rx_errors++;
 	}
 	return ret;
 }
 
+/*
+ * Join or leave the multicast group @mcast_ip, by passing the matching
+ * Ethernet multicast address (RFC 1112) to the driver
+ */
+int eth_mcast_join(struct in_addr mcast_ip, int join)
+{
+	struct udevice *current;
+	u8 mcast_mac[ARP_HLEN];
+	u32 ip = ntohl(mcast_ip.s_addr);
+
+	current = eth_get_dev();
+	if (!current || !eth_get_ops(current)->mcast)
+		return -ENOSYS;
+
+	mcast_mac[0] = 0x01;
+	mcast_mac[1] = 0x00;
+	mcast_mac[2] = 0x5e;
+	mcast_mac[3] = (ip >> 16) & 0x7f;
+	mcast_mac[4] = (ip >> 8) & 0xff;
+	mcast_mac[5] = ip & 0xff;
+
+	return eth_get_ops(current)->mcast(current, mcast_mac, join);
+}
+
+const struct eth_stats *eth_get_stats(struct udevice *dev)
+{
+	struct eth_device_priv *priv = dev_get_uclass_priv(dev);
+
+	return &priv->stats;
+}
+
+void eth_count_rx_dropped(struct udevice *dev, uint count)
+{
+	struct eth_device_priv *priv = dev_get_uclass_priv(dev);
+
+	priv->stats.rx_dropped += count;
+}
+
 int eth_initialize(void)
 {
 	int num_devices = 0;
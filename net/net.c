@@ -99,6 +99,12 @@
 #include <net.h>
 #include <net/fastboot.h>
 #include <net/tftp.h>
+#if defined(CONFIG_PROT_TCP)
+#include <net/tcp.h>
+#endif
+#if defined(CONFIG_CMD_WGET)
+#include <net/wget.h>
+#endif
 #if defined(CONFIG_CMD_PCAP)
 #include <net/pcap.h>
 #endif
@@ -148,6 +154,10 @@ u8 net_server_ethaddr[6];
 struct in_addr	net_ip;
 /* Server IP addr (0 = unknown) */
 struct in_addr	net_server_ip;
+#ifdef CONFIG_TFTP_MULTICAST
+/* Multicast group joined for TFTP (0 = none) */
+struct in_addr	net_mcast_addr;
+#endif
 /* Current receive packet */
 uchar *net_rx_packet;
 /* Current rx packet length */
@@ -355,8 +365,12 @@ void net_auto_load(void)
 
 static void net_init_loop(void)
 {
-	if (eth_get_dev())
+	if (eth_get_dev()) {
+		/* Addresses learnt on another interface are no use here */
+		if (memcmp(net_ethaddr, eth_get_ethaddr(), 6))
+			arp_cache_flush();
 		memcpy(net_ethaddr, eth_get_ethaddr(), 6);
+	}
 
 	return;
 }
@@ -371,6 +385,11 @@ static void net_clear_handlers(void)
 static void net_cleanup_loop(void)
 {
 	net_clear_handlers();
+	arp_cancel();
+#if defined(CONFIG_PROT_TCP)
+	/* Do not leave a connection open for a later command to trip over */
+	tcp_abort();
+#endif
 }
 
 void net_init(void)
@@ -533,6 +552,11 @@ restart:
 		case WOL:
 			wol_start();
 			break;
+#endif
+#if defined(CONFIG_CMD_WGET)
+		case WGET:
+			wget_start();
+			break;
 #endif
 		default:
 			break;
@@ -575,13 +599,14 @@ restart:
 		 */
 		eth_rx();
 
+#if defined(CONFIG_NETCONSOLE_BATCH) && !defined(CONFIG_SPL_BUILD)
+		nc_poll();
+#endif
+
 		/*
 		 *	Abort if ctrl-c was pressed.
 		 */
 		if (ctrlc()) {
-			/* cancel any ARP that may not have completed */
-			net_arp_wait_packet_ip.s_addr = 0;
-
 			net_cleanup_loop();
 			eth_halt();
 			/* Invalidate the last protocol */
@@ -827,6 +852,7 @@ int net_send_ip_packet(uchar *ether, struct in_addr dest, int dport, int sport,
 	uchar *pkt;
 	int eth_hdr_size;
 	int pkt_hdr_size;
+	int ret;
 
 	/* make sure the net_tx_packet is initialized (net_init() was called) */
 	assert(net_tx_packet != NULL);
@@ -841,6 +867,10 @@ int net_send_ip_packet(uchar *ether, struct in_addr dest, int dport, int sport,
 	if (dest.s_addr == 0xFFFFFFFF)
 		ether = (uchar *)net_bcast_ethaddr;
 
+	/* use the ARP cache if the MAC address is not known yet */
+	if (memcmp(ether, net_null_ethaddr, 6) == 0)
+		arp_cache_lookup(dest, ether);
+
 	pkt = (uchar *)net_tx_packet;
 
 	eth_hdr_size = net_set_ether(pkt, ether, PROT_IP);
@@ -851,6 +881,14 @@ int net_send_ip_packet(uchar *ether, struct in_addr dest, int dport, int sport,
 				   payload_len);
 		pkt_hdr_size = eth_hdr_size + IP_UDP_HDR_SIZE;
 		break;
+#if defined(CONFIG_PROT_TCP)
+	case IPPROTO_TCP:
+		pkt_hdr_size = eth_hdr_size +
+			tcp_set_tcp_header(pkt + eth_hdr_size, dest, dport,
+					   sport, payload_len, action,
+					   tcp_seq_num, tcp_ack_num);
+		break;
+#endif
 	default:
 		return -EINVAL;
 	}
@@ -859,21 +897,15 @@ int net_send_ip_packet(uchar *ether, struct in_addr dest, int dport, int sport,
 	if (memcmp(ether, net_null_ethaddr, 6) == 0) {
 		debug_cond(DEBUG_DEV_PKT, "sending ARP for %pI4\n", &dest);
 
-		/* save the ip and eth addr for the packet to send after arp */
-		net_arp_wait_packet_ip = dest;
-		arp_wait_packet_ethaddr = ether;
-
-		/* size of the waiting packet */
-		arp_wait_tx_packet_size = pkt_hdr_size + payload_len;
-
-		/* and do the ARP request */
-		arp_wait_try = 1;
-		arp_wait_timer_start = get_timer(0);
-		arp_request();
+		/* keep the packet to send after arp, saving the eth addr */
+		ret = arp_queue_packet(dest, ether, net_tx_packet,
+				       pkt_hdr_size + payload_len);
+		if (ret)
+			return ret;
 		return 1;	/* waiting */
 	} else {
-		debug_cond(DEBUG_DEV_PKT, "sending UDP to %pI4/%pM\n",
-			   &dest, ether);
+		debug_cond(DEBUG_DEV_PKT, "sending %s to %pI4/%pM\n",
+			   proto == IPPROTO_TCP ? "TCP" : "UDP", &dest, ether);
 		net_send_packet(net_tx_packet, pkt_hdr_size + payload_len);
 		return 0;	/* transmitted */
 	}
@@ -1221,6 +1253,10 @@ void net_process_received_packet(uchar *in_packet, int len)
 		dst_ip = net_read_ip(&ip->ip_dst);
 		if (net_ip.s_addr && dst_ip.s_addr != net_ip.s_addr &&
 		    dst_ip.s_addr != 0xFFFFFFFF) {
+#ifdef CONFIG_TFTP_MULTICAST
+			if (!net_mcast_addr.s_addr ||
+			    dst_ip.s_addr != net_mcast_addr.s_addr)
+#endif
 				return;
 		}
 		/* Read source IP address for later use */
@@ -1257,6 +1293,11 @@ void net_process_received_packet(uchar *in_packet, int len)
 		if (ip->ip_p == IPPROTO_ICMP) {
 			receive_icmp(ip, len, src_ip, et);
 			return;
+#if defined(CONFIG_PROT_TCP)
+		} else if (ip->ip_p == IPPROTO_TCP) {
+			tcp_receive((struct ip_tcp_hdr *)ip, len, src_ip);
+			return;
+#endif
 		} else if (ip->ip_p != IPPROTO_UDP) {	/* Only UDP packets */
 			return;
 		}
@@ -1360,6 +1401,9 @@ static int net_check_prereq(enum proto_t protocol)
 #endif
 #if defined(CONFIG_CMD_NFS)
 	case NFS:
+#endif
+#if defined(CONFIG_CMD_WGET)
+	case WGET:
 #endif
 		/* Fall through */
 	case TFTPGET:
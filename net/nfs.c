@@ -28,6 +28,7 @@
 
 #include <common.h>
 #include <command.h>
+#include <env.h>
 #include <flash.h>
 #include <image.h>
 #include <log.h>
@@ -37,8 +38,10 @@
 #include "nfs.h"
 #include "bootp.h"
 #include <time.h>
+#include <linux/log2.h>
 
 #define HASHES_PER_LINE 65	/* Number of "loading" hashes per line	*/
+#define NFS_HASH_BYTES	(NFS_READ_SIZE / 2 * 10) /* Bytes per hash	*/
 #define NFS_RETRY_COUNT 30
 #ifndef CONFIG_NFS_TIMEOUT
 # define NFS_TIMEOUT 2000UL
@@ -51,10 +54,27 @@
 
 static int fs_mounted;
 static unsigned long rpc_id;
-static int nfs_offset = -1;
-static int nfs_len;
 static ulong nfs_timeout = NFS_TIMEOUT;
 
+/*
+ * An outstanding READ request. Replies are matched to their request by the
+ * RPC transaction ID, so that they can be handled in any order.
+ */
+struct nfs_read_slot {
+	unsigned long id;	/* transaction ID, 0 if the slot is free */
+	unsigned int offset;	/* position in the file */
+	unsigned int len;	/* number of bytes requested */
+};
+
+static struct nfs_read_slot nfs_read_slots[NFS_MAX_READ_WINDOW];
+static int nfs_read_window;
+static unsigned int nfs_read_size;
+static unsigned int nfs_next_offset;	/* next offset to request */
+static unsigned int nfs_file_end;	/* valid if nfs_file_end_known */
+static bool nfs_file_end_known;
+static ulong nfs_read_bytes;
+static ulong nfs_hashes;
+
 static char dirfh[NFS_FHSIZE];	/* NFSv2 / NFSv3 file handle of directory */
 static char filefh[NFS3_FHSIZE]; /* NFSv2 / NFSv3 file handle */
 static int filefh3_length;	/* (variable) length of filefh when NFSv3 */
@@ -175,7 +195,8 @@ static uint32_t *rpc_add_credentials(uint32_t *p)
 /**************************************************************************
 RPC_LOOKUP - Lookup RPC Port numbers
 **************************************************************************/
-static void rpc_req(int rpc_prog, int rpc_proc, uint32_t *data, int datalen)
+static unsigned long rpc_req(int rpc_prog, int rpc_proc, uint32_t *data,
+			     int datalen)
 {
 	struct rpc_t rpc_pkt;
 	unsigned long id;
@@ -220,6 +241,8 @@ static void rpc_req(int rpc_prog, int rpc_proc, uint32_t *data, int datalen)
 
 	net_send_udp_packet(net_server_ethaddr, nfs_server_ip, sport,
 			    nfs_our_port, pktlen);
+
+	return id;
 }
 
 /**************************************************************************
@@ -361,7 +384,7 @@ static void nfs_lookup_req(char *fname)
 /**************************************************************************
 NFS_READ - Read File on NFS Server
 **************************************************************************/
-static void nfs_read_req(int offset, int readlen)
+static unsigned long nfs_read_req(int offset, int readlen)
 {
 	uint32_t data[1024];
 	uint32_t *p;
@@ -388,7 +411,125 @@ static void nfs_read_req(int offset, int readlen)
 
 	len = (uint32_t *)p - (uint32_t *)&(data[0]);
 
-	rpc_req(PROG_NFS, NFS_READ, data, len);
+	return rpc_req(PROG_NFS, NFS_READ, data, len);
+}
+
+/*
+ * Use the largest reads the reassembly buffer allows. NFSv2 servers only
+ * support reads of up to 8KB, so are left with the default.
+ */
+static unsigned int nfs_get_read_size(void)
+{
+#ifdef CONFIG_IP_DEFRAG
+	if (!(supported_nfs_versions & NFSV2_FLAG))
+		return rounddown_pow_of_two(CONFIG_NET_MAXDEFRAG -
+					    IP_UDP_HDR_SIZE -
+					    NFS_READ_REPLY_HDR_SIZE);
+#endif
+	return NFS_READ_SIZE;
+}
+
+/* Ask for the next part of the file in a free slot, if any is left */
+static void nfs_read_next(struct nfs_read_slot *slot)
+{
+	if (nfs_file_end_known && nfs_next_offset >= nfs_file_end) {
+		slot->id = 0;
+		return;
+	}
+	slot->offset = nfs_next_offset;
+	slot->len = nfs_read_size;
+	nfs_next_offset += nfs_read_size;
+	slot->id = nfs_read_req(slot->offset, slot->len);
+}
+
+static void nfs_read_start(void)
+{
+	int i;
+
+	nfs_read_size = nfs_get_read_size();
+	nfs_next_offset = 0;
+	nfs_file_end_known = false;
+	nfs_read_bytes = 0;
+	nfs_hashes = 0;
+	for (i = 0; i < nfs_read_window; i++)
+		nfs_read_next(&nfs_read_slots[i]);
+}
+
+/* Send the outstanding requests again, after a timeout */
+static void nfs_read_resend(void)
+{
+	struct nfs_read_slot *slot;
+	int i;
+
+	for (i = 0; i < nfs_read_window; i++) {
+		slot = &nfs_read_slots[i];
+		if (slot->id)
+			slot->id = nfs_read_req(slot->offset, slot->len);
+	}
+}
+
+static struct nfs_read_slot *nfs_read_find(unsigned long id)
+{
+	int i;
+
+	for (i = 0; i < nfs_read_window; i++) {
+		if (id && nfs_read_slots[i].id == id)
+			return &nfs_read_slots[i];
+	}
+
+	return NULL;
+}
+
+static void nfs_show_progress(void)
+{
+	while (nfs_hashes < nfs_read_bytes / NFS_HASH_BYTES) {
+		putc('#');
+		if (!(++nfs_hashes % HASHES_PER_LINE))
+			puts("\n\t ");
+	}
+}
+
+/*
+ * Account for a reply of @rlen bytes to @slot and reuse the slot for the
+ * next request. Returns true once the whole file has been read.
+ */
+static bool nfs_read_complete(struct nfs_read_slot *slot, int rlen, bool eof)
+{
+	struct nfs_read_slot *other;
+	bool done;
+	int i;
+
+	nfs_read_bytes += rlen;
+	nfs_show_progress();
+
+	if (eof || !rlen) {
+		if (!nfs_file_end_known || slot->offset + rlen < nfs_file_end) {
+			nfs_file_end = slot->offset + rlen;
+			nfs_file_end_known = true;
+		}
+		slot->id = 0;
+	} else if (rlen < slot->len) {
+		/* Short read: ask for the rest of this block */
+		slot->offset += rlen;
+		slot->len -= rlen;
+		slot->id = nfs_read_req(slot->offset, slot->len);
+	} else {
+		nfs_read_next(slot);
+	}
+
+	/* Requests beyond the end of the file are no longer needed */
+	done = nfs_file_end_known;
+	for (i = 0; i < nfs_read_window; i++) {
+		other = &nfs_read_slots[i];
+		if (!other->id)
+			continue;
+		if (nfs_file_end_known && other->offset >= nfs_file_end)
+			other->id = 0;
+		else
+			done = false;
+	}
+
+	return done;
 }
 
 /**************************************************************************
@@ -421,7 +562,7 @@ static void nfs_send(void)
 		nfs_lookup_req(nfs_filename);
 		break;
 	case STATE_READ_REQ:
-		nfs_read_req(nfs_offset, nfs_len);
+		nfs_read_resend();
 		break;
 	case STATE_READLINK_REQ:
 		nfs_readlink_req();
@@ -664,20 +805,25 @@ static int nfs_readlink_reply(uchar *pkt, unsigned len)
 	return 0;
 }
 
-static int nfs_read_reply(uchar *pkt, unsigned len)
+static int nfs_read_reply(uchar *pkt, unsigned len,
+			  struct nfs_read_slot **slotp, bool *eof)
 {
 	struct rpc_t rpc_pkt;
+	struct nfs_read_slot *slot;
 	int rlen;
-	uchar *data_ptr;
+	int data_offset;
 
 	debug("%s\n", __func__);
 
-	memcpy(&rpc_pkt.u.data[0], pkt, sizeof(rpc_pkt.u.reply));
+	/* Only the header is copied; the data is stored straight from pkt */
+	memset(&rpc_pkt.u.data[0], 0, NFS_READ_REPLY_HDR_SIZE);
+	memcpy(&rpc_pkt.u.data[0], pkt, min_t(unsigned int, len,
+					      NFS_READ_REPLY_HDR_SIZE));
 
-	if (ntohl(rpc_pkt.u.reply.id) > rpc_id)
-		return -NFS_RPC_ERR;
-	else if (ntohl(rpc_pkt.u.reply.id) < rpc_id)
+	slot = nfs_read_find(ntohl(rpc_pkt.u.reply.id));
+	if (!slot)
 		return -NFS_RPC_DROP;
+	*slotp = slot;
 
 	if (rpc_pkt.u.reply.rstatus  ||
 	    rpc_pkt.u.reply.verifier ||
@@ -690,34 +836,32 @@ static int nfs_read_reply(uchar *pkt, unsigned len)
 		return -ntohl(rpc_pkt.u.reply.data[0]);
 	}
 
-	if ((nfs_offset != 0) && !((nfs_offset) %
-			(NFS_READ_SIZE / 2 * 10 * HASHES_PER_LINE)))
-		puts("\n\t ");
-	if (!(nfs_offset % ((NFS_READ_SIZE / 2) * 10)))
-		putc('#');
-
 	if (supported_nfs_versions & NFSV2_FLAG) {
 		rlen = ntohl(rpc_pkt.u.reply.data[18]);
-		data_ptr = (uchar *)&(rpc_pkt.u.reply.data[19]);
+		data_offset = 19;
+		/* A short read means the end of the file has been reached */
+		*eof = rlen < slot->len;
 	} else {  /* NFSV3_FLAG */
 		int nfsv3_data_offset =
 			nfs3_get_attributes_offset(rpc_pkt.u.reply.data);
 
 		/* count value */
 		rlen = ntohl(rpc_pkt.u.reply.data[1 + nfsv3_data_offset]);
+		*eof = rpc_pkt.u.reply.data[2 + nfsv3_data_offset] != 0;
 		/* Skip unused values :
 			EOF:		32 bits value,
 			data_size:	32 bits value,
 		*/
-		data_ptr = (uchar *)
-			&(rpc_pkt.u.reply.data[4 + nfsv3_data_offset]);
+		data_offset = 4 + nfsv3_data_offset;
 	}
+	data_offset = (uchar *)&rpc_pkt.u.reply.data[data_offset] -
+		(uchar *)&rpc_pkt;
 
-	if (((uchar *)&(rpc_pkt.u.reply.data[0]) - (uchar *)(&rpc_pkt) + rlen) > len)
-			return -9999;
+	if (rlen < 0 || rlen > slot->len || data_offset + rlen > len)
+		return -9999;
 
-	if (store_block(data_ptr, nfs_offset, rlen))
-			return -9999;
+	if (rlen && store_block(pkt + data_offset, slot->offset, rlen))
+		return -9999;
 
 	return rlen;
 }
@@ -742,12 +886,15 @@ static void nfs_timeout_handler(void)
 static void nfs_handler(uchar *pkt, unsigned dest, struct in_addr sip,
 			unsigned src, unsigned len)
 {
+	struct nfs_read_slot *slot = NULL;
+	bool eof = false;
 	int rlen;
 	int reply;
 
 	debug("%s\n", __func__);
 
-	if (len > sizeof(struct rpc_t))
+	/* Replies to READ may be larger, as they are not copied whole */
+	if (len > sizeof(struct rpc_t) && nfs_state != STATE_READ_REQ)
 		return;
 
 	if (dest != nfs_our_port)
@@ -814,9 +961,7 @@ static void nfs_handler(uchar *pkt, unsigned dest, struct in_addr sip,
 			nfs_send();
 		} else {
 			nfs_state = STATE_READ_REQ;
-			nfs_offset = 0;
-			nfs_len = NFS_READ_SIZE;
-			nfs_send();
+			nfs_read_start();
 		}
 		break;
 
@@ -839,22 +984,22 @@ static void nfs_handler(uchar *pkt, unsigned dest, struct in_addr sip,
 		break;
 
 	case STATE_READ_REQ:
-		rlen = nfs_read_reply(pkt, len);
+		rlen = nfs_read_reply(pkt, len, &slot, &eof);
 		if (rlen == -NFS_RPC_DROP)
 			break;
 		net_set_timeout_handler(nfs_timeout, nfs_timeout_handler);
-		if (rlen > 0) {
-			nfs_offset += rlen;
+		if (rlen >= 0) {
+			if (!nfs_read_complete(slot, rlen, eof))
+				break;
+			nfs_download_state = NETLOOP_SUCCESS;
+			nfs_state = STATE_UMOUNT_REQ;
 			nfs_send();
 		} else if ((rlen == -NFSERR_ISDIR) || (rlen == -NFSERR_INVAL)) {
 			/* symbolic link */
 			nfs_state = STATE_READLINK_REQ;
 			nfs_send();
 		} else {
-			if (!rlen)
-				nfs_download_state = NETLOOP_SUCCESS;
-			if (rlen < 0)
-				debug("NFS READ error (%d)\n", rlen);
+			debug("NFS READ error (%d)\n", rlen);
 			nfs_state = STATE_UMOUNT_REQ;
 			nfs_send();
 		}
@@ -865,9 +1010,17 @@ static void nfs_handler(uchar *pkt, unsigned dest, struct in_addr sip,
 
 void nfs_start(void)
 {
+	char *ep;
+
 	debug("%s\n", __func__);
 	nfs_download_state = NETLOOP_FAIL;
 
+	nfs_read_window = CONFIG_NFS_READ_WINDOW;
+	ep = env_get("nfswindowsize");
+	if (ep)
+		nfs_read_window = simple_strtol(ep, NULL, 10);
+	nfs_read_window = clamp(nfs_read_window, 1, NFS_MAX_READ_WINDOW);
+
 	nfs_server_ip = net_server_ip;
 	nfs_path = (char *)nfs_path_buff;
 
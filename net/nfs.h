@@ -38,11 +38,16 @@
 /*
  * Block size used for NFS read accesses.  A RPC reply packet (including  all
  * headers) must fit within a single Ethernet frame to avoid fragmentation.
- * However, if CONFIG_IP_DEFRAG is set, a bigger value could be used.  In any
- * case, most NFS servers are optimized for a power of 2.
+ * However, if CONFIG_IP_DEFRAG is set, NFSv3 reads use the biggest power of
+ * two that fits in the reassembly buffer.  In any case, most NFS servers are
+ * optimized for a power of 2.
  */
 #define NFS_READ_SIZE	1024	/* biggest power of two that fits Ether frame */
 #define NFS_MAX_ATTRS	26
+/* RPC header and attributes before the data of a READ reply, at most */
+#define NFS_READ_REPLY_HDR_SIZE	((6 + NFS_MAX_ATTRS) * sizeof(uint32_t))
+/* Most READ requests which can be outstanding at once */
+#define NFS_MAX_READ_WINDOW	16
 
 /* Values for Accept State flag on RPC answers (See: rfc1831) */
 enum rpc_accept_stat {
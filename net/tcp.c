@@ -0,0 +1,659 @@
+// SPDX-License-Identifier: GPL-2.0+
+/*
+ * Minimal TCP client
+ *
+ * This supports a single connection at a time, opened by U-Boot, which
+ * mostly receives data: the user sends a short request and the peer sends a
+ * large reply. It implements just enough of RFC 793 and its successors to do
+ * that quickly:
+ *
+ * - window scaling (RFC 7323), so that many segments can be in flight
+ * - received data is handed to the user straight from the packet buffer,
+ *   including out-of-order data, which is remembered so it need not be sent
+ *   again
+ * - an immediate duplicate ACK for each out-of-order segment, which makes the
+ *   peer retransmit a lost segment without waiting for its timeout (fast
+ *   retransmit, RFC 5681), without needing SACK
+ * - retransmission with a timeout based on the round-trip time (RFC 6298)
+ */
+
+#include <common.h>
+#include <log.h>
+#include <net.h>
+#include <net/tcp.h>
+#include <asm/unaligned.h>
+#include <linux/errno.h>
+
+/* Interval of the timer driving delayed ACKs and retransmission, in ms */
+#define TCP_TICK_MS		20
+/* Retransmission timeout limits, in ms */
+#define TCP_INITIAL_RTO		1000
+#define TCP_MIN_RTO		200
+#define TCP_MAX_RTO		16000
+/* Number of retransmissions before giving up */
+#define TCP_MAX_RETRIES		8
+/* Give up if nothing is received for this long while waiting, in ms */
+#define TCP_IDLE_TIMEOUT	30000
+/* Number of out-of-order ranges of received data that are remembered */
+#define TCP_OOO_RANGES		4
+/* Number of duplicate ACKs which trigger a fast retransmit */
+#define TCP_DUP_ACK_LIMIT	3
+
+/* TCP option kinds */
+#define TCP_OPT_END		0
+#define TCP_OPT_NOP		1
+#define TCP_OPT_MSS		2
+#define TCP_OPT_WSCALE		3
+
+#define TCP_MAX_WSCALE		14
+
+enum tcp_state {
+	TCP_CLOSED,
+	TCP_SYN_SENT,
+	TCP_ESTABLISHED,
+	TCP_FIN_WAIT_1,		/* we sent a FIN, which is not yet acked */
+	TCP_FIN_WAIT_2,		/* our FIN is acked, waiting for the peer's */
+};
+
+/* A range of sequence numbers, received ahead of rcv_nxt */
+struct tcp_range {
+	u32 start;
+	u32 end;
+};
+
+/**
+ * struct tcp_conn - state of the connection
+ *
+ * Sequence number names follow RFC 793.
+ */
+struct tcp_conn {
+	enum tcp_state state;
+	const struct tcp_ops *ops;
+	struct in_addr remote_ip;
+	uchar remote_ethaddr[ARP_HLEN];
+	int remote_port;
+	int local_port;
+
+	/* Sending */
+	u32 iss;		/* initial send sequence number */
+	u32 snd_una;		/* oldest unacknowledged sequence number */
+	u32 snd_nxt;		/* next sequence number to send */
+	u16 snd_mss;		/* largest segment the peer accepts */
+	uchar tx_buf[TCP_MSS];	/* data sent but not acknowledged */
+	unsigned int tx_len;
+	bool fin_queued;	/* send a FIN once the data is acknowledged */
+	bool fin_sent;
+	int dup_acks;
+
+	/* Receiving */
+	u32 irs;		/* initial receive sequence number */
+	u32 rcv_nxt;		/* next sequence number expected */
+	u32 rcv_wnd;		/* receive window */
+	u8 rcv_wscale;		/* window scale we apply to rcv_wnd */
+	struct tcp_range ooo[TCP_OOO_RANGES];
+	int ooo_count;
+	bool fin_pending;	/* a FIN was received out of order... */
+	u32 fin_seq;		/* ...with this sequence number */
+	int unacked_segs;	/* segments received since our last ACK */
+	ulong last_rx;		/* time the last segment was received */
+
+	/* Retransmission */
+	ulong rto;
+	ulong rtx_start;	/* time of the last (re)transmission */
+	int retries;
+	ulong srtt;
+	ulong rttvar;
+	bool rtt_timing;	/* measuring the round-trip time of rtt_seq */
+	u32 rtt_seq;
+	ulong rtt_start;
+};
+
+static struct tcp_conn tcp;
+
+static inline bool seq_lt(u32 a, u32 b)
+{
+	return (s32)(a - b) < 0;
+}
+
+static inline bool seq_le(u32 a, u32 b)
+{
+	return (s32)(a - b) <= 0;
+}
+
+/* Pseudo-header used to calculate the TCP checksum */
+struct tcp_pseudo_hdr {
+	struct in_addr src;
+	struct in_addr dst;
+	u8 zero;
+	u8 proto;
+	u16 len;
+} __attribute__((packed));
+
+static uint tcp_checksum(struct in_addr src, struct in_addr dst,
+			 const void *seg, uint len)
+{
+	struct tcp_pseudo_hdr ph;
+
+	net_copy_ip(&ph.src, &src);
+	net_copy_ip(&ph.dst, &dst);
+	ph.zero = 0;
+	ph.proto = IPPROTO_TCP;
+	ph.len = htons(len);
+
+	return add_ip_checksums(sizeof(ph), compute_ip_checksum(&ph, sizeof(ph)),
+				compute_ip_checksum(seg, len));
+}
+
+/* Whether a retransmission is needed if something is not acknowledged */
+static bool tcp_outstanding(void)
+{
+	return tcp.state == TCP_SYN_SENT || tcp.tx_len ||
+	       (tcp.fin_sent && tcp.snd_una != tcp.snd_nxt);
+}
+
+int tcp_set_tcp_header(uchar *pkt, struct in_addr dest, int dport, int sport,
+		       int payload_len, u8 action, u32 tcp_seq_num,
+		       u32 tcp_ack_num)
+{
+	struct ip_tcp_hdr *ip = (struct ip_tcp_hdr *)pkt;
+	uchar *opt = pkt + IP_TCP_HDR_SIZE;
+	int hdr_size = IP_TCP_HDR_SIZE;
+	u32 win;
+
+	if (action & TCP_SYN) {
+		opt[0] = TCP_OPT_MSS;
+		opt[1] = 4;
+		put_unaligned_be16(TCP_MSS, opt + 2);
+		opt[4] = TCP_OPT_NOP;
+		opt[5] = TCP_OPT_WSCALE;
+		opt[6] = 3;
+		opt[7] = tcp.rcv_wscale;
+		hdr_size += TCP_SYN_OPT_SIZE;
+		/* The window in a SYN is never scaled */
+		win = min_t(u32, tcp.rcv_wnd, 0xffff);
+	} else {
+		win = tcp.rcv_wnd >> tcp.rcv_wscale;
+	}
+
+	net_set_ip_header(pkt, dest, net_ip, hdr_size + payload_len,
+			  IPPROTO_TCP);
+
+	ip->tcp_src = htons(sport);
+	ip->tcp_dst = htons(dport);
+	ip->tcp_seq = htonl(tcp_seq_num);
+	ip->tcp_ack = htonl(tcp_ack_num);
+	ip->tcp_hlen = ((hdr_size - IP_HDR_SIZE) / 4) << 4;
+	ip->tcp_flags = action;
+	ip->tcp_win = htons(win);
+	ip->tcp_urg = 0;
+	ip->tcp_xsum = 0;
+
+	ip->tcp_xsum = tcp_checksum(net_ip, dest, pkt + IP_HDR_SIZE,
+				    hdr_size - IP_HDR_SIZE + payload_len);
+
+	return hdr_size;
+}
+
+static uchar *tcp_tx_payload(void)
+{
+	return net_tx_packet + net_eth_hdr_size() + IP_TCP_HDR_SIZE;
+}
+
+static void tcp_send_segment(u8 flags, u32 seq, const void *data,
+			     unsigned int len)
+{
+	if (len)
+		memcpy(tcp_tx_payload(), data, len);
+	if (tcp.state != TCP_SYN_SENT)
+		flags |= TCP_ACK;
+	net_send_ip_packet(tcp.remote_ethaddr, tcp.remote_ip, tcp.remote_port,
+			   tcp.local_port, len, IPPROTO_TCP, flags, seq,
+			   tcp.rcv_nxt);
+	if (flags & TCP_ACK)
+		tcp.unacked_segs = 0;
+}
+
+static void tcp_send_ack(void)
+{
+	tcp_send_segment(TCP_ACK, tcp.snd_nxt, NULL, 0);
+}
+
+/* Start the retransmission timer for something just sent */
+static void tcp_start_rtx(u32 seq, bool retransmit)
+{
+	tcp.rtx_start = get_timer(0);
+	if (retransmit) {
+		/* Karn's algorithm: do not time retransmitted segments */
+		tcp.rtt_timing = false;
+	} else if (!tcp.rtt_timing) {
+		tcp.rtt_timing = true;
+		tcp.rtt_seq = seq;
+		tcp.rtt_start = tcp.rtx_start;
+	}
+}
+
+/* Send again whatever is oldest and not yet acknowledged */
+static void tcp_retransmit(void)
+{
+	if (tcp.state == TCP_SYN_SENT)
+		tcp_send_segment(TCP_SYN, tcp.iss, NULL, 0);
+	else if (tcp.tx_len)
+		tcp_send_segment(TCP_PSH, tcp.snd_una, tcp.tx_buf, tcp.tx_len);
+	else if (tcp.fin_sent)
+		tcp_send_segment(TCP_FIN, tcp.snd_nxt - 1, NULL, 0);
+	tcp_start_rtx(tcp.snd_una, true);
+}
+
+static void tcp_send_fin(void)
+{
+	tcp.fin_queued = false;
+	tcp.fin_sent = true;
+	tcp_send_segment(TCP_FIN, tcp.snd_nxt, NULL, 0);
+	tcp_start_rtx(tcp.snd_nxt, false);
+	tcp.snd_nxt++;
+}
+
+static void tcp_finish(int err)
+{
+	tcp.state = TCP_CLOSED;
+	net_set_timeout_handler(0, NULL);
+	tcp.ops->closed(err);
+}
+
+/* Update the retransmission timeout from a round-trip time sample */
+static void tcp_update_rto(ulong rtt)
+{
+	if (!tcp.srtt) {
+		tcp.srtt = max(rtt, 1UL);
+		tcp.rttvar = rtt / 2;
+	} else {
+		ulong delta = rtt > tcp.srtt ? rtt - tcp.srtt : tcp.srtt - rtt;
+
+		tcp.rttvar = (3 * tcp.rttvar + delta) / 4;
+		tcp.srtt = max((7 * tcp.srtt + rtt) / 8, 1UL);
+	}
+	tcp.rto = clamp(tcp.srtt + 4 * tcp.rttvar, (ulong)TCP_MIN_RTO,
+			(ulong)TCP_MAX_RTO);
+}
+
+static void tcp_timer(void)
+{
+	net_set_timeout_handler(TCP_TICK_MS, tcp_timer);
+
+	if (tcp.unacked_segs)
+		tcp_send_ack();
+
+	if (tcp_outstanding()) {
+		if (get_timer(tcp.rtx_start) < tcp.rto)
+			return;
+		if (++tcp.retries > TCP_MAX_RETRIES) {
+			debug("TCP: too many retransmissions\n");
+			tcp_finish(-ETIMEDOUT);
+			return;
+		}
+		tcp.rto = min(tcp.rto * 2, (ulong)TCP_MAX_RTO);
+		tcp_retransmit();
+	} else if (get_timer(tcp.last_rx) > TCP_IDLE_TIMEOUT) {
+		debug("TCP: connection idle\n");
+		/* All our data and our FIN were acked, so nothing is lost */
+		tcp_finish(tcp.state == TCP_FIN_WAIT_2 ? 0 : -ETIMEDOUT);
+	}
+}
+
+int tcp_connect(struct in_addr ip, u16 port, const struct tcp_ops *ops)
+{
+	u32 win = CONFIG_TCP_RX_WINDOW;
+
+	memset(&tcp, '\0', sizeof(tcp));
+	tcp.ops = ops;
+	tcp.remote_ip = ip;
+	tcp.remote_port = port;
+	/* Use a pseudo-random port and initial sequence number */
+	tcp.local_port = 1024 + (get_timer(0) % 3072);
+	tcp.iss = (u32)get_ticks();
+	tcp.snd_una = tcp.iss;
+	tcp.snd_nxt = tcp.iss + 1;
+
+	while (tcp.rcv_wscale < TCP_MAX_WSCALE &&
+	       (win >> tcp.rcv_wscale) > 0xffff)
+		tcp.rcv_wscale++;
+	tcp.rcv_wnd = min_t(u32, win, 0xffffU << tcp.rcv_wscale);
+
+	tcp.rto = TCP_INITIAL_RTO;
+	tcp.last_rx = get_timer(0);
+	tcp.state = TCP_SYN_SENT;
+	tcp_send_segment(TCP_SYN, tcp.iss, NULL, 0);
+	tcp_start_rtx(tcp.iss, false);
+	net_set_timeout_handler(TCP_TICK_MS, tcp_timer);
+
+	return 0;
+}
+
+int tcp_send(const void *data, unsigned int len)
+{
+	if (tcp.state != TCP_ESTABLISHED || tcp.fin_queued)
+		return -ENOTCONN;
+	if (tcp.tx_len)
+		return -EBUSY;
+	if (len > tcp.snd_mss)
+		return -E2BIG;
+
+	memcpy(tcp.tx_buf, data, len);
+	tcp.tx_len = len;
+	tcp_send_segment(TCP_PSH, tcp.snd_nxt, data, len);
+	tcp_start_rtx(tcp.snd_nxt, false);
+	tcp.snd_nxt += len;
+
+	return 0;
+}
+
+void tcp_close(void)
+{
+	if (tcp.state != TCP_ESTABLISHED)
+		return;
+
+	tcp.state = TCP_FIN_WAIT_1;
+	if (tcp.tx_len)
+		tcp.fin_queued = true;
+	else
+		tcp_send_fin();
+}
+
+void tcp_abort(void)
+{
+	if (tcp.state == TCP_CLOSED)
+		return;
+
+	/* Before the SYN-ACK there is nothing for the peer to forget */
+	if (tcp.state != TCP_SYN_SENT)
+		tcp_send_segment(TCP_RST, tcp.snd_nxt, NULL, 0);
+	tcp.state = TCP_CLOSED;
+	net_set_timeout_handler(0, NULL);
+}
+
+/* Read the options of a SYN from the peer */
+static void tcp_parse_syn_options(const uchar *opt, int len)
+{
+	bool wscale = false;
+
+	/* The default when no MSS option is given (RFC 879) */
+	tcp.snd_mss = 536;
+
+	while (len > 0) {
+		int kind = opt[0];
+		int size;
+
+		if (kind == TCP_OPT_END)
+			break;
+		if (kind == TCP_OPT_NOP) {
+			opt++;
+			len--;
+			continue;
+		}
+		if (len < 2)
+			break;
+		size = opt[1];
+		if (size < 2 || size > len)
+			break;
+		if (kind == TCP_OPT_MSS && size == 4)
+			tcp.snd_mss = clamp_t(u16, get_unaligned_be16(opt + 2), 1,
+					    TCP_MSS);
+		else if (kind == TCP_OPT_WSCALE && size == 3)
+			wscale = true;
+		opt += size;
+		len -= size;
+	}
+
+	/* Scaling is only used if both ends ask for it */
+	if (!wscale) {
+		tcp.rcv_wscale = 0;
+		tcp.rcv_wnd = min_t(u32, tcp.rcv_wnd, 0xffff);
+	}
+}
+
+/* Process an acknowledgment from the peer */
+static void tcp_process_ack(u32 ack, bool has_data)
+{
+	u32 acked;
+
+	if (seq_lt(tcp.snd_una, ack) && seq_le(ack, tcp.snd_nxt)) {
+		acked = ack - tcp.snd_una;
+		tcp.snd_una = ack;
+		if (tcp.rtt_timing && seq_lt(tcp.rtt_seq, ack)) {
+			tcp_update_rto(get_timer(tcp.rtt_start));
+			tcp.rtt_timing = false;
+		}
+		tcp.retries = 0;
+		tcp.dup_acks = 0;
+		tcp.rtx_start = get_timer(0);
+
+		if (tcp.tx_len) {
+			acked = min(acked, tcp.tx_len);
+			tcp.tx_len -= acked;
+			memmove(tcp.tx_buf, tcp.tx_buf + acked, tcp.tx_len);
+			if (!tcp.tx_len && tcp.fin_queued)
+				tcp_send_fin();
+		}
+		if (tcp.fin_sent && ack == tcp.snd_nxt)
+			tcp.state = TCP_FIN_WAIT_2;
+	} else if (ack == tcp.snd_una && !has_data && tcp_outstanding()) {
+		/* Duplicate ACK: the peer may have lost our segment */
+		if (++tcp.dup_acks == TCP_DUP_ACK_LIMIT)
+			tcp_retransmit();
+	}
+}
+
+/* Remember that the range [start, end) was received out of order */
+static void tcp_add_ooo(u32 start, u32 end)
+{
+	struct tcp_range *r;
+	int i;
+
+	for (i = 0; i < tcp.ooo_count; i++) {
+		r = &tcp.ooo[i];
+		/* Merge with an overlapping or adjacent range */
+		if (seq_le(start, r->end) && seq_le(r->start, end)) {
+			if (seq_lt(start, r->start))
+				r->start = start;
+			if (seq_lt(r->end, end))
+				r->end = end;
+			return;
+		}
+	}
+	/* If there is no room, the peer just sends the data again */
+	if (tcp.ooo_count < TCP_OOO_RANGES) {
+		r = &tcp.ooo[tcp.ooo_count++];
+		r->start = start;
+		r->end = end;
+	}
+}
+
+/* Move rcv_nxt past any out-of-order data which is now in order */
+static bool tcp_merge_ooo(void)
+{
+	bool merged = false;
+	int i;
+
+	for (i = 0; i < tcp.ooo_count; i++) {
+		struct tcp_range *r = &tcp.ooo[i];
+
+		if (seq_le(r->start, tcp.rcv_nxt)) {
+			if (seq_lt(tcp.rcv_nxt, r->end))
+				tcp.rcv_nxt = r->end;
+			*r = tcp.ooo[--tcp.ooo_count];
+			merged = true;
+			i = -1;		/* rcv_nxt moved; check them all again */
+		}
+	}
+
+	return merged;
+}
+
+/*
+ * Process data from the peer
+ *
+ * @return true to ACK at once, false to delay the ACK
+ */
+static bool tcp_process_data(u32 seq, const uchar *data, unsigned int len,
+			     bool fin)
+{
+	u32 win_end = tcp.rcv_nxt + tcp.rcv_wnd;
+	bool filled;
+	int ret;
+
+	/* Drop what we already have */
+	if (seq_lt(seq, tcp.rcv_nxt)) {
+		u32 skip = tcp.rcv_nxt - seq;
+
+		if (skip > len) {
+			/* Old duplicate; our ACK may have been lost */
+			return true;
+		}
+		seq += skip;
+		data += skip;
+		len -= skip;
+	}
+	/* Drop what does not fit in the window */
+	if (seq_le(win_end, seq))
+		return true;
+	if (seq_lt(win_end, seq + len)) {
+		len = win_end - seq;
+		fin = false;
+	}
+
+	if (seq != tcp.rcv_nxt) {
+		/* Out of order: keep it if we can, and report the gap */
+		ret = len ? tcp.ops->rx(seq - tcp.irs - 1, data, len) : 0;
+		if (ret == -EAGAIN)
+			return true;
+		if (ret)
+			goto err;
+		if (len)
+			tcp_add_ooo(seq, seq + len);
+		if (fin) {
+			tcp.fin_pending = true;
+			tcp.fin_seq = seq + len;
+		}
+		return true;
+	}
+
+	if (len) {
+		ret = tcp.ops->rx(seq - tcp.irs - 1, data, len);
+		if (ret)
+			goto err;
+		tcp.rcv_nxt += len;
+		tcp.unacked_segs++;
+		filled = tcp_merge_ooo();
+		if (tcp.fin_pending && tcp.fin_seq == tcp.rcv_nxt)
+			fin = true;
+		/* ACK at once when a gap is filled, so the peer speeds up */
+		if (filled && !fin)
+			return true;
+	}
+
+	if (fin) {
+		tcp.rcv_nxt++;
+		if (tcp.state == TCP_ESTABLISHED) {
+			/*
+			 * We have nothing more to say either, so send our FIN
+			 * with the ACK. There is no need to wait for the peer
+			 * to acknowledge it: all the data has arrived, and if
+			 * the FIN is lost the peer just times out.
+			 */
+			tcp_send_segment(TCP_FIN, tcp.snd_nxt++, NULL, 0);
+		} else {
+			tcp_send_ack();
+		}
+		tcp_finish(0);
+		return false;
+	}
+
+	/* Normally ACK every second segment (RFC 1122) */
+	return tcp.unacked_segs >= 2;
+
+err:
+	debug("TCP: user rejected data: %d\n", ret);
+	tcp_abort();
+	tcp.ops->closed(ret);
+	return false;
+}
+
+void tcp_receive(struct ip_tcp_hdr *ip, int len, struct in_addr src_ip)
+{
+	int tcp_len = len - IP_HDR_SIZE;
+	int hdr_len, data_len;
+	u32 seq, ack;
+	u8 flags;
+
+	if (tcp.state == TCP_CLOSED || len < IP_TCP_HDR_SIZE)
+		return;
+	if (src_ip.s_addr != tcp.remote_ip.s_addr ||
+	    ntohs(ip->tcp_src) != tcp.remote_port ||
+	    ntohs(ip->tcp_dst) != tcp.local_port)
+		return;
+
+	hdr_len = (ip->tcp_hlen >> 4) * 4;
+	if (hdr_len < TCP_HDR_SIZE || hdr_len > tcp_len)
+		return;
+	if (tcp_checksum(src_ip, net_ip, (uchar *)ip + IP_HDR_SIZE,
+			 tcp_len) & 0xfffe) {
+		debug("TCP: bad checksum\n");
+		return;
+	}
+
+	data_len = tcp_len - hdr_len;
+	seq = ntohl(ip->tcp_seq);
+	ack = ntohl(ip->tcp_ack);
+	flags = ip->tcp_flags;
+	tcp.last_rx = get_timer(0);
+
+	if (tcp.state == TCP_SYN_SENT) {
+		if ((flags & TCP_ACK) && ack != tcp.iss + 1)
+			return;
+		if (flags & TCP_RST) {
+			if (flags & TCP_ACK)
+				tcp_finish(-ECONNREFUSED);
+			return;
+		}
+		if (!(flags & TCP_SYN) || !(flags & TCP_ACK))
+			return;
+
+		tcp.irs = seq;
+		tcp.rcv_nxt = seq + 1;
+		tcp.snd_una = ack;
+		tcp_parse_syn_options((uchar *)ip + IP_TCP_HDR_SIZE,
+				      hdr_len - TCP_HDR_SIZE);
+		if (tcp.rtt_timing)
+			tcp_update_rto(get_timer(tcp.rtt_start));
+		tcp.rtt_timing = false;
+		tcp.retries = 0;
+		tcp.state = TCP_ESTABLISHED;
+		tcp_send_ack();
+		tcp.ops->connected();
+		return;
+	}
+
+	if (flags & TCP_RST) {
+		/* Only believe a reset that is inside our window */
+		if (seq_le(tcp.rcv_nxt, seq) &&
+		    seq_lt(seq, tcp.rcv_nxt + tcp.rcv_wnd))
+			tcp_finish(-ECONNRESET);
+		return;
+	}
+	if (flags & TCP_SYN) {
+		/* SYN-ACK again, because our ACK was lost */
+		tcp_send_ack();
+		return;
+	}
+
+	if (flags & TCP_ACK)
+		tcp_process_ack(ack, data_len || (flags & TCP_FIN));
+	if (tcp.state == TCP_CLOSED)
+		return;
+
+	if ((data_len || (flags & TCP_FIN)) &&
+	    tcp_process_data(seq, (uchar *)ip + IP_HDR_SIZE + hdr_len,
+			     data_len, flags & TCP_FIN) &&
+	    tcp.state != TCP_CLOSED)
+		tcp_send_ack();
+}
@@ -8,6 +8,7 @@
 
 #include <common.h>
 #include <command.h>
+#include <decomp_stream.h>
 #include <efi_loader.h>
 #include <env.h>
 #include <image.h>
@@ -35,6 +36,8 @@ DECLARE_GLOBAL_DATA_PTR;
 #endif
 /* Number of "loading" hashes per line (for checking the image size) */
 #define HASHES_PER_LINE	65
+/* Lower limit of the adaptive timeout used with a window, in millisecs */
+#define TFTP_MIN_RTO	200UL
 
 /*
  *	TFTP operations.
@@ -91,6 +94,11 @@ static ulong	tftp_load_addr;
 #ifdef CONFIG_LMB
 static ulong	tftp_load_size;
 #endif
+#ifdef CONFIG_TFTP_DECOMP
+/* Decompressor fed with the file as it arrives, if 'tftpdecomp' is set */
+static struct decomp_stream tftp_decomp;
+static bool	tftp_decomp_active;
+#endif
 #ifdef CONFIG_TFTP_TSIZE
 /* The file size reported by the server */
 static int	tftp_tsize;
@@ -139,6 +147,167 @@ static char tftp_filename[MAX_LEN];
 static unsigned short tftp_block_size = TFTP_BLOCK_SIZE;
 static unsigned short tftp_block_size_option = CONFIG_TFTP_BLOCKSIZE;
 
+/*
+ * RFC 7440 lets the server send a window of several blocks before it waits
+ * for an ACK. We ACK the last block of each window, or the last block
+ * received in order if one goes missing.
+ */
+static unsigned short tftp_windowsize = 1;
+static unsigned short tftp_windowsize_option = CONFIG_TFTP_WINDOWSIZE;
+/* block whose arrival completes the current window */
+static ulong	tftp_next_ack;
+/* block last ACKed to report a lost block, or ULONG_MAX */
+static ulong	tftp_last_nack;
+/* smoothed round-trip time and its mean deviation, in millisecs */
+static ulong	tftp_srtt;
+static ulong	tftp_rttvar;
+/* current retransmission timeout when using a window, in millisecs */
+static ulong	tftp_rto;
+/* time the last ACK was sent, valid if tftp_rtt_timing is set */
+static ulong	tftp_ack_time;
+static bool	tftp_rtt_timing;
+
+#ifdef CONFIG_TFTP_MULTICAST
+/*
+ * RFC 2090 lets the server send the file to a multicast group. Only one
+ * client at a time, the master client, ACKs the blocks; the others just
+ * listen and note which blocks they have in a bitmap. A client which becomes
+ * master asks for the first block it is missing. Block numbers do not wrap
+ * in this mode, which limits the file to 65535 blocks.
+ */
+/* 1 if we ask for multicast, else 0 */
+static int	tftp_mcast_option;
+/* 1 if the server is sending to a multicast group, else 0 */
+static int	tftp_mcast_active;
+/* 1 if we are the master client, else 0 */
+static int	tftp_mcast_master;
+/* the UDP port the group is sent data on */
+static int	tftp_mcast_port;
+/* the last block of the file, or 0 if not seen yet */
+static ushort	tftp_mcast_ending_block;
+/* all blocks up to and including this one have been received */
+static ushort	tftp_mcast_prev_hole;
+/* number of different blocks received */
+static ulong	tftp_mcast_num_blocks;
+static u8	tftp_mcast_bitmap[TFTP_SEQUENCE_SIZE / 8];
+#else
+#define tftp_mcast_option	0
+#endif
+
+#ifdef CONFIG_TFTP_PROBE
+/*
+ * When probing, a request is sent for each of a list of names, up to
+ * CONFIG_TFTP_PROBE_WINDOW at a time, each from its own port. The first name
+ * in the list which the server has is loaded. A file found while a name
+ * before it is still waiting for a reply is held back until that one fails.
+ */
+enum {
+	PROBE_IDLE,		/* request not sent yet */
+	PROBE_WAITING,		/* waiting for a reply */
+	PROBE_MISSING,		/* the server does not have the file */
+	PROBE_FOUND,		/* the server has the file */
+};
+
+static const char *const *tftp_probe_names;
+static int	tftp_probe_count;
+/* 1 while we do not know which file to load yet, else 0 */
+static int	tftp_probing;
+/* our port for the first name; each name after it uses the next port */
+static int	tftp_probe_port;
+static u8	tftp_probe_state[TFTP_PROBE_MAX];
+/* index of the file which is being held back, or -1 */
+static int	tftp_probe_held;
+/* the server's port for the file being held back */
+static int	tftp_probe_held_port;
+/* first packet of the file being held back; length 0 if it did not fit */
+static uchar	tftp_probe_pkt[PKTSIZE_ALIGN];
+static unsigned int tftp_probe_pkt_len;
+/* index of the file loaded, or -1 */
+static int	tftp_probe_found;
+#endif
+
+#ifdef CONFIG_TFTP_DECOMP
+static void tftp_decomp_stop(void)
+{
+	if (tftp_decomp_active) {
+		decomp_stream_abort(&tftp_decomp);
+		unmap_sysmem(tftp_decomp.dst);
+		tftp_decomp_active = false;
+	}
+}
+
+/* Set up decompression of the file to the load address, if asked for */
+static int tftp_decomp_start(void)
+{
+	const char *name = env_get("tftpdecomp");
+#ifdef CONFIG_LMB
+	ulong size = tftp_load_size;
+#else
+	ulong size = 0;
+#endif
+	int comp, ret;
+	void *dst;
+
+	tftp_decomp_stop();
+	if (!name)
+		return 0;
+
+	comp = genimg_get_comp_id(name);
+	if (comp < 0) {
+		printf("TFTP error: unknown compression '%s'\n", name);
+		return -EINVAL;
+	}
+	if (!size)
+		size = ULONG_MAX - tftp_load_addr;
+	dst = map_sysmem(tftp_load_addr, size);
+	ret = decomp_stream_init(&tftp_decomp, comp, dst, size);
+	if (ret) {
+		unmap_sysmem(dst);
+		printf("TFTP error: cannot decompress '%s' (%d)\n", name, ret);
+		return ret;
+	}
+	tftp_decomp_active = true;
+
+	return 0;
+}
+
+static int tftp_decomp_block(ulong offset, uchar *src, unsigned int len)
+{
+	int ret;
+
+	/* The data must arrive in order, which multicast does not ensure */
+	if (offset != tftp_decomp.in_len) {
+		puts("\nTFTP error: cannot decompress blocks out of order\n");
+		return -EINVAL;
+	}
+	ret = decomp_stream_feed(&tftp_decomp, src, len);
+	if (ret) {
+		printf("\nTFTP error: decompression failed (%d)\n", ret);
+		return ret;
+	}
+
+	return 0;
+}
+
+/* Complete decompression, leaving its size in net_boot_file_size */
+static int tftp_decomp_finish(void)
+{
+	ulong out_len;
+	int ret;
+
+	tftp_decomp_active = false;
+	ret = decomp_stream_finish(&tftp_decomp, &out_len);
+	unmap_sysmem(tftp_decomp.dst);
+	if (ret) {
+		printf("\nTFTP error: decompression failed (%d)\n", ret);
+		return ret;
+	}
+	net_boot_file_size = out_len;
+
+	return 0;
+}
+#endif /* CONFIG_TFTP_DECOMP */
+
 static inline int store_block(int block, uchar *src, unsigned int len)
 {
 	ulong offset = block * tftp_block_size + tftp_block_wrap_offset;
@@ -165,6 +334,13 @@ static inline int store_block(int block, uchar *src, unsigned int len)
 		}
 	} else
 #endif /* CONFIG_SYS_DIRECT_FLASH_TFTP */
+#ifdef CONFIG_TFTP_DECOMP
+	if (tftp_decomp_active) {
+		if (tftp_decomp_block(offset, src, len))
+			return -1;
+		newsize = tftp_decomp.out_len;
+	} else
+#endif
 	{
 		void *ptr;
 
@@ -198,6 +374,9 @@ static void new_transfer(void)
 	tftp_prev_block = 0;
 	tftp_block_wrap = 0;
 	tftp_block_wrap_offset = 0;
+	tftp_next_ack = tftp_windowsize;
+	tftp_last_nack = ULONG_MAX;
+	tftp_rtt_timing = false;
 #ifdef CONFIG_CMD_TFTPPUT
 	tftp_put_final_block_sent = 0;
 #endif
@@ -228,6 +407,44 @@ static int load_block(unsigned block, uchar *dst, unsigned len)
 
 static void tftp_send(void);
 static void tftp_timeout_handler(void);
+static void tftp_handler(uchar *pkt, unsigned dest, struct in_addr sip,
+			 unsigned src, unsigned len);
+
+/* Get the timeout to use while waiting for a data block */
+static ulong tftp_data_timeout(void)
+{
+	return tftp_windowsize > 1 ? tftp_rto : timeout_ms;
+}
+
+/*
+ * Update the retransmission timeout from a round-trip time sample, in the
+ * same way as TCP does (RFC 6298). The timeout never exceeds timeout_ms.
+ */
+static void tftp_update_rto(ulong rtt)
+{
+	ulong delta;
+
+	if (!tftp_srtt) {
+		/* First sample; the smoothed value must not be 0 */
+		tftp_srtt = max(rtt, 1UL);
+		tftp_rttvar = rtt / 2;
+	} else {
+		delta = rtt > tftp_srtt ? rtt - tftp_srtt : tftp_srtt - rtt;
+		tftp_rttvar = (3 * tftp_rttvar + delta) / 4;
+		tftp_srtt = max((7 * tftp_srtt + rtt) / 8, 1UL);
+	}
+	tftp_rto = clamp(tftp_srtt + 4 * tftp_rttvar, TFTP_MIN_RTO, timeout_ms);
+	debug("TFTP rtt %lu ms, srtt %lu ms, rto %lu ms\n", rtt, tftp_srtt,
+	      tftp_rto);
+}
+
+/* ACK the current block and note when, to measure the round-trip time */
+static void tftp_send_ack(void)
+{
+	tftp_send();
+	tftp_ack_time = get_timer(0);
+	tftp_rtt_timing = true;
+}
 
 /**********************************************************************/
 
@@ -290,6 +507,13 @@ static void update_block_number(void)
 /* The TFTP get or put is complete */
 static void tftp_complete(void)
 {
+#ifdef CONFIG_TFTP_DECOMP
+	if (tftp_decomp_active && tftp_decomp_finish()) {
+		eth_halt();
+		net_set_state(NETLOOP_FAIL);
+		return;
+	}
+#endif
 #ifdef CONFIG_TFTP_TSIZE
 	/* Print hash marks for the last packet received */
 	while (tftp_tsize && tftp_tsize_num_hash < 49) {
@@ -350,6 +574,17 @@ static void tftp_send(void)
 		/* try for more effic. blk size */
 		pkt += sprintf((char *)pkt, "blksize%c%d%c",
 				0, tftp_block_size_option, 0);
+
+		/* try for more blocks in flight, unless using multicast */
+		if (tftp_state == STATE_SEND_RRQ && tftp_windowsize_option > 1 &&
+		    !tftp_mcast_option)
+			pkt += sprintf((char *)pkt, "windowsize%c%d%c",
+				       0, tftp_windowsize_option, 0);
+#ifdef CONFIG_TFTP_MULTICAST
+		/* The value is empty in a request */
+		if (tftp_mcast_option)
+			pkt += sprintf((char *)pkt, "multicast%c%c", 0, 0);
+#endif
 		len = pkt - xp;
 		break;
 
@@ -403,6 +638,292 @@ static void tftp_send(void)
 			    tftp_remote_port, tftp_our_port, len);
 }
 
+/*
+ * Handle a data block which is not the one after the last block received in
+ * order, when using a window. Either a block was lost, or this is an old copy
+ * of a block we already have, from a window the server is sending again.
+ */
+static void tftp_window_out_of_order(ushort block)
+{
+	ushort expected = tftp_prev_block + 1;
+
+	debug("Received unexpected block: %u, expected: %u\n", block,
+	      expected);
+
+	/* Old copy; drop it */
+	if ((ushort)(block - expected) >= TFTP_SEQUENCE_SIZE / 2)
+		return;
+
+	/*
+	 * A block was lost. ACK the last block received in order, so that the
+	 * server sends the window again from the block after it. The rest of
+	 * the current window is also out of order, so only do this once.
+	 */
+	if (tftp_last_nack != tftp_prev_block) {
+		tftp_send_ack();
+		tftp_last_nack = tftp_prev_block;
+		tftp_next_ack = (ushort)(tftp_prev_block + tftp_windowsize);
+	}
+}
+
+#ifdef CONFIG_TFTP_MULTICAST
+/* ACK the blocks received without a gap, to ask for the first missing one */
+static void tftp_mcast_ack(void)
+{
+	tftp_cur_block = tftp_mcast_prev_hole;
+	tftp_send();
+}
+
+static bool tftp_mcast_have_block(ushort block)
+{
+	return tftp_mcast_bitmap[block / 8] & (1 << (block % 8));
+}
+
+/* Leave the multicast group, if we joined one */
+static void tftp_mcast_stop(void)
+{
+	if (!tftp_mcast_active)
+		return;
+
+	eth_mcast_join(net_mcast_addr, 0);
+	net_mcast_addr.s_addr = 0;
+	tftp_mcast_active = 0;
+}
+
+/*
+ * Handle the "multicast" option of an OACK, whose value is
+ * "<addr>,<port>,<mc>". Only the first OACK must give the group address and
+ * port; later ones just tell a client that it has become the master client.
+ *
+ * @param val	Value of the option
+ * @return 0 if OK, -ve on error
+ */
+static int tftp_mcast_oack(char *val)
+{
+	struct in_addr addr;
+	char *port, *mc;
+
+	port = strchr(val, ',');
+	mc = port ? strchr(port + 1, ',') : NULL;
+	if (!mc) {
+		printf("\nTFTP error: bad multicast option '%s'\n", val);
+		return -EINVAL;
+	}
+
+	if (!tftp_mcast_active) {
+		addr = string_to_ip(val);
+		tftp_mcast_port = simple_strtoul(port + 1, NULL, 10);
+		if ((ntohl(addr.s_addr) & 0xf0000000) != 0xe0000000 ||
+		    !tftp_mcast_port) {
+			printf("\nTFTP error: bad multicast group '%s'\n", val);
+			return -EINVAL;
+		}
+		/* Some drivers pass on all multicast packets anyway */
+		if (eth_mcast_join(addr, 1))
+			debug("Cannot join multicast group %pI4\n", &addr);
+		net_mcast_addr = addr;
+		tftp_mcast_active = 1;
+		tftp_mcast_ending_block = 0;
+		tftp_mcast_prev_hole = 0;
+		tftp_mcast_num_blocks = 0;
+		memset(tftp_mcast_bitmap, '\0', sizeof(tftp_mcast_bitmap));
+		debug("Multicast group %pI4, port %d\n", &addr,
+		      tftp_mcast_port);
+	}
+	tftp_state = STATE_DATA;
+	tftp_mcast_master = simple_strtoul(mc + 1, NULL, 10) == 1;
+	debug("Multicast master: %d\n", tftp_mcast_master);
+	if (tftp_mcast_master)
+		tftp_mcast_ack();
+
+	return 0;
+}
+
+/* Handle a data block sent to the multicast group */
+static void tftp_mcast_data(ushort block, uchar *data, unsigned int len)
+{
+	/* Any block for the group shows that the server is still there */
+	timeout_count = 0;
+	net_set_timeout_handler(timeout_ms, tftp_timeout_handler);
+
+	if (!block ||
+	    (block == TFTP_SEQUENCE_SIZE - 1 && len == tftp_block_size)) {
+		puts("\nTFTP error: file has too many blocks for multicast\n");
+		goto fail;
+	}
+	if (len < tftp_block_size)
+		tftp_mcast_ending_block = block;
+
+	if (!tftp_mcast_have_block(block)) {
+		if (store_block(block - 1, data, len))
+			goto fail;
+		tftp_mcast_bitmap[block / 8] |= 1 << (block % 8);
+		tftp_cur_block = ++tftp_mcast_num_blocks;
+		show_block_marker();
+	}
+	while (tftp_mcast_have_block(tftp_mcast_prev_hole + 1))
+		tftp_mcast_prev_hole++;
+
+	if (tftp_mcast_ending_block &&
+	    tftp_mcast_prev_hole == tftp_mcast_ending_block) {
+		/* ACK the last block so the server can forget about us */
+		tftp_mcast_ack();
+		tftp_mcast_stop();
+		tftp_complete();
+	} else if (tftp_mcast_master) {
+		tftp_mcast_ack();
+	}
+	return;
+
+fail:
+	tftp_mcast_stop();
+	eth_halt();
+	net_set_state(NETLOOP_FAIL);
+}
+#endif
+
+#ifdef CONFIG_TFTP_PROBE
+/* Tell the server to stop sending the file for name @index */
+static void tftp_probe_abort(int index, int port)
+{
+	uchar *pkt;
+	int len;
+
+	pkt = net_tx_packet + net_eth_hdr_size() + IP_UDP_HDR_SIZE;
+	*(__be16 *)pkt = htons(TFTP_ERROR);
+	*(__be16 *)(pkt + 2) = htons(TFTP_ERR_UNDEFINED);
+	len = 4 + sprintf((char *)pkt + 4, "Not wanted") + 1;
+	net_send_udp_packet(net_server_ethaddr, tftp_remote_ip, port,
+			    tftp_probe_port + index, len);
+}
+
+/*
+ * Send requests for names not tried yet, as long as there is room in the
+ * window. With @resend, also send again those still waiting for a reply.
+ */
+static void tftp_probe_send(bool resend)
+{
+	int i, waiting = 0;
+
+	for (i = 0; i < tftp_probe_count; i++) {
+		if (tftp_probe_state[i] == PROBE_WAITING) {
+			waiting++;
+			if (!resend)
+				continue;
+		} else if (tftp_probe_state[i] == PROBE_IDLE &&
+			   waiting < CONFIG_TFTP_PROBE_WINDOW) {
+			tftp_probe_state[i] = PROBE_WAITING;
+			waiting++;
+		} else {
+			continue;
+		}
+		strlcpy(tftp_filename, tftp_probe_names[i], MAX_LEN);
+		tftp_our_port = tftp_probe_port + i;
+		tftp_send();
+	}
+}
+
+/* Load the file for name @index, as no name before it can be found now */
+static void tftp_probe_choose(int index)
+{
+	debug("TFTP: loading '%s'\n", tftp_probe_names[index]);
+	tftp_probing = 0;
+	tftp_probe_found = index;
+	strlcpy(tftp_filename, tftp_probe_names[index], MAX_LEN);
+	tftp_our_port = tftp_probe_port + index;
+	timeout_count = 0;
+
+	/* Otherwise wait for the server to send the first packet again */
+	if (tftp_probe_pkt_len)
+		tftp_handler(tftp_probe_pkt, tftp_our_port, tftp_remote_ip,
+			     tftp_probe_held_port, tftp_probe_pkt_len);
+}
+
+static void tftp_probe_check(void)
+{
+	int i;
+
+	for (i = 0; i < tftp_probe_count; i++) {
+		if (tftp_probe_state[i] != PROBE_MISSING)
+			break;
+	}
+
+	if (i == tftp_probe_count) {
+		puts("\nTFTP error: none of the files were found\n");
+		eth_halt();
+		net_set_state(NETLOOP_FAIL);
+	} else if (tftp_probe_state[i] == PROBE_FOUND) {
+		tftp_probe_choose(i);
+	} else {
+		tftp_probe_send(false);
+	}
+}
+
+/* Handle the first reply for one of the names */
+static void tftp_probe_reply(uchar *pkt, unsigned int dest, unsigned int src,
+			     unsigned int len)
+{
+	int index = dest - tftp_probe_port;
+
+	if (index < 0 || index >= tftp_probe_count ||
+	    tftp_probe_state[index] != PROBE_WAITING || len < 4)
+		return;
+
+	switch (ntohs(*(__be16 *)pkt)) {
+	case TFTP_ERROR:
+		debug("TFTP: no '%s': '%s'\n", tftp_probe_names[index],
+		      pkt + 4);
+		tftp_probe_state[index] = PROBE_MISSING;
+		break;
+	case TFTP_DATA:
+		if (ntohs(*(__be16 *)(pkt + 2)) != 1)
+			return;
+		/* fall through */
+	case TFTP_OACK:
+		tftp_probe_state[index] = PROBE_FOUND;
+		if (tftp_probe_held >= 0 && tftp_probe_held < index) {
+			/* We already have a better one */
+			tftp_probe_abort(index, src);
+			return;
+		}
+		if (tftp_probe_held >= 0)
+			tftp_probe_abort(tftp_probe_held, tftp_probe_held_port);
+		tftp_probe_held = index;
+		tftp_probe_held_port = src;
+		tftp_probe_pkt_len = 0;
+		if (len <= sizeof(tftp_probe_pkt)) {
+			memcpy(tftp_probe_pkt, pkt, len);
+			tftp_probe_pkt_len = len;
+		}
+		break;
+	default:
+		return;
+	}
+
+	tftp_probe_check();
+}
+
+static void tftp_probe_timeout(void)
+{
+	int i;
+
+	net_set_timeout_handler(timeout_ms, tftp_timeout_handler);
+	if (++timeout_count <= timeout_count_max) {
+		puts("T ");
+		tftp_probe_send(true);
+		return;
+	}
+
+	/* The server is ignoring the names still waiting; give up on them */
+	timeout_count = 0;
+	for (i = 0; i < tftp_probe_count; i++) {
+		if (tftp_probe_state[i] == PROBE_WAITING)
+			tftp_probe_state[i] = PROBE_MISSING;
+	}
+	tftp_probe_check();
+}
+#endif
+
 #ifdef CONFIG_CMD_TFTPPUT
 static void icmp_handler(unsigned type, unsigned code, unsigned dest,
 			 struct in_addr sip, unsigned src, uchar *pkt,
@@ -421,8 +942,20 @@ static void tftp_handler(uchar *pkt, unsigned dest, struct in_addr sip,
 	__be16 proto;
 	__be16 *s;
 	int i;
+#ifdef CONFIG_TFTP_MULTICAST
+	char *mcast = NULL;
+#endif
 
+#ifdef CONFIG_TFTP_PROBE
+	if (tftp_probing) {
+		tftp_probe_reply(pkt, dest, src, len);
+		return;
+	}
+#endif
 	if (dest != tftp_our_port) {
+#ifdef CONFIG_TFTP_MULTICAST
+		if (!tftp_mcast_active || dest != tftp_mcast_port)
+#endif
 			return;
 	}
 	if (tftp_state != STATE_SEND_RRQ && src != tftp_remote_port &&
@@ -494,6 +1027,17 @@ static void tftp_handler(uchar *pkt, unsigned dest, struct in_addr sip,
 				debug("Blocksize ack: %s, %d\n",
 				      (char *)pkt + i + 8, tftp_block_size);
 			}
+			if (strcmp((char *)pkt + i, "windowsize") == 0) {
+				tftp_windowsize = (unsigned short)
+					simple_strtoul((char *)pkt + i + 11,
+						       NULL, 10);
+				/* The server may only lower the window */
+				tftp_windowsize = clamp(tftp_windowsize,
+					(unsigned short)1,
+					tftp_windowsize_option);
+				debug("Windowsize ack: %s, %d\n",
+				      (char *)pkt + i + 11, tftp_windowsize);
+			}
 #ifdef CONFIG_TFTP_TSIZE
 			if (strcmp((char *)pkt+i, "tsize") == 0) {
 				tftp_tsize = simple_strtoul((char *)pkt + i + 6,
@@ -502,7 +1046,21 @@ static void tftp_handler(uchar *pkt, unsigned dest, struct in_addr sip,
 				      (char *)pkt + i + 6, tftp_tsize);
 			}
 #endif
+#ifdef CONFIG_TFTP_MULTICAST
+			if (strcmp((char *)pkt + i, "multicast") == 0)
+				mcast = (char *)pkt + i + 10;
+#endif
+		}
+#ifdef CONFIG_TFTP_MULTICAST
+		if (mcast && tftp_mcast_option) {
+			if (tftp_mcast_oack(mcast)) {
+				tftp_mcast_stop();
+				eth_halt();
+				net_set_state(NETLOOP_FAIL);
+			}
+			break;
 		}
+#endif
 #ifdef CONFIG_CMD_TFTPPUT
 		if (tftp_put_active) {
 			/* Get ready to send the first block */
@@ -510,12 +1068,28 @@ static void tftp_handler(uchar *pkt, unsigned dest, struct in_addr sip,
 			tftp_cur_block++;
 		}
 #endif
+		/* Lets a lost first block be handled like any other */
+		if (!tftp_put_active)
+			new_transfer();
 		tftp_send(); /* Send ACK or first data block */
 		break;
 	case TFTP_DATA:
 		if (len < 2)
 			return;
 		len -= 2;
+
+#ifdef CONFIG_TFTP_MULTICAST
+		if (tftp_mcast_active) {
+			tftp_mcast_data(ntohs(*(__be16 *)pkt), pkt + 2, len);
+			break;
+		}
+#endif
+		if (tftp_windowsize > 1 &&
+		    (tftp_state == STATE_DATA || tftp_state == STATE_OACK) &&
+		    ntohs(*(__be16 *)pkt) != (ushort)(tftp_prev_block + 1)) {
+			tftp_window_out_of_order(ntohs(*(__be16 *)pkt));
+			break;
+		}
 		tftp_cur_block = ntohs(*(__be16 *)pkt);
 
 		update_block_number();
@@ -546,8 +1120,17 @@ static void tftp_handler(uchar *pkt, unsigned dest, struct in_addr sip,
 		}
 
 		tftp_prev_block = tftp_cur_block;
+		if (tftp_windowsize > 1) {
+			/* The first block of a window times our last ACK */
+			if (tftp_rtt_timing) {
+				tftp_update_rto(get_timer(tftp_ack_time));
+				tftp_rtt_timing = false;
+			}
+			timeout_count = 0;
+		}
 		timeout_count_max = tftp_timeout_count_max;
-		net_set_timeout_handler(timeout_ms, tftp_timeout_handler);
+		net_set_timeout_handler(tftp_data_timeout(),
+					tftp_timeout_handler);
 
 		if (store_block(tftp_cur_block - 1, pkt + 2, len)) {
 			eth_halt();
@@ -557,9 +1140,16 @@ static void tftp_handler(uchar *pkt, unsigned dest, struct in_addr sip,
 
 		/*
 		 *	Acknowledge the block just received, which will prompt
-		 *	the remote for the next one.
+		 *	the remote for the next one. With a window, only the
+		 *	last block of each window and the final block are
+		 *	acknowledged.
 		 */
-		tftp_send();
+		if (tftp_windowsize == 1 || len < tftp_block_size ||
+		    tftp_cur_block == tftp_next_ack) {
+			tftp_send_ack();
+			tftp_next_ack = (ushort)(tftp_cur_block +
+						 tftp_windowsize);
+		}
 
 		if (len < tftp_block_size)
 			tftp_complete();
@@ -568,6 +1158,9 @@ static void tftp_handler(uchar *pkt, unsigned dest, struct in_addr sip,
 	case TFTP_ERROR:
 		printf("\nTFTP error: '%s' (%d)\n",
 		       pkt + 2, ntohs(*(__be16 *)pkt));
+#ifdef CONFIG_TFTP_MULTICAST
+		tftp_mcast_stop();
+#endif
 
 		switch (ntohs(*(__be16 *)pkt)) {
 		case TFTP_ERR_FILE_NOT_FOUND:
@@ -593,11 +1186,40 @@ static void tftp_handler(uchar *pkt, unsigned dest, struct in_addr sip,
 
 static void tftp_timeout_handler(void)
 {
+#ifdef CONFIG_TFTP_PROBE
+	if (tftp_probing) {
+		tftp_probe_timeout();
+		return;
+	}
+#endif
 	if (++timeout_count > timeout_count_max) {
 		restart("Retry count exceeded");
 	} else {
 		puts("T ");
-		net_set_timeout_handler(timeout_ms, tftp_timeout_handler);
+#ifdef CONFIG_TFTP_MULTICAST
+		if (tftp_mcast_active) {
+			/* Only the master client may ask for blocks */
+			net_set_timeout_handler(timeout_ms,
+						tftp_timeout_handler);
+			if (tftp_mcast_master)
+				tftp_mcast_ack();
+			return;
+		}
+#endif
+		if (tftp_state == STATE_DATA && tftp_windowsize > 1) {
+			/*
+			 * Back off, and ask for the window again from the
+			 * block after the last one received in order. That
+			 * ACK is a retransmission, so do not time it.
+			 */
+			tftp_rto = min(tftp_rto * 2, timeout_ms);
+			tftp_last_nack = tftp_cur_block;
+			tftp_next_ack = (ushort)(tftp_cur_block +
+						 tftp_windowsize);
+			tftp_rtt_timing = false;
+		}
+		net_set_timeout_handler(tftp_data_timeout(),
+					tftp_timeout_handler);
 		if (tftp_state != STATE_RECV_WRQ)
 			tftp_send();
 	}
@@ -636,6 +1258,18 @@ void tftp_start(enum proto_t protocol)
 	if (ep != NULL)
 		tftp_block_size_option = simple_strtol(ep, NULL, 10);
 
+	tftp_windowsize_option = CONFIG_TFTP_WINDOWSIZE;
+	ep = env_get("tftpwindowsize");
+	if (ep != NULL) {
+		ulong windowsize = simple_strtoul(ep, NULL, 10);
+
+		if (windowsize >= 1 && windowsize <= 65535)
+			tftp_windowsize_option = windowsize;
+		else
+			printf("TFTP windowsize (%s) out of range, set to %d\n",
+			       ep, CONFIG_TFTP_WINDOWSIZE);
+	}
+
 	ep = env_get("tftptimeout");
 	if (ep != NULL)
 		timeout_ms = simple_strtol(ep, NULL, 10);
@@ -657,10 +1291,23 @@ void tftp_start(enum proto_t protocol)
 	}
 #endif
 
-	debug("TFTP blocksize = %i, timeout = %ld ms\n",
-	      tftp_block_size_option, timeout_ms);
+#ifdef CONFIG_TFTP_MULTICAST
+	/* Leave any group joined by an earlier, interrupted transfer */
+	tftp_mcast_stop();
+	tftp_mcast_master = 0;
+	tftp_mcast_option = protocol != TFTPPUT &&
+		env_get_yesno("tftpmulticast") == 1;
+#endif
+
+	debug("TFTP blocksize = %i, windowsize = %i, timeout = %ld ms\n",
+	      tftp_block_size_option, tftp_windowsize_option, timeout_ms);
 
 	tftp_remote_ip = net_server_ip;
+#ifdef CONFIG_TFTP_PROBE
+	if (tftp_probe_count)
+		strlcpy(tftp_filename, tftp_probe_names[0], MAX_LEN);
+	else
+#endif
 	if (!net_parse_bootfile(&tftp_remote_ip, tftp_filename, MAX_LEN)) {
 		sprintf(default_filename, "%02X%02X%02X%02X.img",
 			net_ip.s_addr & 0xFF,
@@ -697,6 +1344,10 @@ void tftp_start(enum proto_t protocol)
 	putc('\n');
 
 	printf("Filename '%s'.", tftp_filename);
+#ifdef CONFIG_TFTP_PROBE
+	if (tftp_probe_count > 1)
+		printf(" Falling back to %d other names.", tftp_probe_count - 1);
+#endif
 
 	if (net_boot_file_expected_size_in_blocks) {
 		printf(" Size is 0x%x Bytes = ",
@@ -724,6 +1375,13 @@ void tftp_start(enum proto_t protocol)
 			puts("trying to overwrite reserved memory...\n");
 			return;
 		}
+#ifdef CONFIG_TFTP_DECOMP
+		if (tftp_decomp_start()) {
+			eth_halt();
+			net_set_state(NETLOOP_FAIL);
+			return;
+		}
+#endif
 		printf("Load address: 0x%lx\n", tftp_load_addr);
 		puts("Loading: *\b");
 		tftp_state = STATE_SEND_RRQ;
@@ -757,20 +1415,58 @@ void tftp_start(enum proto_t protocol)
 
 	/* zero out server ether in case the server ip has changed */
 	memset(net_server_ethaddr, 0, 6);
-	/* Revert tftp_block_size to dflt */
+	/* Revert tftp_block_size and tftp_windowsize to dflt */
 	tftp_block_size = TFTP_BLOCK_SIZE;
+	tftp_windowsize = 1;
+	tftp_srtt = 0;
+	tftp_rto = timeout_ms;
 #ifdef CONFIG_TFTP_TSIZE
 	tftp_tsize = 0;
 	tftp_tsize_num_hash = 0;
 #endif
 
+#ifdef CONFIG_TFTP_PROBE
+	tftp_probing = tftp_probe_count > 0;
+	if (tftp_probing) {
+		memset(tftp_probe_state, PROBE_IDLE, sizeof(tftp_probe_state));
+		tftp_probe_port = tftp_our_port;
+		tftp_probe_held = -1;
+		tftp_probe_pkt_len = 0;
+		tftp_probe_found = -1;
+		tftp_probe_send(false);
+		return;
+	}
+#endif
 	tftp_send();
 }
 
+#ifdef CONFIG_TFTP_PROBE
+int tftp_probe(const char *const names[], int count)
+{
+	int ret;
+
+	if (count < 1 || count > TFTP_PROBE_MAX)
+		return -EINVAL;
+
+	tftp_probe_names = names;
+	tftp_probe_count = count;
+	ret = net_loop(TFTPGET);
+	tftp_probe_count = 0;
+	tftp_probing = 0;
+	if (ret < 0)
+		return ret;
+
+	return tftp_probe_found;
+}
+#endif
+
 #ifdef CONFIG_CMD_TFTPSRV
 void tftp_start_server(void)
 {
 	tftp_filename[0] = 0;
+#ifdef CONFIG_TFTP_DECOMP
+	tftp_decomp_stop();
+#endif
 
 	if (tftp_init_load_addr()) {
 		eth_halt();
@@ -789,8 +1485,9 @@ void tftp_start_server(void)
 	timeout_ms = TIMEOUT;
 	net_set_timeout_handler(timeout_ms, tftp_timeout_handler);
 
-	/* Revert tftp_block_size to dflt */
+	/* Revert tftp_block_size and tftp_windowsize to dflt */
 	tftp_block_size = TFTP_BLOCK_SIZE;
+	tftp_windowsize = 1;
 	tftp_cur_block = 0;
 	tftp_our_port = WELL_KNOWN_PORT;
 
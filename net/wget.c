@@ -0,0 +1,411 @@
+// SPDX-License-Identifier: GPL-2.0+
+/*
+ * HTTP client, for downloading files with wget
+ *
+ * The file is requested with HTTP/1.1, asking the server to close the
+ * connection afterwards, so the body simply runs to the end of the stream.
+ * Body data is copied from the received packets straight to its place in
+ * memory, including data that arrives out of order, so that a lost packet
+ * only costs its retransmission.
+ */
+
+#include <common.h>
+#include <command.h>
+#include <efi_loader.h>
+#include <env.h>
+#include <image.h>
+#include <lmb.h>
+#include <log.h>
+#include <mapmem.h>
+#include <net.h>
+#include <net/tcp.h>
+#include <net/wget.h>
+#include <linux/ctype.h>
+#include <linux/string.h>
+
+DECLARE_GLOBAL_DATA_PTR;
+
+#define HTTP_PORT		80
+/* Largest response header we accept */
+#define WGET_MAX_HDR		2048
+/* Print a hash for each this many bytes received */
+#define WGET_HASH_BYTES		(64 << 10)
+#define HASHES_PER_LINE		65
+
+ulong wget_range_size;
+ulong wget_range_pos;
+ulong wget_file_size;
+
+enum wget_state {
+	WGET_CONNECTING,
+	WGET_HEADER,		/* receiving the response header */
+	WGET_BODY,		/* receiving the file */
+};
+
+static enum wget_state wget_state;
+static struct in_addr wget_server_ip;
+static int wget_server_port;
+static char wget_path[1024];
+static char wget_req[TCP_MSS + 1];
+static int wget_req_len;
+
+static char wget_hdr[WGET_MAX_HDR + 1];
+static unsigned int wget_hdr_len;
+/* Offset of the body in the stream from the server */
+static u32 wget_body_start;
+/* Number of bytes at the start of the body which are not wanted */
+static ulong wget_skip;
+/* Number of bytes expected, valid if wget_size_known is set */
+static ulong wget_expected;
+static bool wget_size_known;
+
+static ulong wget_load_addr;
+#ifdef CONFIG_LMB
+static ulong wget_load_size;
+#endif
+static ulong wget_hashes;
+static ulong wget_time_start;
+
+static void wget_fail(void)
+{
+	eth_halt();
+	net_set_state(NETLOOP_FAIL);
+}
+
+static void wget_connected(void)
+{
+	int ret;
+
+	wget_state = WGET_HEADER;
+	ret = tcp_send(wget_req, wget_req_len);
+	if (ret) {
+		printf("\nwget error: cannot send request (err=%d)\n", ret);
+		tcp_abort();
+		wget_fail();
+	}
+}
+
+/* Read the header lines which matter to us and check the status */
+static int wget_parse_header(void)
+{
+	ulong content_len = 0, range_start = 0, range_total = 0;
+	bool have_len = false, have_range = false;
+	char *line, *next, *val, *total;
+	int status;
+
+	if (strncmp(wget_hdr, "HTTP/1.", 7) || !wget_hdr[7] ||
+	    wget_hdr[8] != ' ') {
+		printf("\nwget error: bad response from server\n");
+		return -EPROTO;
+	}
+	status = simple_strtoul(wget_hdr + 9, NULL, 10);
+
+	for (line = wget_hdr; line; line = next) {
+		next = strstr(line, "\r\n");
+		if (next) {
+			*next = '\0';
+			next += 2;
+		}
+		val = strchr(line, ':');
+		if (line == wget_hdr || !val)
+			continue;
+		val = skip_spaces(val + 1);
+		if (!strncasecmp(line, "Content-Length:", 15)) {
+			content_len = simple_strtoul(val, NULL, 10);
+			have_len = true;
+		} else if (!strncasecmp(line, "Content-Range:", 14) &&
+			   !strncmp(val, "bytes ", 6)) {
+			range_start = simple_strtoul(val + 6, NULL, 10);
+			total = strchr(val, '/');
+			if (total && isdigit(total[1]))
+				range_total = simple_strtoul(total + 1, NULL,
+							     10);
+			have_range = true;
+		} else if (!strncasecmp(line, "Transfer-Encoding:", 18) &&
+			   strcasecmp(val, "identity")) {
+			printf("\nwget error: transfer encoding '%s' not supported\n",
+			       val);
+			return -EPROTONOSUPPORT;
+		}
+	}
+
+	switch (status) {
+	case 200:
+		/* The server ignored our range request, if any */
+		wget_skip = wget_range_pos;
+		if (have_len) {
+			if (content_len < wget_skip) {
+				printf("\nwget error: file is only %lu bytes\n",
+				       content_len);
+				return -EINVAL;
+			}
+			wget_expected = content_len - wget_skip;
+			if (wget_range_size)
+				wget_expected = min(wget_expected,
+						    wget_range_size);
+		} else {
+			wget_expected = wget_range_size;
+		}
+		wget_size_known = have_len || wget_range_size;
+		wget_file_size = have_len ? content_len : 0;
+		break;
+	case 206:
+		if (!(wget_range_size || wget_range_pos) || !have_range ||
+		    range_start != wget_range_pos) {
+			printf("\nwget error: unexpected partial content\n");
+			return -EPROTO;
+		}
+		wget_skip = 0;
+		wget_expected = content_len;
+		wget_size_known = have_len;
+		wget_file_size = range_total;
+		break;
+	default:
+		printf("\nwget error: server replied '%s'\n", wget_hdr);
+		return status == 404 ? -ENOENT : -EPROTO;
+	}
+
+	return 0;
+}
+
+static void wget_show_progress(void)
+{
+	while (wget_hashes < net_boot_file_size / WGET_HASH_BYTES) {
+		putc('#');
+		if (!(++wget_hashes % HASHES_PER_LINE))
+			puts("\n\t ");
+	}
+}
+
+/* Store body data at @pos from the start of the body */
+static int wget_store(ulong pos, const uchar *data, unsigned int len)
+{
+	ulong store_addr;
+	void *ptr;
+
+	if (pos < wget_skip) {
+		if (pos + len <= wget_skip)
+			return 0;
+		data += wget_skip - pos;
+		len -= wget_skip - pos;
+		pos = wget_skip;
+	}
+	pos -= wget_skip;
+	if (wget_size_known) {
+		if (pos >= wget_expected)
+			return 0;
+		len = min_t(ulong, len, wget_expected - pos);
+	}
+
+	store_addr = wget_load_addr + pos;
+#ifdef CONFIG_LMB
+	if (wget_load_size && pos + len > wget_load_size) {
+		puts("\nwget error: trying to overwrite reserved memory...\n");
+		return -ENOSPC;
+	}
+#endif
+	ptr = map_sysmem(store_addr, len);
+	memcpy(ptr, data, len);
+	unmap_sysmem(ptr);
+
+	if (net_boot_file_size < pos + len) {
+		net_boot_file_size = pos + len;
+		wget_show_progress();
+	}
+
+	return 0;
+}
+
+static int wget_rx(u32 offset, const uchar *data, unsigned int len)
+{
+	unsigned int count;
+	char *end;
+	int ret;
+
+	if (wget_state == WGET_BODY)
+		return wget_store(offset - wget_body_start, data, len);
+
+	/* Wait for the header to arrive in order */
+	if (offset != wget_hdr_len)
+		return -EAGAIN;
+
+	count = min(len, WGET_MAX_HDR - wget_hdr_len);
+	memcpy(wget_hdr + wget_hdr_len, data, count);
+	wget_hdr_len += count;
+	wget_hdr[wget_hdr_len] = '\0';
+
+	end = strstr(wget_hdr, "\r\n\r\n");
+	if (!end) {
+		if (wget_hdr_len == WGET_MAX_HDR) {
+			printf("\nwget error: response header too long\n");
+			return -E2BIG;
+		}
+		return 0;
+	}
+	wget_body_start = end + 4 - wget_hdr;
+	end[2] = '\0';
+	ret = wget_parse_header();
+	if (ret)
+		return ret;
+	wget_state = WGET_BODY;
+
+	/* The rest of this segment is the start of the body */
+	if (offset + len > wget_body_start)
+		return wget_store(0, data + wget_body_start - offset,
+				  offset + len - wget_body_start);
+
+	return 0;
+}
+
+static void wget_closed(int err)
+{
+	ulong elapsed;
+
+	switch (err) {
+	case 0:
+		break;
+	case -ECONNREFUSED:
+		printf("\nwget error: connection refused\n");
+		break;
+	case -ECONNRESET:
+		printf("\nwget error: connection reset\n");
+		break;
+	case -ETIMEDOUT:
+		printf("\nwget error: server not responding\n");
+		break;
+	default:
+		/* Already reported */
+		break;
+	}
+	if (err)
+		goto fail;
+
+	if (wget_state != WGET_BODY) {
+		printf("\nwget error: connection closed without a reply\n");
+		goto fail;
+	}
+	if (wget_size_known && net_boot_file_size != wget_expected) {
+		printf("\nwget error: received %u of %lu bytes\n",
+		       net_boot_file_size, wget_expected);
+		goto fail;
+	}
+
+	elapsed = get_timer(wget_time_start);
+	if (elapsed > 0) {
+		puts("\n\t ");	/* Line up with "Loading: " */
+		print_size(net_boot_file_size / elapsed * 1000, "/s");
+	}
+	puts("\ndone\n");
+	net_set_state(NETLOOP_SUCCESS);
+	return;
+
+fail:
+	wget_fail();
+}
+
+static const struct tcp_ops wget_tcp_ops = {
+	.connected	= wget_connected,
+	.rx		= wget_rx,
+	.closed		= wget_closed,
+};
+
+/* Initialize wget_load_addr and wget_load_size from image_load_addr and lmb */
+static int wget_init_load_addr(void)
+{
+#ifdef CONFIG_LMB
+	struct lmb lmb;
+	phys_size_t max_size;
+
+	lmb_init_and_reserve(&lmb, gd->bd, (void *)gd->fdt_blob);
+
+	max_size = lmb_get_free_size(&lmb, image_load_addr);
+	if (!max_size)
+		return -1;
+
+	wget_load_size = max_size;
+#endif
+	wget_load_addr = image_load_addr;
+	return 0;
+}
+
+/* Build the request, returning -E2BIG if it does not fit in one segment */
+static int wget_build_request(void)
+{
+	char *p = wget_req, *end = wget_req + sizeof(wget_req);
+
+	p += snprintf(p, end - p, "GET %s%s HTTP/1.1\r\nHost: %pI4",
+		      *wget_path == '/' ? "" : "/", wget_path,
+		      &wget_server_ip);
+	if (wget_server_port != HTTP_PORT)
+		p += snprintf(p, end - p, ":%d", wget_server_port);
+	p += snprintf(p, end - p, "\r\nUser-Agent: U-Boot\r\n");
+	if (wget_range_size)
+		p += snprintf(p, end - p, "Range: bytes=%lu-%lu\r\n",
+			      wget_range_pos,
+			      wget_range_pos + wget_range_size - 1);
+	else if (wget_range_pos)
+		p += snprintf(p, end - p, "Range: bytes=%lu-\r\n",
+			      wget_range_pos);
+	p += snprintf(p, end - p, "Connection: close\r\n\r\n");
+	if (p >= end - 1)
+		return -E2BIG;
+	wget_req_len = p - wget_req;
+
+	return 0;
+}
+
+void wget_start(void)
+{
+	char *ep;
+
+	wget_server_ip = net_server_ip;
+	if (!net_parse_bootfile(&wget_server_ip, wget_path,
+				sizeof(wget_path))) {
+		printf("*** ERROR: no file name given\n");
+		net_set_state(NETLOOP_FAIL);
+		return;
+	}
+
+	wget_server_port = HTTP_PORT;
+	ep = env_get("httpdstp");
+	if (ep)
+		wget_server_port = simple_strtol(ep, NULL, 10);
+
+	printf("Using %s device\n", eth_get_name());
+	printf("HTTP from server %pI4; our IP address is %pI4\n",
+	       &wget_server_ip, &net_ip);
+	printf("Filename '%s'.", wget_path);
+	if (wget_range_size)
+		printf(" Range 0x%lx bytes at 0x%lx.", wget_range_size,
+		       wget_range_pos);
+	else if (wget_range_pos)
+		printf(" Starting at 0x%lx.", wget_range_pos);
+	putc('\n');
+
+	if (wget_build_request()) {
+		printf("wget error: file name too long\n");
+		net_set_state(NETLOOP_FAIL);
+		return;
+	}
+	if (wget_init_load_addr()) {
+		eth_halt();
+		net_set_state(NETLOOP_FAIL);
+		puts("\nwget error: ");
+		puts("trying to overwrite reserved memory...\n");
+		return;
+	}
+	printf("Load address: 0x%lx\n", wget_load_addr);
+	puts("Loading: *\b");
+#ifdef CONFIG_CMD_BOOTEFI
+	efi_set_bootdev("Net", "", wget_path);
+#endif
+
+	wget_state = WGET_CONNECTING;
+	wget_file_size = 0;
+	wget_hdr_len = 0;
+	wget_size_known = false;
+	wget_hashes = 0;
+	wget_time_start = get_timer(0);
+
+	tcp_connect(wget_server_ip, wget_server_port, &wget_tcp_ops);
+}
@@ -16,6 +16,7 @@
 
 #include <u-boot/zlib.h>
 #include <bzlib.h>
+#include <decomp_stream.h>
 
 #include <lzma/LzmaTypes.h>
 #include <lzma/LzmaDec.h>
@@ -74,6 +75,32 @@ static const char lzma_compressed[] =
 	"\xfd\xf5\x50\x8d\xca";
 static const unsigned long lzma_compressed_size = 229;
 
+/* xz -z -c --block-size=192 --check=crc32 /tmp/plain.txt > /tmp/plain.xz */
+static const char xz_compressed[] =
+	"\xfd\x37\x7a\x58\x5a\x00\x00\x01\x69\x22\xde\x36\x03\xc0\x6f\xc0"
+	"\x01\x21\x01\x16\x00\x00\x00\x00\x6b\xe7\x55\xb4\xe0\x00\xbf\x00"
+	"\x67\x5d\x00\x24\x88\x08\x26\xd8\x41\xff\x99\xc8\xcf\x66\x3d\x80"
+	"\xac\xba\x17\xf1\xc8\xb9\xdf\x49\x37\xb1\x68\xa0\x2a\xdd\x63\xd1"
+	"\xa7\xa3\x66\xf8\x15\xef\xa6\x67\x8a\x14\x18\x80\xcb\xc7\xb1\xcb"
+	"\x84\x6a\xb2\x51\x16\xa1\x45\xa0\xd6\x3e\x55\x44\x8a\x5c\xa0\x7c"
+	"\xe5\xa8\xbd\x04\x57\x8f\x24\xfd\xb9\x34\x50\x83\x2f\xf3\x46\x3e"
+	"\xb9\xb0\x00\x1a\xf5\xd3\x86\x7e\x8f\x77\xd1\x5d\x0e\x7c\xe1\xac"
+	"\xde\xf8\x65\x1c\xbe\xfb\xfe\x1e\x18\x8b\x00\x00\x01\x4c\x87\x09"
+	"\x03\xc0\x91\x01\x9e\x01\x21\x01\x16\x00\x00\x00\x6c\x95\x6f\x8c"
+	"\xe0\x00\x9d\x00\x89\x5d\x00\x39\x19\x40\x06\x71\xf1\x73\x50\x53"
+	"\xa1\xa6\xab\x0f\xa6\x1f\x7a\xd5\x55\xad\x01\x59\x06\xd5\xba\xbf"
+	"\xf5\x43\x92\x25\xe9\x54\x00\xf9\x3c\x72\xfd\x46\xb4\x93\xe4\xe0"
+	"\x3f\x24\xbb\x7c\xf2\x08\x9f\xfb\x21\x83\xd6\x99\x0f\x7e\x53\xe1"
+	"\x69\x28\x77\x77\x0c\x73\xe5\xba\x89\x23\xbf\xe4\x5d\x12\x92\xde"
+	"\xd5\x29\x5e\xe6\x0a\x0e\x89\x57\x9c\xfc\xe9\x18\x0c\x77\xcc\x89"
+	"\xc2\xb3\x9c\xd2\x90\xe3\x3a\x0e\xf3\xc6\xb1\x1e\x98\xf3\xdf\x87"
+	"\xa8\x9f\x35\xc9\x2f\x81\xc1\x63\x02\xfe\x89\x53\xb6\xa8\x6f\x2b"
+	"\x3c\x61\xda\x76\x95\xc6\x12\x4f\x40\xd0\x34\xd2\xf2\x79\x60\x00"
+	"\x00\x00\x00\x00\xcb\x09\xc5\xf2\x00\x02\x83\x01\xc0\x01\xa5\x01"
+	"\x9e\x01\x00\x00\x21\xc0\xcd\xcd\x9b\xe3\x51\x40\x03\x00\x00\x00"
+	"\x00\x01\x59\x5a";
+static const unsigned long xz_compressed_size = 340;
+
 /* lzop -c /tmp/plain.txt > /tmp/plain.lzo */
 static const char lzo_compressed[] =
 	"\x89\x4c\x5a\x4f\x00\x0d\x0a\x1a\x0a\x10\x30\x20\x60\x09\x40\x01"
@@ -122,6 +149,24 @@ static const char lz4_compressed[] =
 static const unsigned long lz4_compressed_size = 276;
 
 
+/* zstd -c /tmp/plain.txt > /tmp/plain.zst */
+static const char zstd_compressed[] =
+	"\x28\xb5\x2f\xfd\x64\x5e\x00\xc5\x05\x00\x92\x0d\x25\x1a\x90\x17"
+	"\x36\x07\x84\x8d\x9a\xd8\x30\x5a\x8a\x8c\x88\xb5\x7c\x52\x5a\x07"
+	"\x34\xeb\x5b\xc6\x5d\x6f\xc7\x12\x65\xd0\x1b\xa9\xfc\x5c\x43\x6c"
+	"\xad\xc3\x2f\x38\xbc\xf1\x5a\x2b\xbb\x1f\xc7\x19\x4f\x62\x52\x84"
+	"\x76\x49\x53\x67\x61\x1d\x20\xe3\x66\xe2\xd5\x3b\xf2\x06\x78\xf8"
+	"\x39\x74\x78\x95\x65\xe1\x64\x43\x65\x51\xe9\xab\xba\x1a\x0f\x92"
+	"\x7c\xe3\x05\x50\x03\x08\x59\xc9\x5a\x60\x5f\xb6\x50\xdd\x54\x62"
+	"\xc2\x05\x51\x86\xab\x4c\xd6\xf4\xd5\xb2\x26\xae\x17\x31\x16\x9e"
+	"\x7c\x82\x44\x6e\xea\x92\xcf\xce\x67\x47\x81\x32\xac\xc1\xd7\xc5"
+	"\xf2\xa6\xf1\x91\x39\xd5\xb3\x23\xad\xe3\x86\xd0\x48\xf4\x39\x9d"
+	"\x89\x0b\x00\x45\x1b\x08\xb3\x17\x18\x6b\xa0\xb2\x6b\x8e\x28\xa8"
+	"\x55\x65\xb6\xc6\x6a\xa5\x4f\x23\x12\xee\x53\x55\x2d\x44\x2f\x54"
+	"\x95\x01\xe4\xf4\x6e\xfa";
+static const unsigned long zstd_compressed_size = 198;
+
+
 #define TEST_BUFFER_SIZE	512
 
 typedef int (*mutate_func)(struct unit_test_state *uts, void *, unsigned long,
@@ -226,6 +271,25 @@ static int uncompress_using_lzma(struct unit_test_state *uts,
 	return (ret != SZ_OK);
 }
 
+static int compress_using_xz(struct unit_test_state *uts,
+			     void *in, unsigned long in_size,
+			     void *out, unsigned long out_max,
+			     unsigned long *out_size)
+{
+	/* There is no xz compression in u-boot, so fake it. */
+	ut_asserteq(in_size,  strlen(plain));
+	ut_asserteq_mem(plain, in, in_size);
+
+	if (xz_compressed_size > out_max)
+		return -1;
+
+	memcpy(out, xz_compressed, xz_compressed_size);
+	if (out_size)
+		*out_size = xz_compressed_size;
+
+	return 0;
+}
+
 static int compress_using_lzo(struct unit_test_state *uts,
 			      void *in, unsigned long in_size,
 			      void *out, unsigned long out_max,
@@ -296,6 +360,49 @@ static int uncompress_using_lz4(struct unit_test_state *uts,
 	return (ret != 0);
 }
 
+static int compress_using_zstd(struct unit_test_state *uts,
+			       void *in, unsigned long in_size,
+			       void *out, unsigned long out_max,
+			       unsigned long *out_size)
+{
+	/* There is no zstd compression in u-boot, so fake it. */
+	ut_asserteq(in_size,  strlen(plain));
+	ut_asserteq_mem(plain, in, in_size);
+
+	if (zstd_compressed_size > out_max)
+		return -1;
+
+	memcpy(out, zstd_compressed, zstd_compressed_size);
+	if (out_size)
+		*out_size = zstd_compressed_size;
+
+	return 0;
+}
+
+static int uncompress_using_zstd(struct unit_test_state *uts,
+				 void *in, unsigned long in_size,
+				 void *out, unsigned long out_max,
+				 unsigned long *out_size)
+{
+	struct decomp_stream ds;
+	ulong size;
+	int ret;
+
+	ret = decomp_stream_init(&ds, IH_COMP_ZSTD, out, out_max);
+	if (ret)
+		return ret;
+	ret = decomp_stream_feed(&ds, in, in_size);
+	if (ret) {
+		decomp_stream_abort(&ds);
+		return ret;
+	}
+	ret = decomp_stream_finish(&ds, &size);
+	if (out_size)
+		*out_size = size;
+
+	return ret;
+}
+
 #define errcheck(statement) if (!(statement)) { \
 	fprintf(stderr, "\tFailed: %s\n", #statement); \
 	ret = 1; \
@@ -428,6 +535,61 @@ static int compression_test_lzma(struct unit_test_state *uts)
 }
 COMPRESSION_TEST(compression_test_lzma, 0);
 
+static int compression_test_xz(struct unit_test_state *uts)
+{
+	if (!IS_ENABLED(CONFIG_LZMA_XZ))
+		return 0;
+
+	/* The .xz format is handled by the LZMA decompressor */
+	return run_test(uts, "xz", compress_using_xz, uncompress_using_lzma);
+}
+COMPRESSION_TEST(compression_test_xz, 0);
+
+#define DECOMPRESS_BENCH_LOOPS	1000
+
+/**
+ * compression_test_lzma_bench() - measure LZMA and XZ decompression
+ *
+ * This reports the average time taken to decompress the test text from the
+ * LZMA_Alone format and from the multi-block .xz format, which includes
+ * checking the CRC32 of each block.
+ */
+static int compression_test_lzma_bench(struct unit_test_state *uts)
+{
+	struct {
+		const char *name;
+		const char *data;
+		unsigned long size;
+	} vecs[] = {
+		{ "lzma", lzma_compressed, lzma_compressed_size },
+		{ "xz", xz_compressed, xz_compressed_size },
+	};
+	char out[TEST_BUFFER_SIZE];
+	ulong start, delta;
+	SizeT out_size;
+	int i, j;
+
+	for (i = 0; i < ARRAY_SIZE(vecs); i++) {
+		if (!strcmp(vecs[i].name, "xz") && !IS_ENABLED(CONFIG_LZMA_XZ))
+			continue;
+		start = timer_get_us();
+		for (j = 0; j < DECOMPRESS_BENCH_LOOPS; j++) {
+			out_size = sizeof(out);
+			ut_asserteq(SZ_OK, lzmaBuffToBuffDecompress(
+				(unsigned char *)out, &out_size,
+				(unsigned char *)vecs[i].data, vecs[i].size));
+		}
+		delta = timer_get_us() - start;
+		ut_asserteq(strlen(plain), out_size);
+		ut_asserteq_mem(plain, out, out_size);
+		printf("%s: %lu ns per decompression\n", vecs[i].name,
+		       delta * 1000 / DECOMPRESS_BENCH_LOOPS);
+	}
+
+	return 0;
+}
+COMPRESSION_TEST(compression_test_lzma_bench, 0);
+
 static int compression_test_lzo(struct unit_test_state *uts)
 {
 	return run_test(uts, "lzo", compress_using_lzo, uncompress_using_lzo);
@@ -440,6 +602,16 @@ static int compression_test_lz4(struct unit_test_state *uts)
 }
 COMPRESSION_TEST(compression_test_lz4, 0);
 
+static int compression_test_zstd(struct unit_test_state *uts)
+{
+	if (!IS_ENABLED(CONFIG_ZSTD) || !IS_ENABLED(CONFIG_DECOMP_STREAM))
+		return 0;
+
+	return run_test(uts, "zstd", compress_using_zstd,
+			uncompress_using_zstd);
+}
+COMPRESSION_TEST(compression_test_zstd, 0);
+
 static int compress_using_none(struct unit_test_state *uts,
 			       void *in, unsigned long in_size,
 			       void *out, unsigned long out_max,
@@ -518,6 +690,15 @@ static int compression_test_bootm_lzma(struct unit_test_state *uts)
 }
 COMPRESSION_TEST(compression_test_bootm_lzma, 0);
 
+static int compression_test_bootm_xz(struct unit_test_state *uts)
+{
+	if (!IS_ENABLED(CONFIG_LZMA_XZ))
+		return 0;
+
+	return run_bootm_test(uts, IH_COMP_LZMA, compress_using_xz);
+}
+COMPRESSION_TEST(compression_test_bootm_xz, 0);
+
 static int compression_test_bootm_lzo(struct unit_test_state *uts)
 {
 	return run_bootm_test(uts, IH_COMP_LZO, compress_using_lzo);
@@ -530,12 +711,144 @@ static int compression_test_bootm_lz4(struct unit_test_state *uts)
 }
 COMPRESSION_TEST(compression_test_bootm_lz4, 0);
 
+static int compression_test_bootm_zstd(struct unit_test_state *uts)
+{
+	if (!IS_ENABLED(CONFIG_ZSTD) || !IS_ENABLED(CONFIG_DECOMP_STREAM))
+		return 0;
+
+	return run_bootm_test(uts, IH_COMP_ZSTD, compress_using_zstd);
+}
+COMPRESSION_TEST(compression_test_bootm_zstd, 0);
+
 static int compression_test_bootm_none(struct unit_test_state *uts)
 {
 	return run_bootm_test(uts, IH_COMP_NONE, compress_using_none);
 }
 COMPRESSION_TEST(compression_test_bootm_none, 0);
 
+/**
+ * run_stream_test() - Run tests on the incremental decompressor
+ *
+ * The compressed data is fed in chunks of various sizes, which checks that
+ * headers and blocks split across chunks are handled.
+ *
+ * @comp_type:	Compression type to test
+ * @compress:	Our function to compress data
+ * @return 0 if OK, non-zero on failure
+ */
+static int run_stream_test(struct unit_test_state *uts, int comp_type,
+			   mutate_func compress)
+{
+	static const ulong chunk_sizes[] = { 1, 7, 64, TEST_BUFFER_SIZE };
+	ulong compressed_size = TEST_BUFFER_SIZE;
+	char compressed[TEST_BUFFER_SIZE];
+	char out[TEST_BUFFER_SIZE];
+	ulong unc_len = strlen(plain);
+	struct decomp_stream ds;
+	ulong out_len, pos, chunk;
+	int i, ret;
+
+	if (!IS_ENABLED(CONFIG_DECOMP_STREAM))
+		return 0;
+
+	printf("Testing: %s\n", genimg_get_comp_name(comp_type));
+	ut_assertok(compress(uts, (void *)plain, unc_len, compressed,
+			     compressed_size, &compressed_size));
+
+	for (i = 0; i < ARRAY_SIZE(chunk_sizes); i++) {
+		memset(out, 'A', sizeof(out));
+		ut_assertok(decomp_stream_init(&ds, comp_type, out,
+					       sizeof(out)));
+		for (pos = 0; pos < compressed_size; pos += chunk) {
+			chunk = min(chunk_sizes[i], compressed_size - pos);
+			ut_assertok(decomp_stream_feed(&ds, compressed + pos,
+						       chunk));
+		}
+		ut_assertok(decomp_stream_finish(&ds, &out_len));
+		ut_asserteq(unc_len, out_len);
+		ut_asserteq_mem(plain, out, unc_len);
+		ut_asserteq('A', out[unc_len]);
+	}
+
+	/* The output buffer is one byte too small */
+	memset(out, 'A', sizeof(out));
+	ut_assertok(decomp_stream_init(&ds, comp_type, out, unc_len - 1));
+	ret = decomp_stream_feed(&ds, compressed, compressed_size);
+	if (ret)
+		decomp_stream_abort(&ds);
+	else
+		ret = decomp_stream_finish(&ds, &out_len);
+	ut_assert(ret);
+	ut_asserteq('A', out[unc_len - 1]);
+
+	/* We can't detect truncation when not decompressing */
+	if (comp_type == IH_COMP_NONE)
+		return 0;
+	ut_assertok(decomp_stream_init(&ds, comp_type, out, sizeof(out)));
+	ret = decomp_stream_feed(&ds, compressed, compressed_size / 2);
+	if (ret)
+		decomp_stream_abort(&ds);
+	else
+		ret = decomp_stream_finish(&ds, &out_len);
+	ut_assert(ret);
+
+	return 0;
+}
+
+static int compression_test_stream_gzip(struct unit_test_state *uts)
+{
+	return run_stream_test(uts, IH_COMP_GZIP, compress_using_gzip);
+}
+COMPRESSION_TEST(compression_test_stream_gzip, 0);
+
+static int compression_test_stream_bzip2(struct unit_test_state *uts)
+{
+	return run_stream_test(uts, IH_COMP_BZIP2, compress_using_bzip2);
+}
+COMPRESSION_TEST(compression_test_stream_bzip2, 0);
+
+static int compression_test_stream_lzma(struct unit_test_state *uts)
+{
+	return run_stream_test(uts, IH_COMP_LZMA, compress_using_lzma);
+}
+COMPRESSION_TEST(compression_test_stream_lzma, 0);
+
+static int compression_test_stream_xz(struct unit_test_state *uts)
+{
+	if (!IS_ENABLED(CONFIG_LZMA_XZ))
+		return 0;
+
+	return run_stream_test(uts, IH_COMP_LZMA, compress_using_xz);
+}
+COMPRESSION_TEST(compression_test_stream_xz, 0);
+
+static int compression_test_stream_lzo(struct unit_test_state *uts)
+{
+	return run_stream_test(uts, IH_COMP_LZO, compress_using_lzo);
+}
+COMPRESSION_TEST(compression_test_stream_lzo, 0);
+
+static int compression_test_stream_lz4(struct unit_test_state *uts)
+{
+	return run_stream_test(uts, IH_COMP_LZ4, compress_using_lz4);
+}
+COMPRESSION_TEST(compression_test_stream_lz4, 0);
+
+static int compression_test_stream_zstd(struct unit_test_state *uts)
+{
+	if (!IS_ENABLED(CONFIG_ZSTD))
+		return 0;
+
+	return run_stream_test(uts, IH_COMP_ZSTD, compress_using_zstd);
+}
+COMPRESSION_TEST(compression_test_stream_zstd, 0);
+
+static int compression_test_stream_none(struct unit_test_state *uts)
+{
+	return run_stream_test(uts, IH_COMP_NONE, compress_using_none);
+}
+COMPRESSION_TEST(compression_test_stream_none, 0);
+
 int do_ut_compression(struct cmd_tbl *cmdtp, int flag, int argc,
 		      char *const argv[])
 {
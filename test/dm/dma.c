@@ -122,3 +122,71 @@ static int dm_test_dma_rx(struct unit_test_state *uts)
 	return 0;
 }
 DM_TEST(dm_test_dma_rx, DM_TESTF_SCAN_FDT);
+
+static int dm_test_dma_m2m_async(struct unit_test_state *uts)
+{
+	struct dma_copy copy;
+	u8 src_buf[512];
+	u8 dst_buf[512];
+	size_t len = 512;
+	int i;
+
+	memset(dst_buf, 0, len);
+	for (i = 0; i < len; i++)
+		src_buf[i] = i;
+
+	/* The sandbox driver only copies the data when it is waited for */
+	ut_assertok(dma_memcpy_start(&copy, dst_buf, src_buf, len));
+	ut_asserteq(true, copy.pending);
+	ut_asserteq(0, dst_buf[1]);
+	ut_assertok(dma_memcpy_wait(&copy));
+	ut_asserteq_mem(src_buf, dst_buf, len);
+
+	return 0;
+}
+DM_TEST(dm_test_dma_m2m_async, DM_TESTF_SCAN_FDT);
+
+static int dm_test_dma_bulk(struct unit_test_state *uts)
+{
+	size_t len = CONFIG_DMA_BULK_COPY_MIN + 0x123;
+	u8 *src, *dst;
+	int i;
+
+	if (!IS_ENABLED(CONFIG_DMA_BULK_COPY))
+		return 0;
+
+	src = malloc(len);
+	dst = malloc(len + 1);
+	ut_assertnonnull(src);
+	ut_assertnonnull(dst);
+	for (i = 0; i < len; i++)
+		src[i] = i * 7;
+
+	/* Use an unaligned destination so that the CPU copies head and tail */
+	memset(dst, 0, len + 1);
+	ut_assertok(dma_bulk_memcpy(dst + 1, src, len));
+	ut_asserteq(0, dst[0]);
+	ut_asserteq_mem(src, dst + 1, len);
+
+	/* Small and overlapping copies are left to the CPU */
+	ut_asserteq(-E2BIG, dma_bulk_memcpy(dst, src, 512));
+	ut_asserteq(-EINVAL, dma_bulk_memcpy(src + 1, src, len - 1));
+
+	ut_assertok(dma_bulk_memset(dst, 0xa5, len));
+	for (i = 0; i < len; i++)
+		ut_asserteq(0xa5, dst[i]);
+
+	/* Repeat a 3-byte pattern */
+	dst[0] = 1;
+	dst[1] = 2;
+	dst[2] = 3;
+	ut_assertok(dma_bulk_fill(dst, 3, len));
+	for (i = 0; i < len; i++)
+		ut_asserteq(i % 3 + 1, dst[i]);
+
+	free(dst);
+	free(src);
+
+	return 0;
+}
+DM_TEST(dm_test_dma_bulk, DM_TESTF_SCAN_FDT);
@@ -7,17 +7,30 @@
  */
 
 #include <common.h>
+#include <console.h>
 #include <dm.h>
 #include <env.h>
 #include <fdtdec.h>
+#include <hash.h>
+#include <hexdump.h>
+#include <image.h>
 #include <log.h>
 #include <malloc.h>
+#include <mapmem.h>
 #include <net.h>
+#include <stdio_dev.h>
+#include <time.h>
+#include <net/tcp.h>
+#include <net/tftp.h>
+#include <net/wget.h>
 #include <dm/test.h>
 #include <dm/device-internal.h>
 #include <dm/uclass-internal.h>
 #include <asm/eth.h>
+#include <asm/unaligned.h>
 #include <test/ut.h>
+#include <u-boot/crc.h>
+#include <u-boot/sha256.h>
 
 #define DM_TEST_ETH_NUM		4
 
@@ -430,3 +443,1859 @@ static int dm_test_eth_async_ping_reply(struct unit_test_state *uts)
 }
 
 DM_TEST(dm_test_eth_async_ping_reply, DM_TESTF_SCAN_FDT);
+
+static int _dm_test_eth_rx_burst(struct unit_test_state *uts,
+				 struct udevice *dev)
+{
+	const int ring = CONFIG_ETH_SANDBOX_RX_RING;
+	const struct eth_stats *stats;
+	struct eth_stats before;
+
+	stats = eth_get_stats(dev);
+	before = *stats;
+
+	/* Packets which do not fit in the receive ring are dropped */
+	ut_asserteq(ring, sandbox_eth_recv_burst(dev, ring + 4));
+	ut_asserteq(4, stats->rx_dropped - before.rx_dropped);
+
+	/* The whole burst is handled by one call, each request answered */
+	ut_assertok(eth_rx());
+	ut_asserteq(ring, stats->rx_packets - before.rx_packets);
+	ut_asserteq(ring * (ETHER_HDR_SIZE + ARP_HDR_SIZE),
+		    stats->rx_bytes - before.rx_bytes);
+	ut_asserteq(ring, stats->tx_packets - before.tx_packets);
+	ut_asserteq(0, stats->rx_errors - before.rx_errors);
+
+	/* The ring is empty again */
+	ut_asserteq(1, sandbox_eth_recv_burst(dev, 1));
+	ut_assertok(eth_rx());
+	ut_asserteq(ring + 1, stats->rx_packets - before.rx_packets);
+	ut_asserteq(4, stats->rx_dropped - before.rx_dropped);
+
+	return 0;
+}
+
+static int dm_test_eth_rx_burst(struct unit_test_state *uts)
+{
+	struct in_addr old_ip = net_ip;
+	struct udevice *dev;
+	int retval;
+
+	net_init();
+	net_ip = string_to_ip("1.1.2.3");
+	env_set("ethact", "eth@10002000");
+	ut_assertok(eth_init());
+	dev = eth_get_dev();
+	ut_assertnonnull(dev);
+
+	retval = _dm_test_eth_rx_burst(uts, dev);
+
+	eth_halt();
+	net_ip = old_ip;
+
+	return retval;
+}
+DM_TEST(dm_test_eth_rx_burst, DM_TESTF_SCAN_FDT);
+
+#if defined(CONFIG_CMD_ARP)
+/* What was sent while testing the ARP cache */
+struct sb_arp_state {
+	int requests;		/* number of ARP requests */
+	struct in_addr target;	/* target of the last ARP request */
+	int udp;		/* number of UDP packets */
+	struct in_addr udp_ip;	/* destination of the last UDP packet */
+	uchar udp_dest[ARP_HLEN];
+};
+
+static const uchar sb_arp_hwaddr[][ARP_HLEN] = {
+	{ 0x02, 0x00, 0x11, 0x22, 0x33, 0x02 },
+	{ 0x02, 0x00, 0x11, 0x22, 0x33, 0x05 },
+	{ 0x02, 0x00, 0x11, 0x22, 0x33, 0x09 },
+};
+
+/* Record packets sent, without answering anything */
+static int sb_arp_handler(struct udevice *dev, void *packet,
+			  unsigned int len)
+{
+	struct eth_sandbox_priv *priv = dev_get_priv(dev);
+	struct sb_arp_state *state = priv->priv;
+	struct ethernet_hdr *eth = packet;
+	struct arp_hdr *arp = packet + ETHER_HDR_SIZE;
+	struct ip_udp_hdr *ip = packet + ETHER_HDR_SIZE;
+
+	if (ntohs(eth->et_protlen) == PROT_ARP &&
+	    ntohs(arp->ar_op) == ARPOP_REQUEST) {
+		state->requests++;
+		state->target = net_read_ip(&arp->ar_tpa);
+	} else if (ntohs(eth->et_protlen) == PROT_IP &&
+		   ip->ip_p == IPPROTO_UDP) {
+		state->udp++;
+		state->udp_ip = net_read_ip(&ip->ip_dst);
+		memcpy(state->udp_dest, eth->et_dest, ARP_HLEN);
+	}
+
+	return 0;
+}
+
+/* Receive an ARP packet from @sender_ip and handle it */
+static int sb_arp_recv(struct udevice *dev, int op, const char *sender_ip,
+		       const uchar *sender_hwaddr, struct in_addr target_ip)
+{
+	struct ethernet_hdr *eth;
+	struct arp_hdr *arp;
+
+	eth = sandbox_eth_recv_slot(dev);
+	if (!eth)
+		return -ENOSPC;
+
+	memcpy(eth->et_dest, op == ARPOP_REPLY ? net_ethaddr :
+	       net_bcast_ethaddr, ARP_HLEN);
+	memcpy(eth->et_src, sender_hwaddr, ARP_HLEN);
+	eth->et_protlen = htons(PROT_ARP);
+
+	arp = (void *)eth + ETHER_HDR_SIZE;
+	arp->ar_hrd = htons(ARP_ETHER);
+	arp->ar_pro = htons(PROT_IP);
+	arp->ar_hln = ARP_HLEN;
+	arp->ar_pln = ARP_PLEN;
+	arp->ar_op = htons(op);
+	memcpy(&arp->ar_sha, sender_hwaddr, ARP_HLEN);
+	net_write_ip(&arp->ar_spa, string_to_ip(sender_ip));
+	memcpy(&arp->ar_tha, op == ARPOP_REPLY ? net_ethaddr :
+	       net_null_ethaddr, ARP_HLEN);
+	net_write_ip(&arp->ar_tpa, target_ip);
+
+	sandbox_eth_recv_commit(dev, ETHER_HDR_SIZE + ARP_HDR_SIZE);
+
+	return eth_rx();
+}
+
+static int _dm_test_eth_arp_cache(struct unit_test_state *uts,
+				  struct udevice *dev,
+				  struct sb_arp_state *state)
+{
+	uchar ether2[ARP_HLEN], ether5[ARP_HLEN], hwaddr[ARP_HLEN];
+	int i;
+
+	/* Packets to two hosts wait for their ARP replies together */
+	memset(ether2, '\0', ARP_HLEN);
+	memset(ether5, '\0', ARP_HLEN);
+	ut_asserteq(1, net_send_udp_packet(ether2, string_to_ip("1.1.2.2"),
+					   1000, 1000, 0));
+	ut_asserteq(1, net_send_udp_packet(ether5, string_to_ip("1.1.2.5"),
+					   1000, 1000, 0));
+	ut_asserteq(2, state->requests);
+	ut_asserteq(0, state->udp);
+	ut_assert(arp_is_waiting());
+
+	/* Answering the second sends its packet, the first still waits */
+	ut_assertok(sb_arp_recv(dev, ARPOP_REPLY, "1.1.2.5", sb_arp_hwaddr[1],
+				net_ip));
+	ut_asserteq(1, state->udp);
+	ut_asserteq(string_to_ip("1.1.2.5").s_addr, state->udp_ip.s_addr);
+	ut_asserteq_mem(sb_arp_hwaddr[1], state->udp_dest, ARP_HLEN);
+	ut_asserteq_mem(sb_arp_hwaddr[1], ether5, ARP_HLEN);
+	ut_assert(arp_is_waiting());
+	ut_assert(!arp_cache_lookup(string_to_ip("1.1.2.2"), hwaddr));
+
+	ut_assertok(sb_arp_recv(dev, ARPOP_REPLY, "1.1.2.2", sb_arp_hwaddr[0],
+				net_ip));
+	ut_asserteq(2, state->udp);
+	ut_asserteq_mem(sb_arp_hwaddr[0], ether2, ARP_HLEN);
+	ut_assert(!arp_is_waiting());
+
+	/* A gratuitous ARP adds an entry */
+	ut_assertok(sb_arp_recv(dev, ARPOP_REQUEST, "1.1.2.9", sb_arp_hwaddr[2],
+				string_to_ip("1.1.2.9")));
+	ut_assert(arp_cache_lookup(string_to_ip("1.1.2.9"), hwaddr));
+	ut_asserteq_mem(sb_arp_hwaddr[2], hwaddr, ARP_HLEN);
+
+	/* Cached addresses are used without asking again */
+	memset(ether2, '\0', ARP_HLEN);
+	ut_assertok(net_send_udp_packet(ether2, string_to_ip("1.1.2.2"),
+					1000, 1000, 0));
+	ut_asserteq(2, state->requests);
+	ut_asserteq(3, state->udp);
+	ut_asserteq_mem(sb_arp_hwaddr[0], state->udp_dest, ARP_HLEN);
+
+	console_record_reset();
+	run_command("arp", 0);
+	ut_assert_nextline("IP address       MAC address        Expires");
+	ut_assert_nextline("1.1.2.2          %pM  %d s", sb_arp_hwaddr[0],
+			   CONFIG_NET_ARP_CACHE_TTL);
+	ut_assert_nextline("1.1.2.5          %pM  %d s", sb_arp_hwaddr[1],
+			   CONFIG_NET_ARP_CACHE_TTL);
+	ut_assert_nextline("1.1.2.9          %pM  %d s", sb_arp_hwaddr[2],
+			   CONFIG_NET_ARP_CACHE_TTL);
+	ut_assert_console_end();
+
+	ut_assertok(run_command("arp flush", 0));
+	ut_assert(!arp_cache_lookup(string_to_ip("1.1.2.2"), hwaddr));
+	ut_assert(!arp_cache_lookup(string_to_ip("1.1.2.9"), hwaddr));
+
+	/* Once the queue is full, further packets are refused */
+	for (i = 0; i < ARP_QUEUE_SIZE; i++) {
+		memset(ether2, '\0', ARP_HLEN);
+		ut_asserteq(1, net_send_udp_packet(ether2,
+						   string_to_ip("1.1.2.2"),
+						   1000, 1000, 0));
+	}
+	ut_asserteq(-ENOBUFS, net_send_udp_packet(ether2,
+						  string_to_ip("1.1.2.2"),
+						  1000, 1000, 0));
+	ut_asserteq(3, state->requests);
+	ut_asserteq(3, state->udp);
+
+	return 0;
+}
+
+static int dm_test_eth_arp_cache(struct unit_test_state *uts)
+{
+	struct in_addr old_ip = net_ip;
+	struct sb_arp_state state;
+	struct udevice *dev;
+	int retval;
+
+	memset(&state, '\0', sizeof(state));
+	sandbox_eth_set_tx_handler(0, sb_arp_handler);
+	sandbox_eth_set_priv(0, &state);
+
+	net_init();
+	net_ip = string_to_ip("1.1.2.3");
+	net_set_arp_handler(NULL);
+	env_set("ethact", "eth@10002000");
+	ut_assertok(eth_init());
+	dev = eth_get_dev();
+	ut_assertnonnull(dev);
+	memcpy(net_ethaddr, eth_get_ethaddr(), ARP_HLEN);
+	arp_cache_flush();
+
+	retval = _dm_test_eth_arp_cache(uts, dev, &state);
+
+	arp_cache_flush();
+	eth_halt();
+	net_ip = old_ip;
+	sandbox_eth_set_tx_handler(0, NULL);
+
+	return retval;
+}
+DM_TEST(dm_test_eth_arp_cache, DM_TESTF_SCAN_FDT);
+#endif
+
+#if defined(CONFIG_NETCONSOLE_BATCH)
+/* Datagrams sent by netconsole */
+struct sb_nc_state {
+	struct unit_test_state *uts;
+	int count;
+	uint next_seq;		/* expected sequence number */
+	char data[4000];	/* output received, without sequence numbers */
+	int len;
+	int max_len;		/* longest datagram */
+};
+
+static int sb_nc_handler(struct udevice *dev, void *packet, unsigned int len)
+{
+	struct eth_sandbox_priv *priv = dev_get_priv(dev);
+	struct sb_nc_state *state = priv->priv;
+	struct unit_test_state *uts = state->uts;
+	struct ethernet_hdr *eth = packet;
+	struct ip_udp_hdr *ip = packet + ETHER_HDR_SIZE;
+	char *data, *end;
+	int data_len;
+
+	if (!sandbox_eth_arp_req_to_reply(dev, packet, len))
+		return 0;
+	if (ntohs(eth->et_protlen) != PROT_IP || ip->ip_p != IPPROTO_UDP)
+		return 0;
+
+	ut_asserteq(6666, ntohs(ip->udp_dst));
+	data = (char *)ip + IP_UDP_HDR_SIZE;
+	data_len = ntohs(ip->udp_len) - UDP_HDR_SIZE;
+	state->max_len = max(state->max_len, data_len);
+
+	/* Check the sequence number, which is followed by ';' */
+	ut_asserteq(state->next_seq, simple_strtoul(data, &end, 10));
+	ut_asserteq(';', *end++);
+	state->next_seq++;
+	data_len -= end - data;
+
+	ut_assert(state->len + data_len <= sizeof(state->data));
+	memcpy(state->data + state->len, end, data_len);
+	state->len += data_len;
+	state->count++;
+
+	return 0;
+}
+
+static int _dm_test_eth_netconsole(struct unit_test_state *uts,
+				   struct stdio_dev *sdev,
+				   struct sb_nc_state *state)
+{
+	char line[3000];
+
+	/* Output is held until the end of the line */
+	sdev->putc(sdev, 'a');
+	sdev->puts(sdev, "bc");
+	ut_asserteq(0, state->count);
+	sdev->puts(sdev, "def\n");
+	ut_asserteq(1, state->count);
+	ut_asserteq(7, state->len);
+	ut_asserteq_mem("abcdef\n", state->data, 7);
+
+	/* A partial line is sent once it has waited long enough */
+	sdev->puts(sdev, "=> ");
+	nc_poll();
+	ut_asserteq(1, state->count);
+	timer_test_add_offset(CONFIG_NETCONSOLE_FLUSH_MS);
+	nc_poll();
+	ut_asserteq(2, state->count);
+	ut_asserteq_mem("=> ", state->data + 7, 3);
+
+	/* Long output goes in full-sized datagrams */
+	state->len = 0;
+	memset(line, 'x', sizeof(line) - 1);
+	line[sizeof(line) - 1] = '\0';
+	sdev->puts(sdev, line);
+	ut_asserteq(4, state->count);
+	ut_assert(state->len > 2 * 1400);
+	ut_assert(state->max_len <= 1500 - IP_UDP_HDR_SIZE);
+	sdev->putc(sdev, '\n');
+	ut_asserteq(5, state->count);
+	ut_asserteq(sizeof(line), state->len);
+	ut_asserteq('\n', state->data[state->len - 1]);
+
+	return 0;
+}
+
+static int dm_test_eth_netconsole(struct unit_test_state *uts)
+{
+	struct in_addr old_ip = net_ip;
+	struct sb_nc_state state;
+	struct stdio_dev *sdev;
+	int retval;
+
+	memset(&state, '\0', sizeof(state));
+	state.uts = uts;
+	sandbox_eth_set_tx_handler(0, sb_nc_handler);
+	sandbox_eth_set_priv(0, &state);
+
+	net_ip = string_to_ip("1.1.2.3");
+	env_set("ethact", "eth@10002000");
+	env_set("ncip", "1.1.2.2");
+	env_set("ncseq", "yes");
+	sdev = stdio_get_by_name("nc");
+	ut_assertnonnull(sdev);
+	ut_assertok(sdev->start(sdev));
+
+	retval = _dm_test_eth_netconsole(uts, sdev, &state);
+
+	env_set("ncip", NULL);
+	env_set("ncseq", NULL);
+	eth_halt();
+	eth_set_last_protocol(BOOTP);
+	net_ip = old_ip;
+	sandbox_eth_set_tx_handler(0, NULL);
+
+	return retval;
+}
+DM_TEST(dm_test_eth_netconsole, DM_TESTF_SCAN_FDT);
+#endif
+
+#if defined(CONFIG_CMD_WGET)
+#define WGET_TEST_SIZE		30000
+#define WGET_TEST_SEG		1000
+#define WGET_TEST_ADDR		0x100000
+
+/* State of the fake HTTP server which answers wget */
+struct sb_http_server {
+	struct unit_test_state *uts;
+	u16 client_port;
+	u32 iss;		/* our initial sequence number */
+	u32 snd_nxt;		/* next sequence number to send */
+	u32 last_ack;		/* last ACK received from the client */
+	u32 rcv_nxt;		/* next sequence number expected */
+	char req[512];
+	int req_len;
+	char hdr[200];		/* response header */
+	int hdr_len;
+	ulong body_pos;		/* offset of the body in the file */
+	uint stream_len;	/* header plus body */
+	int drop_seg;		/* drop this segment once, -1 for none */
+	int segs;
+	bool fin_sent;
+	int requests;		/* number of requests served */
+	struct in_addr req_ip[8];	/* server asked, for each request */
+	const char *body;	/* body to send instead of the file */
+	char manifest[100];	/* body of /test.bin.sha256 */
+};
+
+static u8 sb_http_file_byte(ulong pos)
+{
+	return (pos * 7) ^ (pos >> 8);
+}
+
+static u8 sb_http_stream_byte(struct sb_http_server *srv, uint pos)
+{
+	if (pos < srv->hdr_len)
+		return srv->hdr[pos];
+	if (srv->body)
+		return srv->body[pos - srv->hdr_len];
+
+	return sb_http_file_byte(srv->body_pos + pos - srv->hdr_len);
+}
+
+/* Queue a TCP segment from the server to be received by U-Boot */
+static void sb_http_send(struct udevice *dev, struct sb_http_server *srv,
+			 u8 flags, u32 seq, uint len)
+{
+	struct eth_sandbox_priv *priv = dev_get_priv(dev);
+	struct ethernet_hdr *eth;
+	struct ip_tcp_hdr *tcp;
+	struct {
+		struct in_addr src;
+		struct in_addr dst;
+		u8 zero;
+		u8 proto;
+		u16 len;
+	} __attribute__((packed)) ph;
+	uchar *data;
+	uint i, tcp_len = TCP_HDR_SIZE + len;
+
+	eth = sandbox_eth_recv_slot(dev);
+	if (!eth)
+		return;
+
+	memcpy(eth->et_dest, net_ethaddr, ARP_HLEN);
+	memcpy(eth->et_src, priv->fake_host_hwaddr, ARP_HLEN);
+	eth->et_protlen = htons(PROT_IP);
+
+	tcp = (void *)eth + ETHER_HDR_SIZE;
+	net_set_ip_header((uchar *)tcp, net_ip, priv->fake_host_ipaddr,
+			  IP_HDR_SIZE + tcp_len, IPPROTO_TCP);
+	tcp->tcp_src = htons(80);
+	tcp->tcp_dst = htons(srv->client_port);
+	tcp->tcp_seq = htonl(seq);
+	tcp->tcp_ack = htonl(srv->rcv_nxt);
+	tcp->tcp_hlen = (TCP_HDR_SIZE / 4) << 4;
+	tcp->tcp_flags = flags | TCP_ACK;
+	tcp->tcp_win = htons(0xffff);
+	tcp->tcp_urg = 0;
+	tcp->tcp_xsum = 0;
+
+	data = (uchar *)tcp + IP_TCP_HDR_SIZE;
+	for (i = 0; i < len; i++)
+		data[i] = sb_http_stream_byte(srv, seq - srv->iss - 1 + i);
+
+	ph.src = priv->fake_host_ipaddr;
+	ph.dst = net_ip;
+	ph.zero = 0;
+	ph.proto = IPPROTO_TCP;
+	ph.len = htons(tcp_len);
+	tcp->tcp_xsum = add_ip_checksums(sizeof(ph),
+					 compute_ip_checksum(&ph, sizeof(ph)),
+					 compute_ip_checksum(&tcp->tcp_src,
+							     tcp_len));
+
+	sandbox_eth_recv_commit(dev, ETHER_HDR_SIZE + IP_HDR_SIZE + tcp_len);
+}
+
+/* Send as much of the response as there is room for */
+static void sb_http_push(struct udevice *dev, struct sb_http_server *srv)
+{
+	uint pos, len;
+
+	if (!srv->hdr_len)
+		return;
+
+	while (!sandbox_eth_recv_full(dev)) {
+		pos = srv->snd_nxt - srv->iss - 1;
+		if (pos >= srv->stream_len)
+			break;
+		len = min(srv->stream_len - pos, (uint)WGET_TEST_SEG);
+		if (srv->segs++ != srv->drop_seg)
+			sb_http_send(dev, srv, TCP_PSH, srv->snd_nxt, len);
+		else
+			srv->drop_seg = -1;
+		srv->snd_nxt += len;
+	}
+	if (srv->snd_nxt - srv->iss - 1 == srv->stream_len && !srv->fin_sent &&
+	    !sandbox_eth_recv_full(dev)) {
+		sb_http_send(dev, srv, TCP_FIN, srv->snd_nxt++, 0);
+		srv->fin_sent = true;
+	}
+}
+
+static int sb_http_request(struct sb_http_server *srv)
+{
+	struct unit_test_state *uts = srv->uts;
+	ulong body_len = WGET_TEST_SIZE;
+	char *range;
+
+	srv->req[srv->req_len] = '\0';
+	if (!strstr(srv->req, "\r\n\r\n"))
+		return 0;
+
+	ut_assertnonnull(strstr(srv->req, "\r\nConnection: close\r\n"));
+	srv->requests++;
+
+	if (!strncmp(srv->req, "GET /test.bin.sha256 HTTP/1.1\r\n", 31)) {
+		srv->body = srv->manifest;
+		body_len = strlen(srv->manifest);
+		srv->hdr_len = sprintf(srv->hdr,
+				       "HTTP/1.1 200 OK\r\n"
+				       "Content-Length: %lu\r\n\r\n", body_len);
+		srv->stream_len = srv->hdr_len + body_len;
+		return 0;
+	}
+	ut_assert(!strncmp(srv->req, "GET /test.bin HTTP/1.1\r\n", 24));
+
+	range = strstr(srv->req, "\r\nRange: bytes=");
+	if (range) {
+		ulong start, end;
+
+		start = simple_strtoul(range + 15, &range, 10);
+		ut_asserteq('-', *range);
+		end = simple_strtoul(range + 1, NULL, 10);
+		end = min(end, (ulong)WGET_TEST_SIZE - 1);
+		srv->body_pos = start;
+		body_len = end - start + 1;
+		srv->hdr_len = sprintf(srv->hdr,
+				       "HTTP/1.1 206 Partial Content\r\n"
+				       "Content-Range: bytes %lu-%lu/%u\r\n"
+				       "Content-Length: %lu\r\n\r\n",
+				       start, end, WGET_TEST_SIZE, body_len);
+	} else {
+		srv->hdr_len = sprintf(srv->hdr,
+				       "HTTP/1.1 200 OK\r\n"
+				       "Content-Length: %lu\r\n\r\n", body_len);
+	}
+	srv->stream_len = srv->hdr_len + body_len;
+
+	return 0;
+}
+
+static int sb_http_handler(struct udevice *dev, void *packet,
+			   unsigned int len)
+{
+	struct eth_sandbox_priv *priv = dev_get_priv(dev);
+	struct sb_http_server *srv = priv->priv;
+	struct ethernet_hdr *eth = packet;
+	struct ip_tcp_hdr *tcp = packet + ETHER_HDR_SIZE;
+	struct unit_test_state *uts = srv->uts;
+	int hdr_len, data_len, ret;
+	u32 seq, ack;
+
+	if (!sandbox_eth_arp_req_to_reply(dev, packet, len))
+		return 0;
+	if (ntohs(eth->et_protlen) != PROT_IP || tcp->ip_p != IPPROTO_TCP)
+		return 0;
+	/* There is no ARP request when the address is already cached */
+	priv->fake_host_ipaddr = net_read_ip(&tcp->ip_dst);
+
+	ut_asserteq(80, ntohs(tcp->tcp_dst));
+	hdr_len = (tcp->tcp_hlen >> 4) * 4;
+	data_len = ntohs(tcp->ip_len) - IP_HDR_SIZE - hdr_len;
+	seq = ntohl(tcp->tcp_seq);
+	ack = ntohl(tcp->tcp_ack);
+
+	if (tcp->tcp_flags & TCP_SYN) {
+		/* Check that the MSS option comes first */
+		ut_asserteq(TCP_HDR_SIZE + TCP_SYN_OPT_SIZE, hdr_len);
+		ut_asserteq(2, *((u8 *)tcp + IP_TCP_HDR_SIZE));
+		srv->client_port = ntohs(tcp->tcp_src);
+		srv->req_len = 0;
+		srv->hdr_len = 0;
+		srv->body = NULL;
+		srv->fin_sent = false;
+		srv->rcv_nxt = seq + 1;
+		srv->snd_nxt = srv->iss + 1;
+		srv->last_ack = srv->iss;
+		sb_http_send(dev, srv, TCP_SYN, srv->iss, 0);
+		return 0;
+	}
+	if (tcp->tcp_flags & TCP_RST)
+		return 0;
+
+	if (data_len && seq == srv->rcv_nxt && !srv->hdr_len) {
+		ut_assert(srv->req_len + data_len < sizeof(srv->req));
+		memcpy(srv->req + srv->req_len,
+		       (uchar *)tcp + IP_HDR_SIZE + hdr_len, data_len);
+		srv->req_len += data_len;
+		srv->rcv_nxt += data_len;
+		ret = sb_http_request(srv);
+		if (ret)
+			return ret;
+		if (srv->hdr_len && srv->requests <= ARRAY_SIZE(srv->req_ip))
+			srv->req_ip[srv->requests - 1] = priv->fake_host_ipaddr;
+	}
+	if (tcp->tcp_flags & TCP_FIN)
+		srv->rcv_nxt++;
+
+	/* Go back on a duplicate ACK, as the client is missing something */
+	if (ack == srv->last_ack && !data_len && srv->hdr_len &&
+	    !(tcp->tcp_flags & TCP_FIN)) {
+		srv->snd_nxt = ack;
+		srv->fin_sent = false;
+	}
+	srv->last_ack = ack;
+	sb_http_push(dev, srv);
+
+	return 0;
+}
+
+static int sb_check_wget(struct unit_test_state *uts, ulong pos, ulong size)
+{
+	u8 *buf = map_sysmem(WGET_TEST_ADDR, size);
+	ulong i;
+
+	ut_asserteq(size, env_get_hex("filesize", 0));
+	for (i = 0; i < size; i++)
+		ut_asserteq(sb_http_file_byte(pos + i), buf[i]);
+	unmap_sysmem(buf);
+
+	return 0;
+}
+
+static int _dm_test_eth_wget(struct unit_test_state *uts,
+			     struct sb_http_server *srv)
+{
+	env_set("ethact", "eth@10002000");
+	env_set("serverip", "1.1.2.2");
+	image_load_addr = WGET_TEST_ADDR;
+	strcpy(net_boot_file_name, "/test.bin");
+
+	/* Whole file, with one segment lost */
+	srv->uts = uts;
+	srv->iss = 0x12345678;
+	srv->drop_seg = 5;
+	sandbox_eth_set_priv(0, srv);
+	ut_asserteq(WGET_TEST_SIZE, net_loop(WGET));
+	ut_asserteq(-1, srv->drop_seg);
+	ut_assertok(sb_check_wget(uts, 0, WGET_TEST_SIZE));
+
+	/* Part of the file, with the sequence number wrapping */
+	memset(srv, '\0', sizeof(*srv));
+	srv->uts = uts;
+	srv->iss = 0xfffff000;
+	srv->drop_seg = -1;
+	wget_range_pos = 0x1234;
+	wget_range_size = 0x2000;
+	ut_asserteq(0x2000, net_loop(WGET));
+	ut_assertok(sb_check_wget(uts, 0x1234, 0x2000));
+
+	return 0;
+}
+
+static int dm_test_eth_wget(struct unit_test_state *uts)
+{
+	struct sb_http_server srv = {};
+	int retval;
+
+	sandbox_eth_set_tx_handler(0, sb_http_handler);
+	retval = _dm_test_eth_wget(uts, &srv);
+
+	/* Restore the env */
+	sandbox_eth_set_tx_handler(0, NULL);
+	sandbox_eth_set_priv(0, NULL);
+	wget_range_pos = 0;
+	wget_range_size = 0;
+	env_set("serverip", NULL);
+
+	return retval;
+}
+DM_TEST(dm_test_eth_wget, DM_TESTF_SCAN_FDT);
+
+#if defined(CONFIG_CMD_WGETSEG)
+static int _dm_test_eth_wgetseg(struct unit_test_state *uts,
+				struct sb_http_server *srv)
+{
+	static const char *const servers[] = {
+		"1.1.2.2",	/* manifest */
+		"1.1.2.2", "1.1.2.3", "1.1.2.2", "1.1.2.3",
+	};
+	u8 digest[SHA256_SUM_LEN];
+	int size = sizeof(digest);
+	u8 *file;
+	int i;
+
+	/* Write the manifest as sha256sum would */
+	file = malloc(WGET_TEST_SIZE);
+	ut_assertnonnull(file);
+	for (i = 0; i < WGET_TEST_SIZE; i++)
+		file[i] = sb_http_file_byte(i);
+	ut_assertok(hash_block("sha256", file, WGET_TEST_SIZE, digest, &size));
+	free(file);
+	bin2hex(srv->manifest, digest, SHA256_SUM_LEN);
+	strcpy(srv->manifest + SHA256_SUM_LEN * 2, "  test.bin\n");
+
+	env_set("ethact", "eth@10002000");
+	env_set("wgetservers", "1.1.2.2 1.1.2.3");
+	env_set("wgetsegsize", "2000");
+	srv->uts = uts;
+	srv->iss = 0x12345678;
+	srv->drop_seg = -1;
+	sandbox_eth_set_priv(0, srv);
+
+	/* The manifest, then the file in four segments */
+	ut_assertok(run_command("wgetseg 100000 /test.bin", 0));
+	ut_asserteq(5, srv->requests);
+	ut_assertok(sb_check_wget(uts, 0, WGET_TEST_SIZE));
+
+	/* The segments alternate between the two servers */
+	for (i = 0; i < 5; i++)
+		ut_asserteq(string_to_ip(servers[i]).s_addr,
+			    srv->req_ip[i].s_addr);
+
+	/* A file which does not match its manifest is rejected */
+	srv->manifest[0] = srv->manifest[0] == '0' ? '1' : '0';
+	ut_asserteq(1, run_command("wgetseg 100000 /test.bin", 0));
+
+	return 0;
+}
+
+static int dm_test_eth_wgetseg(struct unit_test_state *uts)
+{
+	struct sb_http_server srv = {};
+	int retval;
+
+	sandbox_eth_set_tx_handler(0, sb_http_handler);
+	retval = _dm_test_eth_wgetseg(uts, &srv);
+
+	/* Restore the env */
+	sandbox_eth_set_tx_handler(0, NULL);
+	sandbox_eth_set_priv(0, NULL);
+	env_set("wgetservers", NULL);
+	env_set("wgetsegsize", NULL);
+
+	return retval;
+}
+DM_TEST(dm_test_eth_wgetseg, DM_TESTF_SCAN_FDT);
+#endif
+#endif
+
+#define TFTP_TEST_BLKSIZE	512
+#define TFTP_TEST_ADDR		0x100000
+#define TFTP_TEST_SRC_PORT	5000
+
+static u8 sb_tftp_file_byte(ulong pos)
+{
+	return (pos * 13) ^ (pos >> 8);
+}
+
+/* Queue a UDP packet from the server to be received by U-Boot */
+static void sb_tftp_send(struct udevice *dev, struct in_addr dest,
+			 int dport, const void *data, int len)
+{
+	struct eth_sandbox_priv *priv = dev_get_priv(dev);
+	struct ethernet_hdr *eth;
+	struct ip_udp_hdr *ip;
+
+	eth = sandbox_eth_recv_slot(dev);
+	if (!eth)
+		return;
+
+	memcpy(eth->et_dest, net_ethaddr, ARP_HLEN);
+	memcpy(eth->et_src, priv->fake_host_hwaddr, ARP_HLEN);
+	eth->et_protlen = htons(PROT_IP);
+
+	ip = (void *)eth + ETHER_HDR_SIZE;
+	net_set_ip_header((uchar *)ip, dest, priv->fake_host_ipaddr,
+			  IP_UDP_HDR_SIZE + len, IPPROTO_UDP);
+	ip->udp_src = htons(TFTP_TEST_SRC_PORT);
+	ip->udp_dst = htons(dport);
+	ip->udp_len = htons(UDP_HDR_SIZE + len);
+	ip->udp_xsum = 0;
+	memcpy((uchar *)ip + IP_UDP_HDR_SIZE, data, len);
+
+	sandbox_eth_recv_commit(dev, ETHER_HDR_SIZE + IP_UDP_HDR_SIZE + len);
+}
+
+/* State of the fake TFTP server which sends a file to one client */
+struct sb_tftp_get_server {
+	struct unit_test_state *uts;
+	const char *name;	/* file name expected in the RRQ */
+	const u8 *file;
+	int size;
+	int window;		/* window size to expect and offer, or 0 */
+	int drop;		/* block to lose the first time it is sent */
+	int swap;		/* block to send after the next one, once */
+	u16 client_port;
+	int rrqs;		/* number of read requests */
+	int acks[16];		/* blocks ACKed by the client, in order */
+	int num_acks;
+	bool done;		/* the client ACKed the last block */
+};
+
+/* Find the value of an option in a request, or NULL if it is absent */
+static const char *sb_tftp_option(const uchar *data, int len,
+				  const char *name)
+{
+	const char *end = (const char *)data + len;
+	const char *p = (const char *)data + 2;
+	const char *val;
+
+	/* Skip the file name and the mode */
+	p += strlen(p) + 1;
+	p += strlen(p) + 1;
+	while (p < end) {
+		val = p + strlen(p) + 1;
+		if (!strcmp(p, name))
+			return val;
+		p = val + strlen(val) + 1;
+	}
+
+	return NULL;
+}
+
+static void sb_tftp_get_oack(struct udevice *dev,
+			     struct sb_tftp_get_server *srv)
+{
+	uchar buf[100];
+	int len;
+
+	*(__be16 *)buf = htons(6);	/* OACK */
+	len = 2 + sprintf((char *)buf + 2, "blksize%c%d%cwindowsize%c%d",
+			  0, TFTP_TEST_BLKSIZE, 0, 0, srv->window) + 1;
+	sb_tftp_send(dev, net_ip, srv->client_port, buf, len);
+}
+
+static void sb_tftp_get_block(struct udevice *dev,
+			      struct sb_tftp_get_server *srv, int block)
+{
+	uchar buf[4 + TFTP_TEST_BLKSIZE];
+	int len;
+
+	len = min(srv->size - (block - 1) * TFTP_TEST_BLKSIZE,
+		  TFTP_TEST_BLKSIZE);
+	*(__be16 *)buf = htons(3);	/* DATA */
+	*(__be16 *)(buf + 2) = htons(block);
+	memcpy(buf + 4, srv->file + (block - 1) * TFTP_TEST_BLKSIZE, len);
+	sb_tftp_send(dev, net_ip, srv->client_port, buf, 4 + len);
+}
+
+/* Send the blocks after the one just ACKed, losing or reordering some */
+static void sb_tftp_get_window(struct udevice *dev,
+			       struct sb_tftp_get_server *srv, int ack)
+{
+	int block, last;
+
+	last = min(ack + max(srv->window, 1),
+		   srv->size / TFTP_TEST_BLKSIZE + 1);
+	for (block = ack + 1; block <= last; block++) {
+		if (block == srv->drop) {
+			srv->drop = 0;
+			continue;
+		}
+		if (block == srv->swap && block < last) {
+			srv->swap = 0;
+			sb_tftp_get_block(dev, srv, block + 1);
+			sb_tftp_get_block(dev, srv, block++);
+			continue;
+		}
+		sb_tftp_get_block(dev, srv, block);
+	}
+}
+
+static int sb_tftp_get_handler(struct udevice *dev, void *packet,
+			       unsigned int len)
+{
+	struct eth_sandbox_priv *priv = dev_get_priv(dev);
+	struct sb_tftp_get_server *srv = priv->priv;
+	struct ethernet_hdr *eth = packet;
+	struct ip_udp_hdr *ip = packet + ETHER_HDR_SIZE;
+	struct unit_test_state *uts = srv->uts;
+	uchar *data = (uchar *)ip + IP_UDP_HDR_SIZE;
+	const char *window;
+	int opcode, block;
+
+	if (!sandbox_eth_arp_req_to_reply(dev, packet, len))
+		return 0;
+	if (ntohs(eth->et_protlen) != PROT_IP || ip->ip_p != IPPROTO_UDP)
+		return 0;
+
+	opcode = ntohs(*(__be16 *)data);
+	switch (opcode) {
+	case 1:		/* RRQ */
+		ut_asserteq(69, ntohs(ip->udp_dst));
+		ut_asserteq_str(srv->name, (char *)data + 2);
+		srv->client_port = ntohs(ip->udp_src);
+		srv->rrqs++;
+		window = sb_tftp_option(data, ntohs(ip->udp_len) - UDP_HDR_SIZE,
+					"windowsize");
+		if (!srv->window) {
+			ut_assertnull(window);
+			sb_tftp_get_block(dev, srv, 1);
+			break;
+		}
+		ut_assertnonnull(window);
+		ut_asserteq(srv->window, simple_strtol(window, NULL, 10));
+		sb_tftp_get_oack(dev, srv);
+		break;
+	case 4:		/* ACK */
+		ut_asserteq(TFTP_TEST_SRC_PORT, ntohs(ip->udp_dst));
+		ut_asserteq(srv->client_port, ntohs(ip->udp_src));
+		block = ntohs(*(__be16 *)(data + 2));
+		if (srv->num_acks < ARRAY_SIZE(srv->acks))
+			srv->acks[srv->num_acks++] = block;
+		if (block * TFTP_TEST_BLKSIZE > srv->size)
+			srv->done = true;
+		else
+			sb_tftp_get_window(dev, srv, block);
+		break;
+	default:
+		ut_assertf(false, "unexpected TFTP opcode %d\n", opcode);
+	}
+
+	return 0;
+}
+
+#define TFTP_WINDOW_TEST_BLOCKS	13
+#define TFTP_WINDOW_TEST_SIZE	((TFTP_WINDOW_TEST_BLOCKS - 1) * \
+				 TFTP_TEST_BLKSIZE + 100)
+
+static int _dm_test_eth_tftp_window(struct unit_test_state *uts,
+				    struct sb_tftp_get_server *srv)
+{
+	/*
+	 * Block 2 is lost from the first window, so the client ACKs block 1
+	 * and the window is sent again from block 2. Blocks 8 and 9 arrive
+	 * swapped, so the client ACKs block 7 when it sees block 9 early.
+	 */
+	static const int acks[] = { 0, 1, 5, 7, 11, 13 };
+	u8 *buf;
+	int i;
+
+	env_set("ethact", "eth@10002000");
+	env_set("serverip", "1.1.2.2");
+	env_set("tftpwindowsize", "4");
+	image_load_addr = TFTP_TEST_ADDR;
+	strcpy(net_boot_file_name, srv->name);
+
+	srv->uts = uts;
+	sandbox_eth_set_priv(0, srv);
+	ut_asserteq(TFTP_WINDOW_TEST_SIZE, net_loop(TFTPGET));
+	ut_assert(srv->done);
+	ut_asserteq(ARRAY_SIZE(acks), srv->num_acks);
+	for (i = 0; i < ARRAY_SIZE(acks); i++)
+		ut_asserteq(acks[i], srv->acks[i]);
+
+	buf = map_sysmem(TFTP_TEST_ADDR, TFTP_WINDOW_TEST_SIZE);
+	for (i = 0; i < TFTP_WINDOW_TEST_SIZE; i++)
+		ut_asserteq(sb_tftp_file_byte(i), buf[i]);
+	unmap_sysmem(buf);
+
+	/* Without the variable, the window goes back to the default of 1 */
+	env_set("tftpwindowsize", NULL);
+	srv->window = 0;
+	srv->num_acks = 0;
+	srv->done = false;
+	ut_asserteq(TFTP_WINDOW_TEST_SIZE, net_loop(TFTPGET));
+	ut_assert(srv->done);
+	ut_asserteq(TFTP_WINDOW_TEST_BLOCKS, srv->num_acks);
+
+	return 0;
+}
+
+static int dm_test_eth_tftp_window(struct unit_test_state *uts)
+{
+	struct sb_tftp_get_server srv = {
+		.name = "test.bin",
+		.size = TFTP_WINDOW_TEST_SIZE,
+		.window = 4,
+		.drop = 2,
+		.swap = 8,
+	};
+	u8 file[TFTP_WINDOW_TEST_SIZE];
+	int retval, i;
+
+	for (i = 0; i < TFTP_WINDOW_TEST_SIZE; i++)
+		file[i] = sb_tftp_file_byte(i);
+	srv.file = file;
+
+	sandbox_eth_set_tx_handler(0, sb_tftp_get_handler);
+	retval = _dm_test_eth_tftp_window(uts, &srv);
+
+	/* Restore the env */
+	sandbox_eth_set_tx_handler(0, NULL);
+	sandbox_eth_set_priv(0, NULL);
+	env_set("serverip", NULL);
+	env_set("tftpwindowsize", NULL);
+
+	return retval;
+}
+DM_TEST(dm_test_eth_tftp_window, DM_TESTF_SCAN_FDT);
+
+#if defined(CONFIG_CMD_PXE_CACHE)
+#define PXE_CACHE_TEST_SIZE	(TFTP_TEST_BLKSIZE + 100)
+#define PXE_CACHE_TEST_CFG	0x2000
+
+static int _dm_test_eth_pxe_cache(struct unit_test_state *uts,
+				  struct sb_tftp_get_server *srv)
+{
+	static const char cfg[] =
+		"default test\n"
+		"label test\n"
+		"\tkernel test.bin\n";
+	char cmd[30];
+	u8 *buf;
+
+	env_set("ethact", "eth@10002000");
+	env_set("serverip", "1.1.2.2");
+	buf = map_sysmem(PXE_CACHE_TEST_CFG, sizeof(cfg));
+	memcpy(buf, cfg, sizeof(cfg));
+	unmap_sysmem(buf);
+
+	srv->uts = uts;
+	sandbox_eth_set_priv(0, srv);
+
+	/* The kernel is not an image so the boot fails, after loading it */
+	sprintf(cmd, "pxe boot %x", PXE_CACHE_TEST_CFG);
+	run_command(cmd, 0);
+	ut_asserteq(1, srv->rrqs);
+	ut_asserteq(PXE_CACHE_TEST_SIZE, env_get_hex("filesize", 0));
+
+	/* Booting the same label again uses the kernel already loaded */
+	env_set("filesize", NULL);
+	run_command(cmd, 0);
+	ut_asserteq(1, srv->rrqs);
+	ut_asserteq(PXE_CACHE_TEST_SIZE, env_get_hex("filesize", 0));
+
+	/* Once it is overwritten, it is loaded again */
+	buf = map_sysmem(env_get_hex("kernel_addr_r", 0), 1);
+	buf[0] ^= 0xff;
+	unmap_sysmem(buf);
+	run_command(cmd, 0);
+	ut_asserteq(2, srv->rrqs);
+
+	return 0;
+}
+
+static int dm_test_eth_pxe_cache(struct unit_test_state *uts)
+{
+	struct sb_tftp_get_server srv = {
+		.name = "test.bin",
+		.size = PXE_CACHE_TEST_SIZE,
+	};
+	u8 file[PXE_CACHE_TEST_SIZE];
+	int retval, i;
+
+	for (i = 0; i < PXE_CACHE_TEST_SIZE; i++)
+		file[i] = sb_tftp_file_byte(i);
+	srv.file = file;
+
+	sandbox_eth_set_tx_handler(0, sb_tftp_get_handler);
+	retval = _dm_test_eth_pxe_cache(uts, &srv);
+
+	/* Restore the env */
+	sandbox_eth_set_tx_handler(0, NULL);
+	sandbox_eth_set_priv(0, NULL);
+	env_set("serverip", NULL);
+
+	return retval;
+}
+DM_TEST(dm_test_eth_pxe_cache, DM_TESTF_SCAN_FDT);
+#endif
+
+#if defined(CONFIG_TFTP_MULTICAST)
+#define TFTP_TEST_BLOCKS	10
+#define TFTP_TEST_SIZE		((TFTP_TEST_BLOCKS - 1) * TFTP_TEST_BLKSIZE + 100)
+#define TFTP_TEST_PORT		1758
+
+/* State of the fake TFTP server which sends to a multicast group */
+struct sb_tftp_server {
+	struct unit_test_state *uts;
+	struct in_addr group;
+	u16 client_port;
+	int blocks_sent;	/* number of data blocks sent */
+	bool done;		/* the client ACKed the last block */
+};
+
+static void sb_tftp_send_oack(struct udevice *dev, struct sb_tftp_server *srv,
+			      const char *mcast)
+{
+	uchar buf[100];
+	int len;
+
+	*(__be16 *)buf = htons(6);	/* OACK */
+	len = 2 + sprintf((char *)buf + 2, "blksize%c%d%cmulticast%c%s",
+			  0, TFTP_TEST_BLKSIZE, 0, 0, mcast) + 1;
+	sb_tftp_send(dev, net_ip, srv->client_port, buf, len);
+}
+
+/* Send a block of the file to the group */
+static void sb_tftp_send_block(struct udevice *dev, struct sb_tftp_server *srv,
+			       int block)
+{
+	uchar buf[4 + TFTP_TEST_BLKSIZE];
+	int i, len;
+
+	len = min(TFTP_TEST_SIZE - (block - 1) * TFTP_TEST_BLKSIZE,
+		  TFTP_TEST_BLKSIZE);
+	*(__be16 *)buf = htons(3);	/* DATA */
+	*(__be16 *)(buf + 2) = htons(block);
+	for (i = 0; i < len; i++)
+		buf[4 + i] = sb_tftp_file_byte((block - 1) * TFTP_TEST_BLKSIZE +
+					       i);
+	sb_tftp_send(dev, srv->group, TFTP_TEST_PORT, buf, 4 + len);
+	srv->blocks_sent++;
+}
+
+static int sb_tftp_handler(struct udevice *dev, void *packet,
+			   unsigned int len)
+{
+	struct eth_sandbox_priv *priv = dev_get_priv(dev);
+	struct sb_tftp_server *srv = priv->priv;
+	struct ethernet_hdr *eth = packet;
+	struct ip_udp_hdr *ip = packet + ETHER_HDR_SIZE;
+	struct unit_test_state *uts = srv->uts;
+	uchar *data = (uchar *)ip + IP_UDP_HDR_SIZE;
+	u8 group_mac[ARP_HLEN] = { 0x01, 0x00, 0x5e, 0x01, 0x02, 0x03 };
+	int opcode, block, i, data_len;
+	bool mcast = false;
+
+	if (!sandbox_eth_arp_req_to_reply(dev, packet, len))
+		return 0;
+	if (ntohs(eth->et_protlen) != PROT_IP || ip->ip_p != IPPROTO_UDP)
+		return 0;
+
+	data_len = ntohs(ip->udp_len) - UDP_HDR_SIZE;
+	opcode = ntohs(*(__be16 *)data);
+	switch (opcode) {
+	case 1:		/* RRQ */
+		ut_asserteq(69, ntohs(ip->udp_dst));
+		ut_asserteq_str("test.bin", (char *)data + 2);
+		/* Multicast is requested, with an empty value, not a window */
+		for (i = 2; i < data_len; i += strlen((char *)data + i) + 1) {
+			ut_assert(strcmp((char *)data + i, "windowsize"));
+			if (!strcmp((char *)data + i, "multicast")) {
+				ut_asserteq_str("", (char *)data + i + 10);
+				mcast = true;
+			}
+		}
+		ut_assert(mcast);
+		srv->client_port = ntohs(ip->udp_src);
+
+		/*
+		 * Another client is master to start with, so some blocks go
+		 * to the group before this client is asked for its ACKs
+		 */
+		sb_tftp_send_oack(dev, srv, "239.1.2.3,1758,0");
+		sb_tftp_send_block(dev, srv, 3);
+		sb_tftp_send_block(dev, srv, 4);
+		sb_tftp_send_block(dev, srv, 5);
+		sb_tftp_send_block(dev, srv, 8);
+		sb_tftp_send_oack(dev, srv, ",,1");
+		break;
+	case 4:		/* ACK */
+		ut_asserteq(TFTP_TEST_SRC_PORT, ntohs(ip->udp_dst));
+		ut_asserteq(srv->client_port, ntohs(ip->udp_src));
+		ut_assert(priv->mcast_joined);
+		ut_asserteq_mem(group_mac, priv->mcast_hwaddr, ARP_HLEN);
+		block = ntohs(*(__be16 *)(data + 2));
+		if (block == TFTP_TEST_BLOCKS)
+			srv->done = true;
+		else
+			sb_tftp_send_block(dev, srv, block + 1);
+		break;
+	default:
+		ut_assertf(false, "unexpected TFTP opcode %d\n", opcode);
+	}
+
+	return 0;
+}
+
+static int _dm_test_eth_tftp_mcast(struct unit_test_state *uts,
+				   struct sb_tftp_server *srv)
+{
+	struct eth_sandbox_priv *priv;
+	struct udevice *dev;
+	u8 *buf;
+	int i;
+
+	ut_assertok(uclass_get_device_by_name(UCLASS_ETH, "eth@10002000",
+					      &dev));
+	priv = dev_get_priv(dev);
+	env_set("ethact", "eth@10002000");
+	env_set("serverip", "1.1.2.2");
+	env_set("tftpmulticast", "yes");
+	image_load_addr = TFTP_TEST_ADDR;
+	strcpy(net_boot_file_name, "test.bin");
+
+	srv->uts = uts;
+	srv->group = string_to_ip("239.1.2.3");
+	sandbox_eth_set_priv(0, srv);
+	ut_asserteq(TFTP_TEST_SIZE, net_loop(TFTPGET));
+
+	/* Each block is sent once and the group is left at the end */
+	ut_assert(srv->done);
+	ut_asserteq(TFTP_TEST_BLOCKS, srv->blocks_sent);
+	ut_assert(!priv->mcast_joined);
+
+	buf = map_sysmem(TFTP_TEST_ADDR, TFTP_TEST_SIZE);
+	for (i = 0; i < TFTP_TEST_SIZE; i++)
+		ut_asserteq(sb_tftp_file_byte(i), buf[i]);
+	unmap_sysmem(buf);
+
+	return 0;
+}
+
+static int dm_test_eth_tftp_mcast(struct unit_test_state *uts)
+{
+	struct sb_tftp_server srv = {};
+	int retval;
+
+	sandbox_eth_set_tx_handler(0, sb_tftp_handler);
+	retval = _dm_test_eth_tftp_mcast(uts, &srv);
+
+	/* Restore the env */
+	sandbox_eth_set_tx_handler(0, NULL);
+	sandbox_eth_set_priv(0, NULL);
+	env_set("serverip", NULL);
+	env_set("tftpmulticast", NULL);
+
+	return retval;
+}
+DM_TEST(dm_test_eth_tftp_mcast, DM_TESTF_SCAN_FDT);
+#endif
+
+#if defined(CONFIG_TFTP_DECOMP)
+#define TFTP_DECOMP_TEST_SIZE	5000
+/* Room for the gzip header and trailer, and a header per stored block */
+#define TFTP_DECOMP_TEST_MAX	(TFTP_DECOMP_TEST_SIZE + 100)
+
+/*
+ * Make a gzip stream holding the test file in stored (uncompressed) deflate
+ * blocks, so that it can be built here without a compressor
+ */
+static int sb_tftp_make_gzip(u8 *out, int size)
+{
+	static const u8 hdr[] = { 0x1f, 0x8b, 8, 0, 0, 0, 0, 0, 0, 3 };
+	u8 *p = out;
+	u32 crc = 0;
+	int pos, count, i;
+
+	memcpy(p, hdr, sizeof(hdr));
+	p += sizeof(hdr);
+	for (pos = 0; pos < size; pos += count) {
+		count = min(size - pos, 1000);
+		*p++ = pos + count == size;	/* BFINAL, stored block */
+		put_unaligned_le16(count, p);
+		put_unaligned_le16(~count, p + 2);
+		p += 4;
+		for (i = 0; i < count; i++)
+			p[i] = sb_tftp_file_byte(pos + i);
+		crc = crc32(crc, p, count);
+		p += count;
+	}
+	put_unaligned_le32(crc, p);
+	put_unaligned_le32(size, p + 4);
+
+	return p + 8 - out;
+}
+
+static int _dm_test_eth_tftp_decomp(struct unit_test_state *uts,
+				    struct sb_tftp_get_server *srv)
+{
+	u8 *buf;
+	int i;
+
+	env_set("ethact", "eth@10002000");
+	env_set("serverip", "1.1.2.2");
+	env_set("tftpdecomp", "gzip");
+	image_load_addr = TFTP_TEST_ADDR;
+	strcpy(net_boot_file_name, srv->name);
+
+	srv->uts = uts;
+	sandbox_eth_set_priv(0, srv);
+	ut_asserteq(TFTP_DECOMP_TEST_SIZE, net_loop(TFTPGET));
+	ut_assert(srv->done);
+
+	buf = map_sysmem(TFTP_TEST_ADDR, TFTP_DECOMP_TEST_SIZE);
+	for (i = 0; i < TFTP_DECOMP_TEST_SIZE; i++)
+		ut_asserteq(sb_tftp_file_byte(i), buf[i]);
+	unmap_sysmem(buf);
+
+	/* A file cut short is reported as an error */
+	srv->size -= 10;
+	srv->done = false;
+	ut_asserteq(-ENONET, net_loop(TFTPGET));
+	ut_assert(srv->done);
+
+	return 0;
+}
+
+static int dm_test_eth_tftp_decomp(struct unit_test_state *uts)
+{
+	struct sb_tftp_get_server srv = { .name = "test.gz" };
+	u8 file[TFTP_DECOMP_TEST_MAX];
+	int retval;
+
+	srv.file = file;
+	srv.size = sb_tftp_make_gzip(file, TFTP_DECOMP_TEST_SIZE);
+	ut_assert(srv.size <= TFTP_DECOMP_TEST_MAX);
+
+	sandbox_eth_set_tx_handler(0, sb_tftp_get_handler);
+	retval = _dm_test_eth_tftp_decomp(uts, &srv);
+
+	/* Restore the env */
+	sandbox_eth_set_tx_handler(0, NULL);
+	sandbox_eth_set_priv(0, NULL);
+	env_set("serverip", NULL);
+	env_set("tftpdecomp", NULL);
+
+	return retval;
+}
+DM_TEST(dm_test_eth_tftp_decomp, DM_TESTF_SCAN_FDT);
+#endif
+
+#if defined(CONFIG_TFTP_PROBE)
+#define TFTP_PROBE_TEST_SIZE	(TFTP_TEST_BLKSIZE + 100)
+
+/*
+ * Names given to tftp_probe(). The server does not have the first two, has
+ * the rest and answers for the first one only after the others.
+ */
+static const char *const sb_tftp_probe_names[] = {
+	"pxelinux.cfg/01-02-00-11-22-33-44",
+	"pxelinux.cfg/C0A8",
+	"pxelinux.cfg/C0",
+	"pxelinux.cfg/default-sandbox",
+	"pxelinux.cfg/default",
+};
+
+#define TFTP_PROBE_TEST_NAMES	ARRAY_SIZE(sb_tftp_probe_names)
+
+struct sb_tftp_probe_server {
+	struct unit_test_state *uts;
+	u16 client_port[TFTP_PROBE_TEST_NAMES];
+	bool deferred;		/* the reply for the first name is still due */
+	uint aborted;		/* mask of names the client did not want */
+	bool done;		/* the client ACKed the last block */
+};
+
+static void sb_tftp_probe_error(struct udevice *dev, int port)
+{
+	uchar buf[20];
+	int len;
+
+	*(__be16 *)buf = htons(5);	/* ERROR */
+	*(__be16 *)(buf + 2) = htons(1);
+	len = 4 + sprintf((char *)buf + 4, "File not found") + 1;
+	sb_tftp_send(dev, net_ip, port, buf, len);
+}
+
+static void sb_tftp_probe_block(struct udevice *dev, int port, int block)
+{
+	uchar buf[4 + TFTP_TEST_BLKSIZE];
+	int i, len;
+
+	len = min(TFTP_PROBE_TEST_SIZE - (block - 1) * TFTP_TEST_BLKSIZE,
+		  TFTP_TEST_BLKSIZE);
+	*(__be16 *)buf = htons(3);	/* DATA */
+	*(__be16 *)(buf + 2) = htons(block);
+	for (i = 0; i < len; i++)
+		buf[4 + i] = sb_tftp_file_byte((block - 1) * TFTP_TEST_BLKSIZE +
+					       i);
+	sb_tftp_send(dev, net_ip, port, buf, 4 + len);
+}
+
+static int sb_tftp_probe_handler(struct udevice *dev, void *packet,
+				 unsigned int len)
+{
+	struct eth_sandbox_priv *priv = dev_get_priv(dev);
+	struct sb_tftp_probe_server *srv = priv->priv;
+	struct ethernet_hdr *eth = packet;
+	struct ip_udp_hdr *ip = packet + ETHER_HDR_SIZE;
+	struct unit_test_state *uts = srv->uts;
+	uchar *data = (uchar *)ip + IP_UDP_HDR_SIZE;
+	int opcode, port, block, i;
+
+	if (!sandbox_eth_arp_req_to_reply(dev, packet, len))
+		return 0;
+	if (ntohs(eth->et_protlen) != PROT_IP || ip->ip_p != IPPROTO_UDP)
+		return 0;
+
+	opcode = ntohs(*(__be16 *)data);
+	port = ntohs(ip->udp_src);
+	if (opcode == 1) {	/* RRQ */
+		ut_asserteq(69, ntohs(ip->udp_dst));
+		for (i = 0; i < TFTP_PROBE_TEST_NAMES; i++) {
+			if (!strcmp((char *)data + 2, sb_tftp_probe_names[i]))
+				break;
+		}
+		ut_assert(i < TFTP_PROBE_TEST_NAMES);
+		ut_assert(!srv->client_port[i]);
+		srv->client_port[i] = port;
+
+		switch (i) {
+		case 0:
+			srv->deferred = true;
+			break;
+		case 1:
+			sb_tftp_probe_error(dev, port);
+			break;
+		default:
+			sb_tftp_probe_block(dev, port, 1);
+			break;
+		}
+		/* The first name turns out to be missing after all */
+		if (i == TFTP_PROBE_TEST_NAMES - 1 && srv->deferred) {
+			sb_tftp_probe_error(dev, srv->client_port[0]);
+			srv->deferred = false;
+		}
+		return 0;
+	}
+
+	ut_asserteq(TFTP_TEST_SRC_PORT, ntohs(ip->udp_dst));
+	for (i = 0; i < TFTP_PROBE_TEST_NAMES; i++) {
+		if (srv->client_port[i] == port)
+			break;
+	}
+	ut_assert(i < TFTP_PROBE_TEST_NAMES);
+
+	switch (opcode) {
+	case 4:		/* ACK */
+		ut_asserteq(2, i);
+		block = ntohs(*(__be16 *)(data + 2));
+		if (block * TFTP_TEST_BLKSIZE > TFTP_PROBE_TEST_SIZE)
+			srv->done = true;
+		else
+			sb_tftp_probe_block(dev, port, block + 1);
+		break;
+	case 5:		/* ERROR */
+		srv->aborted |= 1 << i;
+		break;
+	default:
+		ut_assertf(false, "unexpected TFTP opcode %d\n", opcode);
+	}
+
+	return 0;
+}
+
+static int _dm_test_eth_tftp_probe(struct unit_test_state *uts,
+				   struct sb_tftp_probe_server *srv)
+{
+	u8 *buf;
+	int i;
+
+	env_set("ethact", "eth@10002000");
+	env_set("serverip", "1.1.2.2");
+	image_load_addr = TFTP_TEST_ADDR;
+
+	srv->uts = uts;
+	sandbox_eth_set_priv(0, srv);
+	ut_asserteq(-EINVAL, tftp_probe(sb_tftp_probe_names, 0));
+	ut_asserteq(2, tftp_probe(sb_tftp_probe_names,
+				  TFTP_PROBE_TEST_NAMES));
+	ut_asserteq(TFTP_PROBE_TEST_SIZE, net_boot_file_size);
+
+	/* Every name was asked for, and the files found later were refused */
+	for (i = 0; i < TFTP_PROBE_TEST_NAMES; i++)
+		ut_assert(srv->client_port[i]);
+	ut_assert(srv->done);
+	ut_asserteq(1 << 3 | 1 << 4, srv->aborted);
+
+	buf = map_sysmem(TFTP_TEST_ADDR, TFTP_PROBE_TEST_SIZE);
+	for (i = 0; i < TFTP_PROBE_TEST_SIZE; i++)
+		ut_asserteq(sb_tftp_file_byte(i), buf[i]);
+	unmap_sysmem(buf);
+
+	return 0;
+}
+
+static int dm_test_eth_tftp_probe(struct unit_test_state *uts)
+{
+	struct sb_tftp_probe_server srv = {};
+	int retval;
+
+	sandbox_eth_set_tx_handler(0, sb_tftp_probe_handler);
+	retval = _dm_test_eth_tftp_probe(uts, &srv);
+
+	/* Restore the env */
+	sandbox_eth_set_tx_handler(0, NULL);
+	sandbox_eth_set_priv(0, NULL);
+	env_set("serverip", NULL);
+
+	return retval;
+}
+DM_TEST(dm_test_eth_tftp_probe, DM_TESTF_SCAN_FDT);
+#endif
+
+#if defined(CONFIG_CMD_NFS)
+#define NFS_TEST_BLKSIZE	1024
+#define NFS_TEST_SIZE		(10 * NFS_TEST_BLKSIZE + 300)
+#define NFS_TEST_MOUNT_PORT	635
+#define NFS_TEST_NFS_PORT	2049
+
+/* State of the fake NFSv2 server */
+struct sb_nfs_server {
+	struct unit_test_state *uts;
+	u16 client_port;
+	int hold;		/* offset answered after the next READ, once */
+	int drop;		/* offset whose READ is lost, once */
+	bool held;		/* a READ is waiting for its reply */
+	u32 held_xid;
+	int held_offset;
+	int held_count;
+	int max_queued;		/* most replies queued when a READ arrives */
+	bool done;		/* the client unmounted */
+};
+
+/* Send an RPC reply whose @words words of results are already in @buf */
+static void sb_nfs_reply(struct udevice *dev, struct sb_nfs_server *srv,
+			 __be32 *buf, u32 xid, int words)
+{
+	buf[0] = htonl(xid);
+	buf[1] = htonl(1);	/* MSG_REPLY */
+	buf[2] = 0;		/* accepted */
+	buf[3] = 0;		/* no verifier */
+	buf[4] = 0;
+	buf[5] = 0;		/* success */
+	/* The client does not check the port replies come from */
+	sb_tftp_send(dev, net_ip, srv->client_port, buf, (6 + words) * 4);
+}
+
+static void sb_nfs_read_reply(struct udevice *dev, struct sb_nfs_server *srv,
+			      u32 xid, int offset, int count)
+{
+	__be32 buf[6 + 19 + NFS_TEST_BLKSIZE / 4];
+	u8 *data = (u8 *)&buf[6 + 19];
+	int i;
+
+	count = clamp(NFS_TEST_SIZE - offset, 0, count);
+	/* Status and attributes, then the count and the data */
+	memset(buf + 6, '\0', 18 * sizeof(*buf));
+	buf[6 + 18] = htonl(count);
+	for (i = 0; i < count; i++)
+		data[i] = sb_tftp_file_byte(offset + i);
+	sb_nfs_reply(dev, srv, buf, xid, 19 + DIV_ROUND_UP(count, 4));
+}
+
+static int sb_nfs_handler(struct udevice *dev, void *packet,
+			  unsigned int len)
+{
+	struct eth_sandbox_priv *priv = dev_get_priv(dev);
+	struct sb_nfs_server *srv = priv->priv;
+	struct ethernet_hdr *eth = packet;
+	struct ip_udp_hdr *ip = packet + ETHER_HDR_SIZE;
+	struct unit_test_state *uts = srv->uts;
+	__be32 *call = (void *)ip + IP_UDP_HDR_SIZE;
+	__be32 buf[6 + 9];
+	int offset, count;
+	u32 xid, prog, proc;
+
+	if (!sandbox_eth_arp_req_to_reply(dev, packet, len))
+		return 0;
+	if (ntohs(eth->et_protlen) != PROT_IP || ip->ip_p != IPPROTO_UDP)
+		return 0;
+
+	srv->client_port = ntohs(ip->udp_src);
+	xid = ntohl(call[0]);
+	ut_asserteq(0, ntohl(call[1]));	/* MSG_CALL */
+	prog = ntohl(call[3]);
+	proc = ntohl(call[5]);
+	memset(buf, '\0', sizeof(buf));
+
+	switch (prog) {
+	case 100000:	/* PORTMAP */
+		ut_asserteq(111, ntohs(ip->udp_dst));
+		ut_asserteq(3, proc);	/* GETPORT */
+		buf[6] = htonl(ntohl(call[6 + 4]) == 100005 ?
+			       NFS_TEST_MOUNT_PORT : NFS_TEST_NFS_PORT);
+		sb_nfs_reply(dev, srv, buf, xid, 1);
+		break;
+	case 100005:	/* MOUNT */
+		ut_asserteq(NFS_TEST_MOUNT_PORT, ntohs(ip->udp_dst));
+		if (proc == 4)		/* UMOUNTALL */
+			srv->done = true;
+		else
+			ut_asserteq(1, proc);	/* MNT */
+		/* Status and an all-zero file handle */
+		sb_nfs_reply(dev, srv, buf, xid, 9);
+		break;
+	case 100003:	/* NFS */
+		ut_asserteq(NFS_TEST_NFS_PORT, ntohs(ip->udp_dst));
+		ut_asserteq(2, ntohl(call[4]));
+		if (proc == 4) {	/* LOOKUP */
+			sb_nfs_reply(dev, srv, buf, xid, 9);
+			break;
+		}
+		ut_asserteq(6, proc);	/* READ */
+
+		/* These follow the credentials and the file handle */
+		offset = ntohl(call[6 + 17]);
+		count = ntohl(call[6 + 18]);
+		ut_assert(count <= NFS_TEST_BLKSIZE);
+		srv->max_queued = max(srv->max_queued, priv->recv_packets);
+		if (offset == srv->drop) {
+			/* Let the client time out once it has nothing else */
+			srv->drop = -1;
+			sandbox_eth_skip_timeout();
+			break;
+		}
+		if (offset == srv->hold) {
+			srv->hold = -1;
+			srv->held = true;
+			srv->held_xid = xid;
+			srv->held_offset = offset;
+			srv->held_count = count;
+			break;
+		}
+		sb_nfs_read_reply(dev, srv, xid, offset, count);
+		if (srv->held) {
+			srv->held = false;
+			sb_nfs_read_reply(dev, srv, srv->held_xid,
+					  srv->held_offset, srv->held_count);
+		}
+		break;
+	default:
+		ut_assertf(false, "unexpected RPC program %u\n", prog);
+	}
+
+	return 0;
+}
+
+static int _dm_test_eth_nfs_window(struct unit_test_state *uts,
+				   struct sb_nfs_server *srv)
+{
+	u8 *buf;
+	int i;
+
+	env_set("ethact", "eth@10002000");
+	env_set("serverip", "1.1.2.2");
+	env_set("nfswindowsize", "4");
+	image_load_addr = TFTP_TEST_ADDR;
+	strcpy(net_boot_file_name, "/export/test.bin");
+
+	/*
+	 * The reply to the third READ comes after the one to the fourth, and
+	 * the sixth READ is lost, so that the client has to send it again
+	 */
+	srv->uts = uts;
+	srv->hold = 2 * NFS_TEST_BLKSIZE;
+	srv->drop = 5 * NFS_TEST_BLKSIZE;
+	sandbox_eth_set_priv(0, srv);
+	ut_asserteq(NFS_TEST_SIZE, net_loop(NFS));
+	ut_assert(srv->done);
+	ut_asserteq(-1, srv->hold);
+	ut_asserteq(-1, srv->drop);
+	ut_assert(!srv->held);
+
+	/* The client had several READs outstanding */
+	ut_assert(srv->max_queued > 1);
+
+	buf = map_sysmem(TFTP_TEST_ADDR, NFS_TEST_SIZE);
+	for (i = 0; i < NFS_TEST_SIZE; i++)
+		ut_asserteq(sb_tftp_file_byte(i), buf[i]);
+	unmap_sysmem(buf);
+
+	return 0;
+}
+
+static int dm_test_eth_nfs_window(struct unit_test_state *uts)
+{
+	struct sb_nfs_server srv = {};
+	int retval;
+
+	sandbox_eth_set_tx_handler(0, sb_nfs_handler);
+	retval = _dm_test_eth_nfs_window(uts, &srv);
+
+	/* Restore the env */
+	sandbox_eth_set_tx_handler(0, NULL);
+	sandbox_eth_set_priv(0, NULL);
+	env_set("serverip", NULL);
+	env_set("nfswindowsize", NULL);
+
+	return retval;
+}
+DM_TEST(dm_test_eth_nfs_window, DM_TESTF_SCAN_FDT);
+#endif
+
+#if defined(CONFIG_DHCP_REBOOT)
+/* Offsets in a BOOTP message of the fields the fake DHCP server uses */
+#define SB_BOOTP_OP		0
+#define SB_BOOTP_YIADDR		16
+#define SB_BOOTP_OPTIONS	240	/* after the magic cookie */
+#define SB_BOOTP_LEN		(SB_BOOTP_OPTIONS + 64)
+
+struct sb_dhcp_server {
+	struct unit_test_state *uts;
+	struct in_addr server;	/* server identifier */
+	struct in_addr lease;	/* address the server gives us */
+	int discovers;		/* number of DHCPDISCOVERs received */
+	int reboots;		/* number of DHCPREQUESTs for a previous lease */
+};
+
+/* Find DHCP option @code in a message, returning NULL if it is not there */
+static const u8 *sb_dhcp_option(const u8 *msg, int len, int code)
+{
+	const u8 *opt = msg + SB_BOOTP_OPTIONS, *end = msg + len;
+
+	while (opt < end && *opt != 0xff) {
+		if (*opt == code)
+			return opt;
+		opt += *opt ? opt[1] + 2 : 1;
+	}
+
+	return NULL;
+}
+
+/* Reply to the request @msg with a DHCP message of type @type */
+static void sb_dhcp_reply(struct udevice *dev, struct sb_dhcp_server *srv,
+			  const u8 *msg, int type)
+{
+	struct eth_sandbox_priv *priv = dev_get_priv(dev);
+	struct ethernet_hdr *eth;
+	struct ip_udp_hdr *ip;
+	struct in_addr bcast_ip;
+	u8 *reply, *opt;
+
+	eth = sandbox_eth_recv_slot(dev);
+	if (!eth)
+		return;
+
+	memcpy(eth->et_dest, net_ethaddr, ARP_HLEN);
+	memcpy(eth->et_src, priv->fake_host_hwaddr, ARP_HLEN);
+	eth->et_protlen = htons(PROT_IP);
+
+	ip = (void *)eth + ETHER_HDR_SIZE;
+	bcast_ip.s_addr = 0xffffffff;
+	net_set_ip_header((uchar *)ip, bcast_ip, srv->server,
+			  IP_UDP_HDR_SIZE + SB_BOOTP_LEN, IPPROTO_UDP);
+	ip->udp_src = htons(67);
+	ip->udp_dst = htons(68);
+	ip->udp_len = htons(UDP_HDR_SIZE + SB_BOOTP_LEN);
+	ip->udp_xsum = 0;
+
+	/* Start from the request, for its ID and hardware address */
+	reply = (u8 *)ip + IP_UDP_HDR_SIZE;
+	memcpy(reply, msg, SB_BOOTP_OPTIONS);
+	reply[SB_BOOTP_OP] = 2;		/* BOOTREPLY */
+	memset(reply + SB_BOOTP_YIADDR, '\0', 4);
+	if (type != 6)			/* DHCPNAK */
+		net_write_ip(reply + SB_BOOTP_YIADDR, srv->lease);
+
+	opt = reply + SB_BOOTP_OPTIONS;
+	memset(opt, '\0', SB_BOOTP_LEN - SB_BOOTP_OPTIONS);
+	*opt++ = 53;			/* DHCP Message Type */
+	*opt++ = 1;
+	*opt++ = type;
+	*opt++ = 54;			/* Server Identifier */
+	*opt++ = 4;
+	net_write_ip(opt, srv->server);
+	opt += 4;
+	if (type != 6) {
+		*opt++ = 51;		/* Lease Time */
+		*opt++ = 4;
+		put_unaligned_be32(3600, opt);
+		opt += 4;
+	}
+	*opt = 0xff;
+
+	sandbox_eth_recv_commit(dev, ETHER_HDR_SIZE + IP_UDP_HDR_SIZE +
+				SB_BOOTP_LEN);
+}
+
+static int sb_dhcp_handler(struct udevice *dev, void *packet,
+			   unsigned int len)
+{
+	struct eth_sandbox_priv *priv = dev_get_priv(dev);
+	struct sb_dhcp_server *srv = priv->priv;
+	struct unit_test_state *uts = srv->uts;
+	struct ethernet_hdr *eth = packet;
+	struct ip_udp_hdr *ip = packet + ETHER_HDR_SIZE;
+	const u8 *msg = (u8 *)ip + IP_UDP_HDR_SIZE;
+	int msg_len = ntohs(ip->udp_len) - UDP_HDR_SIZE;
+	const u8 *type, *req_ip;
+
+	if (ntohs(eth->et_protlen) != PROT_IP || ip->ip_p != IPPROTO_UDP ||
+	    ntohs(ip->udp_dst) != 67)
+		return 0;
+
+	type = sb_dhcp_option(msg, msg_len, 53);
+	ut_assert(type);
+	switch (type[2]) {
+	case 1:		/* DHCPDISCOVER */
+		srv->discovers++;
+		sb_dhcp_reply(dev, srv, msg, 2);
+		break;
+	case 3:		/* DHCPREQUEST */
+		req_ip = sb_dhcp_option(msg, msg_len, 50);
+		ut_assert(req_ip);
+		if (sb_dhcp_option(msg, msg_len, 54)) {
+			/* Accepting our offer */
+			ut_asserteq(srv->lease.s_addr,
+				    net_read_ip((void *)(req_ip + 2)).s_addr);
+			sb_dhcp_reply(dev, srv, msg, 5);
+			break;
+		}
+
+		/* Asking for a previous lease, which is only ours if it is */
+		srv->reboots++;
+		if (net_read_ip((void *)(req_ip + 2)).s_addr ==
+		    srv->lease.s_addr)
+			sb_dhcp_reply(dev, srv, msg, 5);
+		else
+			sb_dhcp_reply(dev, srv, msg, 6);
+		break;
+	default:
+		ut_assertf(false, "unexpected DHCP message %d\n", type[2]);
+	}
+
+	return 0;
+}
+
+static int _dm_test_eth_dhcp_reboot(struct unit_test_state *uts,
+				    struct sb_dhcp_server *srv)
+{
+	env_set("ethact", "eth@10002000");
+	env_set("autoload", "no");
+	srv->uts = uts;
+	srv->server = string_to_ip("1.1.2.2");
+	srv->lease = string_to_ip("1.1.2.7");
+	sandbox_eth_set_priv(0, srv);
+
+	/* The previous lease is confirmed without a DHCPDISCOVER */
+	env_set("dhcplease", "1.1.2.7");
+	ut_assert(net_loop(DHCP) >= 0);
+	ut_asserteq(srv->lease.s_addr, net_ip.s_addr);
+	ut_asserteq(1, srv->reboots);
+	ut_asserteq(0, srv->discovers);
+
+	/* A lease the server refuses is forgotten, then replaced */
+	env_set("dhcplease", "1.1.2.9");
+	ut_assert(net_loop(DHCP) >= 0);
+	ut_asserteq(srv->lease.s_addr, net_ip.s_addr);
+	ut_asserteq(2, srv->reboots);
+	ut_asserteq(1, srv->discovers);
+	ut_asserteq_str("1.1.2.7", env_get("dhcplease"));
+
+	/* Without a lease there is only the full exchange */
+	env_set("dhcplease", NULL);
+	ut_assert(net_loop(DHCP) >= 0);
+	ut_asserteq(2, srv->reboots);
+	ut_asserteq(2, srv->discovers);
+
+	return 0;
+}
+
+static int dm_test_eth_dhcp_reboot(struct unit_test_state *uts)
+{
+	struct sb_dhcp_server srv = {};
+	struct in_addr old_ip = net_ip;
+	int retval;
+
+	sandbox_eth_set_tx_handler(0, sb_dhcp_handler);
+	retval = _dm_test_eth_dhcp_reboot(uts, &srv);
+
+	/* Restore the env */
+	sandbox_eth_set_tx_handler(0, NULL);
+	sandbox_eth_set_priv(0, NULL);
+	env_set("autoload", NULL);
+	env_set("dhcplease", NULL);
+	net_ip = old_ip;
+
+	return retval;
+}
+DM_TEST(dm_test_eth_dhcp_reboot, DM_TESTF_SCAN_FDT);
+#endif
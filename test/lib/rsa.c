@@ -129,6 +129,195 @@ unsigned char data_enc[] = {
 
 static unsigned int data_enc_len = 256;
 
+/*
+ * openssl genrsa -out private3072.pem 3072
+ * openssl rsa -in private3072.pem -pubout -outform der -out public3072.der
+ * dd if=public3072.der of=public3072.raw bs=24 skip=1
+ */
+static unsigned char public_key_3072[] = {
+	0x30, 0x82, 0x01, 0x8a, 0x02, 0x82, 0x01, 0x81, 0x00, 0xc2, 0x4e, 0xac,
+	0x9d, 0xa5, 0x91, 0x67, 0x16, 0x3e, 0x85, 0x11, 0x17, 0x0e, 0xf8, 0x10,
+	0xdb, 0x3c, 0x6a, 0x7b, 0x16, 0x86, 0x9b, 0x23, 0xb5, 0x55, 0x4e, 0x09,
+	0x7c, 0x8d, 0xc6, 0x67, 0x5d, 0xe9, 0x16, 0x18, 0xb1, 0xee, 0x3c, 0x62,
+	0x08, 0xc8, 0xa5, 0x3a, 0xcc, 0x99, 0xbc, 0x3a, 0x1c, 0x58, 0xe9, 0x1e,
+	0x82, 0x4c, 0x40, 0x03, 0xbc, 0x78, 0xf7, 0x2e, 0x96, 0xf9, 0x00, 0x71,
+	0x70, 0x7b, 0xa2, 0x10, 0x68, 0x41, 0x43, 0x22, 0xa3, 0xff, 0xed, 0xbb,
+	0x50, 0x31, 0x1f, 0x3b, 0x09, 0x04, 0x22, 0xf0, 0x5c, 0x9c, 0xde, 0x0e,
+	0x49, 0x4c, 0xd4, 0x3b, 0x14, 0xa3, 0x80, 0x15, 0xab, 0xe0, 0xa0, 0xcc,
+	0x9b, 0xf3, 0xeb, 0xe3, 0x48, 0x60, 0x5b, 0xc4, 0x0d, 0xa9, 0x6b, 0xc4,
+	0xc5, 0x0a, 0xab, 0x82, 0x97, 0xea, 0x69, 0xf9, 0x3e, 0xb8, 0xd9, 0xa0,
+	0x78, 0x3f, 0x52, 0xbb, 0x35, 0x46, 0xb1, 0xa9, 0x82, 0xce, 0xf6, 0x94,
+	0xc9, 0x4c, 0x97, 0x1b, 0xcb, 0xcb, 0xc2, 0x1e, 0xc4, 0x50, 0x4f, 0x60,
+	0x3b, 0xfb, 0x21, 0xb1, 0x08, 0x59, 0x15, 0x78, 0xe4, 0x99, 0xed, 0xab,
+	0x4a, 0x88, 0xbc, 0xc1, 0x55, 0xb1, 0xc1, 0xbb, 0xaa, 0x67, 0x65, 0xa2,
+	0xa9, 0xbd, 0x04, 0x94, 0x99, 0xa6, 0xce, 0x1e, 0x87, 0x36, 0xc2, 0xe2,
+	0x5f, 0x42, 0x3c, 0x7d, 0xc6, 0x4e, 0xcf, 0x7e, 0x21, 0xe6, 0x8b, 0x96,
+	0x39, 0x18, 0x7b, 0x27, 0x25, 0x76, 0x8b, 0x96, 0x8b, 0x0a, 0x9c, 0x4b,
+	0xa1, 0x82, 0xb2, 0x71, 0xad, 0xb0, 0x1f, 0x62, 0x65, 0x29, 0x48, 0xe5,
+	0x3f, 0x40, 0x5c, 0xab, 0xd6, 0x77, 0xf8, 0x8d, 0xa0, 0x00, 0x81, 0x85,
+	0xea, 0x79, 0x8a, 0xf6, 0x6d, 0x40, 0x59, 0x40, 0xeb, 0x75, 0x79, 0x1d,
+	0x26, 0x94, 0x10, 0x1d, 0x13, 0x39, 0x1d, 0x66, 0x8b, 0x22, 0xdb, 0xd0,
+	0x0c, 0x88, 0x21, 0xf6, 0xa5, 0x95, 0xd6, 0xe9, 0xb3, 0xc3, 0x67, 0x47,
+	0x37, 0x2b, 0x4c, 0xdf, 0x00, 0x05, 0x7a, 0x11, 0xd1, 0x88, 0x86, 0x55,
+	0xad, 0x3e, 0xad, 0xfe, 0xee, 0x44, 0x0c, 0xfd, 0x4e, 0x9a, 0xdb, 0xb6,
+	0xda, 0x62, 0x00, 0xe0, 0x8e, 0x59, 0x6f, 0x24, 0x8e, 0xb1, 0x2f, 0xc5,
+	0xc7, 0x29, 0x33, 0x47, 0xbd, 0xef, 0x73, 0xf7, 0x87, 0xa2, 0x9d, 0x3b,
+	0x01, 0xef, 0xd5, 0xd0, 0x1c, 0x65, 0x23, 0xac, 0x6e, 0x27, 0x1d, 0x29,
+	0xbc, 0x55, 0x15, 0x4e, 0x14, 0xa5, 0x38, 0x7f, 0x1e, 0x99, 0x64, 0x46,
+	0x55, 0xe8, 0x7f, 0x73, 0xcd, 0x01, 0x2b, 0x9f, 0x27, 0x91, 0x2d, 0xa3,
+	0xf9, 0x6d, 0xed, 0x54, 0x61, 0xa6, 0xc3, 0x39, 0xf9, 0x66, 0x89, 0x23,
+	0xe9, 0xce, 0xdb, 0xda, 0x74, 0x39, 0x10, 0x7c, 0x5d, 0x69, 0xad, 0x2c,
+	0xcc, 0x4d, 0xce, 0xc0, 0x79, 0x0b, 0xc5, 0x3b, 0xc5, 0x02, 0x03, 0x01,
+	0x00, 0x01
+};
+
+static unsigned int public_key_3072_len = 398;
+
+/*
+ * openssl dgst -sha256 -sign private3072.pem -out data3072.enc data.raw
+ */
+static unsigned char data_enc_3072[] = {
+	0x5f, 0x9b, 0x0b, 0x44, 0x8a, 0x8c, 0x68, 0x9a, 0xe2, 0xf6, 0xe2, 0xe9,
+	0xc0, 0x18, 0xdb, 0xce, 0x91, 0xd7, 0x5d, 0x63, 0x2d, 0xbb, 0x33, 0xb7,
+	0xee, 0x9e, 0x2c, 0xd4, 0x77, 0xa4, 0xaf, 0x56, 0x7c, 0xdc, 0xf6, 0x38,
+	0x19, 0x20, 0xe9, 0xea, 0xd6, 0xb0, 0x66, 0x1d, 0x33, 0x45, 0xa7, 0x03,
+	0x0d, 0x37, 0x71, 0xce, 0x67, 0x0f, 0xe0, 0x75, 0xae, 0xf6, 0x1a, 0x61,
+	0xcd, 0xa8, 0x41, 0x89, 0x12, 0x9d, 0x25, 0x39, 0xd9, 0x56, 0x39, 0xb1,
+	0x54, 0x9b, 0x81, 0x89, 0x31, 0x03, 0xe6, 0x9d, 0xeb, 0x60, 0x42, 0x2e,
+	0x8a, 0xdf, 0x4b, 0x8e, 0x5e, 0xc6, 0xed, 0xe5, 0xec, 0x4a, 0x6c, 0x02,
+	0xd6, 0x76, 0xa9, 0x54, 0x16, 0x4a, 0x92, 0x76, 0x2d, 0x4e, 0x16, 0x5f,
+	0x38, 0xe1, 0x97, 0x0d, 0x53, 0x62, 0x88, 0xa4, 0xdc, 0xfa, 0x53, 0x02,
+	0x01, 0xfb, 0x70, 0x51, 0xb9, 0x2c, 0xa3, 0x8b, 0xc5, 0xc2, 0xff, 0x86,
+	0x71, 0x93, 0x57, 0x22, 0x66, 0xc3, 0x26, 0xb0, 0x83, 0x8a, 0xa3, 0x1e,
+	0x82, 0x79, 0xc6, 0xeb, 0x4d, 0x9f, 0x3c, 0x95, 0xeb, 0x97, 0x22, 0x7a,
+	0xef, 0xdf, 0x25, 0xdd, 0xd3, 0xfb, 0x6e, 0xe2, 0xe9, 0xf1, 0x0c, 0xfb,
+	0xb0, 0x11, 0x14, 0x9f, 0x92, 0xce, 0xd7, 0x92, 0x07, 0x83, 0x40, 0xe8,
+	0x71, 0xd3, 0xee, 0xc2, 0x2f, 0x6d, 0x84, 0x3f, 0x00, 0x8f, 0x52, 0x25,
+	0x0f, 0x26, 0xea, 0x52, 0x63, 0x38, 0xdb, 0xd4, 0xa3, 0x96, 0x4d, 0x72,
+	0x78, 0x34, 0x37, 0x18, 0x62, 0xd8, 0x4c, 0xa6, 0x53, 0x0a, 0x15, 0x69,
+	0x12, 0x61, 0x59, 0xf2, 0xf4, 0x38, 0xf5, 0x10, 0xef, 0x24, 0x68, 0x64,
+	0xa6, 0x0e, 0x69, 0x28, 0xd0, 0xb1, 0x5d, 0x9f, 0xde, 0x53, 0x76, 0xab,
+	0x23, 0xa1, 0x50, 0x88, 0x80, 0xdf, 0xe6, 0x27, 0x1d, 0x5f, 0xe2, 0x4b,
+	0x6a, 0x53, 0xa2, 0x65, 0x69, 0x04, 0x42, 0xd4, 0x99, 0xbd, 0xa8, 0xfb,
+	0x3e, 0x76, 0xab, 0x1f, 0xba, 0x35, 0x98, 0x46, 0x8c, 0x24, 0x8e, 0x6e,
+	0x03, 0x3b, 0xd8, 0xa9, 0x06, 0x25, 0x60, 0x82, 0x13, 0x95, 0xcd, 0xf5,
+	0xfd, 0x8b, 0xd9, 0x6c, 0x44, 0x2f, 0x41, 0xff, 0xc5, 0x3b, 0x63, 0xdc,
+	0x0c, 0x90, 0x17, 0x96, 0xa7, 0xd7, 0x36, 0xe0, 0x56, 0xfc, 0xee, 0xaf,
+	0xfc, 0x5c, 0x9f, 0xb7, 0x96, 0x99, 0x61, 0x12, 0xfc, 0xc0, 0x83, 0xcf,
+	0x73, 0x2d, 0xed, 0x16, 0x4f, 0xeb, 0x7b, 0x1e, 0x71, 0x64, 0x00, 0x2e,
+	0x1b, 0xe7, 0x71, 0xdb, 0x58, 0x1e, 0x2a, 0x8e, 0x85, 0x4a, 0x06, 0x10,
+	0x56, 0x2f, 0x18, 0x34, 0xe2, 0x8e, 0x95, 0x2c, 0x8d, 0x5e, 0x2f, 0xa9,
+	0x53, 0xca, 0x9a, 0xd7, 0x70, 0x71, 0xcb, 0x2f, 0x32, 0x15, 0x50, 0xf4,
+	0x17, 0xdc, 0x88, 0x8d, 0xd6, 0xe1, 0x09, 0x19, 0x8b, 0x2a, 0x7d, 0x35
+};
+
+static unsigned int data_enc_3072_len = 384;
+
+/*
+ * openssl genrsa -out private4096.pem 4096
+ * openssl rsa -in private4096.pem -pubout -outform der -out public4096.der
+ * dd if=public4096.der of=public4096.raw bs=24 skip=1
+ */
+static unsigned char public_key_4096[] = {
+	0x30, 0x82, 0x02, 0x0a, 0x02, 0x82, 0x02, 0x01, 0x00, 0xaf, 0xac, 0x28,
+	0xbc, 0xd2, 0x44, 0xc6, 0x99, 0x46, 0x2b, 0x1f, 0xb4, 0xf9, 0x4c, 0xfa,
+	0x5e, 0xe2, 0x87, 0x68, 0x58, 0xd0, 0x1a, 0x18, 0xd7, 0x5f, 0xf2, 0xaa,
+	0x40, 0x9f, 0xb2, 0xa9, 0x35, 0xca, 0x08, 0x8d, 0xff, 0x0b, 0x18, 0xce,
+	0x88, 0x8c, 0x17, 0xbb, 0xf2, 0xe7, 0xaa, 0x61, 0x3b, 0x75, 0x1f, 0x62,
+	0x3a, 0x69, 0x36, 0x33, 0x4d, 0x22, 0x3c, 0x3f, 0x99, 0x8d, 0x63, 0x7e,
+	0xdd, 0xa5, 0xac, 0x02, 0xdb, 0x0d, 0x21, 0x4c, 0x46, 0x76, 0x50, 0xcb,
+	0x41, 0x7a, 0x95, 0xdf, 0xf9, 0xc5, 0x88, 0x61, 0x13, 0x4d, 0x90, 0x79,
+	0xef, 0x2f, 0xbd, 0xc2, 0x41, 0x21, 0x91, 0x4d, 0xe5, 0xce, 0x31, 0x90,
+	0x70, 0x11, 0x6c, 0x8f, 0xbe, 0x10, 0x0a, 0x01, 0xa1, 0x76, 0x30, 0xf2,
+	0xc0, 0xf7, 0xc6, 0x6b, 0xc8, 0x60, 0x82, 0x33, 0xaf, 0x6b, 0xe3, 0x39,
+	0xd9, 0x37, 0xf8, 0xc1, 0x11, 0xf1, 0x81, 0x4d, 0x0b, 0xaf, 0x70, 0x60,
+	0x3c, 0x12, 0x8a, 0x50, 0x0c, 0xcf, 0x0a, 0x6b, 0x4c, 0x21, 0xe9, 0x39,
+	0xc5, 0xaa, 0x56, 0x49, 0xe6, 0xa4, 0x24, 0x1c, 0x6f, 0x70, 0x03, 0x4a,
+	0xaa, 0xdf, 0x06, 0x2a, 0xbe, 0x6e, 0xf1, 0x60, 0xa9, 0xd2, 0x9a, 0xde,
+	0xf5, 0x0a, 0x30, 0x49, 0x3d, 0x47, 0x4f, 0x8a, 0x3b, 0x85, 0x83, 0xd1,
+	0xb1, 0x71, 0x94, 0x92, 0x57, 0x6f, 0x56, 0x44, 0x2a, 0xdf, 0x0e, 0xad,
+	0xc4, 0x99, 0x68, 0x7f, 0x37, 0x46, 0x94, 0x4e, 0x73, 0x0c, 0x20, 0x9f,
+	0x8c, 0x3c, 0x52, 0x62, 0xb9, 0x26, 0xc7, 0x0e, 0xac, 0x5b, 0x44, 0x73,
+	0x76, 0x6d, 0x57, 0xbd, 0x12, 0xa8, 0x1c, 0x49, 0x12, 0x4a, 0xe7, 0x2b,
+	0xf7, 0x09, 0xf1, 0x02, 0x2a, 0x5c, 0xe0, 0xb0, 0x71, 0xb4, 0x0c, 0x62,
+	0xac, 0x81, 0xc4, 0x22, 0x11, 0x46, 0x24, 0xf8, 0x44, 0x11, 0x3b, 0xc6,
+	0x16, 0x1c, 0x7a, 0xed, 0xd1, 0xd4, 0x9a, 0x85, 0x09, 0x43, 0x5b, 0x8c,
+	0x92, 0xb7, 0x12, 0x6c, 0xfd, 0xd5, 0x9d, 0x2a, 0xa3, 0xfc, 0xf5, 0xad,
+	0x6e, 0x87, 0x64, 0x0b, 0x36, 0x04, 0x12, 0xa8, 0x7d, 0x7f, 0x51, 0x71,
+	0xc9, 0xda, 0x3c, 0xa2, 0x76, 0xde, 0x34, 0x82, 0x6d, 0x50, 0xea, 0xf1,
+	0xc7, 0x3a, 0x11, 0x7d, 0x23, 0xda, 0xf7, 0xa6, 0x34, 0x0e, 0x10, 0x46,
+	0x80, 0x14, 0x8c, 0x79, 0x6d, 0x22, 0xd1, 0xae, 0x9f, 0x07, 0xc6, 0x1f,
+	0xef, 0xbd, 0xba, 0xd0, 0x4b, 0x72, 0xda, 0xb5, 0x66, 0xdf, 0x11, 0x92,
+	0x91, 0x35, 0x3b, 0x7f, 0x5f, 0xbf, 0x1e, 0x4c, 0x60, 0x97, 0xc7, 0x92,
+	0x57, 0x15, 0x95, 0xbf, 0x4b, 0xa1, 0x81, 0x89, 0xb1, 0x06, 0xf3, 0x93,
+	0xe6, 0x4c, 0x8c, 0xa9, 0xeb, 0xec, 0x04, 0x0c, 0xbf, 0x4d, 0x28, 0x06,
+	0xb6, 0xc0, 0x96, 0xbd, 0x2d, 0xaa, 0x71, 0xd7, 0x14, 0x87, 0x3d, 0x53,
+	0x22, 0x6c, 0xd0, 0x97, 0xd0, 0xf5, 0x9e, 0x87, 0x34, 0x2a, 0x1b, 0x45,
+	0xc6, 0xe1, 0x0a, 0x15, 0xd5, 0x49, 0x4b, 0xee, 0x5a, 0xf5, 0x72, 0x93,
+	0x30, 0xa3, 0xc2, 0xfd, 0xe7, 0xe7, 0x16, 0xec, 0x28, 0x31, 0x90, 0x1b,
+	0x4f, 0xe1, 0x05, 0xbc, 0x2b, 0x13, 0xb4, 0x6e, 0xfe, 0xd3, 0x5a, 0x75,
+	0x6c, 0x5e, 0x10, 0xa3, 0x07, 0x83, 0x25, 0x14, 0xf6, 0x74, 0x02, 0x57,
+	0xd7, 0x52, 0x3a, 0x15, 0xa4, 0x03, 0xf4, 0xf0, 0x4d, 0xe6, 0x29, 0x9a,
+	0x88, 0xa0, 0xe2, 0x6a, 0x5c, 0x72, 0x6c, 0xab, 0xba, 0xf3, 0xad, 0xdb,
+	0x32, 0xd5, 0x22, 0xf8, 0xde, 0x11, 0xa8, 0x74, 0x52, 0x3f, 0xf1, 0x16,
+	0x83, 0x16, 0xa7, 0x72, 0xe8, 0x27, 0x61, 0xb4, 0x76, 0x69, 0x49, 0x69,
+	0x16, 0x76, 0xc4, 0x40, 0x5f, 0x82, 0x01, 0x02, 0x45, 0xf5, 0x04, 0xdc,
+	0x9f, 0x87, 0x51, 0xb7, 0x27, 0x02, 0x03, 0x01, 0x00, 0x01
+};
+
+static unsigned int public_key_4096_len = 526;
+
+/*
+ * openssl dgst -sha256 -sign private4096.pem -out data4096.enc data.raw
+ */
+static unsigned char data_enc_4096[] = {
+	0x04, 0x8d, 0x2a, 0x23, 0xd1, 0xfa, 0xf5, 0x96, 0xe7, 0x58, 0x83, 0xeb,
+	0xa9, 0x28, 0x48, 0xfa, 0x35, 0xc6, 0x06, 0x14, 0xa6, 0x2a, 0xbb, 0xaa,
+	0x14, 0x38, 0x69, 0xa2, 0x89, 0x99, 0xee, 0xac, 0x2f, 0xae, 0x9e, 0xd6,
+	0x72, 0x7a, 0xe3, 0xb9, 0x61, 0x6e, 0xba, 0x22, 0xc8, 0xce, 0x37, 0x52,
+	0x7e, 0x98, 0x23, 0x7b, 0x0c, 0xa2, 0xf3, 0x2d, 0x44, 0x0b, 0x09, 0x5b,
+	0xc2, 0x6d, 0xda, 0xd1, 0x05, 0xba, 0x2a, 0x52, 0xfa, 0x72, 0xf8, 0x4c,
+	0x02, 0x35, 0x1b, 0x05, 0x4c, 0x77, 0xe7, 0xd4, 0x9b, 0xb7, 0xae, 0x85,
+	0x8a, 0xd6, 0xde, 0x23, 0x22, 0x80, 0xa6, 0x71, 0x58, 0xaa, 0xa4, 0xc2,
+	0xb1, 0xff, 0x2d, 0xe6, 0xec, 0x11, 0x38, 0xe5, 0xb3, 0xb5, 0xd6, 0xc9,
+	0x5a, 0xa5, 0xca, 0x33, 0x7e, 0x42, 0x1b, 0x1a, 0xcd, 0x9b, 0xdb, 0xca,
+	0xc8, 0x61, 0xc6, 0x57, 0x2c, 0x84, 0xc5, 0xab, 0xcc, 0xf1, 0x6e, 0x49,
+	0xb8, 0x9c, 0x9b, 0x1e, 0x66, 0xe7, 0xc9, 0xeb, 0xd6, 0x45, 0xc7, 0x4e,
+	0xea, 0xd1, 0xec, 0x46, 0x56, 0xef, 0x3b, 0x28, 0xdb, 0xab, 0xfb, 0x51,
+	0x5f, 0x07, 0xe6, 0x33, 0x49, 0x52, 0xc0, 0xbe, 0xb0, 0xf8, 0xc3, 0xe9,
+	0x02, 0xc8, 0xb6, 0x2c, 0x5f, 0xc9, 0xd1, 0x27, 0x69, 0x5a, 0x1d, 0xe1,
+	0x9d, 0x26, 0x3c, 0x92, 0x25, 0x0d, 0xe6, 0xc0, 0xdc, 0x92, 0xb3, 0xf3,
+	0x12, 0xf7, 0x79, 0x0a, 0xb7, 0xb2, 0xbf, 0x6e, 0x17, 0x46, 0x4f, 0x01,
+	0xf0, 0x78, 0x1f, 0x9f, 0x8b, 0x25, 0xce, 0x94, 0xe1, 0xfe, 0x4e, 0x0f,
+	0xff, 0xa7, 0x01, 0x84, 0x24, 0x6b, 0xb6, 0xb5, 0x12, 0x95, 0x21, 0x59,
+	0xa2, 0xef, 0x22, 0x01, 0x6b, 0x04, 0xb1, 0x5b, 0x85, 0xc4, 0x98, 0x7e,
+	0x7c, 0x05, 0xe6, 0x63, 0xbd, 0x92, 0x95, 0x81, 0xa1, 0xf0, 0xb1, 0xeb,
+	0x32, 0x33, 0xb1, 0x69, 0x37, 0xa3, 0x5a, 0x10, 0xd2, 0xdf, 0x3e, 0x61,
+	0x1d, 0x4b, 0xab, 0xfe, 0x21, 0x5b, 0xc0, 0x1b, 0xc7, 0xbc, 0x2e, 0x8d,
+	0xf3, 0x39, 0xef, 0x2c, 0x9e, 0x00, 0xba, 0x11, 0xf7, 0x6b, 0xcd, 0x32,
+	0xc1, 0x58, 0x7f, 0x86, 0x3b, 0x05, 0x81, 0x78, 0x49, 0x8a, 0xff, 0x4f,
+	0x96, 0x45, 0x2c, 0x96, 0x58, 0xda, 0x87, 0x36, 0xac, 0x96, 0xd4, 0x86,
+	0xca, 0x49, 0xe7, 0xe5, 0xdd, 0xa4, 0xa7, 0x57, 0xb5, 0x05, 0x21, 0xeb,
+	0x99, 0xa1, 0x5b, 0x83, 0xed, 0x46, 0xea, 0x04, 0x3c, 0xfd, 0xa9, 0x11,
+	0x50, 0x11, 0x40, 0xee, 0x08, 0x68, 0xc8, 0xa5, 0x95, 0xdb, 0xbb, 0xa3,
+	0x1f, 0x62, 0xfc, 0x30, 0x8f, 0x02, 0x18, 0x99, 0xa0, 0x70, 0x11, 0x3b,
+	0x82, 0xfd, 0x64, 0x5b, 0x1b, 0x68, 0xb6, 0xcf, 0xc8, 0x2f, 0x8e, 0x87,
+	0xe9, 0x6c, 0x2f, 0xff, 0xcc, 0x80, 0x73, 0x07, 0x92, 0x80, 0xff, 0xe7,
+	0x18, 0x9e, 0x65, 0x9b, 0x6d, 0x07, 0x64, 0x59, 0x05, 0x78, 0xca, 0x1d,
+	0x3a, 0x19, 0x90, 0xd4, 0xd1, 0x92, 0x82, 0x33, 0x97, 0x57, 0x79, 0x27,
+	0xcf, 0x0f, 0xc5, 0xbf, 0x30, 0xb1, 0xbe, 0x7d, 0xcc, 0x4e, 0x0a, 0x2f,
+	0x20, 0x78, 0x31, 0xc1, 0xc0, 0xc5, 0x1b, 0x28, 0x58, 0x1b, 0x69, 0x75,
+	0x5f, 0xc6, 0xa1, 0xc6, 0xc8, 0xca, 0x52, 0x03, 0x1f, 0xac, 0x05, 0x7b,
+	0x2c, 0x39, 0xec, 0xc2, 0x0e, 0xb5, 0x8a, 0x92, 0xcc, 0x64, 0x85, 0xf9,
+	0xf6, 0x84, 0x5a, 0xcf, 0xdd, 0xfb, 0xeb, 0x74, 0x13, 0xad, 0x58, 0x5a,
+	0x1f, 0xe9, 0x78, 0x99, 0x62, 0x31, 0x12, 0x1a, 0xb8, 0x6a, 0xb9, 0x63,
+	0x90, 0x9f, 0x1d, 0xb5, 0xad, 0x05, 0xa4, 0x1c, 0x51, 0xb2, 0x0c, 0xa2,
+	0xdd, 0xc1, 0x84, 0x10, 0xf5, 0x2e, 0xb7, 0xe2, 0x56, 0x11, 0x27, 0x6d,
+	0xac, 0xe9, 0x4d, 0x3c, 0xe0, 0x3f, 0x31, 0x96
+};
+
+static unsigned int data_enc_4096_len = 512;
+
 /**
  * lib_rsa_verify_valid() - unit test for rsa_verify()
  *
@@ -203,4 +392,133 @@ static int lib_rsa_verify_invalid(struct unit_test_state *uts)
 }
 
 LIB_TEST(lib_rsa_verify_invalid, 0);
+
+/**
+ * rsa_verify_sha256() - verify data_raw with a given key and signature
+ *
+ * @name:	Algorithm name, e.g. "sha256,rsa4096"
+ * @key:	Public key in DER format
+ * @key_len:	Length of @key
+ * @sig:	Signature
+ * @sig_len:	Length of @sig
+ * Return:	result of rsa_verify()
+ */
+static int rsa_verify_sha256(const char *name, unsigned char *key,
+			     unsigned int key_len, unsigned char *sig,
+			     unsigned int sig_len)
+{
+	struct image_sign_info info;
+	struct image_region reg;
+
+	memset(&info, '\0', sizeof(info));
+	info.name = name;
+	info.padding = image_get_padding_algo("pkcs-1.5");
+	info.checksum = image_get_checksum_algo(name);
+	info.crypto = image_get_crypto_algo(name);
+	if (!info.crypto)
+		return -ENOENT;
+
+	info.key = key;
+	info.keylen = key_len;
+
+	reg.data = data_raw;
+	reg.size = data_raw_len;
+
+	return rsa_verify(&info, &reg, 1, sig, sig_len);
+}
+
+/**
+ * lib_rsa_verify_3072() - unit test for rsa_verify() with a 3072-bit key
+ *
+ * @uts:	unit test state
+ * Return:	0 = success, 1 = failure
+ */
+static int lib_rsa_verify_3072(struct unit_test_state *uts)
+{
+	int ret;
+
+	ret = rsa_verify_sha256("sha256,rsa3072", public_key_3072,
+				public_key_3072_len, data_enc_3072,
+				data_enc_3072_len);
+	ut_assertf(ret == 0, "verification unexpectedly failed (%d)\n", ret);
+
+	return CMD_RET_SUCCESS;
+}
+
+LIB_TEST(lib_rsa_verify_3072, 0);
+
+/**
+ * lib_rsa_verify_4096() - unit test for rsa_verify() with a 4096-bit key
+ *
+ * @uts:	unit test state
+ * Return:	0 = success, 1 = failure
+ */
+static int lib_rsa_verify_4096(struct unit_test_state *uts)
+{
+	int ret;
+
+	ret = rsa_verify_sha256("sha256,rsa4096", public_key_4096,
+				public_key_4096_len, data_enc_4096,
+				data_enc_4096_len);
+	ut_assertf(ret == 0, "verification unexpectedly failed (%d)\n", ret);
+
+	/* A signature made with a different key must be rejected */
+	ret = rsa_verify_sha256("sha256,rsa4096", public_key_4096,
+				public_key_4096_len, data_enc_3072,
+				data_enc_3072_len);
+	ut_assertf(ret != 0, "verification unexpectedly succeeded\n");
+
+	return CMD_RET_SUCCESS;
+}
+
+LIB_TEST(lib_rsa_verify_4096, 0);
+
+#define RSA_BENCH_LOOPS		20
+
+/**
+ * lib_rsa_verify_bench() - measure rsa_verify() for each supported key size
+ *
+ * This reports the average time taken to verify a signature, which includes
+ * deriving the key properties from the DER-encoded public key.
+ *
+ * @uts:	unit test state
+ * Return:	0 = success, 1 = failure
+ */
+static int lib_rsa_verify_bench(struct unit_test_state *uts)
+{
+	struct {
+		const char *name;
+		unsigned char *key;
+		unsigned int key_len;
+		unsigned char *sig;
+		unsigned int sig_len;
+	} vecs[] = {
+		{ "sha256,rsa2048", public_key, public_key_len,
+		  data_enc, data_enc_len },
+		{ "sha256,rsa3072", public_key_3072, public_key_3072_len,
+		  data_enc_3072, data_enc_3072_len },
+		{ "sha256,rsa4096", public_key_4096, public_key_4096_len,
+		  data_enc_4096, data_enc_4096_len },
+	};
+	ulong start, delta;
+	int i, j;
+
+	for (i = 0; i < ARRAY_SIZE(vecs); i++) {
+		start = timer_get_us();
+		for (j = 0; j < RSA_BENCH_LOOPS; j++) {
+			ut_assertok(rsa_verify_sha256(vecs[i].name,
+						      vecs[i].key,
+						      vecs[i].key_len,
+						      vecs[i].sig,
+						      vecs[i].sig_len));
+		}
+		delta = timer_get_us() - start;
+		printf("%s: %lu us per verification\n", vecs[i].name,
+		       delta / RSA_BENCH_LOOPS);
+	}
+
+	return CMD_RET_SUCCESS;
+}
+
+LIB_TEST(lib_rsa_verify_bench, 0);
 #endif /* RSA_VERIFY_WITH_PKEY */
@@ -8,12 +8,30 @@ import pytest
 import re
 from subprocess import call, check_call, check_output, CalledProcessError
 from fstest_defs import *
+from fstest_helpers import md5sum
 
 supported_fs_basic = ['fat16', 'fat32', 'ext4']
 supported_fs_ext = ['fat16', 'fat32']
 supported_fs_mkdir = ['fat16', 'fat32']
 supported_fs_unlink = ['fat16', 'fat32']
 supported_fs_symlink = ['ext4']
+supported_fs_rofs = ['squashfs', 'erofs']
+supported_fs_frag = ['fat16', 'fat32']
+supported_fs_holes = ['ext4']
+
+# Read-only images: file system type, name, options for the tool making the
+# image and the option needed in U-Boot to read it, if any
+rofs_images = [
+    ('squashfs', 'gzip', '-comp gzip', 'gzip'),
+    ('squashfs', 'lzo', '-comp lzo', 'lzo'),
+    ('squashfs', 'lz4', '-comp lz4', 'lz4'),
+    ('squashfs', 'xz', '-comp xz', 'lzma_xz'),
+    ('squashfs', 'zstd', '-comp zstd', 'zstd'),
+    ('erofs', 'plain', '', None),
+    ('erofs', 'chunked', '--chunksize=65536', None),
+    ('erofs', 'lz4', '-zlz4', 'lz4'),
+    ('erofs', 'lz4hc', '-zlz4hc', 'lz4'),
+]
 
 #
 # Filesystem test specific setup
@@ -50,6 +68,9 @@ def pytest_configure(config):
     global supported_fs_mkdir
     global supported_fs_unlink
     global supported_fs_symlink
+    global supported_fs_rofs
+    global supported_fs_frag
+    global supported_fs_holes
 
     def intersect(listA, listB):
         return  [x for x in listA if x in listB]
@@ -62,6 +83,9 @@ def pytest_configure(config):
         supported_fs_mkdir =  intersect(supported_fs, supported_fs_mkdir)
         supported_fs_unlink =  intersect(supported_fs, supported_fs_unlink)
         supported_fs_symlink =  intersect(supported_fs, supported_fs_symlink)
+        supported_fs_rofs =  intersect(supported_fs, supported_fs_rofs)
+        supported_fs_frag =  intersect(supported_fs, supported_fs_frag)
+        supported_fs_holes =  intersect(supported_fs, supported_fs_holes)
 
 def pytest_generate_tests(metafunc):
     """Parametrize fixtures, fs_obj_xxx
@@ -90,6 +114,17 @@ def pytest_generate_tests(metafunc):
     if 'fs_obj_symlink' in metafunc.fixturenames:
         metafunc.parametrize('fs_obj_symlink', supported_fs_symlink,
             indirect=True, scope='module')
+    if 'fs_obj_rofs' in metafunc.fixturenames:
+        images = [img for img in rofs_images if img[0] in supported_fs_rofs]
+        metafunc.parametrize('fs_obj_rofs', images,
+            ids=['%s-%s' % (img[0], img[1]) for img in images],
+            indirect=True, scope='module')
+    if 'fs_obj_frag' in metafunc.fixturenames:
+        metafunc.parametrize('fs_obj_frag', supported_fs_frag,
+            indirect=True, scope='module')
+    if 'fs_obj_holes' in metafunc.fixturenames:
+        metafunc.parametrize('fs_obj_holes', supported_fs_holes,
+            indirect=True, scope='module')
 
 #
 # Helper functions
@@ -172,6 +207,41 @@ def mk_fs(config, fs_type, size, id):
         call('rm -f %s' % fs_img, shell=True)
         raise
 
+def make_tree(src):
+    """Fill a directory with the files used by read-only fs test.
+
+    Args:
+        src: Directory to create.
+
+    Return:
+        Nothing.
+    """
+    os.makedirs(os.path.join(src, 'dir', 'subdir'))
+    os.makedirs(os.path.join(src, 'many'))
+    # Several blocks of random data, not a multiple of the block size so
+    # that the tail is stored apart from the whole blocks
+    check_call('dd if=/dev/urandom of=%s bs=1k count=1000 2>/dev/null'
+        % os.path.join(src, 'random.bin'), shell=True)
+    check_call('head -c 5000 /dev/urandom >> %s'
+        % os.path.join(src, 'random.bin'), shell=True)
+    # Compressible text spanning many blocks
+    with open(os.path.join(src, 'text.txt'), 'w') as fd:
+        for i in range(100000):
+            fd.write('line %d of the text file\n' % i)
+    # A hole in the middle of the file
+    check_call('dd if=/dev/urandom of=%s bs=128k count=1 2>/dev/null'
+        % os.path.join(src, 'sparse.bin'), shell=True)
+    check_call('dd if=/dev/urandom of=%s bs=128k count=1 seek=4 2>/dev/null'
+        % os.path.join(src, 'sparse.bin'), shell=True)
+    with open(os.path.join(src, 'dir', 'subdir', 'small.txt'), 'w') as fd:
+        fd.write('a small file\n')
+    # Enough files for a directory index or many directory blocks
+    for i in range(MANY_FILES):
+        with open(os.path.join(src, 'many', 'file%05d' % i), 'w') as fd:
+            fd.write('contents of file %d\n' % i)
+    os.symlink('dir/subdir/small.txt', os.path.join(src, 'link'))
+    os.symlink('../text.txt', os.path.join(src, 'dir', 'uplink'))
+
 # from test/py/conftest.py
 def tool_is_in_path(tool):
     """Check whether a given command is available on host.
@@ -287,6 +357,10 @@ def fs_obj_basic(request, u_boot_config):
             % big_file, shell=True)
         check_call('dd if=/dev/urandom of=%s bs=1M count=1 seek=2499'
             % big_file, shell=True)
+        # Preallocate the 2nd MB, which leaves an unwritten extent on ext4
+        # and is to read back as zeroes.
+        if fs_type == 'ext4':
+            check_call('fallocate -o 1M -l 1M %s' % big_file, shell=True)
 
         # Create a small file in this image.
         check_call('dd if=/dev/urandom of=%s bs=1M count=1'
@@ -334,6 +408,12 @@ def fs_obj_basic(request, u_boot_config):
 	    % big_file, shell=True).decode()
         md5val.append(out.split()[0])
 
+        # 2MB from 512KB, across the preallocated 2nd MB and into the hole
+        out = check_output(
+            'dd if=%s bs=512K skip=1 count=4 2> /dev/null | md5sum'
+	    % big_file, shell=True).decode()
+        md5val.append(out.split()[0])
+
         umount_fs(mount_dir)
     except CalledProcessError as err:
         pytest.skip('Setup failed for filesystem: ' + fs_type + \
@@ -601,3 +681,199 @@ def fs_obj_symlink(request, u_boot_config):
         call('rmdir %s' % mount_dir, shell=True)
         if fs_img:
             call('rm -f %s' % fs_img, shell=True)
+
+#
+# Fixture for read-only fs test
+#
+# NOTE: yield_fixture was deprecated since pytest-3.0
+@pytest.yield_fixture()
+def fs_obj_rofs(request, u_boot_config):
+    """Set up a read-only file system image made from a directory.
+
+    Args:
+        request: Pytest request object.
+        u_boot_config: U-boot configuration.
+
+    Return:
+        A fixture for read-only fs test, i.e. a pair of the image file name
+        and the directory it was made from.
+    """
+    fs_type, name, args, option = request.param
+
+    if not u_boot_config.buildconfig.get('config_fs_%s' % fs_type, None):
+        pytest.skip('.config feature "FS_%s" not enabled' % fs_type.upper())
+    if option and not u_boot_config.buildconfig.get('config_%s' % option,
+                                                    None):
+        pytest.skip('.config feature "%s" not enabled' % option.upper())
+
+    if fs_type == 'squashfs':
+        tool = 'mksquashfs'
+    else:
+        tool = 'mkfs.%s' % fs_type
+    if not tool_is_in_path(tool):
+        pytest.skip('tool "%s" not in $PATH' % tool)
+
+    src = u_boot_config.persistent_data_dir + '/rofs_src'
+    fs_img = '%s/%s.%s.img' % (u_boot_config.persistent_data_dir, fs_type,
+                               name)
+    try:
+        if not os.path.exists(src):
+            make_tree(src)
+        if fs_type == 'squashfs':
+            check_call('%s %s %s -noappend -no-xattrs %s >/dev/null'
+                % (tool, src, fs_img, args), shell=True)
+        else:
+            check_call('%s %s %s %s >/dev/null'
+                % (tool, args, fs_img, src), shell=True)
+    except CalledProcessError:
+        call('rm -rf %s' % src, shell=True)
+        pytest.skip('Setup failed for filesystem: %s %s' % (fs_type, name))
+        return
+    else:
+        yield [fs_img, src]
+    finally:
+        call('rm -f %s' % fs_img, shell=True)
+
+#
+# Fixture for fragmented file test
+#
+# NOTE: yield_fixture was deprecated since pytest-3.0
+@pytest.yield_fixture()
+def fs_obj_frag(request, u_boot_config):
+    """Set up a file system holding fragmented files.
+
+    Args:
+        request: Pytest request object.
+        u_boot_config: U-boot configuration.
+
+    The volume is full but for $FRAG_SIZE bytes of free space scattered
+    between the clusters of the files.
+
+    Return:
+        A fixture for fragmented file test, i.e. a triplet of file system
+        type, volume file name and a list of MD5 hashes, of the whole of
+        each file and of a part of it, then of the first half of the first
+        file.
+    """
+    fs_type = request.param
+    fs_img = ''
+
+    fs_ubtype = fstype_to_ubname(fs_type)
+    check_ubconfig(u_boot_config, fs_ubtype)
+
+    mount_dir = u_boot_config.persistent_data_dir + '/mnt'
+
+    try:
+
+        # 128MiB volume
+        fs_img = mk_fs(u_boot_config, fs_type, 0x8000000, '128MB')
+
+        # Mount the image so we can populate it.
+        check_call('mkdir -p %s' % mount_dir, shell=True)
+        mount_fs(fs_type, fs_img, mount_dir)
+
+        # Write the files in turns, syncing each chunk so that it is
+        # allocated right away, next to a chunk of another file. The last
+        # one is only there to be deleted and leave free space fragmented.
+        names = ['%s/%s%d.file' % (mount_dir, FRAG_FILE, i)
+                 for i in range(FRAG_FILES + 1)]
+        files = [open(name, 'wb') for name in names]
+        try:
+            for pos in range(0, FRAG_SIZE, FRAG_CHUNK):
+                for fd in files:
+                    fd.write(os.urandom(FRAG_CHUNK))
+                    fd.flush()
+                    os.fsync(fd.fileno())
+        finally:
+            for fd in files:
+                fd.close()
+
+        # Fill up the volume, then free the clusters of the last file so
+        # that all the free space is in holes between the other files
+        call('dd if=/dev/zero of=%s/filler bs=1M 2> /dev/null' % mount_dir,
+            shell=True)
+        check_call('rm %s' % names.pop(), shell=True)
+
+        # The whole of each file, and 3MB from an offset which is not
+        # aligned to a cluster
+        md5val = []
+        for name in names:
+            md5val.append(md5sum(name))
+            md5val.append(md5sum(name, 0x104200, 0x300000))
+        # The first half of the first file, to be written back
+        md5val.append(md5sum(names[0], 0, FRAG_SIZE // 2))
+
+        umount_fs(mount_dir)
+    except CalledProcessError as err:
+        pytest.skip('Setup failed for filesystem: ' + fs_type + \
+            '. {}'.format(err))
+        return
+    else:
+        yield [fs_ubtype, fs_img, md5val]
+    finally:
+        umount_fs(mount_dir)
+        call('rmdir %s' % mount_dir, shell=True)
+        if fs_img:
+            call('rm -f %s' % fs_img, shell=True)
+
+#
+# Fixture for test of writing into small holes of free space
+#
+# NOTE: yield_fixture was deprecated since pytest-3.0
+@pytest.yield_fixture()
+def fs_obj_holes(request, u_boot_config):
+    """Set up a file system whose free space is in many small holes.
+
+    Args:
+        request: Pytest request object.
+        u_boot_config: U-boot configuration.
+
+    Return:
+        A fixture for the test, i.e. a triplet of file system type, volume
+        file name and a list of the MD5 hash of the 1MB file.
+    """
+    fs_type = request.param
+    fs_img = ''
+
+    fs_ubtype = fstype_to_ubname(fs_type)
+    check_ubconfig(u_boot_config, fs_ubtype)
+
+    mount_dir = u_boot_config.persistent_data_dir + '/mnt'
+
+    small_file = mount_dir + '/' + SMALL_FILE
+
+    try:
+
+        # 128MiB volume
+        fs_img = mk_fs(u_boot_config, fs_type, 0x8000000, '128MB')
+
+        # Mount the image so we can populate it.
+        check_call('mkdir -p %s' % mount_dir, shell=True)
+        mount_fs(fs_type, fs_img, mount_dir)
+
+        # Create a small file, to be written back into the holes.
+        check_call('dd if=/dev/urandom of=%s bs=1M count=1'
+            % small_file, shell=True)
+        md5val = [md5sum(small_file)]
+
+        # Pack 16KB files one after the other, then delete every other one
+        # so that the first free blocks are 16KB holes.
+        for i in range(256):
+            with open('%s/hole%03d' % (mount_dir, i), 'wb') as fd:
+                fd.write(os.urandom(0x4000))
+        call('sync')
+        for i in range(1, 256, 2):
+            os.remove('%s/hole%03d' % (mount_dir, i))
+
+        umount_fs(mount_dir)
+    except CalledProcessError as err:
+        pytest.skip('Setup failed for filesystem: ' + fs_type + \
+            '. {}'.format(err))
+        return
+    else:
+        yield [fs_ubtype, fs_img, md5val]
+    finally:
+        umount_fs(mount_dir)
+        call('rmdir %s' % mount_dir, shell=True)
+        if fs_img:
+            call('rm -f %s' % fs_img, shell=True)
@@ -12,5 +12,17 @@ MEDIUM_FILE='10MB.file'
 # $BIG_FILE is the name of the 2.5GB file in the file system image
 BIG_FILE='2.5GB.file'
 
+# $MANY_FILES is the number of files in the large directory of read-only
+# file system images
+MANY_FILES=2000
+
+# $FRAG_FILE is the name prefix of the $FRAG_FILES files of $FRAG_SIZE bytes
+# which are written in turns, $FRAG_CHUNK bytes at a time, so that each of
+# them is fragmented
+FRAG_FILE='frag'
+FRAG_FILES=2
+FRAG_SIZE=0x800000
+FRAG_CHUNK=0x8000
+
 ADDR=0x01000008
 LENGTH=0x00100000
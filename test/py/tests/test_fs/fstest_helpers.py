@@ -3,11 +3,30 @@
 # Author: JJ Hiblot <jjhiblot@ti.com>
 #
 
-from subprocess import check_call, CalledProcessError
+from subprocess import check_call, check_output, CalledProcessError
 
 def assert_fs_integrity(fs_type, fs_img):
     try:
         if fs_type == 'ext4':
             check_call('fsck.ext4 -n -f %s' % fs_img, shell=True)
+        elif fs_type in ['fat', 'fat16', 'fat32']:
+            check_call('fsck.fat -n %s' % fs_img, shell=True)
     except CalledProcessError:
         raise
+
+def md5sum(fname, offset=0, count=None):
+    """Calculate the MD5 hash of part of a file.
+
+    Args:
+        fname: File name.
+        offset: Offset of the part in the file.
+        count: Length of the part, or None for up to the end of the file.
+
+    Return:
+        The hash, as a string of hex digits.
+    """
+    with open(fname, 'rb') as fd:
+        fd.seek(offset)
+        data = fd.read() if count is None else fd.read(count)
+    out = check_output('md5sum', input=data).decode()
+    return out.split()[0]
@@ -290,3 +290,52 @@ class TestFsBasic(object):
                 'setenv filesize'])
             assert(md5val[0] in ''.join(output))
             assert_fs_integrity(fs_type, fs_img)
+
+    def test_fs14(self, u_boot_console, fs_obj_basic):
+        """
+        Test Case 14 - load, 2MB across written, preallocated and sparse parts
+        """
+        fs_type,fs_img,md5val = fs_obj_basic
+        with u_boot_console.log.section('Test Case 14 - load (sparse)'):
+            # Test Case 14a - 2MB from 512KB
+            output = u_boot_console.run_command_list([
+                'host bind 0 %s' % fs_img,
+                '%sload host 0:0 %x /%s 0x200000 0x80000'
+                    % (fs_type, ADDR, BIG_FILE),
+                'printenv filesize'])
+            assert('filesize=200000' in ''.join(output))
+
+            # Test Case 14b - Check md5 of the 2MB
+            output = u_boot_console.run_command_list([
+                'md5sum %x $filesize' % ADDR,
+                'setenv filesize'])
+            assert(md5val[6] in ''.join(output))
+
+    def test_fs15(self, u_boot_console, fs_obj_basic):
+        """
+        Test Case 15 - repeated commands on the same partition, which may
+        keep the filesystem mounted in between
+        """
+        fs_type,fs_img,md5val = fs_obj_basic
+        with u_boot_console.log.section('Test Case 15 - repeated commands'):
+            # Test Case 15a - ls, size and load one after the other
+            output = u_boot_console.run_command_list([
+                'host bind 0 %s' % fs_img,
+                '%sls host 0:0' % fs_type,
+                '%ssize host 0:0 /%s' % (fs_type, SMALL_FILE),
+                'printenv filesize',
+                '%sload host 0:0 %x /%s' % (fs_type, ADDR, SMALL_FILE),
+                'md5sum %x $filesize' % ADDR,
+                'setenv filesize'])
+            assert(SMALL_FILE in ''.join(output))
+            assert('filesize=100000' in ''.join(output))
+            assert(md5val[0] in ''.join(output))
+
+            # Test Case 15b - Load again after binding the image again
+            output = u_boot_console.run_command_list([
+                'host bind 0 %s' % fs_img,
+                'mw.b %x 00 100' % ADDR,
+                '%sload host 0:0 %x /%s' % (fs_type, ADDR, SMALL_FILE),
+                'md5sum %x $filesize' % ADDR,
+                'setenv filesize'])
+            assert(md5val[0] in ''.join(output))
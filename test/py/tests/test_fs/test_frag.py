@@ -0,0 +1,119 @@
+# SPDX-License-Identifier:      GPL-2.0+
+#
+# U-Boot File System: Fragmented File Test
+
+"""
+This test verifies reading files whose clusters are scattered over the
+volume, so that a read goes through many runs of clusters spread over
+several windows of the FAT, and writing to a volume whose free space is
+scattered likewise, which on ext4 takes a file more extents than fit in
+its inode.
+"""
+
+import pytest
+import re
+from fstest_defs import *
+from fstest_helpers import assert_fs_integrity, md5sum
+
+@pytest.mark.boardspec('sandbox')
+@pytest.mark.slow
+class TestFsFrag(object):
+    def test_fs_frag1(self, u_boot_console, fs_obj_frag):
+        """
+        Test Case 1 - load the whole of each fragmented file
+        """
+        fs_type,fs_img,md5val = fs_obj_frag
+        with u_boot_console.log.section('Test Case 1 - load whole files'):
+            u_boot_console.run_command('host bind 0 %s' % fs_img)
+            for i in range(FRAG_FILES):
+                output = u_boot_console.run_command_list([
+                    'mw.b %x 00 100' % ADDR,
+                    '%sload host 0:0 %x /%s%d.file'
+                        % (fs_type, ADDR, FRAG_FILE, i),
+                    'printenv filesize',
+                    'md5sum %x $filesize' % ADDR,
+                    'setenv filesize'])
+                output = ''.join(output)
+                assert('filesize=%x' % FRAG_SIZE in output)
+                assert(md5val[i * 2] in output)
+
+    def test_fs_frag2(self, u_boot_console, fs_obj_frag):
+        """
+        Test Case 2 - load part of each fragmented file, from an offset in
+        the middle of a cluster
+        """
+        fs_type,fs_img,md5val = fs_obj_frag
+        with u_boot_console.log.section('Test Case 2 - load with offset'):
+            u_boot_console.run_command('host bind 0 %s' % fs_img)
+            for i in range(FRAG_FILES):
+                output = u_boot_console.run_command_list([
+                    'mw.b %x 00 100' % ADDR,
+                    '%sload host 0:0 %x /%s%d.file 0x300000 0x104200'
+                        % (fs_type, ADDR, FRAG_FILE, i),
+                    'md5sum %x 0x300000' % ADDR])
+                assert(md5val[i * 2 + 1] in ''.join(output))
+
+    def test_fs_frag3(self, u_boot_console, fs_obj_frag):
+        """
+        Test Case 3 - write more than the free space, which must fail
+        without changing the volume
+        """
+        fs_type,fs_img,md5val = fs_obj_frag
+        with u_boot_console.log.section('Test Case 3 - write (no space)'):
+            md5img = md5sum(fs_img)
+            output = u_boot_console.run_command_list([
+                'host bind 0 %s' % fs_img,
+                '%swrite host 0:0 %x /big.file %x'
+                    % (fs_type, ADDR, FRAG_SIZE * 2)])
+            output = ''.join(output)
+            assert('no space left' in output)
+            assert('bytes written' not in output)
+            assert(md5sum(fs_img) == md5img)
+
+    def test_fs_frag4(self, u_boot_console, fs_obj_frag):
+        """
+        Test Case 4 - write a file into the scattered free space
+        """
+        fs_type,fs_img,md5val = fs_obj_frag
+        with u_boot_console.log.section('Test Case 4a - write (scattered)'):
+            output = u_boot_console.run_command_list([
+                'host bind 0 %s' % fs_img,
+                '%sload host 0:0 %x /%s0.file' % (fs_type, ADDR, FRAG_FILE),
+                '%swrite host 0:0 %x /%s.w %x'
+                    % (fs_type, ADDR, FRAG_FILE, FRAG_SIZE // 2)])
+            assert('%d bytes written' % (FRAG_SIZE // 2) in ''.join(output))
+
+        with u_boot_console.log.section('Test Case 4b - check md5'):
+            output = u_boot_console.run_command_list([
+                'mw.b %x 00 100' % ADDR,
+                '%sload host 0:0 %x /%s.w' % (fs_type, ADDR, FRAG_FILE),
+                'md5sum %x $filesize' % ADDR,
+                'setenv filesize'])
+            assert(md5val[-1] in ''.join(output))
+            assert_fs_integrity(fs_type, fs_img)
+
+@pytest.mark.boardspec('sandbox')
+@pytest.mark.slow
+class TestFsHoles(object):
+    def test_fs_holes1(self, u_boot_console, fs_obj_holes):
+        """
+        Test Case 1 - write a file into 16KB holes, which on ext4 needs a
+        leaf block of extents below the inode
+        """
+        fs_type,fs_img,md5val = fs_obj_holes
+        with u_boot_console.log.section('Test Case 1a - write (holes)'):
+            output = u_boot_console.run_command_list([
+                'host bind 0 %s' % fs_img,
+                '%sload host 0:0 %x /%s' % (fs_type, ADDR, SMALL_FILE),
+                '%swrite host 0:0 %x /%s.w $filesize'
+                    % (fs_type, ADDR, SMALL_FILE)])
+            assert('1048576 bytes written' in ''.join(output))
+
+        with u_boot_console.log.section('Test Case 1b - check md5'):
+            output = u_boot_console.run_command_list([
+                'mw.b %x 00 100' % ADDR,
+                '%sload host 0:0 %x /%s.w' % (fs_type, ADDR, SMALL_FILE),
+                'md5sum %x $filesize' % ADDR,
+                'setenv filesize'])
+            assert(md5val[0] in ''.join(output))
+            assert_fs_integrity(fs_type, fs_img)
@@ -0,0 +1,110 @@
+# SPDX-License-Identifier:      GPL-2.0+
+#
+# U-Boot File System: Read-only File System Test
+
+"""
+This test verifies reading SquashFS images made by mksquashfs with each of
+the supported compressors, and EROFS images made by mkfs.erofs with data
+stored uncompressed, in chunks or compressed with LZ4.
+"""
+
+import os.path
+import pytest
+import re
+from fstest_defs import *
+from fstest_helpers import md5sum
+
+@pytest.mark.boardspec('sandbox')
+@pytest.mark.buildconfigspec('cmd_fs_generic')
+class TestRoFs(object):
+    def test_rofs_ls(self, u_boot_console, fs_obj_rofs):
+        """
+        Test Case 1 - ls of the root directory, a subdirectory and a large
+        directory
+        """
+        fs_img, src = fs_obj_rofs
+        output = u_boot_console.run_command_list([
+            'host bind 0 %s' % fs_img,
+            'ls host 0'])
+        output = ''.join(output)
+        assert(re.search('%d +random.bin' % (1000 * 1024 + 5000), output))
+        assert(re.search('dir/', output))
+        assert('4 file(s), 2 dir(s)' in output)
+
+        output = u_boot_console.run_command('ls host 0 /dir/subdir')
+        assert(re.search('13 +small.txt', output))
+
+        output = u_boot_console.run_command('ls host 0 /many')
+        assert('%d file(s), 0 dir(s)' % MANY_FILES in output)
+
+        output = u_boot_console.run_command('ls host 0 /missing')
+        assert('file(s)' not in output)
+
+    def test_rofs_load(self, u_boot_console, fs_obj_rofs):
+        """
+        Test Case 2 - load whole files, including one with a hole and one
+        whose tail is not a whole block
+        """
+        fs_img, src = fs_obj_rofs
+        u_boot_console.run_command('host bind 0 %s' % fs_img)
+        for name in ['random.bin', 'text.txt', 'sparse.bin',
+                     'dir/subdir/small.txt', 'many/file01234']:
+            fname = os.path.join(src, name)
+            output = u_boot_console.run_command_list([
+                'load host 0 %x /%s' % (ADDR, name),
+                'printenv filesize',
+                'md5sum %x $filesize' % ADDR])
+            output = ''.join(output)
+            assert('filesize=%x' % os.path.getsize(fname) in output)
+            assert(md5sum(fname) in output)
+
+    def test_rofs_load_offset(self, u_boot_console, fs_obj_rofs):
+        """
+        Test Case 3 - load parts of files which start and end inside blocks
+        """
+        fs_img, src = fs_obj_rofs
+        u_boot_console.run_command('host bind 0 %s' % fs_img)
+        for name, offset, count in [('random.bin', 0x12345, 0x54321),
+                                    ('random.bin', 1000 * 1024, 5000),
+                                    ('text.txt', 0x1ffff, 0x2),
+                                    ('sparse.bin', 0x1f000, 0x62000)]:
+            fname = os.path.join(src, name)
+            output = u_boot_console.run_command_list([
+                'load host 0 %x /%s %x %x' % (ADDR, name, count, offset),
+                'printenv filesize',
+                'md5sum %x $filesize' % ADDR])
+            output = ''.join(output)
+            assert('filesize=%x' % count in output)
+            assert(md5sum(fname, offset, count) in output)
+
+    def test_rofs_symlink(self, u_boot_console, fs_obj_rofs):
+        """
+        Test Case 4 - follow symbolic links and '..' in paths
+        """
+        fs_img, src = fs_obj_rofs
+        u_boot_console.run_command('host bind 0 %s' % fs_img)
+        for name, target in [('link', 'dir/subdir/small.txt'),
+                             ('dir/uplink', 'text.txt'),
+                             ('dir/subdir/../../text.txt', 'text.txt')]:
+            fname = os.path.join(src, target)
+            output = u_boot_console.run_command_list([
+                'load host 0 %x /%s' % (ADDR, name),
+                'md5sum %x $filesize' % ADDR])
+            assert(md5sum(fname) in ''.join(output))
+
+    def test_rofs_size(self, u_boot_console, fs_obj_rofs):
+        """
+        Test Case 5 - size of files, and of missing files in a large directory
+        """
+        fs_img, src = fs_obj_rofs
+        output = u_boot_console.run_command_list([
+            'host bind 0 %s' % fs_img,
+            'size host 0 /many/file01999',
+            'printenv filesize'])
+        assert('filesize=%x' % len('contents of file 1999\n')
+            in ''.join(output))
+
+        for name in ['many/file', 'many/file02000', 'many/zzz', 'link/x']:
+            output = u_boot_console.run_command(
+                'size host 0 /%s; echo rc:$?' % name)
+            assert('rc:1' in output)
@@ -55,6 +55,17 @@ env__net_nfs_readable_file = {
     'size': 5058624,
     'crc32': 'c2244b26',
 }
+
+# Details regarding a file that may be read from an HTTP server with wget. The
+# 'fn' is the path on the server; 'port' may be omitted if it is 80. This
+# variable may be omitted or set to None if HTTP testing is not possible or
+# desired.
+env__net_http_readable_file = {
+    'fn': '/ubtest-readable.bin',
+    'addr': 0x10000000,
+    'size': 5058624,
+    'crc32': 'c2244b26',
+}
 """
 
 net_set_up = False
@@ -167,6 +178,49 @@ def test_net_tftpboot(u_boot_console):
     output = u_boot_console.run_command('crc32 $fileaddr $filesize')
     assert expected_crc in output
 
+@pytest.mark.buildconfigspec('cmd_net')
+def test_net_tftpboot_windowsize(u_boot_console):
+    """Test the tftpboot command with the RFC 7440 windowsize option.
+
+    The same file as in test_net_tftpboot is downloaded with a window of 16
+    blocks. Servers which do not support the option must still work, since
+    they ignore it and U-Boot falls back to one block at a time.
+    """
+
+    if not net_set_up:
+        pytest.skip('Network not initialized')
+
+    f = u_boot_console.config.env.get('env__net_tftp_readable_file', None)
+    if not f:
+        pytest.skip('No TFTP readable file to read')
+
+    addr = f.get('addr', None)
+    fn = f['fn']
+    u_boot_console.run_command('setenv tftpwindowsize 16')
+    try:
+        if not addr:
+            output = u_boot_console.run_command('tftpboot %s' % (fn))
+        else:
+            output = u_boot_console.run_command('tftpboot %x %s' %
+                                                (addr, fn))
+    finally:
+        u_boot_console.run_command('setenv tftpwindowsize')
+    expected_text = 'Bytes transferred = '
+    sz = f.get('size', None)
+    if sz:
+        expected_text += '%d' % sz
+    assert expected_text in output
+
+    expected_crc = f.get('crc32', None)
+    if not expected_crc:
+        return
+
+    if u_boot_console.config.buildconfig.get('config_cmd_crc32', 'n') != 'y':
+        return
+
+    output = u_boot_console.run_command('crc32 $fileaddr $filesize')
+    assert expected_crc in output
+
 @pytest.mark.buildconfigspec('cmd_nfs')
 def test_net_nfs(u_boot_console):
     """Test the nfs command.
@@ -206,3 +260,54 @@ def test_net_nfs(u_boot_console):
 
     output = u_boot_console.run_command('crc32 %x $filesize' % addr)
     assert expected_crc in output
+
+@pytest.mark.buildconfigspec('cmd_wget')
+def test_net_wget(u_boot_console):
+    """Test the wget command.
+
+    A file is downloaded from the HTTP server, its size and optionally its
+    CRC32 are validated. Then the second half of the file is downloaded with
+    a range request, and its size is checked.
+
+    The details of the file to download are provided by the boardenv_* file;
+    see the comment at the beginning of this file.
+    """
+
+    if not net_set_up:
+        pytest.skip('Network not initialized')
+
+    f = u_boot_console.config.env.get('env__net_http_readable_file', None)
+    if not f:
+        pytest.skip('No HTTP readable file to read')
+
+    addr = f.get('addr', None)
+    if not addr:
+        addr = u_boot_utils.find_ram_base(u_boot_console)
+
+    fn = f['fn']
+    port = f.get('port', None)
+    if port:
+        u_boot_console.run_command('setenv httpdstp %d' % port)
+    try:
+        output = u_boot_console.run_command('wget %x %s' % (addr, fn))
+        expected_text = 'Bytes transferred = '
+        sz = f.get('size', None)
+        if sz:
+            expected_text += '%d' % sz
+        assert expected_text in output
+
+        expected_crc = f.get('crc32', None)
+        if expected_crc and u_boot_console.config.buildconfig.get(
+                'config_cmd_crc32', 'n') == 'y':
+            output = u_boot_console.run_command('crc32 %x $filesize' % addr)
+            assert expected_crc in output
+
+        if not sz:
+            return
+        half = sz // 2
+        output = u_boot_console.run_command('wget %x %s %x %x' %
+                                            (addr, fn, sz - half, half))
+        assert 'Bytes transferred = %d' % (sz - half) in output
+    finally:
+        if port:
+            u_boot_console.run_command('setenv httpdstp')
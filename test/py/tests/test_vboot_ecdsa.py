@@ -0,0 +1,118 @@
+# SPDX-License-Identifier:	GPL-2.0+
+#
+# U-Boot Verified Boot Test with ECDSA signatures
+
+"""
+This tests verified boot with ECDSA keys:
+
+- Create a FIT with a configuration signed using an ECDSA key
+- Check that U-Boot and fit_check_sign accept it
+- Corrupt the signature
+- Check that U-Boot and fit_check_sign reject it
+
+The RSA tests in test_vboot.py cover the generic signing and verification
+flow in more detail; this test only checks the ECDSA-specific parts.
+"""
+
+import pytest
+import u_boot_utils as util
+
+TESTDATA = [
+    ['ecdsa256', 'prime256v1'],
+    ['ecdsa384', 'secp384r1'],
+]
+
+@pytest.mark.boardspec('sandbox')
+@pytest.mark.buildconfigspec('fit_signature')
+@pytest.mark.buildconfigspec('ecdsa')
+@pytest.mark.requiredtool('dtc')
+@pytest.mark.requiredtool('fdtget')
+@pytest.mark.requiredtool('fdtput')
+@pytest.mark.requiredtool('openssl')
+@pytest.mark.parametrize("algo,curve", TESTDATA)
+def test_vboot_ecdsa(u_boot_console, algo, curve):
+    """Test ECDSA signing with mkimage and verification with 'bootm'."""
+    def dtc(dts):
+        """Compile a .dts file from the vboot test directory into tmpdir"""
+        dtb = dts.replace('.dts', '.dtb')
+        util.run_and_log(cons, 'dtc %s %s%s -O dtb -o %s%s' %
+                         (dtc_args, datadir, dts, tmpdir, dtb))
+
+    def run_bootm(test_type, expect_string, boots):
+        """Run 'bootm' in a fresh U-Boot, which picks up the new public key"""
+        cons.restart_uboot()
+        with cons.log.section('Verified boot %s %s' % (algo, test_type)):
+            output = cons.run_command_list(
+                ['host load hostfs - 100 %stest.fit' % tmpdir,
+                 'fdt addr 100',
+                 'bootm 100'])
+        assert expect_string in ''.join(output)
+        if boots:
+            assert 'sandbox: continuing, as we cannot run' in ''.join(output)
+        else:
+            assert('sandbox: continuing, as we cannot run'
+                   not in ''.join(output))
+
+    cons = u_boot_console
+    tmpdir = cons.config.result_dir + '/'
+    datadir = cons.config.source_dir + '/test/py/tests/vboot/'
+    fit = '%stest.fit' % tmpdir
+    its = '%ssign-configs-%s.its' % (tmpdir, algo)
+    mkimage = cons.config.build_dir + '/tools/mkimage'
+    fit_check_sign = cons.config.build_dir + '/tools/fit_check_sign'
+    dtc_args = '-I dts -O dtb -i %s' % tmpdir
+    dtb = '%ssandbox-u-boot.dtb' % tmpdir
+    sig_node = '/configurations/conf-1/signature'
+
+    util.run_and_log(cons, 'openssl ecparam -name %s -genkey -noout '
+                     '-out %sdev.key' % (curve, tmpdir))
+
+    # Create a number kernel image with zeroes
+    with open('%stest-kernel.bin' % tmpdir, 'w') as fd:
+        fd.write(500 * chr(0))
+
+    # Use the RSA configuration-signing source with the ECDSA algorithm
+    with open(datadir + 'sign-configs-sha256.its') as fd:
+        source = fd.read()
+    with open(its, 'w') as fd:
+        fd.write(source.replace('sha256,rsa2048', 'sha256,%s' % algo))
+
+    try:
+        # We need to use our own device tree file. Remember to restore it
+        # afterwards.
+        old_dtb = cons.config.dtb
+        cons.config.dtb = dtb
+
+        dtc('sandbox-kernel.dts')
+        dtc('sandbox-u-boot.dts')
+        util.run_and_log(cons, [mkimage, '-D', dtc_args, '-f', its, fit])
+        util.run_and_log(cons, [mkimage, '-F', '-k', tmpdir, '-K', dtb,
+                                '-r', fit])
+
+        # The public key must have been written to U-Boot's device tree
+        output = util.run_and_log(cons, 'fdtget %s /signature/key-dev '
+                                  'ecdsa,curve' % dtb)
+        assert curve in output
+
+        run_bootm('signed config', 'dev+', True)
+        util.run_and_log(cons, [fit_check_sign, '-f', fit, '-k', dtb])
+
+        # Increment the first byte of the signature, which should cause
+        # failure
+        sig = util.run_and_log(cons, 'fdtget -t bx %s %s value' %
+                               (fit, sig_node))
+        byte_list = sig.split()
+        byte = int(byte_list[0], 16)
+        byte_list[0] = '%x' % ((byte + 1) & 0xff)
+        sig = ' '.join(byte_list)
+        util.run_and_log(cons, 'fdtput -t bx %s %s value %s' %
+                         (fit, sig_node, sig))
+
+        run_bootm('signed config with bad signature', 'Bad Data Hash', False)
+        util.run_and_log_expect_exception(
+            cons, [fit_check_sign, '-f', fit, '-k', dtb],
+            1, 'Failed to verify required signature')
+    finally:
+        # Go back to the original U-Boot with the correct dtb.
+        cons.config.dtb = old_dtb
+        cons.restart_uboot()